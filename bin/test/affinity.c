@@ -0,0 +1,101 @@
+//
+//  affinity.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Pins a thread to every online CPU in turn and checks that it only ever observes the CPU it was pinned to
+#define kAffinityIterations 100000
+
+struct affinity_state
+{
+	int cpu;
+	int pinned;
+	int mismatches;
+};
+
+static void affinity_worker(void *argument)
+{
+	struct affinity_state *state = argument;
+	uint32_t mask = 0;
+
+	// The worker may run before it's pinned, it only starts counting once it sees its new mask and got moved
+	for(int i = 0; i < kAffinityIterations && !state->pinned; i ++)
+	{
+		if(sched_getaffinity(0, &mask) == 0 && mask == (1u << state->cpu) && sched_getcpu() == state->cpu)
+			state->pinned = 1;
+		else
+			thread_yield();
+	}
+
+	if(!state->pinned)
+		return;
+
+	for(int i = 0; i < kAffinityIterations; i ++)
+	{
+		if(sched_getcpu() != state->cpu)
+			state->mismatches ++;
+
+		if((i % 1000) == 0)
+			thread_yield();
+	}
+}
+
+int test_affinity(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "affinity: sched_getaffinity() failed");
+	test_assert(online != 0, "affinity: empty affinity mask");
+
+	test_assert(sched_setaffinity(0, 0) == -1, "affinity: empty mask was accepted");
+
+	for(int cpu = 0; cpu < 32; cpu ++)
+	{
+		if(!(online & (1u << cpu)))
+			continue;
+
+		struct affinity_state state;
+		state.cpu = cpu;
+		state.pinned = 0;
+		state.mismatches = 0;
+
+		// Migrate the main thread while it is running
+		test_assert(sched_setaffinity(0, 1 << cpu) == 0, "affinity: sched_setaffinity() failed for CPU %d", cpu);
+		thread_yield();
+		test_assert(sched_getcpu() == cpu, "affinity: main thread runs on CPU %d instead of %d", sched_getcpu(), cpu);
+
+		// And a new thread, which inherits nothing and is pinned after creation
+		tid_t thread = thread_create(&affinity_worker, &state);
+		test_assert(sched_setaffinity(thread, 1 << cpu) == 0, "affinity: sched_setaffinity() failed for the worker on CPU %d", cpu);
+
+		uint32_t mask = 0;
+		test_assert(sched_getaffinity(thread, &mask) == 0, "affinity: sched_getaffinity() failed for the worker");
+		test_assert(mask == (1u << cpu), "affinity: mask read back as 0x%x instead of 0x%x", mask, 1u << cpu);
+
+		thread_join(thread);
+
+		test_assert(state.pinned, "affinity: worker never ended up on CPU %d", cpu);
+		test_assert(state.mismatches == 0, "affinity: worker left CPU %d %d times", cpu, state.mismatches);
+	}
+
+	sched_setaffinity(0, online);
+
+	printf("affinity: pinned threads stayed on their CPUs (mask 0x%x)\n", online);
+	return 1;
+}
@@ -0,0 +1,71 @@
+//
+//  balance.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Runs a fixed amount of CPU bound work on one thread, and then on many threads at once.
+// Meant to be run with -smp 4, where the many thread run should get close to 4x the throughput
+#define kBalanceThreads    16
+#define kBalanceIterations 20000000
+
+static volatile uint32_t balance_sink;
+
+static void balance_worker(__unused void *argument)
+{
+	uint32_t state = 0x12345678;
+
+	for(uint32_t i = 0; i < kBalanceIterations; i ++)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+	}
+
+	balance_sink = state;
+}
+
+static uint64_t balance_run(int count)
+{
+	tid_t threads[kBalanceThreads];
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < count; i ++)
+		threads[i] = thread_create(&balance_worker, NULL);
+
+	for(int i = 0; i < count; i ++)
+		thread_join(threads[i]);
+
+	return test_rdtsc() - start;
+}
+
+int test_balance(void)
+{
+	uint64_t single = balance_run(1);
+	uint64_t many = balance_run(kBalanceThreads);
+
+	// Work per cycle relative to the single thread, in percent
+	uint64_t throughput = (single * kBalanceThreads * 100) / many;
+
+	printf("balance: 1 thread %llu cycles, %d threads %llu cycles, %d%% throughput\n", single, kBalanceThreads, many, (int)throughput);
+	test_print_file("/dev/scheduler");
+
+	test_assert(throughput >= 90, "balance: running threads in parallel lost throughput");
+	return 1;
+}
@@ -0,0 +1,162 @@
+//
+//  deadline.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Runs periodic deadline threads next to CPU hogs on the same CPU. A thread that stays within its
+// runtime must never miss a deadline, one that needs more than its runtime has to be throttled
+#define kDeadlinePeriod  10000 // Microseconds
+#define kDeadlineRuntime 2000
+#define kDeadlineJobs    100
+#define kDeadlineHogs    2
+
+struct deadline_state
+{
+	int cpu;
+	uint32_t work; // Microseconds of work per job
+	uint64_t cyclesPerMicrosecond;
+	int admitted;
+	uint32_t maxJitter; // Microseconds a job started away from its period
+	struct sched_deadline info;
+};
+
+static volatile int deadline_running;
+
+static void deadline_spin(uint64_t cycles)
+{
+	uint64_t start = test_rdtsc();
+	while(test_rdtsc() - start < cycles)
+	{}
+}
+
+static void deadline_hog(void *argument)
+{
+	struct deadline_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	while(deadline_running)
+	{}
+}
+
+static void deadline_worker(void *argument)
+{
+	struct deadline_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	state->admitted = (sched_setdeadline(0, kDeadlineRuntime, kDeadlinePeriod, 0) == 0);
+	if(!state->admitted)
+		return;
+
+	thread_yield(); // Line up with the start of a period
+
+	uint64_t period = (uint64_t)kDeadlinePeriod * state->cyclesPerMicrosecond;
+	uint64_t last = test_rdtsc();
+
+	for(int i = 0; i < kDeadlineJobs; i ++)
+	{
+		deadline_spin((uint64_t)state->work * state->cyclesPerMicrosecond);
+		thread_yield();
+
+		uint64_t now = test_rdtsc();
+		uint64_t elapsed = now - last;
+		uint64_t jitter = (elapsed > period) ? elapsed - period : period - elapsed;
+
+		// Jobs cut off by their budget lose phase, only measure the well behaved ones
+		if(state->work < kDeadlineRuntime && jitter / state->cyclesPerMicrosecond > state->maxJitter)
+			state->maxJitter = (uint32_t)(jitter / state->cyclesPerMicrosecond);
+
+		last = now;
+	}
+
+	sched_getdeadline(0, &state->info);
+	sched_setdeadline(0, 0, 0, 0);
+}
+
+static int deadline_run(struct deadline_state *state)
+{
+	deadline_running = 1;
+
+	tid_t hogs[kDeadlineHogs];
+
+	for(int i = 0; i < kDeadlineHogs; i ++)
+		hogs[i] = thread_create(&deadline_hog, state);
+
+	tid_t worker = thread_create(&deadline_worker, state);
+	thread_join(worker);
+
+	deadline_running = 0;
+
+	for(int i = 0; i < kDeadlineHogs; i ++)
+		thread_join(hogs[i]);
+
+	return state->admitted;
+}
+
+int test_deadline(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "deadline: sched_getaffinity() failed");
+
+	int cpu = 0;
+	while(!(online & (1 << cpu)))
+		cpu ++;
+
+	uint64_t start = test_rdtsc();
+	usleep(100000);
+	uint64_t cyclesPerMicrosecond = (test_rdtsc() - start) / 100000;
+
+	// Parameter checks and admission control
+	test_assert(sched_setdeadline(0, 5000, 1000, 0) == -1, "deadline: runtime above the period was accepted");
+	test_assert(sched_setdeadline(0, 1000, 10000, 20000) == -1, "deadline: deadline above the period was accepted");
+	test_assert(sched_setaffinity(0, 1 << cpu) == 0, "deadline: sched_setaffinity() failed");
+	test_assert(sched_setdeadline(0, 9900, 10000, 0) == -1, "deadline: 99%% bandwidth was accepted");
+	test_assert(sched_setdeadline(0, 5000, 10000, 0) == 0, "deadline: 50%% bandwidth was rejected");
+	test_assert(sched_setdeadline(0, 0, 0, 0) == 0, "deadline: leaving the deadline class failed");
+	sched_setaffinity(0, online);
+
+	// A well behaved periodic thread
+	struct deadline_state state = { 0 };
+	state.cpu = cpu;
+	state.work = kDeadlineRuntime / 2;
+	state.cyclesPerMicrosecond = cyclesPerMicrosecond;
+
+	test_assert(deadline_run(&state), "deadline: periodic thread wasn't admitted");
+	test_assert(state.info.misses == 0, "deadline: %u of %u jobs missed their deadline", state.info.misses, state.info.jobs);
+
+	printf("deadline: %u jobs next to %d hogs, %u misses, %u us max period jitter\n", state.info.jobs, kDeadlineHogs, state.info.misses, state.maxJitter);
+
+	// One that needs more than it asked for
+	struct deadline_state overrun = { 0 };
+	overrun.cpu = cpu;
+	overrun.work = kDeadlineRuntime * 2;
+	overrun.cyclesPerMicrosecond = cyclesPerMicrosecond;
+
+	test_assert(deadline_run(&overrun), "deadline: overrunning thread wasn't admitted");
+	test_assert(overrun.info.overruns > 0, "deadline: thread using twice its runtime was never throttled");
+
+	printf("deadline: overrunning thread was throttled %u times in %u jobs\n", overrun.info.overruns, overrun.info.jobs);
+	test_print_file("/dev/scheduler");
+	return 1;
+}
@@ -0,0 +1,122 @@
+//
+//  fair.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Measures how late a thread that sleeps a lot gets to run again while CPU hogs of the same priority
+// compete for its CPU. Done for the first two CPUs, boot with sched.fair=0xaaaaaaaa to compare a CPU
+// using the fair class with one using the classic policy. /dev/scheduler lists which CPU uses what
+#define kFairHogs    3
+#define kFairSamples 200
+#define kFairSleep   2000 // Microseconds
+
+struct fair_state
+{
+	int cpu;
+	volatile int running;
+	uint64_t cyclesPerMicrosecond;
+	uint64_t total;
+	uint64_t max;
+};
+
+static void fair_hog(void *argument)
+{
+	struct fair_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	while(state->running)
+	{}
+}
+
+static void fair_sleeper(void *argument)
+{
+	struct fair_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	for(int i = 0; i < kFairSamples; i ++)
+	{
+		uint64_t start = test_rdtsc();
+		usleep(kFairSleep);
+		uint64_t elapsed = (test_rdtsc() - start) / state->cyclesPerMicrosecond;
+		uint64_t latency = (elapsed > kFairSleep) ? elapsed - kFairSleep : 0;
+
+		state->total += latency;
+
+		if(latency > state->max)
+			state->max = latency;
+	}
+}
+
+static void fair_measure(int cpu, uint64_t cyclesPerMicrosecond)
+{
+	struct fair_state state;
+	state.cpu = cpu;
+	state.cyclesPerMicrosecond = cyclesPerMicrosecond;
+	state.total = 0;
+	state.max = 0;
+
+	state.running = 1;
+
+	tid_t hogs[kFairHogs];
+
+	for(int i = 0; i < kFairHogs; i ++)
+		hogs[i] = thread_create(&fair_hog, &state);
+
+	tid_t sleeper = thread_create(&fair_sleeper, &state);
+	thread_join(sleeper);
+
+	state.running = 0;
+
+	for(int i = 0; i < kFairHogs; i ++)
+		thread_join(hogs[i]);
+
+	printf("fair: cpu%d with %d hogs, wakeup latency %u us avg, %u us max\n", cpu, kFairHogs, (uint32_t)(state.total / kFairSamples), (uint32_t)state.max);
+}
+
+int test_fair(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "fair: sched_getaffinity() failed");
+
+	uint64_t start = test_rdtsc();
+	usleep(100000);
+	uint64_t cyclesPerMicrosecond = (test_rdtsc() - start) / 100000;
+
+	test_assert(cyclesPerMicrosecond > 0, "fair: TSC didn't advance");
+
+	int measured = 0;
+
+	for(int cpu = 0; cpu < 32 && measured < 2; cpu ++)
+	{
+		if(!(online & (1 << cpu)))
+			continue;
+
+		fair_measure(cpu, cyclesPerMicrosecond);
+		measured ++;
+	}
+
+	test_print_file("/dev/scheduler");
+	return 1;
+}
@@ -0,0 +1,151 @@
+//
+//  fpu.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Two threads on the same CPU keep values in all SSE registers across many preemptions
+// and do floating point maths in between. Lazy FPU switching must not mix their state up
+#define kFPUThreads 2
+#define kFPURounds 20
+#define kFPUSpin 20000000 // Loop iterations with the registers live, long enough to get preempted
+
+struct fpu_state
+{
+	uint32_t seed;
+	int cpu;
+	int corruptions;
+	int wrongResults;
+};
+
+#if __SSE2__
+
+static int fpu_check_registers(uint32_t seed)
+{
+	uint32_t in[32] __attribute__((aligned(16)));
+	uint32_t out[32] __attribute__((aligned(16)));
+
+	for(int i = 0; i < 32; i ++)
+		in[i] = seed * 0x9e3779b9 + i;
+
+	__asm__ volatile(
+		"movdqa 0x00(%0), %%xmm0\n"
+		"movdqa 0x10(%0), %%xmm1\n"
+		"movdqa 0x20(%0), %%xmm2\n"
+		"movdqa 0x30(%0), %%xmm3\n"
+		"movdqa 0x40(%0), %%xmm4\n"
+		"movdqa 0x50(%0), %%xmm5\n"
+		"movdqa 0x60(%0), %%xmm6\n"
+		"movdqa 0x70(%0), %%xmm7\n"
+		"1: decl %2\n"
+		"jnz 1b\n"
+		"movdqa %%xmm0, 0x00(%1)\n"
+		"movdqa %%xmm1, 0x10(%1)\n"
+		"movdqa %%xmm2, 0x20(%1)\n"
+		"movdqa %%xmm3, 0x30(%1)\n"
+		"movdqa %%xmm4, 0x40(%1)\n"
+		"movdqa %%xmm5, 0x50(%1)\n"
+		"movdqa %%xmm6, 0x60(%1)\n"
+		"movdqa %%xmm7, 0x70(%1)\n"
+		:: "r" (in), "r" (out), "r" (kFPUSpin)
+		: "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "memory", "cc");
+
+	for(int i = 0; i < 32; i ++)
+	{
+		if(in[i] != out[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+static int fpu_check_maths(uint32_t seed)
+{
+	volatile double sum = 0.0;
+	double step = 0.5 * seed;
+
+	for(int i = 1; i <= 100000; i ++)
+		sum += step;
+
+	// Every partial sum is exactly representable
+	return (sum == 50000.0 * seed);
+}
+
+static void fpu_worker(void *argument)
+{
+	struct fpu_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	for(int i = 0; i < kFPURounds; i ++)
+	{
+		if(!fpu_check_registers(state->seed))
+			state->corruptions ++;
+		if(!fpu_check_maths(state->seed))
+			state->wrongResults ++;
+	}
+}
+
+int test_fpu(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "fpu: sched_getaffinity() failed");
+
+	int cpu = 0;
+	while(!(online & (1 << cpu)))
+		cpu ++;
+
+	struct fpu_state states[kFPUThreads];
+	tid_t threads[kFPUThreads];
+
+	for(int i = 0; i < kFPUThreads; i ++)
+	{
+		states[i].seed = i + 1;
+		states[i].cpu = cpu;
+		states[i].corruptions = 0;
+		states[i].wrongResults = 0;
+
+		threads[i] = thread_create(&fpu_worker, &states[i]);
+	}
+
+	for(int i = 0; i < kFPUThreads; i ++)
+		thread_join(threads[i]);
+
+	for(int i = 0; i < kFPUThreads; i ++)
+	{
+		test_assert(states[i].corruptions == 0, "fpu: thread %d found its SSE registers changed %d times", i, states[i].corruptions);
+		test_assert(states[i].wrongResults == 0, "fpu: thread %d got %d wrong floating point results", i, states[i].wrongResults);
+	}
+
+	printf("fpu: %d threads on cpu%d kept their SSE state over %d rounds\n", kFPUThreads, cpu, kFPURounds);
+	test_print_file("/dev/fpu");
+	return 1;
+}
+
+#else
+
+int test_fpu(void)
+{
+	puts("fpu: skipped, userland is built without SSE2\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  function.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include "tests.h"
+
+// IO::Function only exists inside the kernel, writing "benchmark" to /dev/functions runs it there
+// and the result line shows up in its statistics
+#define kFunctionPollInterval 100000
+#define kFunctionTimeout 100 // Polls until the benchmark is considered stuck
+
+static char function_buffer[256];
+
+static char *function_read_result(void)
+{
+	int fd = open("/dev/functions", O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	size_t length = read(fd, function_buffer, sizeof(function_buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return NULL;
+
+	function_buffer[length] = '\0';
+	return strstr(function_buffer, "benchmark: ");
+}
+
+int test_function(void)
+{
+	int fd = open("/dev/functions", O_WRONLY);
+	test_assert(fd >= 0, "function: couldn't open /dev/functions");
+
+	const char *command = "benchmark";
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	test_assert(result == strlen(command), "function: couldn't start the benchmark");
+
+	char *line = NULL;
+
+	for(int i = 0; i < kFunctionTimeout; i ++)
+	{
+		usleep(kFunctionPollInterval);
+
+		line = function_read_result();
+		if(line && strncmp(line, "benchmark: running", 18) != 0)
+			break;
+	}
+
+	test_assert(line, "function: no benchmark result in /dev/functions");
+	test_assert(strncmp(line, "benchmark: running", 18) != 0, "function: the benchmark didn't finish");
+	test_assert(strstr(line, "heap "), "function: malformed benchmark result");
+
+	char *end = strstr(line, "\n");
+	if(end)
+		*end = '\0';
+
+	printf("function: %s\n", line + 11);
+	return 1;
+}
@@ -0,0 +1,174 @@
+//
+//  futex.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/spinlock.h>
+#include <sys/futex.h>
+#include <sys/sync.h>
+#include <sys/errno.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Threads hammer a shared counter, once protected by the futex based mutex and once by the
+// spinlock. The spinlock burns its whole time slice when the owner got preempted, the mutex
+// spins briefly and then sleeps in the kernel until the owner hands the lock over.
+#define kFutexThreads 4
+#define kFutexIterations 20000
+
+struct futex_state
+{
+	mutex_t mutex;
+	spinlock_t spinlock;
+	volatile uint32_t counter;
+	int useSpinlock;
+};
+
+static void futex_worker(void *argument)
+{
+	struct futex_state *state = argument;
+
+	for(int i = 0; i < kFutexIterations; i ++)
+	{
+		if(state->useSpinlock)
+		{
+			spinlock_lock(&state->spinlock);
+			state->counter ++;
+			spinlock_unlock(&state->spinlock);
+		}
+		else
+		{
+			mutex_lock(&state->mutex);
+			state->counter ++;
+			mutex_unlock(&state->mutex);
+		}
+	}
+}
+
+static uint64_t futex_contend(struct futex_state *state, int useSpinlock)
+{
+	tid_t threads[kFutexThreads];
+
+	state->counter = 0;
+	state->useSpinlock = useSpinlock;
+
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < kFutexThreads; i ++)
+		threads[i] = thread_create(&futex_worker, state);
+	for(int i = 0; i < kFutexThreads; i ++)
+		thread_join(threads[i]);
+
+	return test_rdtsc() - start;
+}
+
+
+static volatile uint32_t _onceCalls;
+static once_t _once = ONCE_INIT;
+
+static void futex_once_function(void)
+{
+	_onceCalls ++;
+	thread_yield(); // Give the other threads a chance to pile up behind it
+}
+
+static void futex_once_worker(__unused void *argument)
+{
+	once_call(&_once, &futex_once_function);
+}
+
+
+struct futex_handoff
+{
+	mutex_t mutex;
+	cond_t cond;
+	sem_t semaphore;
+	volatile int ready;
+};
+
+static void futex_handoff_worker(void *argument)
+{
+	struct futex_handoff *handoff = argument;
+
+	mutex_lock(&handoff->mutex);
+	handoff->ready = 1;
+	cond_signal(&handoff->cond);
+	mutex_unlock(&handoff->mutex);
+
+	sem_post(&handoff->semaphore);
+}
+
+int test_futex(void)
+{
+	// Raw futex semantics
+	volatile uint32_t word = 1;
+
+	test_assert(futex_wait(&word, 0, 0) == -1 && errno == EAGAIN, "futex: futex_wait() slept on a mismatched value");
+	test_assert(futex_wait(&word, 1, 10000) == -1 && errno == ETIMEDOUT, "futex: futex_wait() didn't time out");
+	test_assert(futex_wake(&word, 1) == 0, "futex: futex_wake() woke up a thread nobody started");
+
+	// Mutual exclusion under contention
+	struct futex_state state;
+	mutex_init(&state.mutex);
+	spinlock_init(&state.spinlock);
+
+	uint64_t mutexCycles = futex_contend(&state, 0);
+	test_assert(state.counter == kFutexThreads * kFutexIterations, "futex: mutex lost increments, %u", state.counter);
+
+	uint64_t spinlockCycles = futex_contend(&state, 1);
+	test_assert(state.counter == kFutexThreads * kFutexIterations, "futex: spinlock lost increments, %u", state.counter);
+
+	test_assert(mutex_try_lock(&state.mutex) == 1, "futex: mutex was left locked");
+	test_assert(mutex_try_lock(&state.mutex) == 0, "futex: mutex was locked twice");
+	mutex_unlock(&state.mutex);
+
+	uint32_t operations = kFutexThreads * kFutexIterations;
+	printf("futex: %d threads, mutex %llu cycles/op, spinlock %llu cycles/op\n", kFutexThreads, mutexCycles / operations, spinlockCycles / operations);
+
+	// Once
+	tid_t threads[kFutexThreads];
+
+	for(int i = 0; i < kFutexThreads; i ++)
+		threads[i] = thread_create(&futex_once_worker, NULL);
+	for(int i = 0; i < kFutexThreads; i ++)
+		thread_join(threads[i]);
+
+	test_assert(_onceCalls == 1, "futex: once_call() ran the function %u times", _onceCalls);
+
+	// Condition variable and semaphore
+	struct futex_handoff handoff;
+	mutex_init(&handoff.mutex);
+	cond_init(&handoff.cond);
+	sem_init(&handoff.semaphore, 0);
+	handoff.ready = 0;
+
+	mutex_lock(&handoff.mutex);
+	test_assert(cond_timedwait(&handoff.cond, &handoff.mutex, 10000) == ETIMEDOUT, "futex: cond_timedwait() didn't time out");
+
+	tid_t thread = thread_create(&futex_handoff_worker, &handoff);
+
+	while(!handoff.ready)
+		cond_wait(&handoff.cond, &handoff.mutex);
+
+	mutex_unlock(&handoff.mutex);
+
+	sem_wait(&handoff.semaphore);
+	test_assert(sem_try_wait(&handoff.semaphore) == 0, "futex: semaphore was posted twice");
+
+	thread_join(thread);
+	return 1;
+}
@@ -0,0 +1,213 @@
+//
+//  idle.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <sys/kern_return.h>
+#include <ipc/ipc_message.h>
+#include <ipc/ipc_port.h>
+#include <string.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Measures how long it takes from sending a message to an idle CPU until the receiver runs,
+// once with the idle CPU halted and woken by an IPI and once waiting in MWAIT
+#define kIdleIterations 500
+#define kIdleSettleTime 200 // Microseconds the receiving CPU gets to go idle
+#define kIdleSendOffset 0x10000
+
+struct idle_message
+{
+	ipc_header_t header;
+	uint64_t sent;
+};
+
+struct idle_state
+{
+	ipc_port_t port;
+	int cpu;
+	int failures;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+};
+
+static int idle_set_mode(const char *mode)
+{
+	int fd = open("/dev/idle", O_WRONLY);
+	if(fd < 0)
+		return 0;
+
+	size_t result = write(fd, mode, strlen(mode));
+	close(fd);
+
+	return (result == strlen(mode));
+}
+
+static int idle_get_mwait(void)
+{
+	int fd = open("/dev/idle", O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+	char buffer[32];
+	size_t length = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return 0;
+
+	buffer[length] = '\0';
+	return (strncmp(buffer, "mode: mwait", 11) == 0);
+}
+
+static void idle_receiver(void *argument)
+{
+	struct idle_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	for(int i = 0; i < kIdleIterations; i ++)
+	{
+		struct idle_message message;
+
+		message.header.port = state->port;
+		message.header.flags = IPC_HEADER_FLAG_BLOCK;
+		message.header.size = sizeof(uint64_t);
+
+		if(ipc_read(&message.header) != KERN_SUCCESS)
+		{
+			state->failures ++;
+			continue;
+		}
+
+		uint64_t latency = test_rdtsc() - message.sent;
+
+		state->total += latency;
+
+		if(latency < state->min)
+			state->min = latency;
+		if(latency > state->max)
+			state->max = latency;
+	}
+}
+
+static int idle_measure(const char *mode, struct idle_state *state, uint64_t cyclesPerMicrosecond)
+{
+	state->failures = 0;
+	state->total = 0;
+	state->min = UINT64_MAX;
+	state->max = 0;
+
+	tid_t thread = thread_create(&idle_receiver, state);
+
+	for(int i = 0; i < kIdleIterations; i ++)
+	{
+		// Spin instead of sleeping, so only the receiving CPU goes idle
+		uint64_t settle = test_rdtsc();
+		while(test_rdtsc() - settle < kIdleSettleTime * cyclesPerMicrosecond)
+		{}
+
+		struct idle_message message;
+
+		message.header.port = state->port + kIdleSendOffset;
+		message.header.flags = 0;
+		message.header.id = 0;
+		message.header.size = sizeof(uint64_t);
+		message.sent = test_rdtsc();
+
+		if(ipc_write(&message.header) != KERN_SUCCESS)
+			state->failures ++;
+	}
+
+	thread_join(thread);
+
+	test_assert(state->failures == 0, "idle: %d messages got lost in %s mode", state->failures, mode);
+
+	printf("idle: %s wakeup latency %llu us avg (%llu min, %llu max) over %d wakeups\n", mode,
+	       (state->total / kIdleIterations) / cyclesPerMicrosecond, state->min / cyclesPerMicrosecond, state->max / cyclesPerMicrosecond, kIdleIterations);
+	return 1;
+}
+
+int test_idle(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "idle: sched_getaffinity() failed");
+
+	int first = -1, second = -1;
+
+	for(int i = 0; i < 32 && second == -1; i ++)
+	{
+		if(!(online & (1 << i)))
+			continue;
+
+		if(first == -1)
+			first = i;
+		else
+			second = i;
+	}
+
+	if(second == -1)
+	{
+		puts("idle: skipped, needs at least two CPUs\n");
+		return 1;
+	}
+
+	uint64_t start = test_rdtsc();
+	usleep(100000);
+	uint64_t cyclesPerMicrosecond = (test_rdtsc() - start) / 100000;
+
+	struct idle_state state;
+	state.cpu = second;
+
+	ipc_space_t space;
+	test_assert(ipc_task_space(&space, getpid()) == KERN_SUCCESS, "idle: ipc_task_space() failed");
+	test_assert(ipc_allocate_port(&state.port) == KERN_SUCCESS, "idle: ipc_allocate_port() failed");
+	test_assert(ipc_insert_port(space, state.port + kIdleSendOffset, state.port, IPC_PORT_RIGHT_SEND) == KERN_SUCCESS, "idle: ipc_insert_port() failed");
+
+	test_assert(sched_setaffinity(0, 1 << first) == 0, "idle: sched_setaffinity() failed");
+	thread_yield();
+
+	int result = 1;
+	int mwait = idle_get_mwait();
+
+	if(!idle_set_mode("hlt") || !idle_measure("hlt", &state, cyclesPerMicrosecond))
+		result = 0;
+
+	// Not every CPU, or hypervisor, exposes MONITOR/MWAIT
+	if(idle_set_mode("mwait"))
+	{
+		if(!idle_measure("mwait", &state, cyclesPerMicrosecond))
+			result = 0;
+	}
+	else
+	{
+		puts("idle: mwait not supported, only measured hlt\n");
+	}
+
+	idle_set_mode(mwait ? "mwait" : "hlt");
+	sched_setaffinity(0, online);
+
+	ipc_deallocate_port(state.port + kIdleSendOffset);
+	ipc_deallocate_port(state.port);
+
+	test_print_file("/dev/idle");
+	return result;
+}
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "tests.h"
 
 void send_file_name(const char *name, ipc_port_t port)
 {
@@ -43,8 +44,72 @@ void send_file_name(const char *name, ipc_port_t port)
 	ipc_write(&message.header);
 }
 
+void test_print_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		printf("Couldn't open %s\n", path);
+		return;
+	}
+
+	char buffer[512];
+	size_t length;
+
+	while((length = read(fd, buffer, sizeof(buffer) - 1)) > 0 && length != (size_t)-1)
+	{
+		buffer[length] = '\0';
+		puts(buffer);
+	}
+
+	close(fd);
+}
+
 int main(__unused int argc, __unused char *argv[])
 {
+	if(!test_swap())
+		puts("swap: FAILED\n");
+	if(!test_sched())
+		puts("sched: FAILED\n");
+	if(!test_balance())
+		puts("balance: FAILED\n");
+	if(!test_affinity())
+		puts("affinity: FAILED\n");
+	if(!test_sleep())
+		puts("sleep: FAILED\n");
+	if(!test_pingpong())
+		puts("pingpong: FAILED\n");
+	if(!test_fair())
+		puts("fair: FAILED\n");
+	if(!test_deadline())
+		puts("deadline: FAILED\n");
+	if(!test_schedtrace())
+		puts("schedtrace: FAILED\n");
+	if(!test_idle())
+		puts("idle: FAILED\n");
+	if(!test_fpu())
+		puts("fpu: FAILED\n");
+	if(!test_futex())
+		puts("futex: FAILED\n");
+	if(!test_mutex())
+		puts("mutex: FAILED\n");
+	if(!test_function())
+		puts("function: FAILED\n");
+	if(!test_rcu())
+		puts("rcu: FAILED\n");
+	if(!test_rwlock())
+		puts("rwlock: FAILED\n");
+	if(!test_waitqueue())
+		puts("waitqueue: FAILED\n");
+	if(!test_syscall())
+		puts("syscall: FAILED\n");
+	if(!test_preempt())
+		puts("preempt: FAILED\n");
+	if(!test_rusage())
+		puts("rusage: FAILED\n");
+	if(!test_sysenter())
+		puts("sysenter: FAILED\n");
+
 	puts("Waiting for IPC port\n");
 
 	ipc_port_t port;
@@ -0,0 +1,80 @@
+//
+//  mutex.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include "tests.h"
+
+// The priority inversion regression test runs inside the kernel, as kernel mutexes can't be reached from
+// userland. Writing "inversion" to /dev/mutexes starts it and the result line shows up in its statistics
+#define kMutexPollInterval 100000
+#define kMutexTimeout 50 // Polls until the test is considered stuck
+
+static char mutex_buffer[4096];
+
+static char *mutex_read_result(void)
+{
+	int fd = open("/dev/mutexes", O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	size_t length = read(fd, mutex_buffer, sizeof(mutex_buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return NULL;
+
+	mutex_buffer[length] = '\0';
+	return strstr(mutex_buffer, "inversion: ");
+}
+
+int test_mutex(void)
+{
+	int fd = open("/dev/mutexes", O_WRONLY);
+	test_assert(fd >= 0, "mutex: couldn't open /dev/mutexes");
+
+	const char *command = "inversion";
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	test_assert(result == strlen(command), "mutex: couldn't start the inversion test");
+
+	char *line = NULL;
+
+	for(int i = 0; i < kMutexTimeout; i ++)
+	{
+		usleep(kMutexPollInterval);
+
+		line = mutex_read_result();
+		if(line && strncmp(line, "inversion: running", 18) != 0)
+			break;
+	}
+
+	test_assert(line, "mutex: no inversion result in /dev/mutexes");
+	test_assert(strncmp(line, "inversion: running", 18) != 0, "mutex: the inversion test didn't finish");
+
+	char *end = strstr(line, "\n");
+	if(end)
+		*end = '\0';
+
+	printf("mutex: %s\n", line);
+	test_assert(strncmp(line, "inversion: passed", 17) == 0, "mutex: the high priority thread was held up by the medium priority one");
+
+	return 1;
+}
@@ -0,0 +1,156 @@
+//
+//  pingpong.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <sys/kern_return.h>
+#include <ipc/ipc_message.h>
+#include <ipc/ipc_port.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Two threads pinned to different CPUs wake each other up through blocking IPC reads.
+// Every wakeup is a cross CPU unblock, so this mostly measures the scheduler command path
+#define kPingPongIterations 10000
+#define kPingPongSendOffset 0x10000 // Added to a receive port's name to name its send right
+
+struct pingpong_message
+{
+	ipc_header_t header;
+	uint32_t sequence;
+};
+
+struct pingpong_state
+{
+	ipc_port_t ping; // Receive rights
+	ipc_port_t pong;
+	int cpu;
+	int failures;
+};
+
+static int pingpong_send(ipc_port_t port, uint32_t sequence)
+{
+	struct pingpong_message message;
+
+	message.header.port = port + kPingPongSendOffset;
+	message.header.flags = 0;
+	message.header.id = 0;
+	message.header.size = sizeof(uint32_t);
+	message.sequence = sequence;
+
+	return (ipc_write(&message.header) == KERN_SUCCESS);
+}
+
+static int pingpong_receive(ipc_port_t port, uint32_t sequence)
+{
+	struct pingpong_message message;
+
+	message.header.port = port;
+	message.header.flags = IPC_HEADER_FLAG_BLOCK;
+	message.header.size = sizeof(uint32_t);
+
+	return (ipc_read(&message.header) == KERN_SUCCESS && message.sequence == sequence);
+}
+
+static void pingpong_worker(void *argument)
+{
+	struct pingpong_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	for(uint32_t i = 0; i < kPingPongIterations; i ++)
+	{
+		if(!pingpong_receive(state->ping, i) || !pingpong_send(state->pong, i))
+			state->failures ++;
+	}
+}
+
+int test_pingpong(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "pingpong: sched_getaffinity() failed");
+
+	int first = -1, second = -1;
+
+	for(int i = 0; i < 32 && second == -1; i ++)
+	{
+		if(!(online & (1 << i)))
+			continue;
+
+		if(first == -1)
+			first = i;
+		else
+			second = i;
+	}
+
+	if(second == -1)
+	{
+		puts("pingpong: skipped, needs at least two CPUs\n");
+		return 1;
+	}
+
+	struct pingpong_state state;
+	state.cpu = second;
+	state.failures = 0;
+
+	ipc_space_t space;
+	test_assert(ipc_task_space(&space, getpid()) == KERN_SUCCESS, "pingpong: ipc_task_space() failed");
+	test_assert(ipc_allocate_port(&state.ping) == KERN_SUCCESS && ipc_allocate_port(&state.pong) == KERN_SUCCESS, "pingpong: ipc_allocate_port() failed");
+	test_assert(ipc_insert_port(space, state.ping + kPingPongSendOffset, state.ping, IPC_PORT_RIGHT_SEND) == KERN_SUCCESS, "pingpong: ipc_insert_port() failed");
+	test_assert(ipc_insert_port(space, state.pong + kPingPongSendOffset, state.pong, IPC_PORT_RIGHT_SEND) == KERN_SUCCESS, "pingpong: ipc_insert_port() failed");
+
+	test_assert(sched_setaffinity(0, 1 << first) == 0, "pingpong: sched_setaffinity() failed");
+	thread_yield();
+
+	tid_t thread = thread_create(&pingpong_worker, &state);
+
+	uint64_t min = UINT64_MAX, max = 0;
+	uint64_t start = test_rdtsc();
+
+	for(uint32_t i = 0; i < kPingPongIterations; i ++)
+	{
+		uint64_t roundtrip = test_rdtsc();
+
+		if(!pingpong_send(state.ping, i) || !pingpong_receive(state.pong, i))
+			state.failures ++;
+
+		roundtrip = test_rdtsc() - roundtrip;
+
+		if(roundtrip < min)
+			min = roundtrip;
+		if(roundtrip > max)
+			max = roundtrip;
+	}
+
+	uint64_t total = test_rdtsc() - start;
+
+	thread_join(thread);
+	sched_setaffinity(0, online);
+
+	ipc_deallocate_port(state.ping + kPingPongSendOffset);
+	ipc_deallocate_port(state.pong + kPingPongSendOffset);
+	ipc_deallocate_port(state.ping);
+	ipc_deallocate_port(state.pong);
+
+	test_assert(state.failures == 0, "pingpong: %d messages got lost or reordered", state.failures);
+
+	printf("pingpong: cpu%d <-> cpu%d, %d round trips, %llu cycles avg (%llu min, %llu max)\n", first, second, kPingPongIterations, total / kPingPongIterations, min, max);
+	test_print_file("/dev/scheduler");
+	return 1;
+}
@@ -0,0 +1,163 @@
+//
+//  preempt.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Measures how late a periodic deadline thread gets to run while another thread on the same CPU
+// writes a big file to FFS. The writes run in the kernel, which has to be preempted for the deadline
+// thread to be on time. Without kernel preemption the delay grows with the size of the file
+#define kPreemptPeriod   2000 // Microseconds
+#define kPreemptRuntime  500
+#define kPreemptWork     100
+#define kPreemptJobs     500
+#define kPreemptMaxDelay 5000 // Microseconds a job may start late with the writer running
+
+#define kPreemptFile      "/tmp/preempt"
+#define kPreemptFileSize  (8 * 1024 * 1024)
+#define kPreemptChunkSize (64 * 1024)
+
+struct preempt_state
+{
+	int cpu;
+	uint64_t cyclesPerMicrosecond;
+	int admitted;
+	uint32_t maxDelay; // Microseconds a job started after its period
+	size_t written; // Bytes written by the writer
+};
+
+static volatile int preempt_running;
+static char preempt_buffer[kPreemptChunkSize];
+
+static void preempt_writer(void *argument)
+{
+	struct preempt_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	while(preempt_running)
+	{
+		int fd = open(kPreemptFile, O_WRONLY | O_CREAT);
+		if(fd < 0)
+			return;
+
+		for(size_t offset = 0; offset < kPreemptFileSize && preempt_running; offset += kPreemptChunkSize)
+		{
+			size_t result = write(fd, preempt_buffer, kPreemptChunkSize);
+			if(result == (size_t)-1)
+				break;
+
+			state->written += result;
+		}
+
+		close(fd);
+		remove(kPreemptFile); // Start over with an empty file, growing it is the expensive part
+	}
+}
+
+static void preempt_worker(void *argument)
+{
+	struct preempt_state *state = argument;
+
+	sched_setaffinity(0, 1 << state->cpu);
+	thread_yield();
+
+	state->admitted = (sched_setdeadline(0, kPreemptRuntime, kPreemptPeriod, 0) == 0);
+	if(!state->admitted)
+		return;
+
+	thread_yield(); // Line up with the start of a period
+
+	uint64_t period = (uint64_t)kPreemptPeriod * state->cyclesPerMicrosecond;
+	uint64_t last = test_rdtsc();
+
+	for(int i = 0; i < kPreemptJobs; i ++)
+	{
+		uint64_t start = test_rdtsc();
+		while(test_rdtsc() - start < (uint64_t)kPreemptWork * state->cyclesPerMicrosecond)
+		{}
+
+		thread_yield();
+
+		uint64_t now = test_rdtsc();
+		uint64_t elapsed = now - last;
+
+		if(elapsed > period && (elapsed - period) / state->cyclesPerMicrosecond > state->maxDelay)
+			state->maxDelay = (uint32_t)((elapsed - period) / state->cyclesPerMicrosecond);
+
+		last = now;
+	}
+
+	sched_setdeadline(0, 0, 0, 0);
+}
+
+static int preempt_run(struct preempt_state *state, int withWriter)
+{
+	preempt_running = 1;
+
+	tid_t writer = 0;
+	if(withWriter)
+		writer = thread_create(&preempt_writer, state);
+
+	tid_t worker = thread_create(&preempt_worker, state);
+	thread_join(worker);
+
+	preempt_running = 0;
+
+	if(withWriter)
+		thread_join(writer);
+
+	return state->admitted;
+}
+
+int test_preempt(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "preempt: sched_getaffinity() failed");
+
+	int cpu = 0;
+	while(!(online & (1 << cpu)))
+		cpu ++;
+
+	uint64_t start = test_rdtsc();
+	usleep(100000);
+	uint64_t cyclesPerMicrosecond = (test_rdtsc() - start) / 100000;
+
+	struct preempt_state idle = { 0 };
+	idle.cpu = cpu;
+	idle.cyclesPerMicrosecond = cyclesPerMicrosecond;
+
+	test_assert(preempt_run(&idle, 0), "preempt: periodic thread wasn't admitted");
+
+	struct preempt_state busy = { 0 };
+	busy.cpu = cpu;
+	busy.cyclesPerMicrosecond = cyclesPerMicrosecond;
+
+	test_assert(preempt_run(&busy, 1), "preempt: periodic thread wasn't admitted next to the writer");
+	test_assert(busy.written > 0, "preempt: writer didn't write anything to %s", kPreemptFile);
+
+	printf("preempt: %u us max scheduling delay idle, %u us while writing %u kb to FFS\n", idle.maxDelay, busy.maxDelay, (uint32_t)(busy.written / 1024));
+	test_print_file("/dev/preempt");
+
+	test_assert(busy.maxDelay < kPreemptMaxDelay, "preempt: jobs started up to %u us late while writing", busy.maxDelay);
+	return 1;
+}
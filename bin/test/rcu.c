@@ -0,0 +1,78 @@
+//
+//  rcu.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include "tests.h"
+
+// The lookups are benchmarked inside the kernel, from userland they'd be serialized by the syscall
+// handling. Writing "benchmark" to /dev/rcu starts it and the result line shows up in its statistics
+#define kRCUPollInterval 100000
+#define kRCUTimeout 100 // Polls until the benchmark is considered stuck
+
+static char rcu_buffer[1024];
+
+static char *rcu_read_result(void)
+{
+	int fd = open("/dev/rcu", O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	size_t length = read(fd, rcu_buffer, sizeof(rcu_buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return NULL;
+
+	rcu_buffer[length] = '\0';
+	return strstr(rcu_buffer, "benchmark: ");
+}
+
+int test_rcu(void)
+{
+	int fd = open("/dev/rcu", O_WRONLY);
+	test_assert(fd >= 0, "rcu: couldn't open /dev/rcu");
+
+	const char *command = "benchmark";
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	test_assert(result == strlen(command), "rcu: couldn't start the benchmark");
+
+	char *line = NULL;
+
+	for(int i = 0; i < kRCUTimeout; i ++)
+	{
+		usleep(kRCUPollInterval);
+
+		line = rcu_read_result();
+		if(line && strncmp(line, "benchmark: running", 18) != 0)
+			break;
+	}
+
+	test_assert(line, "rcu: no benchmark result in /dev/rcu");
+	test_assert(strncmp(line, "benchmark: running", 18) != 0, "rcu: the benchmark didn't finish");
+
+	char *end = strstr(line, "\n");
+	if(end)
+		*end = '\0';
+
+	printf("rcu: %s\n", line + 11);
+	return 1;
+}
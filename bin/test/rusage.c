@@ -0,0 +1,63 @@
+//
+//  rusage.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/resource.h>
+#include <sys/thread.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Checks that getrusage() charges the calling thread for the time it spends in user space and counts
+// the syscalls it makes, and that the task totals include the thread's numbers
+#define kRusageSpinIterations (50 * 1000 * 1000)
+#define kRusageSyscalls 1000
+
+static uint64_t rusage_microseconds(const struct timeval *time)
+{
+	return ((uint64_t)time->tv_sec * 1000000) + time->tv_usec;
+}
+
+int test_rusage(void)
+{
+	struct rusage before, after, task;
+
+	test_assert(getrusage(RUSAGE_THREAD, &before) == 0, "rusage: getrusage() failed");
+	test_assert(getrusage(42, &after) != 0, "rusage: getrusage() accepted an invalid who");
+
+	volatile uint32_t counter = 0;
+	for(uint32_t i = 0; i < kRusageSpinIterations; i ++)
+		counter ++;
+
+	uint32_t mask;
+	for(int i = 0; i < kRusageSyscalls; i ++)
+		sched_getaffinity(0, &mask);
+
+	test_assert(getrusage(RUSAGE_THREAD, &after) == 0, "rusage: getrusage() failed");
+	test_assert(getrusage(RUSAGE_SELF, &task) == 0, "rusage: getrusage() failed");
+
+	uint64_t user = rusage_microseconds(&after.ru_utime) - rusage_microseconds(&before.ru_utime);
+	uint32_t syscalls = after.ru_nsyscalls - before.ru_nsyscalls;
+
+	printf("rusage: %llu us user time, %u syscalls, %u voluntary, %u involuntary switches\n", user, syscalls, after.ru_nvcsw, after.ru_nivcsw);
+
+	test_assert(user > 0, "rusage: no user time was charged for spinning");
+	test_assert(syscalls >= kRusageSyscalls, "rusage: only %u of %d syscalls were counted", syscalls, kRusageSyscalls);
+
+	test_assert(rusage_microseconds(&task.ru_utime) >= rusage_microseconds(&after.ru_utime), "rusage: task has less user time than its thread");
+	test_assert(task.ru_nsyscalls >= after.ru_nsyscalls, "rusage: task made fewer syscalls than its thread");
+	return 1;
+}
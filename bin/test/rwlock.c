@@ -0,0 +1,90 @@
+//
+//  rwlock.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include "tests.h"
+
+// Like the RCU benchmark this runs inside the kernel. Writing "benchmark" to /dev/locks starts it,
+// once it's done there is one line per lock with the read cost at 1, 2 and 4 CPUs
+#define kRWLockPollInterval 100000
+#define kRWLockTimeout 200 // Polls until the benchmark is considered stuck
+
+static char rwlock_buffer[1024];
+
+static char *rwlock_read_result(void)
+{
+	int fd = open("/dev/locks", O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	size_t length = read(fd, rwlock_buffer, sizeof(rwlock_buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return NULL;
+
+	rwlock_buffer[length] = '\0';
+	return rwlock_buffer;
+}
+
+int test_rwlock(void)
+{
+	int fd = open("/dev/locks", O_WRONLY);
+	test_assert(fd >= 0, "rwlock: couldn't open /dev/locks");
+
+	const char *command = "benchmark";
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	test_assert(result == strlen(command), "rwlock: couldn't start the benchmark");
+
+	char *output = NULL;
+
+	for(int i = 0; i < kRWLockTimeout; i ++)
+	{
+		usleep(kRWLockPollInterval);
+
+		output = rwlock_read_result();
+		if(output && strstr(output, "benchmark: running") == NULL)
+			break;
+	}
+
+	test_assert(output, "rwlock: couldn't read /dev/locks");
+	test_assert(strstr(output, "benchmark: running") == NULL, "rwlock: the benchmark didn't finish");
+	test_assert(strstr(output, "seqlock:"), "rwlock: no benchmark result in /dev/locks");
+
+	char *line = output;
+
+	while(*line)
+	{
+		char *end = strstr(line, "\n");
+		if(end)
+			*end = '\0';
+
+		printf("rwlock: %s\n", line);
+
+		if(!end)
+			break;
+
+		line = end + 1;
+	}
+
+	return 1;
+}
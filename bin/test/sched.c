@@ -0,0 +1,67 @@
+//
+//  sched.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Measures the cost of going through the scheduler with and without a large number of blocked
+// threads around. With O(1) runqueues both numbers should be about the same
+#define kSchedIdleThreads 1000
+#define kSchedYields      10000
+
+static void sched_idle_thread(void *argument)
+{
+	thread_join((tid_t)(uintptr_t)argument); // Blocks until the main thread exits
+}
+
+static uint64_t sched_measure_yield(void)
+{
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < kSchedYields; i ++)
+		thread_yield();
+
+	return (test_rdtsc() - start) / kSchedYields;
+}
+
+int test_sched(void)
+{
+	uint64_t before = sched_measure_yield();
+	tid_t main = thread_gettid();
+
+	int created = 0;
+
+	for(; created < kSchedIdleThreads; created ++)
+	{
+		if(thread_create(&sched_idle_thread, (void *)(uintptr_t)main) == 0)
+			break;
+	}
+
+	// Give every thread the chance to run once and block
+	for(int i = 0; i < created; i ++)
+		thread_yield();
+
+	uint64_t after = sched_measure_yield();
+
+	printf("sched: %d cycles per yield, %d with %d idle threads\n", (int)before, (int)after, created);
+	test_print_file("/dev/scheduler");
+
+	test_assert(created == kSchedIdleThreads, "sched: only created %d threads", created);
+	return 1;
+}
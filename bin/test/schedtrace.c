@@ -0,0 +1,134 @@
+//
+//  schedtrace.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Mirrors OS::SchedulerTrace::Event
+struct schedtrace_event
+{
+	uint64_t timestamp;
+	uint8_t type;
+	uint8_t cpu;
+	uint16_t vector;
+	uint32_t pid;
+	uint32_t tid;
+	uint32_t argument;
+} __attribute__((packed));
+
+enum
+{
+	schedtrace_header,
+	schedtrace_lost,
+	schedtrace_switch,
+	schedtrace_wakeup,
+	schedtrace_block,
+	schedtrace_migrate,
+	schedtrace_ipi_sent,
+	schedtrace_ipi_received,
+	schedtrace_commands,
+	schedtrace_idle_enter,
+	schedtrace_idle_exit,
+	schedtrace_types
+};
+
+#define kSchedtraceSleepers 2
+#define kSchedtraceMaxCPUs  32
+
+static int schedtrace_control(const char *command)
+{
+	int fd = open("/dev/schedtrace_control", O_WRONLY);
+	if(fd < 0)
+		return 0;
+
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	return (result == strlen(command));
+}
+
+static void schedtrace_sleeper(__unused void *argument)
+{
+	for(int i = 0; i < 20; i ++)
+		usleep(1000);
+}
+
+int test_schedtrace(void)
+{
+	test_assert(schedtrace_control("clear"), "schedtrace: couldn't clear the trace");
+	test_assert(schedtrace_control("start"), "schedtrace: couldn't start tracing");
+
+	tid_t threads[kSchedtraceSleepers];
+
+	for(int i = 0; i < kSchedtraceSleepers; i ++)
+		threads[i] = thread_create(&schedtrace_sleeper, NULL);
+	for(int i = 0; i < kSchedtraceSleepers; i ++)
+		thread_join(threads[i]);
+
+	test_assert(schedtrace_control("stop"), "schedtrace: couldn't stop tracing");
+
+	int fd = open("/dev/schedtrace", O_RDONLY);
+	test_assert(fd >= 0, "schedtrace: couldn't open /dev/schedtrace");
+
+	struct schedtrace_event events[64];
+	uint64_t last[kSchedtraceMaxCPUs] = { 0 };
+	uint32_t counts[schedtrace_types] = { 0 };
+	uint32_t total = 0;
+	size_t length;
+
+	while((length = read(fd, events, sizeof(events))) > 0 && length != (size_t)-1)
+	{
+		test_assert((length % sizeof(struct schedtrace_event)) == 0, "schedtrace: read returned a partial event");
+
+		for(size_t i = 0; i < length / sizeof(struct schedtrace_event); i ++)
+		{
+			struct schedtrace_event *event = &events[i];
+
+			test_assert(event->type < schedtrace_types, "schedtrace: unknown event type %u", event->type);
+			test_assert(total > 0 || event->type == schedtrace_header, "schedtrace: dump doesn't start with a header");
+			test_assert(event->type != schedtrace_header || event->argument > 0, "schedtrace: header has no TSC frequency");
+
+			// Rings are drained one after another, but each CPU records in order
+			if(event->type != schedtrace_header && event->cpu < kSchedtraceMaxCPUs)
+			{
+				test_assert(event->timestamp >= last[event->cpu], "schedtrace: cpu%u went back in time", event->cpu);
+				last[event->cpu] = event->timestamp;
+			}
+
+			counts[event->type] ++;
+			total ++;
+		}
+	}
+
+	close(fd);
+
+	test_assert(counts[schedtrace_header] == 1, "schedtrace: expected one header, got %u", counts[schedtrace_header]);
+	test_assert(counts[schedtrace_switch] > 0, "schedtrace: no context switches recorded");
+	test_assert(counts[schedtrace_block] > 0, "schedtrace: no blocked threads recorded");
+	test_assert(counts[schedtrace_wakeup] > 0, "schedtrace: no wakeups recorded");
+
+	printf("schedtrace: %u events, %u switches, %u wakeups, %u blocks, %u migrations, %u ipis, %u lost\n",
+	       total, counts[schedtrace_switch], counts[schedtrace_wakeup], counts[schedtrace_block], counts[schedtrace_migrate], counts[schedtrace_ipi_sent], counts[schedtrace_lost]);
+
+	test_print_file("/dev/schedtrace_control");
+	return 1;
+}
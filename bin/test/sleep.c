@@ -0,0 +1,94 @@
+//
+//  sleep.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/kern_return.h>
+#include <ipc/ipc_message.h>
+#include <ipc/ipc_port.h>
+#include <stdint.h>
+#include <time.h>
+#include "tests.h"
+
+// Measures how far past the requested time usleep() returns. The TSC is calibrated against a one
+// second sleep, which is long enough for a single timer wheel tick of error to not matter.
+#define kSleepIterations 20
+
+static void sleep_measure(uint64_t cyclesPerMicrosecond, useconds_t duration)
+{
+	uint64_t min = UINT64_MAX, max = 0, total = 0;
+
+	for(int i = 0; i < kSleepIterations; i ++)
+	{
+		uint64_t start = test_rdtsc();
+		usleep(duration);
+		uint64_t elapsed = (test_rdtsc() - start) / cyclesPerMicrosecond;
+		uint64_t over = (elapsed > duration) ? elapsed - duration : 0;
+
+		if(over < min)
+			min = over;
+		if(over > max)
+			max = over;
+
+		total += over;
+	}
+
+	printf("sleep: %u us, oversleep min %u avg %u max %u us\n", (uint32_t)duration, (uint32_t)min, (uint32_t)(total / kSleepIterations), (uint32_t)max);
+}
+
+int test_sleep(void)
+{
+	uint64_t start = test_rdtsc();
+	test_assert(sleep(1) == 0, "sleep: sleep() failed");
+	uint64_t cyclesPerMicrosecond = (test_rdtsc() - start) / 1000000;
+
+	test_assert(cyclesPerMicrosecond > 0, "sleep: TSC didn't advance");
+
+	struct timespec invalid = { 0, 1000000000 };
+	test_assert(nanosleep(&invalid, NULL) == -1, "sleep: invalid timespec was accepted");
+
+	sleep_measure(cyclesPerMicrosecond, 1000);
+	sleep_measure(cyclesPerMicrosecond, 10000);
+	sleep_measure(cyclesPerMicrosecond, 100000);
+
+	// A blocking read on a port nobody writes to has to time out
+	ipc_port_t port;
+	test_assert(ipc_allocate_port(&port) == KERN_SUCCESS, "sleep: ipc_allocate_port() failed");
+
+	struct
+	{
+		ipc_header_t header;
+		char buffer[32];
+	} message;
+
+	message.header.port = port;
+	message.header.flags = IPC_HEADER_FLAG_BLOCK;
+	message.header.size = sizeof(message.buffer);
+
+	start = test_rdtsc();
+	ipc_return_t result = ipc_read_timeout(&message.header, 50000);
+	uint64_t elapsed = (test_rdtsc() - start) / cyclesPerMicrosecond;
+
+	ipc_deallocate_port(port);
+
+	test_assert(result == KERN_TIMEOUT, "sleep: ipc_read_timeout() returned %d", (int)result);
+	test_assert(elapsed >= 50000, "sleep: ipc_read_timeout() returned after %u us", (uint32_t)elapsed);
+
+	printf("sleep: ipc_read_timeout() timed out after %u us\n", (uint32_t)elapsed);
+	test_print_file("/dev/clock");
+	return 1;
+}
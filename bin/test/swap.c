@@ -0,0 +1,106 @@
+//
+//  swap.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+
+// Allocates more anonymous memory than a small machine has and makes sure it all survives the trip through the swap.
+// Run under something like qemu -m 32 to actually exercise the swap, on bigger machines this just tests mmap
+#define kSwapChunkSize   (2 * 1024 * 1024)
+#define kSwapChunkCount  24
+#define kSwapPageSize    4096
+
+static uint32_t swap_page_seed(size_t chunk, size_t page)
+{
+	return (uint32_t)((chunk << 16) | page) * 2654435761u;
+}
+
+static void swap_fill_page(uint32_t *words, size_t chunk, size_t page)
+{
+	uint32_t seed = swap_page_seed(chunk, page);
+
+	// Mix of zero pages, compressible pages and noise that the swap has to reject
+	switch(page % 3)
+	{
+		case 0:
+			memset(words, 0, kSwapPageSize);
+			break;
+		case 1:
+			for(size_t i = 0; i < kSwapPageSize / 4; i ++)
+				words[i] = seed + (i / 64);
+			break;
+		case 2:
+			for(size_t i = 0; i < kSwapPageSize / 4; i ++)
+			{
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+
+				words[i] = seed;
+			}
+			break;
+	}
+}
+
+static int swap_verify_page(const uint32_t *words, size_t chunk, size_t page)
+{
+	uint32_t expected[kSwapPageSize / 4];
+	swap_fill_page(expected, chunk, page);
+
+	for(size_t i = 0; i < kSwapPageSize / 4; i ++)
+	{
+		if(words[i] != expected[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+int test_swap(void)
+{
+	uint8_t *chunks[kSwapChunkCount];
+	size_t count = 0;
+
+	for(; count < kSwapChunkCount; count ++)
+	{
+		chunks[count] = mmap(NULL, kSwapChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(chunks[count] == MAP_FAILED)
+			break;
+
+		for(size_t page = 0; page < kSwapChunkSize / kSwapPageSize; page ++)
+			swap_fill_page((uint32_t *)(chunks[count] + page * kSwapPageSize), count, page);
+	}
+
+	printf("swap: mapped %d chunks of %d bytes\n", (int)count, kSwapChunkSize);
+	test_assert(count > 0, "swap: mmap failed right away");
+
+	// Touch everything again in order, old chunks will have to come back from the swap
+	for(size_t chunk = 0; chunk < count; chunk ++)
+	{
+		for(size_t page = 0; page < kSwapChunkSize / kSwapPageSize; page ++)
+		{
+			const uint32_t *words = (const uint32_t *)(chunks[chunk] + page * kSwapPageSize);
+			test_assert(swap_verify_page(words, chunk, page), "swap: chunk %d page %d is corrupted", (int)chunk, (int)page);
+		}
+	}
+
+	test_print_file("/dev/swap");
+	return 1;
+}
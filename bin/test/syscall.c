@@ -0,0 +1,93 @@
+//
+//  syscall.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/thread.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Every syscall is completed by a kernel worker. Each CPU has its own, so syscalls made on
+// different CPUs at the same time shouldn't have to wait for each other
+#define kSyscallIterations 20000
+#define kSyscallMaxCPUs 4
+
+static volatile int syscall_failures;
+
+static void syscall_worker(void *argument)
+{
+	int cpu = (int)(uintptr_t)argument;
+	uint32_t mask;
+
+	sched_setaffinity(0, 1 << cpu);
+	thread_yield();
+
+	for(int i = 0; i < kSyscallIterations; i ++)
+	{
+		if(sched_getaffinity(0, &mask) != 0)
+			syscall_failures ++;
+	}
+}
+
+// Returns the cycles it took count threads, one per CPU, to make kSyscallIterations syscalls each
+static uint64_t syscall_run(int *cpus, int count)
+{
+	tid_t threads[kSyscallMaxCPUs];
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < count; i ++)
+		threads[i] = thread_create(&syscall_worker, (void *)(uintptr_t)cpus[i]);
+
+	for(int i = 0; i < count; i ++)
+		thread_join(threads[i]);
+
+	return test_rdtsc() - start;
+}
+
+int test_syscall(void)
+{
+	uint32_t online;
+	test_assert(sched_getaffinity(0, &online) == 0, "syscall: sched_getaffinity() failed");
+
+	int cpus[kSyscallMaxCPUs];
+	int available = 0;
+
+	for(int cpu = 0; cpu < 32 && available < kSyscallMaxCPUs; cpu ++)
+	{
+		if(online & (1 << cpu))
+			cpus[available ++] = cpu;
+	}
+
+	uint64_t single = 0;
+
+	for(int count = 1; count <= available; count *= 2)
+	{
+		uint64_t cycles = syscall_run(cpus, count);
+
+		if(count == 1)
+			single = cycles;
+
+		// Syscalls per cycle relative to a single CPU, in percent
+		uint64_t throughput = (single * count * 100) / cycles;
+		printf("syscall: %d cpus, %llu cycles per syscall, %d%% throughput\n", count, cycles / kSyscallIterations, (int)throughput);
+
+		if(count > 1)
+			test_assert(throughput >= 100, "syscall: %d cpus made fewer syscalls than one", count);
+	}
+
+	test_assert(syscall_failures == 0, "syscall: %d syscalls failed", syscall_failures);
+	return 1;
+}
@@ -0,0 +1,139 @@
+//
+//  sysenter.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/tls.h>
+#include <sys/mman.h>
+#include <sys/unistd.h>
+#include <sys/errno.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include "tests.h"
+
+// Compares the round trip of a null syscall through int 0x80 and through SYSENTER. Syscall numbers
+// past the table return right away without touching any register, which leaves only the cost of
+// entering and leaving the kernel. Also checks that __syscall() passes arguments and errno
+// correctly on whichever path it picked
+#define kSysenterIterations 100000
+#define kSysenterNullSyscall 128
+
+static uint64_t sysenter_int_roundtrip(void)
+{
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < kSysenterIterations; i ++)
+	{
+		uint32_t eax = kSysenterNullSyscall;
+		__asm__ volatile("int $0x80" : "+a" (eax) :: "memory");
+	}
+
+	return (test_rdtsc() - start) / kSysenterIterations;
+}
+
+static uint64_t sysenter_fast_roundtrip(void)
+{
+	uint64_t start = test_rdtsc();
+
+	for(int i = 0; i < kSysenterIterations; i ++)
+	{
+		uint32_t eax = kSysenterNullSyscall;
+
+		// Same convention as __syscall(), edx and ebp carry the return address and stack
+		__asm__ volatile("pushl %%ebp\n\t"
+		                 "movl %%esp, %%ebp\n\t"
+		                 "movl $1f, %%edx\n\t"
+		                 "sysenter\n"
+		                 "1:\n\t"
+		                 "popl %%ebp" : "+a" (eax) :: "ecx", "edx", "memory");
+	}
+
+	return (test_rdtsc() - start) / kSysenterIterations;
+}
+
+// Enters with NT and TF set through a syscall that blocks, so the thread resumes through whatever
+// path the kernel picks. Neither flag may leak into the kernel, NT would fault the kernel's iret and
+// TF would single step it. Returns the flags userland sees afterwards
+static uint32_t sysenter_dirty_flags(uint32_t *result)
+{
+	uint32_t eax = SYS_Nanosleep;
+	uint32_t seconds = 0;
+	uint32_t nanoseconds = 1000000;
+	uint32_t flags;
+
+	// popfl has to come right before sysenter, TF only traps after the instruction that follows it
+	__asm__ volatile("pushl %%ebp\n\t"
+	                 "movl %%esp, %%ebp\n\t"
+	                 "movl $1f, %%edx\n\t"
+	                 "pushfl\n\t"
+	                 "orl $0x4100, (%%esp)\n\t"
+	                 "popfl\n\t"
+	                 "sysenter\n"
+	                 "1:\n\t"
+	                 "pushfl\n\t"
+	                 "popl %%edx\n\t"
+	                 "pushfl\n\t"
+	                 "andl $0xffffbeff, (%%esp)\n\t"
+	                 "popfl\n\t"
+	                 "popl %%ebp" : "+a" (eax), "+c" (seconds), "+D" (nanoseconds), "=d" (flags) :: "memory");
+
+	*result = eax;
+	return flags;
+}
+
+int test_sysenter(void)
+{
+	uint32_t fast;
+	TLS_GET_CPU_DATA_MEMBER(fast, fastSyscall);
+
+	uint64_t slow = sysenter_int_roundtrip();
+	printf("sysenter: int 0x80 takes %llu cycles per round trip\n", slow);
+
+	if(fast)
+	{
+		uint64_t cycles = sysenter_fast_roundtrip();
+		printf("sysenter: sysenter takes %llu cycles per round trip\n", cycles);
+
+		test_assert(cycles <= slow, "sysenter: sysenter (%llu cycles) is slower than int 0x80 (%llu cycles)", cycles, slow);
+	}
+	else
+		printf("sysenter: not supported by the CPU, syscalls use int 0x80\n");
+
+	if(fast)
+	{
+		uint32_t result;
+		uint32_t flags = sysenter_dirty_flags(&result);
+
+		test_assert(result == 0, "sysenter: nanosleep with NT and TF set failed (%u)", result);
+		test_assert((flags & 0x100) == 0, "sysenter: TF survived the syscall");
+	}
+
+	// Six arguments, the fourth and later ones take a different route with SYSENTER
+	uint8_t *page = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	test_assert(page != MAP_FAILED, "sysenter: mmap() failed");
+
+	page[0] = 0x42;
+	test_assert(munmap(page, 4096) == 0, "sysenter: munmap() failed");
+
+	// Errors come back in a different register with SYSENTER
+	errno = 0;
+
+	char buffer[4];
+	test_assert(read(-1, buffer, sizeof(buffer)) == (size_t)-1, "sysenter: read() on an invalid descriptor succeeded");
+	test_assert(errno != 0, "sysenter: read() on an invalid descriptor didn't set errno");
+
+	return 1;
+}
@@ -0,0 +1,69 @@
+//
+//  tests.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _TESTS_H_
+#define _TESTS_H_
+
+#include <sys/cdefs.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define test_assert(condition, ...) \
+	do { \
+		if(!(condition)) \
+		{ \
+			printf("%s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			puts("\n"); \
+			return 0; \
+		} \
+	} while(0)
+
+static inline uint64_t test_rdtsc(void)
+{
+	uint32_t low, high;
+	__asm__ volatile("rdtsc" : "=a" (low), "=d" (high));
+
+	return ((uint64_t)high << 32) | low;
+}
+
+void test_print_file(const char *path);
+
+int test_affinity(void);
+int test_swap(void);
+int test_sched(void);
+int test_balance(void);
+int test_sleep(void);
+int test_pingpong(void);
+int test_fair(void);
+int test_deadline(void);
+int test_schedtrace(void);
+int test_idle(void);
+int test_fpu(void);
+int test_futex(void);
+int test_mutex(void);
+int test_function(void);
+int test_rcu(void);
+int test_rwlock(void);
+int test_waitqueue(void);
+int test_syscall(void);
+int test_preempt(void);
+int test_rusage(void);
+int test_sysenter(void);
+
+#endif /* _TESTS_H_ */
@@ -0,0 +1,93 @@
+//
+//  waitqueue.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <string.h>
+#include "tests.h"
+
+// The wakeup round trips are measured inside the kernel between two kernel threads. Writing "benchmark"
+// to /dev/waitqueue starts it, once it's done there is a line for the same CPU and one across CPUs
+#define kWaitqueuePollInterval 100000
+#define kWaitqueueTimeout 100 // Polls until the benchmark is considered stuck
+
+static char waitqueue_buffer[1024];
+
+static char *waitqueue_read_result(void)
+{
+	int fd = open("/dev/waitqueue", O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	size_t length = read(fd, waitqueue_buffer, sizeof(waitqueue_buffer) - 1);
+	close(fd);
+
+	if(length == (size_t)-1)
+		return NULL;
+
+	waitqueue_buffer[length] = '\0';
+	return waitqueue_buffer;
+}
+
+int test_waitqueue(void)
+{
+	int fd = open("/dev/waitqueue", O_WRONLY);
+	test_assert(fd >= 0, "waitqueue: couldn't open /dev/waitqueue");
+
+	const char *command = "benchmark";
+	size_t result = write(fd, command, strlen(command));
+	close(fd);
+
+	test_assert(result == strlen(command), "waitqueue: couldn't start the benchmark");
+
+	char *output = NULL;
+
+	for(int i = 0; i < kWaitqueueTimeout; i ++)
+	{
+		usleep(kWaitqueuePollInterval);
+
+		output = waitqueue_read_result();
+		if(output && strstr(output, "benchmark: running") == NULL)
+			break;
+	}
+
+	test_assert(output, "waitqueue: couldn't read /dev/waitqueue");
+	test_assert(strstr(output, "benchmark: running") == NULL, "waitqueue: the benchmark didn't finish");
+	test_assert(strstr(output, "same cpu: ") && strstr(output, "cross cpu: "), "waitqueue: no benchmark result in /dev/waitqueue");
+
+	// Both threads failing to start leaves the same CPU round trips at 0
+	test_assert(strncmp(strstr(output, "same cpu: "), "same cpu: 0 ", 12) != 0, "waitqueue: the benchmark threads didn't run");
+
+	char *line = output;
+
+	while(*line)
+	{
+		char *end = strstr(line, "\n");
+		if(end)
+			*end = '\0';
+
+		printf("waitqueue: %s\n", line);
+
+		if(!end)
+			break;
+
+		line = end + 1;
+	}
+
+	return 1;
+}
@@ -0,0 +1,232 @@
+//
+//  main.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <sys/unistd.h>
+#include <sys/fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Samples /dev/top twice per interval and lists the tasks by the CPU time they used in between.
+// Usage: top [iterations], runs until killed without an argument
+#define kTopInterval 1000000 // Microseconds
+#define kTopMaxTasks 128
+#define kTopNameLength 64
+
+struct top_task
+{
+	int pid;
+	uint32_t threads;
+	uint64_t user; // Microseconds
+	uint64_t kernel;
+	uint64_t voluntary;
+	uint64_t involuntary;
+	uint64_t syscalls;
+	uint32_t usage; // Tenths of a percent of one CPU during the last interval
+	char name[kTopNameLength];
+};
+
+struct top_sample
+{
+	uint64_t time;
+	size_t count;
+	struct top_task tasks[kTopMaxTasks];
+};
+
+static char top_buffer[16384];
+static struct top_sample top_samples[2];
+
+static uint64_t top_parse_number(const char **cursor)
+{
+	const char *string = *cursor;
+	uint64_t value = 0;
+	int negative = 0;
+
+	while(*string == ' ')
+		string ++;
+
+	if(*string == '-')
+	{
+		negative = 1;
+		string ++;
+	}
+
+	while(*string >= '0' && *string <= '9')
+	{
+		value = (value * 10) + (*string - '0');
+		string ++;
+	}
+
+	*cursor = string;
+	return negative ? (uint64_t)(-(int64_t)value) : value;
+}
+
+static int top_read_sample(struct top_sample *sample)
+{
+	int fd = open("/dev/top", O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+	size_t length = 0;
+
+	while(length < sizeof(top_buffer) - 1)
+	{
+		size_t result = read(fd, top_buffer + length, sizeof(top_buffer) - 1 - length);
+		if(result == 0 || result == (size_t)-1)
+			break;
+
+		length += result;
+	}
+
+	close(fd);
+
+	top_buffer[length] = '\0';
+
+	const char *cursor = top_buffer;
+	if(strncmp(cursor, "time ", 5) != 0)
+		return 0;
+
+	cursor += 5;
+
+	sample->time = top_parse_number(&cursor);
+	sample->count = 0;
+
+	while(*cursor && sample->count < kTopMaxTasks)
+	{
+		if(*cursor == '\n')
+		{
+			cursor ++;
+			continue;
+		}
+
+		struct top_task *task = sample->tasks + sample->count;
+
+		task->pid = (int)top_parse_number(&cursor);
+		task->threads = (uint32_t)top_parse_number(&cursor);
+		task->user = top_parse_number(&cursor);
+		task->kernel = top_parse_number(&cursor);
+		task->voluntary = top_parse_number(&cursor);
+		task->involuntary = top_parse_number(&cursor);
+		task->syscalls = top_parse_number(&cursor);
+		task->usage = 0;
+
+		while(*cursor == ' ')
+			cursor ++;
+
+		size_t nameLength = 0;
+		while(*cursor && *cursor != '\n')
+		{
+			if(nameLength < kTopNameLength - 1)
+				task->name[nameLength ++] = *cursor;
+
+			cursor ++;
+		}
+
+		task->name[nameLength] = '\0';
+		sample->count ++;
+	}
+
+	return 1;
+}
+
+static void top_calculate_usage(struct top_sample *sample, const struct top_sample *previous)
+{
+	uint64_t elapsed = sample->time - previous->time;
+	if(elapsed == 0)
+		return;
+
+	for(size_t i = 0; i < sample->count; i ++)
+	{
+		struct top_task *task = sample->tasks + i;
+		uint64_t before = 0;
+
+		// Tasks that started during the interval count from zero
+		for(size_t j = 0; j < previous->count; j ++)
+		{
+			if(previous->tasks[j].pid == task->pid)
+			{
+				before = previous->tasks[j].user + previous->tasks[j].kernel;
+				break;
+			}
+		}
+
+		uint64_t used = task->user + task->kernel;
+		task->usage = (used > before) ? (uint32_t)(((used - before) * 1000) / elapsed) : 0;
+	}
+
+	// Insertion sort, the busiest task first
+	for(size_t i = 1; i < sample->count; i ++)
+	{
+		struct top_task task = sample->tasks[i];
+		size_t j = i;
+
+		while(j > 0 && sample->tasks[j - 1].usage < task.usage)
+		{
+			sample->tasks[j] = sample->tasks[j - 1];
+			j --;
+		}
+
+		sample->tasks[j] = task;
+	}
+}
+
+static void top_print(const struct top_sample *sample)
+{
+	printf("%u tasks\n", (uint32_t)sample->count);
+	printf("  PID  THR   CPU%%   USER ms   KERN ms     VCSW    IVCSW  SYSCALLS  NAME\n");
+
+	for(size_t i = 0; i < sample->count; i ++)
+	{
+		const struct top_task *task = sample->tasks + i;
+
+		printf("%5d %4u %4u.%u %9u %9u %8u %8u %9u  %s\n", task->pid, task->threads, task->usage / 10, task->usage % 10,
+		       (uint32_t)(task->user / 1000), (uint32_t)(task->kernel / 1000),
+		       (uint32_t)task->voluntary, (uint32_t)task->involuntary, (uint32_t)task->syscalls, task->name);
+	}
+
+	printf("\n");
+}
+
+int main(int argc, const char *argv[])
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : 0;
+	int current = 0;
+
+	if(!top_read_sample(&top_samples[current]))
+	{
+		printf("top: couldn't read /dev/top\n");
+		return EXIT_FAILURE;
+	}
+
+	for(int i = 0; iterations == 0 || i < iterations; i ++)
+	{
+		usleep(kTopInterval);
+
+		struct top_sample *previous = &top_samples[current];
+		current = !current;
+
+		if(!top_read_sample(&top_samples[current]))
+			return EXIT_FAILURE;
+
+		top_calculate_usage(&top_samples[current], previous);
+		top_print(&top_samples[current]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -29,6 +29,10 @@ ipc_return_t ipc_read(ipc_header_t *header)
 {
 	return KERN_TRAP3(KERN_IPC_Message, header, header->size, (int)IPC_READ);
 }
+ipc_return_t ipc_read_timeout(ipc_header_t *header, uint32_t timeout)
+{
+	return KERN_TRAP4(KERN_IPC_Message, header, header->size, (int)IPC_READ, timeout);
+}
 
 #else
 #include <libkern.h>
@@ -41,5 +45,9 @@ ipc_return_t ipc_read(__unused ipc_header_t *header)
 {
 	panic("ipc_read() called");
 }
+ipc_return_t ipc_read_timeout(__unused ipc_header_t *header, __unused uint32_t timeout)
+{
+	panic("ipc_read_timeout() called");
+}
 
 #endif
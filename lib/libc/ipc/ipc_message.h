@@ -20,6 +20,7 @@
 #define _IPC_IPC_MESSAGE_H_
 
 #include "../sys/cdefs.h"
+#include "../stdint.h"
 #include "ipc_types.h"
 
 __BEGIN_DECLS
@@ -49,6 +50,7 @@ typedef struct
 
 ipc_return_t ipc_write(ipc_header_t *header);
 ipc_return_t ipc_read(ipc_header_t *header);
+ipc_return_t ipc_read_timeout(ipc_header_t *header, uint32_t timeout); // Timeout in microseconds for IPC_HEADER_FLAG_BLOCK reads, returns KERN_TIMEOUT
 
 __END_DECLS
 
@@ -0,0 +1,46 @@
+//
+//  sys/futex.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SYS_FUTEX_H_
+#define _SYS_FUTEX_H_
+
+#include "cdefs.h"
+#include "../stdint.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+#define FUTEX_WAKE_ALL 0xffffffff
+
+__BEGIN_DECLS
+
+#ifndef __KERNEL
+
+// Blocks as long as *address equals expected, or until the timeout in microseconds passed. A timeout of 0
+// waits forever. Returns 0 when woken up, spurious wakeups are possible and callers have to check their condition
+// again. Fails with EAGAIN if the value didn't match and with ETIMEDOUT if the timeout passed
+int futex_wait(volatile uint32_t *address, uint32_t expected, uint32_t timeout);
+
+// Wakes up at most count threads waiting on the address and returns how many were woken up
+int futex_wake(volatile uint32_t *address, uint32_t count);
+
+#endif /* __KERNEL */
+
+__END_DECLS
+
+#endif /* _SYS_FUTEX_H_ */
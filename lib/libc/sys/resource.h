@@ -0,0 +1,50 @@
+//
+//  resource.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+#include "cdefs.h"
+#include "types.h"
+#include "../stdint.h"
+
+__BEGIN_DECLS
+
+#define RUSAGE_SELF   0 // All threads of the calling process
+#define RUSAGE_THREAD 1 // Only the calling thread
+
+struct timeval
+{
+	time_t tv_sec;
+	long tv_usec;
+};
+
+struct rusage
+{
+	struct timeval ru_utime; // Time spent running user code
+	struct timeval ru_stime; // Time spent in the kernel, including syscalls completed by kernel workers
+	uint32_t ru_nvcsw; // The thread blocked or used up its deadline budget
+	uint32_t ru_nivcsw; // The thread was preempted
+	uint32_t ru_nsyscalls;
+};
+
+int getrusage(int who, struct rusage *usage);
+
+__END_DECLS
+
+#endif /* _SYS_RESOURCE_H_ */
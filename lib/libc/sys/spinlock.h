@@ -23,13 +23,14 @@
 
 __BEGIN_DECLS
 
+// Ticket lock, the low half of _lock is the ticket being served and the high half the next one
 typedef struct
 {
 	int _lock;
 } spinlock_t;
 
 #define SPINLOCK_INIT {0}
-#define SPINLOCK_INIT_LOCKED {1}
+#define SPINLOCK_INIT_LOCKED {0x10000}
 
 void spinlock_init(spinlock_t *lock);
 
@@ -0,0 +1,203 @@
+//
+//  sys/sync.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "sync.h"
+#include "futex.h"
+#include "errno.h"
+
+#define MUTEX_SPIN_COUNT 128
+
+#define ONCE_RUNNING 1
+#define ONCE_WAITING 2
+#define ONCE_DONE    3
+
+static inline void sync_pause(void)
+{
+	__asm__ volatile("pause" ::: "memory");
+}
+
+static inline int sync_cas(volatile uint32_t *value, uint32_t expected, uint32_t desired)
+{
+	return __atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// MARK: -
+// MARK: Mutex
+
+void mutex_init(mutex_t *mutex)
+{
+	__atomic_store_n(&mutex->_state, 0, __ATOMIC_RELEASE);
+}
+
+// Takes the lock in the contended state, so the unlock wakes up the next waiter
+static void __mutex_lock_contended(mutex_t *mutex)
+{
+	while(__atomic_exchange_n(&mutex->_state, 2, __ATOMIC_ACQUIRE) != 0)
+		futex_wait(&mutex->_state, 2, 0);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+	if(sync_cas(&mutex->_state, 0, 1))
+		return;
+
+	// Critical sections are usually short, spinning for a bit avoids the syscall if the owner is running
+	for(int i = 0; i < MUTEX_SPIN_COUNT; i ++)
+	{
+		sync_pause();
+
+		uint32_t state = __atomic_load_n(&mutex->_state, __ATOMIC_RELAXED);
+		if(state == 2)
+			break;
+
+		if(state == 0 && sync_cas(&mutex->_state, 0, 1))
+			return;
+	}
+
+	__mutex_lock_contended(mutex);
+}
+
+int mutex_try_lock(mutex_t *mutex)
+{
+	return sync_cas(&mutex->_state, 0, 1);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+	if(__atomic_exchange_n(&mutex->_state, 0, __ATOMIC_RELEASE) == 2)
+		futex_wake(&mutex->_state, 1);
+}
+
+// MARK: -
+// MARK: Condition variable
+
+void cond_init(cond_t *cond)
+{
+	__atomic_store_n(&cond->_sequence, 0, __ATOMIC_RELEASE);
+}
+
+static int __cond_wait(cond_t *cond, mutex_t *mutex, uint32_t timeout)
+{
+	// Any signal after the mutex is unlocked bumps the sequence, which makes the futex wait return right away
+	uint32_t sequence = __atomic_load_n(&cond->_sequence, __ATOMIC_RELAXED);
+
+	mutex_unlock(mutex);
+
+	int result = futex_wait(&cond->_sequence, sequence, timeout);
+	int timedOut = (result == -1 && errno == ETIMEDOUT);
+
+	// Other threads might have been woken up together with this one
+	__mutex_lock_contended(mutex);
+
+	return timedOut ? ETIMEDOUT : 0;
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+	__cond_wait(cond, mutex, 0);
+}
+
+int cond_timedwait(cond_t *cond, mutex_t *mutex, uint32_t timeout)
+{
+	return __cond_wait(cond, mutex, timeout ? timeout : 1);
+}
+
+void cond_signal(cond_t *cond)
+{
+	__atomic_fetch_add(&cond->_sequence, 1, __ATOMIC_RELEASE);
+	futex_wake(&cond->_sequence, 1);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+	__atomic_fetch_add(&cond->_sequence, 1, __ATOMIC_RELEASE);
+	futex_wake(&cond->_sequence, FUTEX_WAKE_ALL);
+}
+
+// MARK: -
+// MARK: Semaphore
+
+void sem_init(sem_t *semaphore, uint32_t value)
+{
+	semaphore->_waiters = 0;
+	__atomic_store_n(&semaphore->_value, value, __ATOMIC_RELEASE);
+}
+
+int sem_try_wait(sem_t *semaphore)
+{
+	uint32_t value = __atomic_load_n(&semaphore->_value, __ATOMIC_RELAXED);
+
+	while(value > 0)
+	{
+		if(__atomic_compare_exchange_n(&semaphore->_value, &value, value - 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 1;
+	}
+
+	return 0;
+}
+
+void sem_wait(sem_t *semaphore)
+{
+	while(!sem_try_wait(semaphore))
+	{
+		// sem_post() increments the value before it checks for waiters, so either it sees
+		// this waiter or the kernel sees the new value and doesn't put the thread to sleep
+		__atomic_fetch_add(&semaphore->_waiters, 1, __ATOMIC_SEQ_CST);
+		futex_wait(&semaphore->_value, 0, 0);
+		__atomic_fetch_sub(&semaphore->_waiters, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void sem_post(sem_t *semaphore)
+{
+	__atomic_fetch_add(&semaphore->_value, 1, __ATOMIC_SEQ_CST);
+
+	if(__atomic_load_n(&semaphore->_waiters, __ATOMIC_SEQ_CST) > 0)
+		futex_wake(&semaphore->_value, 1);
+}
+
+// MARK: -
+// MARK: Once
+
+void once_call(once_t *once, void (*function)(void))
+{
+	if(__atomic_load_n(&once->_state, __ATOMIC_ACQUIRE) == ONCE_DONE)
+		return;
+
+	if(sync_cas(&once->_state, 0, ONCE_RUNNING))
+	{
+		function();
+
+		if(__atomic_exchange_n(&once->_state, ONCE_DONE, __ATOMIC_RELEASE) == ONCE_WAITING)
+			futex_wake(&once->_state, FUTEX_WAKE_ALL);
+
+		return;
+	}
+
+	while(1)
+	{
+		uint32_t state = __atomic_load_n(&once->_state, __ATOMIC_ACQUIRE);
+		if(state == ONCE_DONE)
+			return;
+
+		if(state == ONCE_RUNNING && !sync_cas(&once->_state, ONCE_RUNNING, ONCE_WAITING))
+			continue;
+
+		futex_wait(&once->_state, ONCE_WAITING, 0);
+	}
+}
@@ -0,0 +1,79 @@
+//
+//  sys/sync.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SYS_SYNC_H_
+#define _SYS_SYNC_H_
+
+#include "cdefs.h"
+#include "../stdint.h"
+
+__BEGIN_DECLS
+
+// Blocking synchronization primitives built on top of futexes. None of them enter
+// the kernel unless a thread actually has to wait, or has to wake up a waiting thread.
+// All timeouts are in microseconds
+
+typedef struct
+{
+	volatile uint32_t _state; // 0 unlocked, 1 locked, 2 locked with possible waiters
+} mutex_t;
+
+typedef struct
+{
+	volatile uint32_t _sequence;
+} cond_t;
+
+typedef struct
+{
+	volatile uint32_t _value;
+	volatile uint32_t _waiters;
+} sem_t;
+
+typedef struct
+{
+	volatile uint32_t _state;
+} once_t;
+
+#define MUTEX_INIT {0}
+#define COND_INIT {0}
+#define SEM_INIT(value) {(value), 0}
+#define ONCE_INIT {0}
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+int  mutex_try_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+// Wakeups can be spurious, the condition has to be checked again after returning
+void cond_init(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+int  cond_timedwait(cond_t *cond, mutex_t *mutex, uint32_t timeout); // Returns ETIMEDOUT if the timeout passed
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
+void sem_init(sem_t *semaphore, uint32_t value);
+void sem_wait(sem_t *semaphore);
+int  sem_try_wait(sem_t *semaphore);
+void sem_post(sem_t *semaphore);
+
+// Calls the function exactly once, concurrent callers wait until it returned
+void once_call(once_t *once, void (*function)(void));
+
+__END_DECLS
+
+#endif /* _SYS_SYNC_H_ */
@@ -32,6 +32,7 @@ __BEGIN_DECLS
 #define SYS_Stat  6
 #define SYS_Pid   7
 #define SYS_Ioctl 8
+#define SYS_Futex 9
 
 #define SYS_ThreadCreate 10
 #define SYS_ThreadJoin   11
@@ -39,12 +40,19 @@ __BEGIN_DECLS
 #define SYS_Fork         13
 #define SYS_Exec         14
 #define SYS_Spawn        15
+#define SYS_SchedSetAffinity 16
+#define SYS_SchedGetAffinity 17
+#define SYS_Nanosleep        18
+#define SYS_SchedSetDeadline 19
 
 #define SYS_Mmap     20
 #define SYS_Munmap   21
 #define SYS_Mprotect 22
 #define SYS_Msync    23
 
+#define SYS_SchedGetDeadline 24
+#define SYS_GetRusage        25
+
 unsigned int __syscall(int type, ...);
 
 #define SYSCALL8(type, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7) \
@@ -52,3 +52,31 @@ void thread_yield()
 {
 	SYSCALL0(SYS_ThreadYield);
 }
+
+int sched_setaffinity(tid_t thread, uint32_t mask)
+{
+	return (int)SYSCALL2(SYS_SchedSetAffinity, thread, mask);
+}
+
+int sched_getaffinity(tid_t thread, uint32_t *mask)
+{
+	return (int)SYSCALL2(SYS_SchedGetAffinity, thread, mask);
+}
+
+int sched_getcpu()
+{
+	uint16_t cpu;
+	TLS_GET_CPU_DATA_MEMBER(cpu, cpuID);
+
+	return cpu;
+}
+
+int sched_setdeadline(tid_t thread, uint32_t runtime, uint32_t period, uint32_t deadline)
+{
+	return (int)SYSCALL4(SYS_SchedSetDeadline, thread, runtime, period, deadline);
+}
+
+int sched_getdeadline(tid_t thread, struct sched_deadline *info)
+{
+	return (int)SYSCALL2(SYS_SchedGetDeadline, thread, info);
+}
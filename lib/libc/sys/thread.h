@@ -21,14 +21,36 @@
 
 #include "cdefs.h"
 #include "types.h"
+#include "../stdint.h"
 
 __BEGIN_DECLS
 
+// Earliest deadline first scheduling, all times are in microseconds
+struct sched_deadline
+{
+	uint32_t runtime; // CPU time guaranteed per period
+	uint32_t period;
+	uint32_t deadline; // Relative to the start of the period
+	uint32_t jobs; // Periods the thread got its runtime for
+	uint32_t misses; // Jobs that weren't done by their deadline
+	uint32_t overruns; // Jobs that used up their runtime and were throttled
+};
+
 tid_t thread_create(void (*entry)(void *), void *argument);
 tid_t thread_gettid();
 void thread_join(tid_t thread);
 void thread_yield();
 
+// Affinity masks have one bit per CPU ID, a thread ID of 0 refers to the calling thread
+int sched_setaffinity(tid_t thread, uint32_t mask);
+int sched_getaffinity(tid_t thread, uint32_t *mask);
+int sched_getcpu();
+
+// A runtime of 0 takes the thread out of the deadline class, a deadline of 0 uses the period.
+// Fails if the bandwidth doesn't fit on any CPU, thread_yield() ends the current job early
+int sched_setdeadline(tid_t thread, uint32_t runtime, uint32_t period, uint32_t deadline);
+int sched_getdeadline(tid_t thread, struct sched_deadline *info);
+
 __END_DECLS
 
 #endif /* _SYS_THREAD_H_ */
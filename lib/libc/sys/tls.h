@@ -32,6 +32,8 @@ struct cpu_data
 	pid_t pid;
 	tid_t tid;
 	void *tls;
+	uint32_t reserved[3];
+	uint32_t fastSyscall; // The CPU supports SYSENTER and __syscall() uses it
 };
 
 #define TLS_GET_CPU_DATA_MEMBER(val, member) \
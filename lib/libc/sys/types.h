@@ -26,6 +26,9 @@ typedef int  pid_t;
 
 typedef unsigned long long ino_t;
 
+typedef long time_t;
+typedef unsigned int useconds_t;
+
 #ifndef _SIZE_T
 #define _SIZE_T
 typedef unsigned int size_t;
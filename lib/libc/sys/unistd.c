@@ -98,3 +98,13 @@ pid_t spawn(const char *path, char *const argv[], char *const envp[])
 	return (pid_t)SYSCALL3(SYS_Spawn, path, argv, envp);
 }
 
+
+unsigned int sleep(unsigned int seconds)
+{
+	SYSCALL2(SYS_Nanosleep, seconds, 0);
+	return 0;
+}
+int usleep(useconds_t microseconds)
+{
+	return (int)SYSCALL2(SYS_Nanosleep, microseconds / 1000000, (microseconds % 1000000) * 1000);
+}
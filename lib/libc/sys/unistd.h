@@ -62,6 +62,9 @@ pid_t fork();
 int execve(const char *path, char *const argv[], char *const envp[]);
 pid_t spawn(const char *path, char *const argv[], char *const envp[]);
 
+unsigned int sleep(unsigned int seconds);
+int usleep(useconds_t microseconds);
+
 #endif
 
 __END_DECLS
@@ -0,0 +1,41 @@
+//
+//  time.c
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "time.h"
+#include "sys/syscall.h"
+#include "sys/errno.h"
+
+int nanosleep(const struct timespec *request, struct timespec *remaining)
+{
+	if(request->tv_sec < 0 || request->tv_nsec < 0 || request->tv_nsec >= 1000000000)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	int result = (int)SYSCALL2(SYS_Nanosleep, request->tv_sec, request->tv_nsec);
+
+	// Sleeps can't be interrupted, so there is never any time left over
+	if(result == 0 && remaining)
+	{
+		remaining->tv_sec = 0;
+		remaining->tv_nsec = 0;
+	}
+
+	return result;
+}
@@ -108,8 +108,13 @@ namespace std
 			
 			if(value->_next)
 				value->_next->_prev = value->_prev;
+			else
+				_tail = value->_prev;
+
 			if(value->_prev)
 				value->_prev->_next = value->_next;
+			else
+				_head = value->_next;
 			
 			value->_next = nullptr;
 			value->_prev = nullptr;
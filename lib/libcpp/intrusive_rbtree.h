@@ -0,0 +1,402 @@
+//
+//  intrusive_rbtree.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/stdbool.h>
+#include <libc/stddef.h>
+
+#ifndef _INTRUSIVE_RBTREE_H_
+#define _INTRUSIVE_RBTREE_H_
+
+namespace std
+{
+	// Red-black tree of intrusive members, ordered by the comparator passed to insert().
+	// Members that compare equal are kept in insertion order, the leftmost member is cached
+	template<class T>
+	class intrusive_rbtree
+	{
+	public:
+		class member
+		{
+		public:
+			member(T *value) :
+				_value(value),
+				_parent(nullptr),
+				_left(nullptr),
+				_right(nullptr),
+				_red(false)
+			{}
+
+			T *get() const { return _value; }
+
+			member *next() const
+			{
+				const member *node = this;
+
+				if(node->_right)
+				{
+					node = node->_right;
+
+					while(node->_left)
+						node = node->_left;
+
+					return const_cast<member *>(node);
+				}
+
+				member *parent = node->_parent;
+
+				while(parent && node == parent->_right)
+				{
+					node = parent;
+					parent = parent->_parent;
+				}
+
+				return parent;
+			}
+
+		private:
+			friend class intrusive_rbtree;
+
+			T *_value;
+			member *_parent;
+			member *_left;
+			member *_right;
+			bool _red;
+		};
+
+		intrusive_rbtree() :
+			_root(nullptr),
+			_leftmost(nullptr),
+			_count(0)
+		{}
+
+		// compare(a, b) returns true if a has to be ordered before b
+		template<class Compare>
+		void insert(member &value, Compare compare)
+		{
+			member *node = &value;
+			member *parent = nullptr;
+			member **link = &_root;
+			bool leftmost = true;
+
+			while(*link)
+			{
+				parent = *link;
+
+				if(compare(node->_value, parent->_value))
+				{
+					link = &parent->_left;
+				}
+				else
+				{
+					link = &parent->_right;
+					leftmost = false;
+				}
+			}
+
+			node->_parent = parent;
+			node->_left = nullptr;
+			node->_right = nullptr;
+			node->_red = true;
+
+			*link = node;
+
+			if(leftmost)
+				_leftmost = node;
+
+			_count ++;
+			insert_fixup(node);
+		}
+
+		void erase(member &value)
+		{
+			member *node = &value;
+			member *removed = node; // The node that actually leaves its position in the tree
+			member *child;
+			member *parent;
+			bool removedRed = node->_red;
+
+			if(_leftmost == node)
+				_leftmost = node->next();
+
+			if(!node->_left)
+			{
+				child = node->_right;
+				parent = node->_parent;
+
+				transplant(node, node->_right);
+			}
+			else if(!node->_right)
+			{
+				child = node->_left;
+				parent = node->_parent;
+
+				transplant(node, node->_left);
+			}
+			else
+			{
+				removed = node->_right;
+
+				while(removed->_left)
+					removed = removed->_left;
+
+				removedRed = removed->_red;
+				child = removed->_right;
+
+				if(removed->_parent == node)
+				{
+					parent = removed;
+				}
+				else
+				{
+					parent = removed->_parent;
+					transplant(removed, removed->_right);
+
+					removed->_right = node->_right;
+					removed->_right->_parent = removed;
+				}
+
+				transplant(node, removed);
+
+				removed->_left = node->_left;
+				removed->_left->_parent = removed;
+				removed->_red = node->_red;
+			}
+
+			if(!removedRed)
+				erase_fixup(child, parent);
+
+			node->_parent = nullptr;
+			node->_left = nullptr;
+			node->_right = nullptr;
+
+			_count --;
+		}
+
+		size_t size() const { return _count; }
+		bool empty() const { return (_count == 0); }
+
+		member *head() const { return _leftmost; }
+
+	private:
+		static bool is_red(member *node)
+		{
+			return (node && node->_red);
+		}
+
+		void transplant(member *node, member *replacement)
+		{
+			if(!node->_parent)
+				_root = replacement;
+			else if(node == node->_parent->_left)
+				node->_parent->_left = replacement;
+			else
+				node->_parent->_right = replacement;
+
+			if(replacement)
+				replacement->_parent = node->_parent;
+		}
+
+		void rotate_left(member *node)
+		{
+			member *pivot = node->_right;
+
+			node->_right = pivot->_left;
+
+			if(pivot->_left)
+				pivot->_left->_parent = node;
+
+			transplant(node, pivot);
+
+			pivot->_left = node;
+			node->_parent = pivot;
+		}
+		void rotate_right(member *node)
+		{
+			member *pivot = node->_left;
+
+			node->_left = pivot->_right;
+
+			if(pivot->_right)
+				pivot->_right->_parent = node;
+
+			transplant(node, pivot);
+
+			pivot->_right = node;
+			node->_parent = pivot;
+		}
+
+		void insert_fixup(member *node)
+		{
+			while(node != _root && node->_parent->_red)
+			{
+				member *parent = node->_parent;
+				member *grandparent = parent->_parent; // The root is black, so a red parent always has one
+
+				if(parent == grandparent->_left)
+				{
+					member *uncle = grandparent->_right;
+
+					if(is_red(uncle))
+					{
+						parent->_red = false;
+						uncle->_red = false;
+						grandparent->_red = true;
+
+						node = grandparent;
+						continue;
+					}
+
+					if(node == parent->_right)
+					{
+						node = parent;
+						rotate_left(node);
+
+						parent = node->_parent;
+					}
+
+					parent->_red = false;
+					grandparent->_red = true;
+
+					rotate_right(grandparent);
+				}
+				else
+				{
+					member *uncle = grandparent->_left;
+
+					if(is_red(uncle))
+					{
+						parent->_red = false;
+						uncle->_red = false;
+						grandparent->_red = true;
+
+						node = grandparent;
+						continue;
+					}
+
+					if(node == parent->_left)
+					{
+						node = parent;
+						rotate_right(node);
+
+						parent = node->_parent;
+					}
+
+					parent->_red = false;
+					grandparent->_red = true;
+
+					rotate_left(grandparent);
+				}
+			}
+
+			_root->_red = false;
+		}
+
+		// node took the place of a removed black node and may be nullptr, hence the explicit parent
+		void erase_fixup(member *node, member *parent)
+		{
+			while(node != _root && !is_red(node))
+			{
+				if(node == parent->_left)
+				{
+					member *sibling = parent->_right;
+
+					if(sibling->_red)
+					{
+						sibling->_red = false;
+						parent->_red = true;
+
+						rotate_left(parent);
+						sibling = parent->_right;
+					}
+
+					if(!is_red(sibling->_left) && !is_red(sibling->_right))
+					{
+						sibling->_red = true;
+
+						node = parent;
+						parent = node->_parent;
+						continue;
+					}
+
+					if(!is_red(sibling->_right))
+					{
+						sibling->_left->_red = false;
+						sibling->_red = true;
+
+						rotate_right(sibling);
+						sibling = parent->_right;
+					}
+
+					sibling->_red = parent->_red;
+					parent->_red = false;
+					sibling->_right->_red = false;
+
+					rotate_left(parent);
+					node = _root;
+				}
+				else
+				{
+					member *sibling = parent->_left;
+
+					if(sibling->_red)
+					{
+						sibling->_red = false;
+						parent->_red = true;
+
+						rotate_right(parent);
+						sibling = parent->_left;
+					}
+
+					if(!is_red(sibling->_left) && !is_red(sibling->_right))
+					{
+						sibling->_red = true;
+
+						node = parent;
+						parent = node->_parent;
+						continue;
+					}
+
+					if(!is_red(sibling->_left))
+					{
+						sibling->_right->_red = false;
+						sibling->_red = true;
+
+						rotate_left(sibling);
+						sibling = parent->_left;
+					}
+
+					sibling->_red = parent->_red;
+					parent->_red = false;
+					sibling->_left->_red = false;
+
+					rotate_right(parent);
+					node = _root;
+				}
+			}
+
+			if(node)
+				node->_red = false;
+		}
+
+		member *_root;
+		member *_leftmost;
+		size_t _count;
+	};
+}
+
+#endif /* _INTRUSIVE_RBTREE_H_ */
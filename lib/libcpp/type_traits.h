@@ -26,6 +26,14 @@ namespace std
 	template<class T>
 	struct remove_const<const T> { typedef T type; };
 
+	template<class T>
+	struct remove_volatile { typedef T type; };
+	template<class T>
+	struct remove_volatile<volatile T> { typedef T type; };
+
+	template<class T>
+	struct remove_cv { typedef typename remove_volatile<typename remove_const<T>::type>::type type; };
+
 	template<class T>
 	struct remove_reference { typedef T type; };
 
@@ -88,6 +96,16 @@ namespace std
 
 
 
+	template<bool condition, class T = void>
+	struct enable_if {};
+
+	template<class T>
+	struct enable_if<true, T> { typedef T type; };
+
+	// Unlike the standard one, arrays and functions don't decay to pointers
+	template<class T>
+	struct decay { typedef typename remove_cv<typename remove_reference<T>::type>::type type; };
+
 	template<bool condition, class T, class T2>
 	struct conditional { typedef T type; };
 
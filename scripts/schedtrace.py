@@ -0,0 +1,112 @@
+#!/usr/bin/python3
+
+# Converts a dump of /dev/schedtrace into the Chrome trace format, which can be
+# loaded into chrome://tracing or Perfetto. Every CPU shows up as its own process,
+# with the running threads as slices and everything else as instant events.
+#
+# usage: schedtrace.py <dump> [output.json]
+
+import json
+import struct
+import sys
+
+# Has to match OS::SchedulerTrace::Event in sys/os/scheduler/trace.h
+eventFormat = '<QBBHIII'
+eventSize = struct.calcsize(eventFormat)
+
+eventTypes = ['header', 'lost', 'switch', 'wakeup', 'block', 'migrate', 'ipi sent', 'ipi received', 'commands', 'idle enter', 'idle exit']
+
+def readEvents(path):
+	f = open(path, 'rb')
+	b = f.read()
+	f.close()
+
+	events = []
+
+	for offset in range(0, len(b) - eventSize + 1, eventSize):
+		timestamp, type, cpu, vector, pid, tid, argument = struct.unpack_from(eventFormat, b, offset)
+
+		if type >= len(eventTypes):
+			sys.exit('Unknown event type %d at offset %d, dump is corrupt or out of date' %(type, offset))
+
+		events.append({ 'timestamp': timestamp, 'type': eventTypes[type], 'cpu': cpu, 'vector': vector, 'pid': pid, 'tid': tid, 'argument': argument })
+
+	return events
+
+def convert(events):
+	headers = [event for event in events if event['type'] == 'header']
+	events = [event for event in events if event['type'] != 'header']
+
+	if len(headers) == 0:
+		sys.exit('No header found, the dump has to start at the beginning of /dev/schedtrace')
+
+	frequency = float(max(headers[0]['argument'], 1)) # TSC cycles per microsecond
+
+	# Every CPU records on its own, so the events are only ordered per CPU
+	events.sort(key=lambda event: event['timestamp'])
+	base = events[0]['timestamp'] if len(events) > 0 else 0
+
+	def time(event):
+		return (event['timestamp'] - base) / frequency
+
+	output = []
+	running = {}
+
+	for cpu in range(headers[0]['cpu']):
+		output.append({ 'ph': 'M', 'name': 'process_name', 'pid': cpu, 'args': { 'name': 'cpu%d' %(cpu) } })
+
+	def closeSlice(cpu, end):
+		if cpu not in running:
+			return
+
+		start, name, args = running.pop(cpu)
+
+		if end > start:
+			output.append({ 'ph': 'X', 'name': name, 'pid': cpu, 'tid': 0, 'ts': start, 'dur': end - start, 'args': args })
+
+	for event in events:
+		cpu = event['cpu']
+		ts = time(event)
+
+		if event['type'] == 'switch':
+			closeSlice(cpu, ts)
+			running[cpu] = (ts, '%d:%d' %(event['pid'], event['tid']), { 'pid': event['pid'], 'tid': event['tid'], 'previous': event['argument'] })
+			continue
+
+		if event['type'] == 'idle enter':
+			closeSlice(cpu, ts)
+			running[cpu] = (ts, 'idle', {})
+			continue
+
+		if event['type'] == 'idle exit':
+			continue # The switch that follows takes over
+
+		args = { 'argument': event['argument'] }
+
+		if event['tid'] != 0:
+			args['pid'] = event['pid']
+			args['tid'] = event['tid']
+		if event['vector'] != 0:
+			args['vector'] = '0x%x' %(event['vector'])
+
+		output.append({ 'ph': 'i', 's': 't', 'name': event['type'], 'pid': cpu, 'tid': 0, 'ts': ts, 'args': args })
+
+	if len(events) > 0:
+		end = time(events[-1])
+
+		for cpu in list(running.keys()):
+			closeSlice(cpu, end)
+
+	return { 'traceEvents': output, 'displayTimeUnit': 'ns' }
+
+if len(sys.argv) < 2:
+	sys.exit('usage: %s <dump> [output.json]' %(sys.argv[0]))
+
+trace = convert(readEvents(sys.argv[1]))
+
+if len(sys.argv) > 2:
+	out = open(sys.argv[2], 'w')
+	json.dump(trace, out)
+	out.close()
+else:
+	json.dump(trace, sys.stdout)
@@ -20,6 +20,7 @@
 #define _IOFUNCTION_H_
 
 #include <libcpp/type_traits.h>
+#include <libcpp/new.h>
 #include "IORuntime.h"
 
 namespace IO
@@ -28,33 +29,52 @@ namespace IO
 	class Function
 	{};
 
+	// Callables that fit into kInlineSize, like lambdas with a few captures or bound member
+	// functions, are stored inside the function itself. Only larger ones go to the heap
 	template<class Res, class... Args>
 	class Function<Res (Args...)>
 	{
 	public:
+		static constexpr size_t kInlineSize = 6 * sizeof(void *);
+
 		Function() :
 			_callback(nullptr)
 		{}
-		template<typename F>
+		template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Function>::value>::type>
 		Function(F &&f) :
-			_callback(new ImplementationType<F>(std::move(f)))
+			_callback(nullptr)
+		{
+			Store(std::forward<F>(f));
+		}
+		template<class T>
+		Function(T *object, Res (T::*method)(Args...)) :
+			Function([object, method](Args... args) -> Res { return (object->*method)(args...); })
 		{}
-		
+		template<class T>
+		Function(const T *object, Res (T::*method)(Args...) const) :
+			Function([object, method](Args... args) -> Res { return (object->*method)(args...); })
+		{}
+
 		Function(Function &&other) :
-			_callback(std::move(other._callback))
+			_callback(nullptr)
 		{
-			other._callback = nullptr;
+			Take(std::move(other));
 		}
 
 		Function &operator =(Function &&other)
 		{
-			_callback = std::move(other._callback);
-			other._callback = nullptr;
+			if(this != &other)
+			{
+				Clear();
+				Take(std::move(other));
+			}
+
+			return *this;
 		}
 
 		~Function()
 		{
-			delete _callback;
+			Clear();
 		}
 
 		Function(const Function&) = delete;
@@ -67,21 +87,68 @@ namespace IO
 		struct Base
 		{
 			virtual Res Call(Args... args) const = 0;
+			virtual Base *MoveTo(void *buffer) = 0; // Move constructs the callable into buffer
 			virtual ~Base() {}
 		};
 		
 		template<typename F>
 		struct ImplementationType : Base
 		{
-			ImplementationType(F &&f) :
-				_function(std::move(f))
+			template<typename T>
+			ImplementationType(T &&f) :
+				_function(std::forward<T>(f))
 			{}
 			
 			Res Call(Args... args) const final { return _function(args...); }
+			Base *MoveTo(void *buffer) final { return new(buffer) ImplementationType(std::move(_function)); }
 			F _function;
 		};
-		
+
+		bool IsInline() const { return (_callback == reinterpret_cast<const Base *>(_storage)); }
+
+		template<typename F>
+		void Store(F &&f)
+		{
+			typedef ImplementationType<typename std::decay<F>::type> Type;
+			Store<Type>(std::forward<F>(f), std::integral_constant<bool, (sizeof(Type) <= kInlineSize && alignof(Type) <= alignof(void *))>());
+		}
+		template<typename Type, typename F>
+		void Store(F &&f, std::true_type)
+		{
+			_callback = new(_storage) Type(std::forward<F>(f));
+		}
+		template<typename Type, typename F>
+		void Store(F &&f, std::false_type)
+		{
+			_callback = new Type(std::forward<F>(f));
+		}
+
+		void Take(Function &&other)
+		{
+			if(other.IsInline())
+			{
+				_callback = other._callback->MoveTo(_storage);
+				other.Clear();
+			}
+			else
+			{
+				_callback = other._callback;
+				other._callback = nullptr;
+			}
+		}
+
+		void Clear()
+		{
+			if(IsInline())
+				_callback->~Base();
+			else
+				delete _callback;
+
+			_callback = nullptr;
+		}
+
 		Base *_callback;
+		alignas(void *) uint8_t _storage[kInlineSize];
 	};
 }
 
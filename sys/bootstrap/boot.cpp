@@ -32,11 +32,44 @@ namespace Sys
 	}
 }
 
+#include <libc/string.h>
 #include "multiboot.h"
 
 namespace Sys
 {
 	MultibootHeader *bootInfo = nullptr;
+
+	const char *GetBootArgument(const char *name, size_t *length)
+	{
+		if(!bootInfo || !(bootInfo->flags & MultibootHeader::Flags::CommandLine) || !bootInfo->commandLine)
+			return nullptr;
+
+		const char *argument = reinterpret_cast<const char *>(bootInfo->commandLine);
+		size_t nameLength = strlen(name);
+
+		while(*argument)
+		{
+			while(*argument == ' ')
+				argument ++;
+
+			const char *end = argument;
+
+			while(*end && *end != ' ')
+				end ++;
+
+			if(static_cast<size_t>(end - argument) > nameLength && strncmp(argument, name, nameLength) == 0 && argument[nameLength] == '=')
+			{
+				argument += nameLength + 1;
+				*length = static_cast<size_t>(end - argument);
+
+				return argument;
+			}
+
+			argument = end;
+		}
+
+		return nullptr;
+	}
 }
 
 extern "C" void SysBoot_Multiboot(Sys::MultibootHeader *info) __attribute__ ((noreturn));
@@ -108,6 +108,10 @@ namespace Sys
 	static_assert(sizeof(MultibootHeader) == 72, "MultibootHeader must be 72 bytes exactly!");
 
 	extern MultibootHeader *bootInfo;
+
+	// Looks up name=value on the kernel command line. Returns the value, which isn't
+	// null terminated, and its length, or nullptr if the argument wasn't passed
+	const char *GetBootArgument(const char *name, size_t *length);
 }
 
 #endif /* _MULTIBOOT_H_ */
@@ -42,6 +42,8 @@ namespace OS
 				return EEXIST;
 			case KERN_RESOURCE_EXHAUSTED:
 				return EAGAIN;
+			case KERN_TIMEOUT:
+				return ETIMEDOUT;
 
 			default:
 				panic("Unknown error code (%d)", value);
@@ -19,7 +19,10 @@
 #include <machine/port.h>
 #include <kern/kprintf.h>
 #include <libcpp/atomic.h>
+#include <libcpp/algorithm.h>
 #include <os/scheduler/scheduler.h>
+#include <os/locks/seqlock.h>
+#include <os/timer.h>
 #include "clock.h"
 
 namespace Sys
@@ -33,24 +36,136 @@ namespace Sys
 		static uint32_t _timerResolution = 100; // In Hertz
 		static uint32_t _timerApicCount  = 0;
 
-		static uint32_t _timeMsec        = 0;
-		static uint64_t _timeTicks       = 0;
 		static uint32_t _timeMsecPerTick = 0;
 
-		
+		static constexpr uint32_t kTimerSlack = 20; // Microseconds
+
+		// The time is kept by the TSC, which keeps counting no matter which CPU takes timer interrupts.
+		// The 64 bit base can't be read atomically, so the time base is published through a seqlock
+		struct TimeBase
+		{
+			uint64_t tscBase;
+			uint32_t tscPerUsec;
+		};
+
+		static TimeBase _timeBase = { 0, 1 };
+		static OS::SeqLock _timeBaseLock;
+
+		struct CPUTimer
+		{
+			uint64_t deadlines[static_cast<size_t>(Event::__Count)];
+			uint64_t programmed; // The deadline the APIC timer is currently armed for
+			bool active;
+			Statistics statistics; // Only written by the owning CPU, read by anyone through the seqlock
+			OS::SeqLock statisticsLock;
+		};
+
+		static CPUTimer _cpuTimers[CONFIG_MAX_CPUS];
+
+		static TimeBase GetTimeBase()
+		{
+			TimeBase base;
+			uint32_t sequence;
+
+			do {
+				sequence = _timeBaseLock.ReadBegin();
+				base = _timeBase;
+			} while(_timeBaseLock.ReadRetry(sequence));
+
+			return base;
+		}
+
+		static void SetTimeBase(uint64_t tscBase, uint32_t tscPerUsec)
+		{
+			_timeBaseLock.WriteBegin();
+			_timeBase.tscBase = tscBase;
+			_timeBase.tscPerUsec = tscPerUsec;
+			_timeBaseLock.WriteEnd();
+		}
 
 		uint64_t GetMicroseconds()
 		{
-			return _timeMsec;
+			TimeBase base = GetTimeBase();
+			return (CPUReadTimestamp() - base.tscBase) / base.tscPerUsec;
 		}
 		uint64_t GetTicks()
 		{
-			return _timeTicks;
+			return GetMicroseconds() / _timeMsecPerTick;
 		}
 		uint32_t GetMicrosecondsPerTick()
 		{
 			return _timeMsecPerTick;
 		}
+		uint32_t GetTimestampFrequency()
+		{
+			return GetTimeBase().tscPerUsec;
+		}
+
+
+		static void ProgramCPUTimer(CPUTimer &timer)
+		{
+			uint64_t deadline = 0;
+
+			for(uint64_t candidate : timer.deadlines)
+			{
+				if(candidate && (deadline == 0 || candidate < deadline))
+					deadline = candidate;
+			}
+
+			if(!timer.active || timer.programmed == deadline)
+				return;
+
+			timer.programmed = deadline;
+
+			timer.statisticsLock.WriteBegin();
+			timer.statistics.programmed ++;
+			timer.statisticsLock.WriteEnd();
+
+			if(deadline == 0)
+			{
+				APIC::UnarmTimer();
+				return;
+			}
+
+			// Deadlines that don't fit into the counter fire early and are re-armed from there
+			uint64_t now = GetMicroseconds();
+			uint64_t delta = (deadline > now) ? (deadline - now) : 1;
+			uint64_t count = (delta * _timerApicCount) / _timeMsecPerTick;
+
+			count = std::min(count, static_cast<uint64_t>(0xffffffff));
+			count = std::max(count, static_cast<uint64_t>(1));
+
+			APIC::ArmTimer(static_cast<uint32_t>(count));
+		}
+
+		void SetTimerDeadline(Event event, uint64_t deadline)
+		{
+			CPUTimer &timer = _cpuTimers[CPU::GetCurrentCPU()->GetID()];
+
+			timer.deadlines[static_cast<size_t>(event)] = deadline;
+			ProgramCPUTimer(timer);
+		}
+
+		uint64_t GetTimerDeadline(Event event)
+		{
+			return _cpuTimers[CPU::GetCurrentCPU()->GetID()].deadlines[static_cast<size_t>(event)];
+		}
+
+		bool GetStatistics(CPU *cpu, Statistics *statistics)
+		{
+			if(!cpu || !_cpuTimers[cpu->GetID()].active)
+				return false;
+
+			CPUTimer &timer = _cpuTimers[cpu->GetID()];
+			uint32_t sequence;
+
+			do {
+				sequence = timer.statisticsLock.ReadBegin();
+				*statistics = timer.statistics;
+			} while(timer.statisticsLock.ReadRetry(sequence));
+
+			return true;
+		}
 
 
 
@@ -155,21 +270,82 @@ namespace Sys
 			return accumulator / 10;
 		}
 
+		uint32_t CalculateTSCFrequency()
+		{
+			uint64_t start = CPUReadTimestamp();
 
+			AwaitPITTicks(1);
 
-		uint32_t ClockTick(uint32_t esp, Sys::CPU *cpu)
+			// Cycles per 10ms PIT tick, in cycles per microsecond
+			uint64_t cycles = CPUReadTimestamp() - start;
+			return static_cast<uint32_t>(cycles / 10000);
+		}
+
+		uint32_t CalculateTSCFrequencyAverage()
 		{
-			_timeTicks ++;
-			_timeMsec += _timeMsecPerTick;
+			uint32_t accumulator = 0;
 
-			return OS::Scheduler::GetScheduler()->ScheduleOnCPU(esp, cpu);
+			for(int i = 0; i < 10; i++)
+				accumulator += CalculateTSCFrequency();
+
+			return std::max(accumulator / 10, static_cast<uint32_t>(1));
 		}
 
-		uint32_t ClockTickSimple(uint32_t esp, __unused Sys::CPU *cpu)
+
+
+		uint32_t ClockTick(uint32_t esp, Sys::CPU *cpu)
 		{
-			_timeTicks ++;
-			_timeMsec += _timeMsecPerTick;
+			CPUTimer &timer = _cpuTimers[cpu->GetID()];
+			OS::Scheduler *scheduler = OS::Scheduler::GetScheduler();
+
+			timer.programmed = 0; // One-shot, so it's no longer armed
+
+			OS::Thread *thread = scheduler->GetActiveThread();
+
+			timer.statisticsLock.WriteBegin();
+			timer.statistics.interrupts ++;
+
+			if(thread && thread->GetPriorityClass() == OS::Thread::PriorityClass::PriorityClassIdle)
+				timer.statistics.idleWakeups ++;
+
+			timer.statisticsLock.WriteEnd();
 
+			// The APIC timer and the TSC are calibrated separately, so allow the interrupt to be a bit early
+			uint64_t now = GetMicroseconds() + kTimerSlack;
+			uint64_t &timersDeadline = timer.deadlines[static_cast<size_t>(Event::Timers)];
+			uint64_t &schedulerDeadline = timer.deadlines[static_cast<size_t>(Event::Scheduler)];
+
+			bool handled = false;
+
+			if(timersDeadline && timersDeadline <= now)
+			{
+				timersDeadline = 0;
+				handled = true;
+
+				OS::ExpireTimers(cpu);
+			}
+
+			if(schedulerDeadline && schedulerDeadline <= now)
+			{
+				schedulerDeadline = 0;
+				handled = true;
+
+				esp = scheduler->ScheduleOnCPU(esp, cpu); // Programs the next scheduler deadline
+			}
+			else
+			{
+				// Expired timers may have woken up threads
+				esp = scheduler->PokeCPU(esp, cpu);
+			}
+
+			if(!handled)
+			{
+				timer.statisticsLock.WriteBegin();
+				timer.statistics.earlyInterrupts ++;
+				timer.statisticsLock.WriteEnd();
+			}
+
+			ProgramCPUTimer(timer);
 			return esp;
 		}
 
@@ -177,10 +353,13 @@ namespace Sys
 
 		uint32_t ActivateCPUClock(uint32_t esp, Sys::CPU *cpu)
 		{
-			OS::Scheduler::GetScheduler()->ActivateCPU(cpu);
+			CPUTimer &timer = _cpuTimers[cpu->GetID()];
 
-			Sys::APIC::SetTimer(_timerDivisor, Sys::APIC::TimerMode::Periodic, _timerApicCount);
-			Sys::APIC::ArmTimer(_timerApicCount);
+			Sys::APIC::SetTimer(_timerDivisor, Sys::APIC::TimerMode::OneShot, 0);
+			timer.active = true;
+
+			OS::Scheduler::GetScheduler()->ActivateCPU(cpu);
+			ProgramCPUTimer(timer); // Timers might have been armed before
 
 			return OS::Scheduler::GetScheduler()->ScheduleOnCPU(esp, cpu);
 		}
@@ -203,13 +382,13 @@ namespace Sys
 		Clock::_timerApicCount = Clock::CalculateAPICFrequencyAverage(Clock::_timerResolution, Clock::_timerDivisor);
 		Clock::_timeMsecPerTick = (1000 / Clock::_timerResolution) * 1000;
 
-		Clock::DeactivatePIT();
+		uint32_t tscPerUsec = Clock::CalculateTSCFrequencyAverage();
+		Clock::SetTimeBase(CPUReadTimestamp(), tscPerUsec);
 
+		Clock::DeactivatePIT();
 
-		Sys::SetInterruptHandler(0x35, &Clock::ClockTickSimple);
-
-		Sys::APIC::SetTimer(Clock::_timerDivisor, APIC::TimerMode::Periodic, Clock::_timerApicCount);
-		Sys::APIC::ArmTimer(Clock::_timerApicCount);
+		// No timer interrupts until the scheduler is up and programs the first deadline
+		APIC::UnarmTimer();
 
 		return ErrorNone;
 	}
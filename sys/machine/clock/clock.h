@@ -27,9 +27,32 @@ namespace Sys
 {
 	namespace Clock
 	{
+		struct Statistics
+		{
+			uint64_t interrupts; // Timer interrupts taken
+			uint64_t idleWakeups; // Interrupts that woke the CPU up from its idle thread
+			uint64_t earlyInterrupts; // Interrupts that fired before any deadline was due
+			uint64_t programmed; // Times the timer was re-programmed
+		};
+
 		uint64_t GetMicroseconds();
 		uint64_t GetTicks();
 		uint32_t GetMicrosecondsPerTick();
+		uint32_t GetTimestampFrequency(); // TSC cycles per microsecond
+
+		enum class Event
+		{
+			Scheduler,
+			Timers,
+			__Count
+		};
+
+		// The local APIC timer runs in one-shot mode and only fires at the earliest deadline of the current CPU.
+		// Deadlines are absolute times in microseconds, 0 clears it. Must be called with interrupts disabled
+		void SetTimerDeadline(Event event, uint64_t deadline);
+		uint64_t GetTimerDeadline(Event event);
+
+		bool GetStatistics(CPU *cpu, Statistics *statistics);
 
 		bool ActivatePIT();
 		void DeactivatePIT();
@@ -25,6 +25,7 @@
 #include "cpu.h"
 #include "acpi.h"
 #include "gdt.h"
+#include "fpu.h"
 
 namespace Sys
 {
@@ -70,6 +71,8 @@ namespace Sys
 	{
 		_info = CPUInfo();
 		_flags |= CPU::Flags::Running;
+
+		FPU::InitCPU(this);
 	}
 
 
@@ -94,8 +94,17 @@ namespace Sys
 		pid_t pid;
 		tid_t tid;
 		vm_address_t tls;
+		uint32_t preemptCount; // Raised by every spinlock the CPU holds, see os/scheduler/preempt.h
+		uint32_t preemptPending; // Set when a preemption was deferred, the count dropping to zero acts on it
+		uint32_t preemptSnapshot; // The count of the thread that was interrupted
+		uint32_t fastSyscall; // Set when SYSENTER is configured on the CPU, see machine/interrupts/trampoline.h
 	};
 
+	// spinlock.S touches the preemption fields directly
+	static_assert(__builtin_offsetof(CPUData, preemptCount) == 16, "spinlock.S expects the preemption count at %fs:16");
+	static_assert(__builtin_offsetof(CPUData, preemptPending) == 20, "spinlock.S expects the pending flag at %fs:20");
+	static_assert(__builtin_offsetof(CPUData, fastSyscall) == 28, "syscall.S expects the SYSENTER flag at %fs:28");
+
 	enum class CPUVendor
 	{
 		Intel,
@@ -287,7 +296,7 @@ namespace Sys
 
 		__asm__ volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
 
-		return (low | (high << 31));
+		return (static_cast<uint64_t>(high) << 32) | low;
 	}
 
 	static inline void CPUPause()
@@ -300,11 +309,56 @@ namespace Sys
 		__asm__ volatile("hlt");
 	}
 
+	// Arms the monitor on the cache line of address, a write to it ends a following CPUMWait()
+	static inline void CPUMonitor(const volatile void *address)
+	{
+		__asm__ volatile("monitor" :: "a" (address), "c" (0), "d" (0));
+	}
+
+	// Returns the index of the least significant set bit, value must not be 0
+	static inline uint32_t CPUBitScanForward(uint32_t value)
+	{
+		uint32_t result;
+		__asm__ volatile("bsfl %1, %0" : "=r" (result) : "rm" (value));
+
+		return result;
+	}
+
+	// Returns the index of the most significant set bit, value must not be 0
+	static inline uint32_t CPUBitScanReverse(uint32_t value)
+	{
+		uint32_t result;
+		__asm__ volatile("bsrl %1, %0" : "=r" (result) : "rm" (value));
+
+		return result;
+	}
+
+	static inline uint64_t CPUReadTimestamp()
+	{
+		uint32_t high;
+		uint32_t low;
+
+		__asm__ volatile("rdtsc" : "=a" (low), "=d" (high));
+
+		return (static_cast<uint64_t>(high) << 32) | low;
+	}
+
+	// Reads the interrupt flag itself, unlike the InterruptsEnabled flag this is also correct inside interrupt handlers
+	static inline bool CPUInterruptsEnabled()
+	{
+		uint32_t flags;
+		__asm__ volatile("pushf; popl %0" : "=r" (flags));
+
+		return (flags & (1 << 9));
+	}
+
 	KernReturn<void> CPUInit();
 	KernReturn<void> CPUInitSecondStage();
 
 #define CPU_DATA_SET(member,value) \
 	__asm__ volatile("mov %0, %%fs:%P1" :: "r" (value), "i" (offsetof(Sys::CPUData, member)));
+#define CPU_DATA_GET(member,value) \
+	__asm__ volatile("mov %%fs:%P1, %0" : "=r" (value) : "i" (offsetof(Sys::CPUData, member)));
 }
 
 #endif
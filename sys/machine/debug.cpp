@@ -115,6 +115,16 @@ namespace Sys
 		uint32_t dr6;
 		__asm__ volatile("mov %%dr6, %0" : "=r" (dr6));
 
+		// Single stepping only ever reaches ring 0 through a SYSENTER with TF set, the trap hits the first
+		// instruction of the entry stub. Drop TF, the stub loads clean flags itself right after
+		if((dr6 & (1 << 14)) && (state->cs & 0x3) == 0)
+		{
+			state->eflags &= ~0x100;
+
+			__asm__ volatile("mov %0, %%dr6" : : "r" (0));
+			return esp;
+		}
+
 		int watchpoint;
 		uintptr_t address;
 
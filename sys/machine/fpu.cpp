@@ -0,0 +1,215 @@
+//
+//  fpu.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/string.h>
+#include <kern/kalloc.h>
+#include <kern/kprintf.h>
+#include <kern/panic.h>
+#include <machine/interrupts/interrupts.h>
+#include <os/scheduler/scheduler.h>
+#include "fpu.h"
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+
+#define CR4_OSFXSR     (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+namespace Sys
+{
+	namespace FPU
+	{
+		struct CPUFPU
+		{
+			OS::Thread *owner; // Thread whose state is in the registers
+			bool trapping; // CR0.TS is set
+			Statistics statistics;
+		};
+
+		static CPUFPU _cpuFPU[CONFIG_MAX_CPUS];
+
+		static inline uint32_t ReadCR0()
+		{
+			uint32_t cr0;
+			__asm__ volatile("mov %%cr0, %0" : "=r" (cr0));
+
+			return cr0;
+		}
+
+		static inline void SetTrapping(CPUFPU &fpu, bool trapping)
+		{
+			if(fpu.trapping == trapping)
+				return;
+
+			if(trapping)
+				__asm__ volatile("mov %0, %%cr0" :: "r" (ReadCR0() | CR0_TS));
+			else
+				__asm__ volatile("clts");
+
+			fpu.trapping = trapping;
+		}
+
+		static inline void Save(CPUFPU &fpu, OS::Thread *thread)
+		{
+			__asm__ volatile("fxsave (%0)" :: "r" (thread->GetFPUState()->area) : "memory");
+			fpu.statistics.saves ++;
+		}
+		static inline void Restore(CPUFPU &fpu, OS::Thread *thread)
+		{
+			__asm__ volatile("fxrstor (%0)" :: "r" (thread->GetFPUState()->area) : "memory");
+			fpu.statistics.restores ++;
+		}
+
+
+		FPUState *AllocateState()
+		{
+			void *allocation = kalloc(sizeof(FPUState) + 15);
+			if(!allocation)
+				return nullptr;
+
+			FPUState *state = reinterpret_cast<FPUState *>((reinterpret_cast<uintptr_t>(allocation) + 15) & ~15);
+
+			memset(state->area, 0, sizeof(state->area));
+			state->allocation = allocation;
+
+			// Loading an image built from scratch also makes sure no register content of another thread leaks through
+			*reinterpret_cast<uint16_t *>(state->area + 0) = 0x037f; // FCW, all x87 exceptions masked
+			*reinterpret_cast<uint32_t *>(state->area + 24) = 0x1f80; // MXCSR, all SSE exceptions masked
+
+			return state;
+		}
+		void FreeState(FPUState *state)
+		{
+			if(state)
+				kfree(state->allocation);
+		}
+
+
+		void SwitchThread(CPU *cpu, OS::Thread *thread)
+		{
+			CPUFPU &fpu = _cpuFPU[cpu->GetID()];
+			SetTrapping(fpu, (fpu.owner != thread));
+		}
+
+		void SaveThread(CPU *cpu, OS::Thread *thread)
+		{
+			CPUFPU &fpu = _cpuFPU[cpu->GetID()];
+			if(fpu.owner != thread)
+				return;
+
+			bool trapping = fpu.trapping;
+
+			SetTrapping(fpu, false);
+			Save(fpu, thread);
+
+			fpu.owner = nullptr;
+			SetTrapping(fpu, trapping);
+		}
+
+		void ReleaseThread(CPU *cpu, OS::Thread *thread)
+		{
+			CPUFPU &fpu = _cpuFPU[cpu->GetID()];
+
+			if(fpu.owner == thread)
+				fpu.owner = nullptr;
+		}
+
+		bool GetStatistics(CPU *cpu, Statistics *statistics)
+		{
+			if(!cpu)
+				return false;
+
+			*statistics = _cpuFPU[cpu->GetID()].statistics;
+			return true;
+		}
+
+		static uint32_t DeviceNotAvailable(uint32_t esp, CPU *cpu)
+		{
+			CPUFPU &fpu = _cpuFPU[cpu->GetID()];
+			OS::Thread *thread = OS::Scheduler::GetScheduler()->GetActiveThread();
+
+			fpu.statistics.traps ++;
+			SetTrapping(fpu, false);
+
+			if(fpu.owner == thread)
+				return esp;
+
+			if(!thread->GetFPUState())
+			{
+				FPUState *state = AllocateState();
+				if(!state)
+					panic("Failed to allocate FPU state for thread %d", thread->GetTid());
+
+				thread->SetFPUState(state);
+			}
+
+			if(fpu.owner)
+				Save(fpu, fpu.owner);
+
+			Restore(fpu, thread);
+			fpu.owner = thread;
+
+			return esp;
+		}
+
+		void InitCPU(CPU *cpu)
+		{
+			CPUFPU &fpu = _cpuFPU[cpu->GetID()];
+
+			fpu.owner = nullptr;
+			fpu.trapping = true;
+			memset(&fpu.statistics, 0, sizeof(Statistics));
+
+			CPUInfo *info = cpu->GetInfo();
+			if(!(info->GetFeatures() & CPUInfo::Feature::FXSR))
+				return;
+
+			// Native x87 error reporting, no emulation and trap on the first use after a switch
+			uint32_t cr0 = ReadCR0();
+			cr0 = (cr0 & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS;
+
+			__asm__ volatile("mov %0, %%cr0" :: "r" (cr0));
+
+			uint32_t cr4;
+			__asm__ volatile("mov %%cr4, %0" : "=r" (cr4));
+
+			cr4 |= CR4_OSFXSR;
+
+			if(info->GetFeatures() & CPUInfo::Feature::SSE)
+				cr4 |= CR4_OSXMMEXCPT;
+
+			__asm__ volatile("mov %0, %%cr4" :: "r" (cr4));
+		}
+	}
+
+	KernReturn<void> FPUInit()
+	{
+		CPUInfo *info = CPU::GetCurrentCPU()->GetInfo();
+
+		if(!(info->GetFeatures() & CPUInfo::Feature::FXSR))
+		{
+			kprintf("unsupported CPU (no FXSAVE/FXRSTOR)");
+			return Error(KERN_RESOURCES_MISSING);
+		}
+
+		SetInterruptHandler(0x7, &FPU::DeviceNotAvailable);
+		return ErrorNone;
+	}
+}
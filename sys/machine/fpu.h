@@ -0,0 +1,75 @@
+//
+//  fpu.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _FPU_H_
+#define _FPU_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <kern/kern_return.h>
+#include "cpu.h"
+
+namespace OS
+{
+	class Thread;
+}
+
+namespace Sys
+{
+	// FXSAVE area, the x87, MMX and SSE registers of a thread
+	struct FPUState
+	{
+		uint8_t area[512];
+		void *allocation;
+	} __attribute__((aligned(16)));
+
+	/**
+	 * The FPU state is switched lazily. Every CPU remembers the thread whose state is loaded in
+	 * its registers, switching to any other thread sets CR0.TS. The first FPU or SSE instruction
+	 * of that thread then raises #NM, which saves the registers for the previous owner and loads
+	 * the threads state. Threads that never touch the FPU never pay for it.
+	 *
+	 * A state only lives in the registers of the CPU the thread is scheduled on, so it's saved
+	 * before the thread gets migrated away.
+	 **/
+	namespace FPU
+	{
+		struct Statistics
+		{
+			uint64_t traps; // #NM exceptions taken
+			uint64_t saves;
+			uint64_t restores;
+		};
+
+		FPUState *AllocateState(); // Comes in the default state of FNINIT, with all SSE exceptions masked
+		void FreeState(FPUState *state);
+
+		// All must be called with interrupts disabled on the CPU the thread is scheduled on
+		void SwitchThread(CPU *cpu, OS::Thread *thread);
+		void SaveThread(CPU *cpu, OS::Thread *thread);
+		void ReleaseThread(CPU *cpu, OS::Thread *thread);
+
+		bool GetStatistics(CPU *cpu, Statistics *statistics);
+
+		void InitCPU(CPU *cpu); // Called by every CPU during its bootstrap
+	}
+
+	KernReturn<void> FPUInit();
+}
+
+#endif /* _FPU_H_ */
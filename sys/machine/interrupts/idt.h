@@ -32,6 +32,8 @@
 
 #define IDT_ENTRIES 256
 
+#define IR_SYSENTER_VECTOR 0x82 // Stored as the interrupt of states that entered through SYSENTER
+
 extern "C"
 {
 	void idt_exception_divbyzero(); // 0
@@ -120,6 +122,8 @@ extern "C"
 	idt_interrupt_set(0xd);
 	idt_interrupt_set(0xe);
 	idt_interrupt_set(0xf);
+
+	void idt_sysenter_entry(); // Target of SYSENTER, builds the same state as an interrupt
 } /* extern "C" */
 
 #endif /* _IDT_H_ */
@@ -21,6 +21,9 @@
 #include <machine/debug.h>
 #include <kern/kprintf.h>
 #include <kern/panic.h>
+#include <os/scheduler/scheduler.h>
+#include <os/scheduler/preempt.h>
+#include <os/scheduler/accounting.h>
 #include "interrupts.h"
 #include "trampoline.h"
 #include "apic.h"
@@ -50,6 +53,9 @@ uint32_t ir_handle_interrupt(uint32_t esp)
 	Sys::CPUState *prev = cpu->GetLastState();
 	cpu->SetState(state);
 
+	uint32_t preemptCount = OS::Preempt::EnterInterrupt();
+	OS::Accounting::EnterInterrupt(cpu, state);
+
 	switch(state->interrupt)
 	{
 		case 0x27:
@@ -73,8 +79,21 @@ uint32_t ir_handle_interrupt(uint32_t esp)
 			break;
 
 		case 0xe:
+		{
+			Sys::InterruptHandler handler = _interrupt_handler[0xe];
+			if(handler)
+			{
+				esp = handler(esp, cpu);
+				break;
+			}
+
 			panicSegfault();
 			break;
+		}
+
+		case IR_SYSENTER_VECTOR:
+			needsEOI = false; // Not a real interrupt, there is nothing to acknowledge
+			// Fall through
 
 		default:
 		{
@@ -82,6 +101,12 @@ uint32_t ir_handle_interrupt(uint32_t esp)
 			if(handler)
 				esp = handler(esp, cpu);
 
+			// Act on wakeups right away instead of at the next scheduler tick, this is
+			// also where a thread in the kernel gets preempted
+			OS::Scheduler *scheduler = OS::Scheduler::GetScheduler();
+			if(scheduler && state->interrupt >= 0x20)
+				esp = scheduler->PokeCPU(esp, cpu);
+
 			break;
 		}
 	}
@@ -91,6 +116,9 @@ uint32_t ir_handle_interrupt(uint32_t esp)
 	if(needsEOI)
 		Sys::APIC::Write(Sys::APIC::Register::EOI, 0);
 
+	OS::Accounting::LeaveInterrupt(cpu);
+	OS::Preempt::LeaveInterrupt(preemptCount);
+
 	return esp;
 }
 
@@ -41,4 +41,6 @@ namespace Sys
 	KernReturn<void> InterruptsInitAP();
 }
 
+void panicSegfault();
+
 #endif /* _INTERRUPTS_H_ */
@@ -29,6 +29,10 @@
 extern "C" uintptr_t idt_begin;
 extern "C" uintptr_t idt_end;
 
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
 namespace Sys
 {
 	struct TrampolineMap
@@ -44,6 +48,42 @@ namespace Sys
 	TrampolineMap *_map = nullptr;
 	uintptr_t _physicalTrampoline = 0x0;
 
+	static uint32_t _sysenterStack[CONFIG_MAX_CPUS]; // Last value written to SYSENTER_ESP, 0 without SYSENTER
+
+	static bool TrampolineSupportsSysenter()
+	{
+		CPUInfo info;
+
+		if(!(info.GetFeatures() & CPUInfo::Feature::SEP))
+			return false;
+
+		// The Pentium Pro reports SEP but doesn't implement it
+		if(info.GetFamily() == 6 && info.GetModel() < 3 && info.GetStepping() < 3)
+			return false;
+
+		return true;
+	}
+
+	static void TrampolineInitSysenter(CPU *cpu, CPUData *trampolineData, uint32_t offset)
+	{
+		trampolineData->fastSyscall = 0;
+		_sysenterStack[cpu->GetID()] = 0;
+
+		if(!TrampolineSupportsSysenter())
+			return;
+
+		// SYSENTER loads cs and ss from the MSR and the GDT entry after it, SYSEXIT uses the
+		// two entries after that as the userland segments. The GDT is laid out just like that
+		uint32_t esp = cpu->GetTrampoline()->tss.esp0;
+
+		CPUWriteMSR(MSR_SYSENTER_CS, 0x8);
+		CPUWriteMSR(MSR_SYSENTER_ESP, esp);
+		CPUWriteMSR(MSR_SYSENTER_EIP, reinterpret_cast<uint32_t>(&idt_sysenter_entry) + offset);
+
+		_sysenterStack[cpu->GetID()] = esp;
+		trampolineData->fastSyscall = 1;
+	}
+
 	KernReturn<void> TrampolineInit()
 	{
 		assert(sizeof(TrampolineMap) <= IR_TRAMPOLINE_PAGES * VM_PAGE_SIZE);
@@ -98,6 +138,12 @@ namespace Sys
 
 		uintptr_t idtBegin = reinterpret_cast<uintptr_t>(&idt_begin);
 		IDTInit(trampoline->idt, IR_TRAMPOLINE_BEGIN - idtBegin);
+
+		// Spinlocks start counting as soon as %fs points to the data
+		trampolineData->preemptCount = 0;
+		trampolineData->preemptPending = 0;
+		trampolineData->preemptSnapshot = 0;
+
 		GDTInit(trampoline->gdt, &trampoline->tss, trampolineData);
 
 		trampolineData->cpuID = cpu->GetID();
@@ -107,9 +153,23 @@ namespace Sys
 		trampoline->tss.esp0 = reinterpret_cast<uint32_t>(esp) + (VM_PAGE_SIZE - sizeof(Sys::CPUState));
 		trampoline->tss.ss0  = 0x10;
 
+		TrampolineInitSysenter(cpu, trampolineData, IR_TRAMPOLINE_BEGIN - idtBegin);
+
 		return ErrorNone;
 	}
 
+	void TrampolineSetSysenterStack(CPU *cpu, uint32_t esp)
+	{
+		uint32_t &stack = _sysenterStack[cpu->GetID()];
+
+		// Writing the MSR is slow, but every userland thread keeps the same kernel stack
+		if(stack && stack != esp)
+		{
+			CPUWriteMSR(MSR_SYSENTER_ESP, esp);
+			stack = esp;
+		}
+	}
+
 	KernReturn<void> TrampolineMapIntoDirectory(VM::Directory *directory)
 	{
 		KernReturn<vm_address_t> vaddress = directory->AllocLimit(_physicalTrampoline, IR_TRAMPOLINE_BEGIN, VM::kUpperLimit, IR_TRAMPOLINE_PAGES, kVMFlagsKernel);
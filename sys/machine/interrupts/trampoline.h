@@ -38,10 +38,15 @@ namespace Sys
 	};
 
 	static_assert(sizeof(Sys::Trampoline) == 0x8a4, "Sys::Trampoline size must match the size in idt.S");
+	static_assert(__builtin_offsetof(CPUState, interrupt) == 48 && __builtin_offsetof(CPUState, esp) == 68, "Sys::CPUState layout must match the SYSEXIT path in idt.S");
 
 	KernReturn<void> TrampolineInit();
 	KernReturn<void> TrampolineInitCPU();
 
+	// SYSENTER doesn't use the TSS, the stack of the next thread that returns to userland has to be
+	// written into the SYSENTER_ESP MSR as well. Does nothing on CPUs without SYSENTER
+	void TrampolineSetSysenterStack(CPU *cpu, uint32_t esp);
+
 	KernReturn<void> TrampolineMapIntoDirectory(VM::Directory *directory);
 }
 
@@ -36,6 +36,7 @@ namespace Sys
 
 		static uint32_t _heapBitmap[_heapWidth];
 		static spinlock_t _heapLock = SPINLOCK_INIT;
+		static size_t _freePages = 0;
 
 
 		static inline void MarkUsed(uintptr_t page)
@@ -124,6 +125,8 @@ namespace Sys
 					MarkUsed(temp);
 					temp += VM_PAGE_SIZE;
 				}
+
+				_freePages -= pages;
 			}
 
 			spinlock_unlock(&_heapLock);
@@ -148,10 +151,17 @@ namespace Sys
 				page += VM_PAGE_SIZE;
 			}
 
+			_freePages += pages;
+
 			spinlock_unlock(&_heapLock);
 			return ErrorNone;
 		}
 
+		size_t GetFreePages()
+		{
+			return _freePages;
+		}
+
 
 		void MarkRange(uintptr_t begin, uintptr_t end)
 		{
@@ -240,6 +250,12 @@ namespace Sys
 
 		PM::MarkMultiboot(info);
 
+		for(size_t i = 0; i < PM::_heapWidth; i ++)
+		{
+			for(uint32_t bits = PM::_heapBitmap[i]; bits; bits &= (bits - 1))
+				PM::_freePages ++;
+		}
+
 		return ErrorNone;	
 	}
 }
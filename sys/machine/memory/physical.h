@@ -34,6 +34,8 @@ namespace Sys
 		KernReturn<uintptr_t> Alloc(size_t pages);
 		KernReturn<uintptr_t> AllocLimit(size_t pages, uintptr_t lower, uintptr_t upper);
 		KernReturn<void> Free(uintptr_t page, size_t pages);
+
+		size_t GetFreePages();
 	}
 
 	KernReturn<void> PMInit();
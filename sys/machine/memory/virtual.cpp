@@ -251,6 +251,57 @@ namespace Sys
 			return Error(KERN_INVALID_ADDRESS);
 		}
 
+		KernReturn<uint32_t> Directory::GetEntry(vm_address_t address)
+		{
+			ScopedDirectory scoped(_directory);
+			uint32_t *mapped = scoped.GetDirectory();
+
+			if(!mapped)
+				return Error(KERN_NO_MEMORY);
+
+			uint32_t index = address / VM_PAGE_SIZE;
+			if(!(mapped[index / kDirectoryLength] & Flags::Present))
+				return Error(KERN_INVALID_ADDRESS);
+
+			ScopedMapping temp(_kernelDirectory, mapped[index / kDirectoryLength] & ~0xfff, 1);
+			uint32_t *pageTable = reinterpret_cast<uint32_t *>(temp.GetAddress());
+
+			if(!pageTable)
+				return Error(KERN_NO_MEMORY);
+
+			return pageTable[index % kPagetableLength];
+		}
+
+		KernReturn<void> Directory::ExchangeEntry(vm_address_t address, uint32_t expected, uint32_t entry)
+		{
+			ScopedDirectory scoped(_directory);
+			uint32_t *mapped = scoped.GetDirectory();
+
+			if(!mapped)
+				return Error(KERN_NO_MEMORY);
+
+			uint32_t index = address / VM_PAGE_SIZE;
+			if(!(mapped[index / kDirectoryLength] & Flags::Present))
+				return Error(KERN_INVALID_ADDRESS);
+
+			ScopedMapping temp(_kernelDirectory, mapped[index / kDirectoryLength] & ~0xfff, 1);
+			uint32_t *pageTable = reinterpret_cast<uint32_t *>(temp.GetAddress());
+
+			if(!pageTable)
+				return Error(KERN_NO_MEMORY);
+
+			// The CPU updates the accessed and dirty bits behind our back, so the lock alone isn't enough
+			spinlock_lock(&_lock);
+			bool exchanged = __sync_bool_compare_and_swap(pageTable + (index % kPagetableLength), expected, entry);
+			spinlock_unlock(&_lock);
+
+			if(!exchanged)
+				return Error(KERN_RESOURCE_IN_USE);
+
+			invlpg(address);
+			return ErrorNone;
+		}
+
 		KernReturn<vm_address_t> Directory::Alloc(uintptr_t physical, size_t pages, Flags flags)
 		{
 			return AllocLimit(physical, kLowerLimit, kUpperLimit, pages, flags);
@@ -373,7 +424,7 @@ namespace Sys
 
 					for(; pageIndex < kPagetableLength; pageIndex ++)
 					{
-						if(!(table[pageIndex] & Directory::Flags::Present))
+						if(!(table[pageIndex] & (Directory::Flags::Present | kEntrySwapped)))
 						{
 							if(found == 0)
 								regionStart = (pageTableIndex << VM_DIRECTORY_SHIFT) + (pageIndex << VM_PAGE_SHIFT);
@@ -508,7 +559,7 @@ namespace Sys
 					{
 						bool isFree = true;
 
-						if(utable && utable[pageIndex] & Directory::Flags::Present)
+						if(utable && utable[pageIndex] & (Directory::Flags::Present | kEntrySwapped))
 							isFree = false;
 
 						if(ktable && ktable[pageIndex] & Directory::Flags::Present)
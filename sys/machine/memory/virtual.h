@@ -51,6 +51,11 @@ namespace Sys
 		constexpr vm_address_t kUpperLimit  = 0xfffff000;
 		constexpr vm_address_t kKernelLimit = 0x0ffff000;
 
+		// Software defined bits of non present page table entries. The swap uses them
+		// to remember pages it has taken away, everything else treats them as allocated
+		constexpr uint32_t kEntrySwapped  = (1 << 9);
+		constexpr uint32_t kEntryResident = (1 << 10);
+
 		class Directory
 		{
 		public:
@@ -75,6 +80,11 @@ namespace Sys
 
 			KernReturn<uintptr_t> ResolveAddress(vm_address_t address);
 
+			// Raw access to the page table entry of a page, including non present ones
+			// ExchangeEntry() only replaces the entry if it still matches the expected value
+			KernReturn<uint32_t> GetEntry(vm_address_t address);
+			KernReturn<void> ExchangeEntry(vm_address_t address, uint32_t expected, uint32_t entry);
+
 			KernReturn<vm_address_t> Alloc(uintptr_t physical, size_t pages, Flags flags);
 			KernReturn<vm_address_t> AllocLimit(uintptr_t physical, vm_address_t lower, vm_address_t upper, size_t pages, Flags flags);
 			KernReturn<vm_address_t> AllocTwoSidedLimit(uintptr_t physical, vm_address_t lower, vm_address_t upper, size_t pages, Flags flags);
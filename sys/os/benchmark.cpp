@@ -0,0 +1,133 @@
+//
+//  benchmark.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libcpp/atomic.h>
+#include <machine/cpu.h>
+#include <os/locks/mutex.h>
+#include <os/scheduler/scheduler.h>
+#include <os/waitqueue.h>
+#include "benchmark.h"
+
+namespace OS
+{
+	namespace Benchmark
+	{
+		static constexpr uint64_t kPollInterval = 1000;
+
+		// Only one parallel run at a time, the benchmarks share the slots
+		static Mutex _parallelLock("benchmark");
+		static uint32_t _cpus[CONFIG_MAX_CPUS];
+		static std::atomic<uint32_t> _started;
+		static std::atomic<uint32_t> _ready;
+		static std::atomic<uint32_t> _done;
+		static std::atomic<bool> _go;
+
+		void Exit()
+		{
+			Scheduler *scheduler = Scheduler::GetScheduler();
+			Thread *thread = scheduler->GetActiveThread();
+
+			scheduler->BlockThread(thread);
+			scheduler->RemoveThread(thread);
+
+			thread->GetTask()->MarkThreadExit(thread);
+
+			while(1)
+				scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU());
+		}
+
+		KernReturn<Thread *> StartThread(void (*entry)(), Thread::PriorityClass priority, uint32_t affinity)
+		{
+			Scheduler *scheduler = Scheduler::GetScheduler();
+
+			KernReturn<Thread *> thread = scheduler->GetKernelTask()->AttachThread(reinterpret_cast<Thread::Entry>(entry), priority, 0, nullptr);
+			if(!thread.IsValid())
+				return thread;
+
+			if(affinity != UINT32_MAX)
+				scheduler->SetThreadAffinity(thread, affinity);
+
+			return thread;
+		}
+
+		size_t RunParallel(void (*entry)(), size_t count)
+		{
+			_parallelLock.Lock();
+
+			size_t workers = 0;
+
+			_started = 0;
+			_ready = 0;
+			_done = 0;
+			_go = false;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount() && workers < count; i ++)
+			{
+				if(!(Sys::CPU::GetCPUWithID(i)->GetFlags() & Sys::CPU::Flags::Running))
+					continue;
+
+				_cpus[workers] = i;
+
+				if(!StartThread(entry, Thread::PriorityClassHigh, 1 << i).IsValid())
+					break;
+
+				workers ++;
+
+				while(_started.load() != workers)
+					WaitWithTimeout(&_started, kPollInterval);
+			}
+
+			while(_ready.load() != workers)
+				WaitWithTimeout(&_ready, kPollInterval);
+
+			_go.store(true, std::memory_order_release);
+
+			while(_done.load() != workers)
+				WaitWithTimeout(&_done, kPollInterval);
+
+			_parallelLock.Unlock();
+
+			return workers;
+		}
+
+		size_t Begin()
+		{
+			// Threads are started one after another, each one takes the next slot
+			size_t slot = _started.load();
+			_started ++;
+
+			// They start wherever the scheduler puts them and are moved over once their affinity is set
+			while(Sys::CPU::GetCurrentCPU()->GetID() != _cpus[slot])
+				Sys::CPUPause();
+
+			// Everyone starts at once, so the work really overlaps
+			_ready ++;
+
+			while(!_go.load(std::memory_order_acquire))
+				Sys::CPUPause();
+
+			return slot;
+		}
+
+		void Finish()
+		{
+			_done ++;
+			Exit();
+		}
+	}
+}
@@ -0,0 +1,137 @@
+//
+//  benchmark.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libc/sys/spinlock.h>
+#include <kern/kern_return.h>
+#include <os/scheduler/thread.h>
+
+namespace OS
+{
+	/**
+	 * Shared plumbing for the kernel self-tests and benchmarks. A benchmark only supplies its workload,
+	 * the Runner runs it on a kernel thread, one run at a time, and keeps the last result around for
+	 * the /dev statistics file that started it.
+	 **/
+	namespace Benchmark
+	{
+		enum class State
+		{
+			Idle,
+			Running,
+			Done
+		};
+
+		// Kernel threads started by a benchmark leave through here
+		void Exit() __attribute__((noreturn));
+
+		// Starts a kernel thread that is moved to the CPUs in the affinity mask
+		KernReturn<Thread *> StartThread(void (*entry)(), Thread::PriorityClass priority, uint32_t affinity = UINT32_MAX);
+
+		// Starts the entry on up to count CPUs, one thread each, and returns how many ran once all of them are done.
+		// The threads call Begin() first, which returns their slot and lets all of them start at the same time
+		size_t RunParallel(void (*entry)(), size_t count);
+		size_t Begin();
+		void Finish() __attribute__((noreturn));
+
+		template<class T, void (*Workload)(T &result)>
+		class Runner
+		{
+		public:
+			// Fails with KERN_RESOURCE_IN_USE while a run is in progress
+			static KernReturn<void> Start()
+			{
+				spinlock_lock(&_lock);
+
+				if(_state == State::Running)
+				{
+					spinlock_unlock(&_lock);
+					return Error(KERN_RESOURCE_IN_USE);
+				}
+
+				_state = State::Running;
+				spinlock_unlock(&_lock);
+
+				KernReturn<Thread *> driver = StartThread(&Driver, Thread::PriorityClassKernel);
+				if(!driver.IsValid())
+				{
+					spinlock_lock(&_lock);
+					_state = State::Idle;
+					spinlock_unlock(&_lock);
+
+					return driver.GetError();
+				}
+
+				return ErrorNone;
+			}
+
+			static State GetState()
+			{
+				spinlock_lock(&_lock);
+				State state = _state;
+				spinlock_unlock(&_lock);
+
+				return state;
+			}
+
+			// The result is only valid once the state is Done
+			static State GetResult(T *result)
+			{
+				spinlock_lock(&_lock);
+				State state = _state;
+				*result = _result;
+				spinlock_unlock(&_lock);
+
+				return state;
+			}
+
+		private:
+			static void Driver()
+			{
+				T result = {};
+				Workload(result);
+
+				spinlock_lock(&_lock);
+				_result = result;
+				_state = State::Done;
+				spinlock_unlock(&_lock);
+
+				Exit();
+			}
+
+			static State _state;
+			static T _result;
+			static spinlock_t _lock;
+		};
+
+		template<class T, void (*Workload)(T &)>
+		State Runner<T, Workload>::_state = State::Idle;
+
+		template<class T, void (*Workload)(T &)>
+		T Runner<T, Workload>::_result;
+
+		template<class T, void (*Workload)(T &)>
+		spinlock_t Runner<T, Workload>::_lock = SPINLOCK_INIT;
+	}
+}
+
+#endif /* _BENCHMARK_H_ */
@@ -0,0 +1,84 @@
+//
+//  functionbenchmark.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include <libio/core/IOFunction.h>
+#include <machine/cpu.h>
+#include "functionbenchmark.h"
+
+namespace OS
+{
+	namespace FunctionBenchmark
+	{
+		static constexpr size_t kIterations = 20000;
+
+		struct Counter
+		{
+			uint32_t Add(uint32_t value) { return (total += value); }
+			uint32_t total;
+		};
+
+		// Out of line, so the compiler can't see through the function and drop the whole thing
+		static uint32_t __attribute__((noinline)) Invoke(const IO::Function<uint32_t (uint32_t)> &function, uint32_t value)
+		{
+			return function(value);
+		}
+
+		void Run(Result &result)
+		{
+			volatile uint32_t sink = 0;
+
+			uint32_t a = 1;
+			uint32_t b = 2;
+			uint32_t large[16] = { 0 };
+
+			Counter counter = { 0 };
+
+			uint64_t start = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+			{
+				IO::Function<uint32_t (uint32_t)> function([a, b](uint32_t value) { return value + a + b; });
+				sink = Invoke(function, static_cast<uint32_t>(i));
+			}
+
+			uint64_t lambda = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+			{
+				IO::Function<uint32_t (uint32_t)> function(&counter, &Counter::Add);
+				sink = Invoke(function, static_cast<uint32_t>(i));
+			}
+
+			uint64_t member = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+			{
+				IO::Function<uint32_t (uint32_t)> function([large](uint32_t value) { return value + large[value % 16]; });
+				sink = Invoke(function, static_cast<uint32_t>(i));
+			}
+
+			uint64_t end = Sys::CPUReadTimestamp();
+			(void)sink;
+
+			result.lambdaCycles = static_cast<uint32_t>((lambda - start) / kIterations);
+			result.memberCycles = static_cast<uint32_t>((member - lambda) / kIterations);
+			result.heapCycles = static_cast<uint32_t>((end - member) / kIterations);
+		}
+	}
+}
@@ -0,0 +1,49 @@
+//
+//  functionbenchmark.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef _FUNCTIONBENCHMARK_H_
+#define _FUNCTIONBENCHMARK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <os/benchmark.h>
+
+namespace OS
+{
+	/**
+	 * Constructs, invokes and destroys IO::Function objects in a loop. Small lambdas and bound
+	 * member functions are stored inline, the large lambda doesn't fit and goes through the heap.
+	 * Started by writing "benchmark" to /dev/functions, which also shows the result.
+	 **/
+	namespace FunctionBenchmark
+	{
+		// Average TSC cycles per construct, invoke and destroy
+		struct Result
+		{
+			uint32_t lambdaCycles;
+			uint32_t memberCycles;
+			uint32_t heapCycles;
+		};
+
+		void Run(Result &result);
+		typedef Benchmark::Runner<Result, &Run> Runner;
+	}
+}
+
+#endif /* _FUNCTIONBENCHMARK_H_ */
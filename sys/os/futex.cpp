@@ -0,0 +1,275 @@
+//
+//  os/futex.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <machine/interrupts/interrupts.h>
+#include <os/scheduler/scheduler.h>
+#include <os/swap/swap.h>
+#include <os/syscall/syscall.h>
+#include "futex.h"
+
+namespace OS
+{
+	namespace Futex
+	{
+		static constexpr size_t kBucketCount = 256;
+		static constexpr size_t kWakeBatch = 16;
+
+		struct Bucket
+		{
+			spinlock_t lock;
+			std::intrusive_list<Waiter> waiters;
+		} __attribute__((aligned(64)));
+
+		static Bucket _buckets[kBucketCount];
+
+		static_assert(kBucketCount == 256, "GetBucket() uses the top 8 bits of the hash");
+
+		static Bucket *GetBucket(uintptr_t key)
+		{
+			uint32_t hash = static_cast<uint32_t>(key >> 2) * 0x9e3779b1;
+			return _buckets + (hash >> 24);
+		}
+
+		// Timeouts take the bucket lock from the timer interrupt, so it must never be held with interrupts enabled
+		static bool LockBucket(Bucket *bucket)
+		{
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&bucket->lock);
+
+			return enabled;
+		}
+		static void UnlockBucket(Bucket *bucket, bool enabled)
+		{
+			spinlock_unlock(&bucket->lock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+		}
+
+		static KernReturn<uintptr_t> ResolveKey(Task *task, uint32_t *address)
+		{
+			vm_address_t vaddress = reinterpret_cast<vm_address_t>(address);
+
+			if(!vaddress || (vaddress & (sizeof(uint32_t) - 1)))
+				return Error(KERN_INVALID_ARGUMENT);
+
+			KernReturn<uintptr_t> physical = Swap::ResolveAddress(task->GetDirectory(), vaddress);
+			if(!physical.IsValid())
+				return physical.GetError();
+
+			KernReturn<uint32_t> entry = task->GetDirectory()->GetEntry(VM_PAGE_ALIGN_DOWN(vaddress));
+			if(!entry.IsValid() || !(entry.Get() & Sys::VM::Directory::Flags::Userspace))
+				return Error(KERN_INVALID_ADDRESS);
+
+			return physical.Get();
+		}
+
+		static void WaitTimeout(__unused Timer *timer, void *context)
+		{
+			Waiter *waiter = reinterpret_cast<Waiter *>(context);
+			Bucket *bucket = GetBucket(waiter->key);
+
+			bool enabled = LockBucket(bucket);
+
+			// A wakeup that dequeued the waiter first cancels the timer before it unblocks the thread
+			if(!waiter->queued)
+			{
+				UnlockBucket(bucket, enabled);
+				return;
+			}
+
+			bucket->waiters.erase(waiter->entry);
+			waiter->queued = false;
+
+			UnlockBucket(bucket, enabled);
+
+			Thread *thread = waiter->thread;
+			Swap::UnpinPage(waiter->key);
+
+			// The thread is still blocked, so its saved state can be changed. A timeout that fires before the
+			// syscall itself completed is overwritten with the regular result and shows up as a spurious wakeup
+			Sys::CPUState *state = reinterpret_cast<Sys::CPUState *>(thread->GetESP());
+			state->eax = static_cast<uint32_t>(-1);
+			state->ecx = ETIMEDOUT;
+
+			Scheduler::GetScheduler()->UnblockThread(thread);
+			thread->Release();
+		}
+
+		static KernReturn<uint32_t> Wait(Thread *thread, uint32_t *address, uint32_t expected, uint32_t timeout)
+		{
+			Task *task = thread->GetTask();
+
+			KernReturn<uintptr_t> resolved = ResolveKey(task, address);
+			if(!resolved.IsValid())
+				return resolved.GetError();
+
+			uintptr_t key = resolved.Get();
+			Swap::PinPage(key);
+
+			// The page could have been swapped out and back in before the pin was visible
+			KernReturn<uintptr_t> pinned = ResolveKey(task, address);
+			if(!pinned.IsValid() || pinned.Get() != key)
+			{
+				Swap::UnpinPage(key);
+				return Error(KERN_FAILURE, EAGAIN);
+			}
+
+			SyscallScopedMapping mapping(task, address, sizeof(uint32_t));
+			KernReturn<volatile uint32_t *> word = mapping.GetMemory<volatile uint32_t>();
+			if(!word.IsValid())
+			{
+				Swap::UnpinPage(key);
+				return word.GetError();
+			}
+
+			Bucket *bucket = GetBucket(key);
+			Waiter *waiter = thread->GetFutexWaiter();
+
+			bool enabled = LockBucket(bucket);
+
+			// Wakers change the value before they take the bucket lock, so checking it under the lock can't miss a wakeup
+			if(*word.Get() != expected)
+			{
+				UnlockBucket(bucket, enabled);
+				Swap::UnpinPage(key);
+
+				return Error(KERN_FAILURE, EAGAIN);
+			}
+
+			waiter->thread = thread->Retain();
+			waiter->key = key;
+			waiter->queued = true;
+
+			bucket->waiters.push_back(waiter->entry);
+
+			// Like joining, the extra block keeps the thread asleep after the syscall returns until it's woken up
+			Scheduler::GetScheduler()->BlockThread(thread);
+
+			if(timeout)
+			{
+				Timer *timer = thread->GetSleepTimer();
+				timer->SetCallback(&WaitTimeout, waiter);
+				timer->Arm(timeout);
+			}
+
+			UnlockBucket(bucket, enabled);
+			return 0;
+		}
+
+		static KernReturn<uint32_t> Wake(Thread *thread, uint32_t *address, uint32_t count)
+		{
+			KernReturn<uintptr_t> resolved = ResolveKey(thread->GetTask(), address);
+			if(!resolved.IsValid())
+				return resolved.GetError();
+
+			uintptr_t key = resolved.Get();
+			Bucket *bucket = GetBucket(key);
+			uint32_t woken = 0;
+
+			while(woken < count)
+			{
+				Waiter *batch[kWakeBatch];
+				size_t batched = 0;
+
+				bool enabled = LockBucket(bucket);
+
+				std::intrusive_list<Waiter>::member *member = bucket->waiters.head();
+				while(member && batched < kWakeBatch && woken + batched < count)
+				{
+					Waiter *waiter = member->get();
+
+					if(waiter->key != key)
+					{
+						member = member->next();
+						continue;
+					}
+
+					member = bucket->waiters.erase(member);
+					waiter->queued = false;
+
+					batch[batched ++] = waiter;
+				}
+
+				UnlockBucket(bucket, enabled);
+
+				// The threads stay blocked until their timer is cancelled, so a new wait can't arm it in the meantime
+				for(size_t i = 0; i < batched; i ++)
+				{
+					Thread *waiting = batch[i]->thread;
+
+					waiting->GetSleepTimer()->Cancel();
+					Swap::UnpinPage(key);
+
+					Scheduler::GetScheduler()->UnblockThread(waiting);
+					waiting->Release();
+				}
+
+				woken += batched;
+
+				if(batched < kWakeBatch)
+					break;
+			}
+
+			return woken;
+		}
+	}
+
+	namespace Futex
+	{
+		void Cancel(Thread *thread)
+		{
+			Waiter *waiter = thread->GetFutexWaiter();
+			Bucket *bucket = GetBucket(waiter->key);
+
+			bool enabled = LockBucket(bucket);
+
+			// Either never waited or a wakeup or timeout already took it, those finish on their own
+			if(!waiter->queued)
+			{
+				UnlockBucket(bucket, enabled);
+				return;
+			}
+
+			bucket->waiters.erase(waiter->entry);
+			waiter->queued = false;
+
+			UnlockBucket(bucket, enabled);
+
+			// A timeout that fired meanwhile finds the waiter dequeued and backs off
+			thread->GetSleepTimer()->Cancel();
+			Swap::UnpinPage(waiter->key);
+
+			waiter->thread->Release();
+		}
+	}
+
+	KernReturn<uint32_t> Syscall_Futex(Thread *thread, FutexArgs *arguments)
+	{
+		switch(arguments->operation)
+		{
+			case FUTEX_WAIT:
+				return Futex::Wait(thread, arguments->address, arguments->value, arguments->timeout);
+			case FUTEX_WAKE:
+				return Futex::Wake(thread, arguments->address, arguments->value);
+
+			default:
+				return Error(KERN_INVALID_ARGUMENT);
+		}
+	}
+}
@@ -0,0 +1,75 @@
+//
+//  os/futex.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libc/sys/futex.h>
+#include <libcpp/intrusive_list.h>
+#include <kern/kern_return.h>
+
+namespace OS
+{
+	class Thread;
+
+	/**
+	 * Futexes are keyed by the physical address of the user word, so tasks that share the page
+	 * also share the futex. Waiters are kept in a fixed number of hashed buckets, each with its
+	 * own lock. Waiting blocks the thread past the end of the syscall, like joining does, and a
+	 * wakeup or the timeout unblocks it again.
+	 *
+	 * Pages with waiters on them are pinned and skipped by the swap, otherwise swapping the page
+	 * back in would move the word to a different physical address than the waiters are keyed by.
+	 **/
+	namespace Futex
+	{
+		// Embedded in every thread, a thread can only wait on one futex at a time
+		struct Waiter
+		{
+			Waiter() :
+				thread(nullptr),
+				key(0),
+				queued(false),
+				entry(this)
+			{}
+
+			Thread *thread;
+			uintptr_t key;
+			bool queued;
+			std::intrusive_list<Waiter>::member entry;
+		};
+
+		// Dequeues the thread if it's waiting on a futex and drops everything the wait holds on to.
+		// Called when the thread exits, so that no wakeup or timeout ever touches it afterwards
+		void Cancel(Thread *thread);
+	}
+
+	struct FutexArgs
+	{
+		int operation;
+		uint32_t *address;
+		uint32_t value; // The expected value for FUTEX_WAIT, the number of threads to wake for FUTEX_WAKE
+		uint32_t timeout; // In microseconds, 0 waits forever
+	} __attribute__((packed));
+
+	KernReturn<uint32_t> Syscall_Futex(Thread *thread, FutexArgs *arguments);
+}
+
+#endif /* _FUTEX_H_ */
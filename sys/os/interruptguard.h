@@ -32,16 +32,22 @@ namespace OS
 			InheritInterrupts
 		};
 
-		InterruptGuard(Mode mode)
+		InterruptGuard(Mode mode) :
+			_wasEnabled(false)
 		{
 			if(mode == Mode::DisableInterrupts)
-				Sys::DisableInterrupts();
+				_wasEnabled = Sys::DisableInterrupts();
 		}
 
 		~InterruptGuard()
 		{
-			Sys::EnableInterrupts();
+			// Only restore what was there before, guards inside of interrupt handlers or critical sections must leave interrupts off
+			if(_wasEnabled)
+				Sys::EnableInterrupts();
 		}
+
+	private:
+		bool _wasEnabled;
 	};
 }
 
@@ -17,6 +17,7 @@
 //
 
 #include <libio/core/IONumber.h>
+#include <machine/clock/clock.h>
 #include <os/waitqueue.h>
 #include <kern/kprintf.h>
 #include <libc/ipc/ipc_message.h>
@@ -30,7 +31,7 @@ namespace OS
 		IODefineMeta(Space, IO::Object)
 
 		static IO::Dictionary *_spaceMap;
-		static Mutex _spaceLock;
+		static Mutex _spaceLock("ipc spaces");
 		static std::atomic<ipc_space_t> _spaceName;
 		static Space *_kernelSpace;
 
@@ -267,7 +268,7 @@ namespace OS
 			return ErrorNone;
 		}
 
-		KernReturn<void> Space::Read(Message *message)
+		KernReturn<void> Space::Read(Message *message, uint64_t deadline)
 		{
 			IO::StrongRef<Port> receiver = GetPortWithName(message->GetPort());
 
@@ -287,12 +288,31 @@ namespace OS
 			{
 				if(header->flags & IPC_HEADER_FLAG_BLOCK)
 				{
-					KernReturn<void> result = WaitWithCallback(receiver.Load(), [this] {
+					uint64_t timeout = 0;
+
+					if(deadline)
+					{
+						uint64_t now = Sys::Clock::GetMicroseconds();
+						if(now >= deadline)
+							return Error(KERN_TIMEOUT);
+
+						timeout = deadline - now;
+					}
+
+					KernReturn<void> result = WaitWithCallback(receiver.Load(), timeout, [this] {
 						Unlock();
 					});
 
-					if(!result.IsValid()) // No need to lock because the lambda is only performed when the wait succeeds
-						return Error(KERN_TASK_RESTART);
+					if(!result.IsValid())
+					{
+						if(result.GetError().GetCode() == KERN_TIMEOUT)
+						{
+							Lock();
+							return Error(KERN_TIMEOUT);
+						}
+
+						return Error(KERN_TASK_RESTART); // No need to lock because the lambda is only performed when the wait succeeds
+					}
 
 					goto readMessageRetry;
 				}
@@ -53,7 +53,7 @@ namespace OS
 
 			/** Must *both* be called with lock being held **/
 			KernReturn<void> Write(Message *message);
-			KernReturn<void> Read(Message *message);
+			KernReturn<void> Read(Message *message, uint64_t deadline = 0); // Deadline as in Sys::Clock::GetMicroseconds(), 0 waits forever
 
 			ipc_space_t GetName() const { return _name; }
 			Task *GetTask() const { return _task; }
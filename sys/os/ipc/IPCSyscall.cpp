@@ -19,6 +19,7 @@
 #include <os/syscall/syscall.h>
 #include <os/scheduler/scheduler.h>
 #include <kern/kprintf.h>
+#include <machine/clock/clock.h>
 #include "IPCSyscall.h"
 
 namespace OS
@@ -63,8 +64,17 @@ namespace OS
 			{
 				case IPC_READ:
 				{
+					// Blocking reads restart the syscall until a message arrives, so the deadline has to outlive a single attempt
+					uint64_t deadline = thread->GetSyscallDeadline();
+
+					if(arguments->timeout && deadline == 0)
+					{
+						deadline = Sys::Clock::GetMicroseconds() + arguments->timeout;
+						thread->SetSyscallDeadline(deadline);
+					}
+
 					Message *message = Message::Alloc()->Init(header);
-					result = space->Read(message);
+					result = space->Read(message, deadline);
 					message->Release();
 					
 					break;
@@ -152,7 +162,7 @@ namespace OS
 			OS::SyscallScopedMapping portMapping(thread->GetTask(), arguments->space, sizeof(ipc_space_t));
 			ipc_space_t *space = portMapping.GetMemory<ipc_space_t>();
 
-			Task *task = Scheduler::GetScheduler()->GetTaskWithPID(arguments->pid);
+			IO::StrongRef<Task> task = Scheduler::GetScheduler()->GetTaskWithPID(arguments->pid);
 			if(!task)
 				return Error(KERN_INVALID_ARGUMENT);
 
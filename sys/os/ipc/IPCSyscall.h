@@ -39,6 +39,7 @@ namespace OS
 			ipc_header_t *header;
 			ipc_size_t size;
 			int mode;
+			uint32_t timeout; // Microseconds for blocking reads, 0 waits forever
 		} __attribute__((packed));
 
 		struct IPCSpecialPortArgs
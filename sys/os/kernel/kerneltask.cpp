@@ -21,8 +21,8 @@
 #include <machine/interrupts/interrupts.h>
 #include <os/scheduler/scheduler.h>
 #include <os/waitqueue.h>
+#include <os/workqueue.h>
 #include <os/ipc/IPC.h>
-#include <os/locks/mutex.h>
 #include <libc/ipc/ipc_message.h>
 
 namespace Sys
@@ -32,85 +32,6 @@ namespace Sys
 
 namespace OS
 {
-	void KernelWorkThread()
-	{
-		struct WorkProxy
-		{
-			WorkQueue::Entry *entries;
-			WorkQueue *queue;
-		};
-
-		size_t count = Sys::CPU::GetCPUCount();
-		WorkProxy *proxies = new WorkProxy[count];
-
-		for(size_t i = 0; i < count; i ++)
-		{
-			Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
-			WorkProxy *proxy = proxies + i;
-
-			proxy->queue = cpu->GetWorkQueue();	
-		}
-
-		Mutex lock;
-		Thread *self = Scheduler::GetScheduler()->GetActiveThread();
-
-		while(1)
-		{
-			lock.Lock(Mutex::Mode::NoInterrupts);
-			Sys::CPU *current = Sys::CPU::GetCurrentCPU();
-
-			for(size_t i = 0; i < count; i ++)
-			{
-				Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
-				WorkProxy *proxy = proxies + i;
-
-				proxy->entries = (cpu == current) ? proxy->queue->PopAll() : proxy->queue->PopAllRemote();
-			}
-
-			lock.Unlock();
-
-			// Perform the work
-			for(size_t i = 0; i < count; i ++)
-			{
-				WorkProxy *proxy = proxies + i;
-
-				WorkQueue::Entry *entry = proxy->entries;
-				while(entry)
-				{
-					entry->callback(entry->context);
-					entry = entry->next;
-				}
-			}
-
-			// Refurbish the work lists
-			lock.Lock(Mutex::Mode::NoInterrupts);
-			current = Sys::CPU::GetCurrentCPU();
-
-			for(size_t i = 0; i < count; i ++)
-			{
-				Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
-				WorkProxy *proxy = proxies + i;
-
-				if(!proxy->entries)
-					continue;
-
-				if(cpu == current)
-				{
-					proxy->queue->RefurbishList(proxy->entries);
-					proxy->entries = nullptr;
-				}
-				else
-				{
-					proxy->queue->RefurbishListRemote(proxy->entries);
-					proxy->entries = nullptr;
-				}
-			}
-
-			lock.Unlock();
-			Scheduler::GetScheduler()->YieldThread(self);
-		}
-	}
-
 	extern void BootstrapServerThread();
 
 	IPC::Port *bootstrapPort = nullptr;
@@ -149,7 +70,9 @@ namespace OS
 
 		space->Unlock();
 
-		__unused Thread *workThread = self->AttachThread(reinterpret_cast<Thread::Entry>(&KernelWorkThread), Thread::PriorityClassKernel, 16, nullptr);
+		if(!WorkQueue::StartWorkers().IsValid())
+			panic("Couldn't start the kernel workers");
+
 		__unused Thread *bootstrapThread = self->AttachThread(reinterpret_cast<Thread::Entry>(&BootstrapServerThread), Thread::PriorityClassKernel, 16, nullptr);
 
 		// Start the test program
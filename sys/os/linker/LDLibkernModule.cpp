@@ -124,7 +124,7 @@ namespace OS
 			void *argument;
 		};
 
-		static Mutex __interruptLock;
+		static Mutex __interruptLock("libkern interrupts");
 		static InterruptEntry __interruptEntries[255];
 
 		uint32_t __libkern_interruptHandler(uint32_t esp, __unused Sys::CPU *cpu)
@@ -153,23 +153,57 @@ namespace OS
 			Sys::SetInterruptHandler(vector, &__libkern_interruptHandler);
 		}
 
+		// Events are buffered until a work queue entry drains them, a full queue is retried on the next event
 		static IO::KeyboardEvent _eventStack[128];
+		static size_t _eventStackHead = 0;
 		static size_t _eventStackSize = 0;
+		static bool _eventDrainScheduled = false;
+		static Mutex _eventLock("libkern keyboard events");
 
-		void __libkern_handleKeyboardEvent(void *context)
+		void __libkern_handleKeyboardEvents(__unused void *context)
 		{
-			IO::KeyboardEvent *event = reinterpret_cast<IO::KeyboardEvent *>(context);
-			VFS::Devices::Keyboard *keyboard = VFS::Devices::GetKeyboard(event->GetSender());
+			while(1)
+			{
+				_eventLock.Lock(Mutex::Mode::NoInterrupts);
+
+				if(_eventStackSize == 0)
+				{
+					_eventDrainScheduled = false;
+					_eventLock.Unlock();
+					return;
+				}
+
+				IO::KeyboardEvent event;
+				memcpy(&event, _eventStack + _eventStackHead, sizeof(IO::KeyboardEvent));
+
+				_eventStackHead = (_eventStackHead + 1) % 128;
+				_eventStackSize --;
 
-			keyboard->HandleEvent(event);
+				_eventLock.Unlock();
+
+				VFS::Devices::Keyboard *keyboard = VFS::Devices::GetKeyboard(event.GetSender());
+				keyboard->HandleEvent(&event);
+			}
 		}
 
 		void __libkern_dispatchKeyboardEvent(IO::KeyboardEvent *event)
 		{
-			memcpy(_eventStack + _eventStackSize, event, sizeof(IO::KeyboardEvent));
-			Sys::CPU::GetCurrentCPU()->GetWorkQueue()->PushEntry(&__libkern_handleKeyboardEvent, _eventStack + _eventStackSize);
+			_eventLock.Lock(Mutex::Mode::NoInterrupts);
+
+			if(_eventStackSize == 128)
+			{
+				// The oldest event is the least interesting one
+				_eventStackHead = (_eventStackHead + 1) % 128;
+				_eventStackSize --;
+			}
+
+			memcpy(_eventStack + ((_eventStackHead + _eventStackSize) % 128), event, sizeof(IO::KeyboardEvent));
+			_eventStackSize ++;
+
+			if(!_eventDrainScheduled)
+				_eventDrainScheduled = Sys::CPU::GetCurrentCPU()->GetWorkQueue()->PushEntry(&__libkern_handleKeyboardEvents, nullptr);
 
-			_eventStackSize = (_eventStackSize + 1) % 128;
+			_eventLock.Unlock();
 		}
 
 		IO::Object *__libkern_registerKeyboard(IO::Object *service)
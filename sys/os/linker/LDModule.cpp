@@ -67,6 +67,10 @@ namespace OS
 
 		extern Module *__GetModuleWithNameNoLockPrivate(const char *name, bool loadIfNeeded);
 
+		Module::Module() :
+			storeEntry(this)
+		{}
+
 		Module* Module::Init(Type type)
 		{
 			if(!IO::Object::Init())
@@ -24,6 +24,7 @@
 #include <libio/core/IOArray.h>
 #include <libio/core/IOString.h>
 #include <os/loader/elf.h>
+#include <os/rcu.h>
 
 #define kModuleSymbolStubName 0xdeadbeef
 
@@ -64,7 +65,12 @@ namespace OS
 			size_t GetPages() const { return _pages; }
 			const uint8_t *GetMemory() const { return reinterpret_cast<uint8_t *>(_memory); }
 
+			// Published by the store once the module finished loading
+			RCU::List<Module>::Member storeEntry;
+			RCU::Entry bootstrapEntry; // Used when the work queue is full
+
 		protected:
+			Module();
 			Module *Init(Type type);
 
 		private:
@@ -18,6 +18,7 @@
 
 #include <libio/core/IODictionary.h>
 #include <os/locks/mutex.h>
+#include <os/rcu.h>
 #include <os/workqueue.h>
 #include <vfs/vfs.h>
 #include "LDStore.h"
@@ -27,9 +28,14 @@ namespace OS
 {
 	namespace LD
 	{
-		static Mutex _moduleLock;
+		// A sleeping lock, loading and relocating a module takes long enough that it has to stay preemptible
+		static Mutex _moduleLock("ld modules");
 		static IO::Dictionary *_moduleStore;
 
+		// Fully loaded modules for lock free lookups. Modules are never unloaded, so nothing is ever
+		// removed from the list, and modules that are still loading are only found through the store
+		static RCU::List<Module> _modules;
+
 		IO::Array *__GetAllModules()
 		{
 			if(!_moduleLock.TryLock(Mutex::Mode::Simple))
@@ -71,10 +77,14 @@ namespace OS
 				return result.GetError();
 			}
 
+			_modules.PushFront(module->storeEntry);
+
 			if(module->GetType() == Module::Type::Extension)
 			{
+				// Starting it inline could recurse into the module lock, RCU::Call() defers it without failing
 				Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
-				cpu->GetWorkQueue()->PushEntry(&BootstrapModule, reinterpret_cast<void *>(module));
+				if(!cpu->GetWorkQueue()->PushEntry(&BootstrapModule, reinterpret_cast<void *>(module)))
+					RCU::Call(&module->bootstrapEntry, &BootstrapModule, reinterpret_cast<void *>(module));
 			}
 
 			return ErrorNone;
@@ -82,7 +92,7 @@ namespace OS
 
 		KernReturn<void> AddModule(Module *module)
 		{
-			_moduleLock.Lock(Mutex::Mode::NoInterrupts);
+			_moduleLock.Lock(Mutex::Mode::Simple);
 			KernReturn<void> result = __AddModule(module);
 			_moduleLock.Unlock();
 
@@ -92,11 +102,18 @@ namespace OS
 
 
 
-		Module *__GetModuleWithNameNoLockPrivate(const char *name, bool loadIfNeeded)
+		static const char *GetModuleName(const char *name)
 		{
 			if(strncmp(name, "/slib/", 6) == 0)
 				name += 6; // Skip the /slib/ prefix
 
+			return name;
+		}
+
+		Module *__GetModuleWithNameNoLockPrivate(const char *name, bool loadIfNeeded)
+		{
+			name = GetModuleName(name);
+
 			IO::String *lookup = IO::String::Alloc()->InitWithCString(name, false);
 			Module *result = _moduleStore->GetObjectForKey<Module>(lookup);
 			lookup->Release();
@@ -123,8 +140,28 @@ namespace OS
 
 		IO::StrongRef<Module> GetModuleWithName(const char *name, bool loadIfNeeded)
 		{
-			_moduleLock.Lock(Mutex::Mode::NoInterrupts);
-			IO::StrongRef<Module> result = __GetModuleWithNameNoLockPrivate(name, loadIfNeeded);
+			IO::StrongRef<Module> result;
+			const char *lookup = GetModuleName(name);
+
+			bool enabled = RCU::ReadLock();
+
+			for(RCU::List<Module>::Member *entry = _modules.GetHead(); entry; entry = entry->GetNext())
+			{
+				if(strcmp(entry->Get()->GetName(), lookup) == 0)
+				{
+					result = entry->Get();
+					break;
+				}
+			}
+
+			RCU::ReadUnlock(enabled);
+
+			if(result)
+				return result;
+
+			// Modules that are still loading, or aren't loaded yet
+			_moduleLock.Lock(Mutex::Mode::Simple);
+			result = __GetModuleWithNameNoLockPrivate(name, loadIfNeeded);
 			_moduleLock.Unlock();
 
 			return result;
@@ -132,9 +169,25 @@ namespace OS
 
 		IO::StrongRef<Module> GetModuleWithAddress(vm_address_t address)
 		{
-			_moduleLock.Lock(Mutex::Mode::NoInterrupts);
+			IO::StrongRef<Module> result;
+
+			bool enabled = RCU::ReadLock();
+
+			for(RCU::List<Module>::Member *entry = _modules.GetHead(); entry; entry = entry->GetNext())
+			{
+				if(entry->Get()->ContainsAddress(address))
+				{
+					result = entry->Get();
+					break;
+				}
+			}
+
+			RCU::ReadUnlock(enabled);
+
+			if(result)
+				return result;
 
-			IO::StrongRef<Module> result(nullptr);
+			_moduleLock.Lock(Mutex::Mode::Simple);
 
 			_moduleStore->Enumerate<IO::String, Module>([&](__unused IO::String *name, Module *module, bool &stop) {
 
@@ -0,0 +1,184 @@
+//
+//  inversion.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libcpp/algorithm.h>
+#include <libcpp/atomic.h>
+#include <machine/clock/clock.h>
+#include <os/scheduler/scheduler.h>
+#include <os/waitqueue.h>
+
+#include "mutex.h"
+#include "inversion.h"
+
+namespace OS
+{
+	namespace Inversion
+	{
+		static constexpr uint64_t kLowWork = 50000; // CPU time the owner needs with the mutex held
+		static constexpr uint64_t kMediumWork = 300000;
+		static constexpr uint64_t kPollInterval = 1000;
+
+		enum Progress : uint32_t
+		{
+			LowLocked = (1 << 0),
+			LowDone = (1 << 1),
+			MediumRunning = (1 << 2),
+			MediumDone = (1 << 3),
+			HighDone = (1 << 4)
+		};
+
+		static Mutex _mutex;
+		static std::atomic<uint32_t> _progress;
+		static uint32_t _cpu;
+
+		// Written by the high priority thread before it sets HighDone
+		static uint64_t _waited;
+		static bool _overtaken;
+
+		// Burns CPU time rather than wall time, gaps in which the thread was preempted don't count
+		static void Work(uint64_t duration)
+		{
+			uint64_t last = Sys::Clock::GetMicroseconds();
+			uint64_t done = 0;
+
+			while(done < duration)
+			{
+				uint64_t now = Sys::Clock::GetMicroseconds();
+
+				if(now - last < 100)
+					done += now - last;
+
+				last = now;
+			}
+		}
+
+		// The threads start wherever the scheduler puts them and are moved over once their affinity is set
+		static void MoveToCPU()
+		{
+			while(Sys::CPU::GetCurrentCPU()->GetID() != _cpu)
+				Sys::CPUPause();
+		}
+
+		static void LowThread()
+		{
+			MoveToCPU();
+
+			_mutex.Lock();
+			_progress.fetch_or(LowLocked);
+
+			Work(kLowWork);
+
+			_mutex.Unlock();
+			_progress.fetch_or(LowDone);
+
+			Benchmark::Exit();
+		}
+
+		static void MediumThread()
+		{
+			MoveToCPU();
+			_progress.fetch_or(MediumRunning);
+
+			Work(kMediumWork);
+
+			_progress.fetch_or(MediumDone);
+
+			Benchmark::Exit();
+		}
+
+		static void HighThread()
+		{
+			MoveToCPU();
+
+			uint64_t start = Sys::Clock::GetMicroseconds();
+
+			_mutex.Lock();
+
+			_waited = Sys::Clock::GetMicroseconds() - start;
+			_overtaken = (_progress.load() & MediumDone);
+
+			_mutex.Unlock();
+			_progress.fetch_or(HighDone);
+
+			Benchmark::Exit();
+		}
+
+		static Thread *Spawn(void (*entry)(), Thread::PriorityClass priority)
+		{
+			KernReturn<Thread *> thread = Benchmark::StartThread(entry, priority, 1 << _cpu);
+			return thread.IsValid() ? thread.Get() : nullptr;
+		}
+
+		static void WaitFor(uint32_t flags)
+		{
+			while((_progress.load() & flags) != flags)
+				WaitWithTimeout(&_progress, kPollInterval);
+		}
+
+		void Run(Result &result)
+		{
+			Scheduler *scheduler = Scheduler::GetScheduler();
+
+			result.inherited = Thread::kNoInheritedPriority;
+			uint32_t spawned = 0;
+
+			_progress.store(0);
+			_cpu = Sys::CPU::GetCurrentCPU()->GetID();
+
+			// Every thread that got started has to be done before another run may start
+			if(Spawn(&LowThread, Thread::PriorityClassNormal))
+			{
+				spawned |= LowDone;
+				WaitFor(LowLocked);
+
+				Thread *medium = Spawn(&MediumThread, Thread::PriorityClassHigh);
+				if(medium)
+				{
+					spawned |= MediumDone;
+					WaitFor(MediumRunning);
+
+					result.medium = scheduler->GetThreadPriority(medium);
+
+					if(Spawn(&HighThread, Thread::PriorityClassKernel))
+					{
+						spawned |= HighDone;
+
+						Thread *owner;
+						while(!(_progress.load() & HighDone))
+						{
+							if((owner = _mutex.GetOwner()))
+								result.inherited = std::min(result.inherited, owner->GetInheritedPriority());
+
+							WaitWithTimeout(&_progress, kPollInterval);
+						}
+					}
+				}
+			}
+
+			WaitFor(spawned);
+
+			if(spawned & HighDone)
+			{
+				result.waited = static_cast<uint32_t>(_waited);
+				result.overtaken = _overtaken;
+
+				result.passed = (!result.overtaken && result.inherited < result.medium);
+			}
+		}
+	}
+}
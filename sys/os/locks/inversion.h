@@ -0,0 +1,52 @@
+//
+//  inversion.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_INVERSION_H_
+#define _OS_INVERSION_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <os/benchmark.h>
+
+namespace OS
+{
+	/**
+	 * Self-test for mutex priority inheritance. Reproduces the classic inversion on a single CPU:
+	 * a low priority thread holds a mutex, a medium priority thread hogs the CPU and a high priority
+	 * thread blocks on the mutex. Without inheritance the high priority thread waits for the medium one,
+	 * with it the owner runs at the high priority until it unlocks. Started by writing "inversion" to
+	 * /dev/mutexes, which also shows the result.
+	 **/
+	namespace Inversion
+	{
+		// Times are in microseconds
+		struct Result
+		{
+			bool passed;
+			uint32_t waited; // Until the high priority thread got the mutex
+			uint32_t inherited; // Best runqueue level the owner inherited while the high priority thread waited
+			uint32_t medium; // Runqueue level of the medium priority thread
+			bool overtaken; // The medium priority thread finished before the high priority one got the mutex
+		};
+
+		void Run(Result &result);
+		typedef Benchmark::Runner<Result, &Run> Runner;
+	}
+}
+
+#endif /* _OS_INVERSION_H_ */
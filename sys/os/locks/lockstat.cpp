@@ -0,0 +1,281 @@
+//
+//  lockstat.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libcpp/atomic.h>
+#include <libc/sys/spinlock.h>
+#include <machine/cpu.h>
+#include "lockstat.h"
+
+#if CONFIG_LOCKSTAT
+// Called by spinlock.S, so they must never take a spinlock themselves
+extern "C" void spinlock_stat_acquired(spinlock_t *lock, void *address, uint32_t spins);
+extern "C" void spinlock_stat_released(spinlock_t *lock);
+#endif
+
+namespace OS
+{
+	namespace LockStat
+	{
+#if CONFIG_LOCKSTAT
+		static constexpr size_t kLockStatSites = 512; // Has to be a power of two
+		static constexpr size_t kLockStatDepth = 16; // Spinlocks per CPU that are tracked for their hold time
+
+		struct SiteEntry
+		{
+			std::atomic<uintptr_t> address;
+			std::atomic<uint64_t> acquisitions;
+			std::atomic<uint64_t> contentions;
+			std::atomic<uint64_t> spins;
+			std::atomic<uint64_t> maxHoldCycles;
+		};
+
+		struct HeldLock
+		{
+			spinlock_t *lock;
+			SiteEntry *site;
+			uint64_t acquired;
+		};
+
+		// Only ever touched by its own CPU with interrupts disabled
+		struct CPUState
+		{
+			size_t depth;
+			HeldLock locks[kLockStatDepth];
+		};
+
+		static SiteEntry _sites[kLockStatSites];
+		static CPUState _cpuStates[CONFIG_MAX_CPUS];
+		static std::atomic<bool> _recording(false);
+
+		static inline uint32_t SaveInterrupts()
+		{
+			uint32_t flags;
+			__asm__ volatile("pushf; popl %0; cli" : "=r" (flags) : : "memory");
+
+			return flags;
+		}
+		static inline void RestoreInterrupts(uint32_t flags)
+		{
+			__asm__ volatile("pushl %0; popf" : : "r" (flags) : "memory", "cc");
+		}
+
+		// The table is never shrunk, so a site keeps its entry once it has one
+		static SiteEntry *FindSite(uintptr_t address)
+		{
+			size_t index = ((address >> 2) * 2654435761u) & (kLockStatSites - 1);
+
+			for(size_t i = 0; i < kLockStatSites; i ++)
+			{
+				SiteEntry *entry = &_sites[(index + i) & (kLockStatSites - 1)];
+				uintptr_t expected = entry->address.load(std::memory_order_relaxed);
+
+				if(expected == 0 && entry->address.compare_exchange(expected, address))
+					return entry;
+				if(expected == address)
+					return entry;
+			}
+
+			return nullptr;
+		}
+
+		static void RemoveHeldLock(CPUState &state, size_t index)
+		{
+			for(size_t i = index + 1; i < state.depth; i ++)
+				state.locks[i - 1] = state.locks[i];
+
+			state.depth --;
+		}
+
+		// Returns the depth if the lock isn't held
+		static size_t FindHeldLock(CPUState &state, spinlock_t *lock)
+		{
+			for(size_t i = state.depth; i > 0; i --)
+			{
+				if(state.locks[i - 1].lock == lock)
+					return i - 1;
+			}
+
+			return state.depth;
+		}
+
+		bool IsAvailable()
+		{
+			return true;
+		}
+		bool IsRecording()
+		{
+			return _recording.load(std::memory_order_relaxed);
+		}
+
+		KernReturn<void> Start()
+		{
+			if(_recording.load())
+				return ErrorNone;
+
+			// Locks taken before recording started are unknown, their releases are ignored
+			for(size_t i = 0; i < CONFIG_MAX_CPUS; i ++)
+				_cpuStates[i].depth = 0;
+
+			_recording.store(true);
+			return ErrorNone;
+		}
+		void Stop()
+		{
+			_recording.store(false);
+		}
+		void Reset()
+		{
+			for(size_t i = 0; i < kLockStatSites; i ++)
+			{
+				_sites[i].acquisitions.store(0, std::memory_order_relaxed);
+				_sites[i].contentions.store(0, std::memory_order_relaxed);
+				_sites[i].spins.store(0, std::memory_order_relaxed);
+				_sites[i].maxHoldCycles.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		size_t GetSites(Site *sites, size_t count)
+		{
+			size_t found = 0;
+
+			for(size_t i = 0; i < kLockStatSites; i ++)
+			{
+				SiteEntry &entry = _sites[i];
+
+				Site site;
+				site.address = entry.address.load(std::memory_order_relaxed);
+				site.acquisitions = entry.acquisitions.load(std::memory_order_relaxed);
+				site.contentions = entry.contentions.load(std::memory_order_relaxed);
+				site.spins = entry.spins.load(std::memory_order_relaxed);
+				site.maxHoldCycles = entry.maxHoldCycles.load(std::memory_order_relaxed);
+
+				if(site.address == 0 || site.acquisitions == 0)
+					continue;
+
+				// Insertion sort, the most spins first
+				size_t index = found;
+
+				while(index > 0 && sites[index - 1].spins < site.spins)
+				{
+					if(index < count)
+						sites[index] = sites[index - 1];
+
+					index --;
+				}
+
+				if(index < count)
+					sites[index] = site;
+
+				if(found < count)
+					found ++;
+			}
+
+			return found;
+		}
+#else
+		bool IsAvailable()
+		{
+			return false;
+		}
+		bool IsRecording()
+		{
+			return false;
+		}
+
+		KernReturn<void> Start()
+		{
+			return Error(KERN_UNSUPPORTED);
+		}
+		void Stop()
+		{}
+		void Reset()
+		{}
+
+		size_t GetSites(__unused Site *sites, __unused size_t count)
+		{
+			return 0;
+		}
+#endif
+	}
+}
+
+#if CONFIG_LOCKSTAT
+void spinlock_stat_acquired(spinlock_t *lock, void *address, uint32_t spins)
+{
+	using namespace OS::LockStat;
+
+	if(!_recording.load(std::memory_order_relaxed))
+		return;
+
+	SiteEntry *site = FindSite(reinterpret_cast<uintptr_t>(address));
+	if(!site)
+		return;
+
+	site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+	if(spins)
+	{
+		site->contentions.fetch_add(1, std::memory_order_relaxed);
+		site->spins.fetch_add(spins, std::memory_order_relaxed);
+	}
+
+	uint32_t flags = SaveInterrupts();
+	CPUState &state = _cpuStates[Sys::CPU::GetCurrentCPU()->GetID()];
+
+	// Still there if it was released on another CPU, the oldest entry goes if there is no room
+	size_t index = FindHeldLock(state, lock);
+	if(index < state.depth)
+		RemoveHeldLock(state, index);
+	if(state.depth == kLockStatDepth)
+		RemoveHeldLock(state, 0);
+
+	HeldLock &held = state.locks[state.depth ++];
+	held.lock = lock;
+	held.site = site;
+	held.acquired = Sys::CPUReadTimestamp();
+
+	RestoreInterrupts(flags);
+}
+
+void spinlock_stat_released(spinlock_t *lock)
+{
+	using namespace OS::LockStat;
+
+	if(!_recording.load(std::memory_order_relaxed))
+		return;
+
+	uint32_t flags = SaveInterrupts();
+	CPUState &state = _cpuStates[Sys::CPU::GetCurrentCPU()->GetID()];
+
+	size_t index = FindHeldLock(state, lock);
+	if(index < state.depth)
+	{
+		HeldLock &held = state.locks[index];
+
+		uint64_t hold = Sys::CPUReadTimestamp() - held.acquired;
+		uint64_t max = held.site->maxHoldCycles.load(std::memory_order_relaxed);
+
+		while(hold > max && !held.site->maxHoldCycles.compare_exchange(max, hold, std::memory_order_relaxed))
+		{}
+
+		RemoveHeldLock(state, index);
+	}
+
+	RestoreInterrupts(flags);
+}
+#endif
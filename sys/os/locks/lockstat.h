@@ -0,0 +1,59 @@
+//
+//  lockstat.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_LOCKSTAT_H_
+#define _OS_LOCKSTAT_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libc/stddef.h>
+#include <kern/kern_return.h>
+
+namespace OS
+{
+	/**
+	 * Spinlock statistics per lock site, the address spinlock_lock() or spinlock_try_lock() was
+	 * called from. Only available when the kernel is built with CONFIG_LOCKSTAT, which makes every
+	 * spinlock operation report to it. Even then nothing is recorded until it's started by writing
+	 * "start" to /dev/lockstat, which also shows the most contended sites.
+	 **/
+	namespace LockStat
+	{
+		// All times are in TSC cycles
+		struct Site
+		{
+			uintptr_t address;
+			uint64_t acquisitions;
+			uint64_t contentions; // Acquisitions that had to spin
+			uint64_t spins; // Pauses while waiting for the lock
+			uint64_t maxHoldCycles;
+		};
+
+		bool IsAvailable();
+		bool IsRecording();
+
+		KernReturn<void> Start(); // Fails with KERN_UNSUPPORTED without CONFIG_LOCKSTAT
+		void Stop();
+		void Reset();
+
+		// Copies up to count sites, the ones with the most spins first. Returns the number of sites copied
+		size_t GetSites(Site *sites, size_t count);
+	}
+}
+
+#endif /* _OS_LOCKSTAT_H_ */
@@ -16,28 +16,157 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <os/waitqueue.h>
+#include <libcpp/algorithm.h>
 #include <os/scheduler/scheduler.h>
+#include <os/scheduler/preempt.h>
 #include <machine/interrupts/interrupts.h>
+#include <os/workqueue.h>
 
 #include "mutex.h"
 
 namespace OS
 {
+	static constexpr size_t kMutexSpinCount = 100; // Pauses between checks whether the owner is still running
+	static constexpr size_t kMutexInheritanceDepth = 16; // Also stops the propagation from looping in a deadlock
+
+	static Mutex *_namedMutexes = nullptr;
+	static spinlock_t _namedLock = SPINLOCK_INIT;
+
+	// Nests inside the wait lock of a mutex, every change to a waiter list also holds it
+	static spinlock_t _inheritanceLock = SPINLOCK_INIT;
+
+	struct Mutex::Waiter
+	{
+		Waiter(Thread *tthread) :
+			thread(tthread),
+			granted(false),
+			entry(this)
+		{}
+
+		Thread *thread;
+		std::atomic<bool> granted; // Set once the mutex was handed over, the waiter is gone right after
+		std::intrusive_list<Waiter>::member entry;
+	};
+
+	Mutex::Mutex(const char *name) :
+		_state(Unlocked),
+		_owner(nullptr),
+		_lockMode(Mode::Simple),
+		_wasEnabled(false),
+		_waitLock(SPINLOCK_INIT),
+		_contendedOwner(nullptr),
+		_contendedEntry(this),
+		_name(name),
+		_nextNamed(nullptr),
+		_acquired(0),
+		_statistics()
+	{
+		if(_name)
+		{
+			spinlock_lock(&_namedLock);
+			_nextNamed = _namedMutexes;
+			_namedMutexes = this;
+			spinlock_unlock(&_namedLock);
+		}
+	}
+
+	Mutex::~Mutex()
+	{
+		if(_state.load() != Unlocked)
+			panic("Mutex destructor called while mutex is locked");
+
+		if(_name)
+		{
+			spinlock_lock(&_namedLock);
+
+			Mutex **link = &_namedMutexes;
+			while(*link && *link != this)
+				link = &(*link)->_nextNamed;
+
+			if(*link)
+				*link = _nextNamed;
+
+			spinlock_unlock(&_namedLock);
+		}
+	}
+
 	void Mutex::Unlock()
 	{
-		_owned.store(false, std::memory_order_release);
+		uint64_t held = Sys::CPUReadTimestamp() - _acquired;
 
-		switch(_lockMode)
+		_statistics.holdCycles += held;
+		if(held > _statistics.maxHoldCycles)
+			_statistics.maxHoldCycles = held;
+
+		// The next owner overwrites these as soon as the mutex is released
+		Mode mode = _lockMode;
+		bool wasEnabled = _wasEnabled;
+
+		_owner.store(nullptr, std::memory_order_relaxed);
+
+		uint32_t expected = Locked;
+		if(!_state.compare_exchange(expected, Unlocked))
+		{
+			// Contended, hand the mutex over to the longest sleeping waiter
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_waitLock);
+			spinlock_lock(&_inheritanceLock);
+
+			Thread *previous = _contendedOwner;
+			SetContendedOwner(nullptr);
+
+			std::intrusive_list<Waiter>::member *first = _waiters.head();
+			Thread *thread = nullptr;
+
+			if(first)
+			{
+				Waiter *waiter = first->get();
+				_waiters.erase(first);
+
+				thread = waiter->thread;
+				thread->_blockingMutex = nullptr;
+
+				if(_waiters.empty())
+					_state.store(Locked, std::memory_order_relaxed);
+				else
+					SetContendedOwner(thread);
+
+				_owner.store(thread, std::memory_order_relaxed);
+			}
+			else
+			{
+				_state.store(Unlocked, std::memory_order_release);
+			}
+
+			// The previous owner drops what it inherited through this mutex, the new one picks up the remaining waiters
+			if(previous)
+				PropagatePriority(previous);
+			if(thread)
+				PropagatePriority(thread);
+
+			spinlock_unlock(&_inheritanceLock);
+
+			if(first)
+				first->get()->granted.store(true, std::memory_order_release);
+
+			spinlock_unlock(&_waitLock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+
+			if(thread)
+				Scheduler::GetScheduler()->UnblockThread(thread);
+		}
+
+		switch(mode)
 		{
 			case Mode::Simple:
 				break;
 			case Mode::NoScheduler:
-				if(_wasEnabled)
-					Scheduler::GetScheduler()->EnableCPU(nullptr); // todo: Maybe keep track of the disabled CPU?!
+				Preempt::Enable();
 				break;
 			case Mode::NoInterrupts:
-				if(_wasEnabled)
+				if(wasEnabled)
 					Sys::EnableInterrupts();
 				break;
 		}
@@ -48,39 +177,256 @@ namespace OS
 		if(TryLock(mode))
 			return;
 
+		uint64_t start = Sys::CPUReadTimestamp();
+
 		while(1)
 		{
-			for(size_t i = 0; i < 10000; i ++)
+			for(size_t i = 0; i < kMutexSpinCount; i ++)
 			{
-				if(TryLock(mode))
+				uint32_t expected = Unlocked;
+
+				if(_state.load(std::memory_order_relaxed) == Unlocked && _state.compare_exchange(expected, Locked, std::memory_order_acquire))
+				{
+					Acquired(mode, start, false);
 					return;
+				}
 
 				Sys::CPUPause();
 			}
+
+			if(!CanSleep())
+				continue;
+
+			// An owner that is running is probably about to release the mutex again
+			Thread *owner = _owner.load(std::memory_order_relaxed);
+			if(owner && Scheduler::GetScheduler()->IsThreadRunning(owner))
+				continue;
+
+			bool slept = Sleep();
+			Acquired(mode, start, slept);
+
+			return;
 		}
 	}
 
 	bool Mutex::TryLock(Mode mode)
 	{
-		bool expected = false;
-		if(_owned.compare_exchange(expected, true, std::memory_order_release))
+		uint32_t expected = Unlocked;
+		if(_state.compare_exchange(expected, Locked, std::memory_order_acquire))
+		{
+			Acquired(mode, 0, false);
+			return true;
+		}
+
+		return false;
+	}
+
+	void Mutex::GetStatistics(Statistics *statistics) const
+	{
+		*statistics = _statistics;
+	}
+
+	void Mutex::EnumerateNamed(void (*callback)(const Mutex *mutex, void *context), void *context)
+	{
+		spinlock_lock(&_namedLock);
+
+		for(Mutex *mutex = _namedMutexes; mutex; mutex = mutex->_nextNamed)
+			callback(mutex, context);
+
+		spinlock_unlock(&_namedLock);
+	}
+
+
+	bool Mutex::CanSleep()
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+		if(!scheduler)
+			return false;
+
+		if(!Sys::CPUInterruptsEnabled() || !Sys::CPU::GetCurrentCPU()->GetFlagsSet(Sys::CPU::Flags::WaitQueueEnabled))
+			return false;
+
+		return (scheduler->GetActiveThread() != nullptr);
+	}
+
+	// Returns with the mutex acquired, and whether the thread had to sleep for it
+	bool Mutex::Sleep()
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+		Thread *thread = scheduler->GetActiveThread();
+
+		Sys::CPU::GetCurrentCPU()->GetWorkQueue()->WorkerWillSleep(thread);
+
+		Waiter waiter(thread);
+
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_waitLock);
+
+		// Unlocking a contended mutex takes the wait lock, so it either finds this waiter or the mutex is free by now
+		uint32_t state = _state.load(std::memory_order_relaxed);
+
+		while(1)
+		{
+			if(state == Unlocked)
+			{
+				if(_state.compare_exchange(state, Locked, std::memory_order_acquire))
+				{
+					spinlock_unlock(&_waitLock);
+
+					if(enabled)
+						Sys::EnableInterrupts();
+
+					return false;
+				}
+
+				continue;
+			}
+
+			if(state == Contended || _state.compare_exchange(state, Contended, std::memory_order_relaxed))
+				break;
+		}
+
+		spinlock_lock(&_inheritanceLock);
+
+		_waiters.push_back(waiter.entry);
+		thread->_blockingMutex = this;
+
+		// The owner might not have published itself yet, in which case it picks up the waiters in Acquired()
+		Thread *owner = _owner.load(std::memory_order_relaxed);
+		if(owner)
+		{
+			SetContendedOwner(owner);
+			PropagatePriority(owner);
+		}
+
+		spinlock_unlock(&_inheritanceLock);
+
+		scheduler->BlockThread(thread);
+
+		spinlock_unlock(&_waitLock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU());
+
+		// The reschedule IPI might not have arrived yet
+		while(!waiter.granted.load(std::memory_order_acquire))
+			Sys::CPUPause();
+
+		return true;
+	}
+
+	void Mutex::Acquired(Mode mode, uint64_t start, bool slept)
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+		Thread *owner = scheduler ? scheduler->GetActiveThread() : nullptr;
+
+		// Full barrier, threads that went to sleep before the owner was known have to be found here
+		_owner.exchange(owner);
+
+		if(owner && !slept && _state.load() == Contended)
 		{
-			_lockMode = mode;
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_waitLock);
+			spinlock_lock(&_inheritanceLock);
 
-			switch(_lockMode)
+			if(!_waiters.empty() && _contendedOwner != owner)
 			{
-				case Mode::Simple:
-					break;
-				case Mode::NoScheduler:
-					_wasEnabled = Scheduler::GetScheduler()->DisableCPU(nullptr);
-				case Mode::NoInterrupts:
-					_wasEnabled = Sys::DisableInterrupts();
-					break;
+				SetContendedOwner(owner);
+				PropagatePriority(owner);
 			}
 
-			return true;
+			spinlock_unlock(&_inheritanceLock);
+			spinlock_unlock(&_waitLock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
 		}
 
-		return false;
+		_lockMode = mode;
+
+		switch(_lockMode)
+		{
+			case Mode::Simple:
+				break;
+			case Mode::NoScheduler:
+				Preempt::Disable();
+				break;
+			case Mode::NoInterrupts:
+				_wasEnabled = Sys::DisableInterrupts();
+				break;
+		}
+
+		_acquired = Sys::CPUReadTimestamp();
+		_statistics.acquisitions ++;
+
+		if(start)
+		{
+			uint64_t waited = _acquired - start;
+
+			_statistics.contentions ++;
+			_statistics.waitCycles += waited;
+
+			if(waited > _statistics.maxWaitCycles)
+				_statistics.maxWaitCycles = waited;
+
+			if(slept)
+				_statistics.sleeps ++;
+		}
+	}
+
+	// Called with the inheritance lock held
+	uint32_t Mutex::GetWaiterPriority() const
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+		uint32_t priority = Thread::kNoInheritedPriority;
+
+		for(std::intrusive_list<Waiter>::member *entry = _waiters.head(); entry; entry = entry->next())
+		{
+			Thread *thread = entry->get()->thread;
+
+			priority = std::min(priority, scheduler->GetThreadPriority(thread));
+			priority = std::min(priority, thread->GetInheritedPriority());
+		}
+
+		return priority;
+	}
+
+	void Mutex::SetContendedOwner(Thread *owner)
+	{
+		if(_contendedOwner == owner)
+			return;
+
+		if(_contendedOwner)
+			_contendedOwner->_contendedMutexes.erase(_contendedEntry);
+		if(owner)
+			owner->_contendedMutexes.push_back(_contendedEntry);
+
+		_contendedOwner = owner;
+	}
+
+	// Recalculates the priority the thread inherits from its contended mutexes. A change is passed on to the
+	// owner of the mutex the thread is blocked on, and so forth. Called with the inheritance lock held
+	void Mutex::PropagatePriority(Thread *thread)
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+
+		for(size_t i = 0; thread && i < kMutexInheritanceDepth; i ++)
+		{
+			uint32_t priority = Thread::kNoInheritedPriority;
+
+			for(std::intrusive_list<Mutex>::member *entry = thread->_contendedMutexes.head(); entry; entry = entry->next())
+				priority = std::min(priority, entry->get()->GetWaiterPriority());
+
+			if(priority == thread->_inheritedPriority.load(std::memory_order_relaxed))
+				return;
+
+			thread->_inheritedPriority.store(priority, std::memory_order_release);
+			scheduler->UpdateInheritedPriority(thread);
+
+			Mutex *mutex = thread->_blockingMutex;
+			thread = mutex ? mutex->_contendedOwner : nullptr;
+		}
 	}
 }
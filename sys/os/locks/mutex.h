@@ -21,41 +21,101 @@
 
 #include <prefix.h>
 #include <libc/stdint.h>
+#include <libc/sys/spinlock.h>
 #include <libcpp/atomic.h>
+#include <libcpp/intrusive_list.h>
 #include <kern/kprintf.h>
 #include <machine/cpu.h>
 #include <kern/panic.h>
 
 namespace OS
 {
+	class Thread;
+
+	/**
+	 * Adaptive mutex. Contending threads spin as long as the owner is running on another CPU,
+	 * and sleep in a FIFO queue once it isn't. Unlocking hands the mutex directly to the first
+	 * sleeping thread, so it can't be taken away by a spinning thread in the meantime.
+	 *
+	 * Sleeping requires a thread context with interrupts and the waitqueue enabled, everywhere
+	 * else contending threads keep spinning. Named mutexes show up in /dev/mutexes.
+	 *
+	 * The owner of a mutex with sleeping waiters inherits the priority of the most important one,
+	 * transitively through the mutexes the owner itself is blocked on, until it unlocks.
+	 **/
 	class Mutex
 	{
 	public:
 		enum class Mode
 		{
 			Simple, // Only locks the mutex
-			NoScheduler, // Locks the mutex and disables the scheduler
+			NoScheduler, // Locks the mutex and disables preemption on the CPU
 			NoInterrupts // Locks the mutex and disables interrupts
 		};
 
-		Mutex() :
-			_owned(false)
-		{}
-
-		~Mutex()
+		// All times are in TSC cycles
+		struct Statistics
 		{
-			if(_owned.load())
-				panic("Mutex destructor called while mutex is locked");
-		}
+			uint64_t acquisitions;
+			uint64_t contentions; // Acquisitions that had to wait for the owner
+			uint64_t sleeps; // Contentions that ended up sleeping
+			uint64_t holdCycles;
+			uint64_t maxHoldCycles;
+			uint64_t waitCycles;
+			uint64_t maxWaitCycles;
+		};
+
+		Mutex(const char *name = nullptr);
+		~Mutex();
 
 		void Unlock();
 		void Lock(Mode mode = Mode::Simple);
 		bool TryLock(Mode mode);
 
+		const char *GetName() const { return _name; }
+		Thread *GetOwner() const { return _owner.load(std::memory_order_relaxed); }
+		void GetStatistics(Statistics *statistics) const;
+
+		// Whether the current context can sleep, which needs a thread with interrupts and the waitqueue enabled
+		static bool CanSleep();
+
+		// Calls the callback for every named mutex, which must not lock or create mutexes itself
+		static void EnumerateNamed(void (*callback)(const Mutex *mutex, void *context), void *context);
+
 	private:
-		std::atomic<bool> _owned;
+		struct Waiter;
+
+		enum State : uint32_t
+		{
+			Unlocked,
+			Locked,
+			Contended // Locked with threads sleeping on it
+		};
+
+		bool Sleep();
+		void Acquired(Mode mode, uint64_t start, bool slept);
+
+		uint32_t GetWaiterPriority() const;
+		void SetContendedOwner(Thread *owner);
+		static void PropagatePriority(Thread *thread);
+
+		std::atomic<uint32_t> _state;
+		std::atomic<Thread *> _owner;
 		Mode _lockMode;
 		bool _wasEnabled;
+
+		spinlock_t _waitLock;
+		std::intrusive_list<Waiter> _waiters;
+
+		// Protected by the inheritance lock
+		Thread *_contendedOwner; // Owner that inherits priority from the waiters
+		std::intrusive_list<Mutex>::member _contendedEntry;
+
+		const char *_name;
+		Mutex *_nextNamed;
+
+		uint64_t _acquired;
+		Statistics _statistics;
 	};
 }
 
@@ -0,0 +1,140 @@
+//
+//  rwbenchmark.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/sys/spinlock.h>
+#include <machine/cpu.h>
+#include "rwspinlock.h"
+#include "rwlock.h"
+#include "seqlock.h"
+#include "rwbenchmark.h"
+
+namespace OS
+{
+	namespace RWBenchmark
+	{
+		static constexpr size_t kIterations = 20000;
+		static constexpr size_t kCPUs[kSteps] = { 1, 2, 4 };
+
+		static uint64_t _cycles[CONFIG_MAX_CPUS];
+		static Lock _lock;
+
+		// The data all workers read
+		static uint64_t _value = 0;
+		static spinlock_t _spinlock = SPINLOCK_INIT;
+		static RWSpinLock _rwSpinLock;
+		static RWLock _rwLock;
+		static SeqLock _seqLock;
+
+		static uint64_t Read()
+		{
+			volatile uint64_t *value = &_value;
+			uint64_t result = 0;
+
+			switch(_lock)
+			{
+				case Lock::Spinlock:
+					spinlock_lock(&_spinlock);
+					result = *value;
+					spinlock_unlock(&_spinlock);
+					break;
+				case Lock::RWSpinLock:
+					_rwSpinLock.ReadLock();
+					result = *value;
+					_rwSpinLock.ReadUnlock();
+					break;
+				case Lock::RWLock:
+					_rwLock.ReadLock();
+					result = *value;
+					_rwLock.ReadUnlock();
+					break;
+				case Lock::SeqLock:
+				{
+					uint32_t sequence;
+
+					do {
+						sequence = _seqLock.ReadBegin();
+						result = *value;
+					} while(_seqLock.ReadRetry(sequence));
+					break;
+				}
+				case Lock::__Count:
+					break;
+			}
+
+			return result;
+		}
+
+		static void WorkerThread()
+		{
+			uint64_t *cycles = &_cycles[Benchmark::Begin()];
+			uint64_t start = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+				Read();
+
+			*cycles = Sys::CPUReadTimestamp() - start;
+
+			Benchmark::Finish();
+		}
+
+		static uint32_t Average(size_t workers)
+		{
+			uint64_t cycles = 0;
+
+			for(size_t i = 0; i < workers; i ++)
+				cycles += _cycles[i];
+
+			return workers ? static_cast<uint32_t>(cycles / (workers * kIterations)) : 0;
+		}
+
+		void Run(Result &result)
+		{
+			for(size_t step = 0; step < kSteps; step ++)
+			{
+				for(size_t lock = 0; lock < static_cast<size_t>(Lock::__Count); lock ++)
+				{
+					_lock = static_cast<Lock>(lock);
+
+					size_t workers = Benchmark::RunParallel(&WorkerThread, kCPUs[step]);
+
+					result.cpus[step] = workers;
+					result.cycles[step][lock] = Average(workers);
+				}
+			}
+		}
+
+		const char *GetLockName(Lock lock)
+		{
+			switch(lock)
+			{
+				case Lock::Spinlock:
+					return "spinlock";
+				case Lock::RWSpinLock:
+					return "rw spinlock";
+				case Lock::RWLock:
+					return "rwlock";
+				case Lock::SeqLock:
+					return "seqlock";
+				case Lock::__Count:
+					break;
+			}
+
+			return "unknown";
+		}
+	}
+}
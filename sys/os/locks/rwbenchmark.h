@@ -0,0 +1,60 @@
+//
+//  rwbenchmark.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_RWBENCHMARK_H_
+#define _OS_RWBENCHMARK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <os/benchmark.h>
+
+namespace OS
+{
+	/**
+	 * Measures how well read-side critical sections scale, with 1, 2 and 4 CPUs reading the same
+	 * value at once. A plain spinlock serves as the baseline that doesn't scale at all. Started by
+	 * writing "benchmark" to /dev/locks, which also shows the result.
+	 **/
+	namespace RWBenchmark
+	{
+		enum class Lock
+		{
+			Spinlock,
+			RWSpinLock,
+			RWLock,
+			SeqLock,
+			__Count
+		};
+
+		static constexpr size_t kSteps = 3; // 1, 2 and 4 CPUs
+
+		// Average TSC cycles per read
+		struct Result
+		{
+			uint32_t cpus[kSteps]; // Might be less than asked for on smaller machines
+			uint32_t cycles[kSteps][static_cast<size_t>(Lock::__Count)];
+		};
+
+		void Run(Result &result);
+		typedef Benchmark::Runner<Result, &Run> Runner;
+
+		const char *GetLockName(Lock lock);
+	}
+}
+
+#endif /* _OS_RWBENCHMARK_H_ */
@@ -0,0 +1,142 @@
+//
+//  rwlock.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <os/scheduler/scheduler.h>
+#include <machine/interrupts/interrupts.h>
+#include <os/workqueue.h>
+
+#include "rwlock.h"
+
+namespace OS
+{
+	static constexpr size_t kRWLockSpinCount = 100; // Pauses before a writer sleeps until the readers are gone
+
+	RWLock::RWLock(const char *name) :
+		_state(0),
+		_mutex(name),
+		_drainLock(SPINLOCK_INIT),
+		_drainer(nullptr),
+		_drained(false)
+	{}
+
+	void RWLock::ReadLock()
+	{
+		if(!(_state.fetch_add(1) & kWriter))
+			return;
+
+		// A writer got here first, back out and queue up behind it
+		ReadUnlock();
+
+		_mutex.Lock();
+		_state.fetch_add(1);
+		_mutex.Unlock();
+	}
+
+	void RWLock::ReadUnlock()
+	{
+		if(_state.fetch_sub(1) != (kWriter + 1))
+			return;
+
+		// Last reader out with a writer waiting
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_drainLock);
+
+		Thread *thread = _drainer;
+		_drainer = nullptr;
+
+		if(thread)
+			_drained.store(true, std::memory_order_release);
+
+		spinlock_unlock(&_drainLock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		if(thread)
+			Scheduler::GetScheduler()->UnblockThread(thread);
+	}
+
+	void RWLock::WriteLock()
+	{
+		_mutex.Lock();
+
+		if(_state.fetch_or(kWriter) != 0)
+			DrainReaders();
+	}
+
+	void RWLock::WriteUnlock()
+	{
+		_state.fetch_and(~kWriter);
+		_mutex.Unlock();
+	}
+
+
+	void RWLock::DrainReaders()
+	{
+		while(1)
+		{
+			for(size_t i = 0; i < kRWLockSpinCount; i ++)
+			{
+				if(_state.load(std::memory_order_acquire) == kWriter)
+					return;
+
+				Sys::CPUPause();
+			}
+
+			if(!Mutex::CanSleep())
+				continue;
+
+			Scheduler *scheduler = Scheduler::GetScheduler();
+			Thread *thread = scheduler->GetActiveThread();
+
+			Sys::CPU::GetCurrentCPU()->GetWorkQueue()->WorkerWillSleep(thread);
+
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_drainLock);
+
+			// The last reader decrements before taking the drain lock, so it either shows up here or finds the drainer
+			if(_state.load() == kWriter)
+			{
+				spinlock_unlock(&_drainLock);
+
+				if(enabled)
+					Sys::EnableInterrupts();
+
+				return;
+			}
+
+			_drainer = thread;
+			_drained.store(false, std::memory_order_relaxed);
+
+			scheduler->BlockThread(thread);
+
+			spinlock_unlock(&_drainLock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+
+			scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU());
+
+			// The reschedule IPI might not have arrived yet
+			while(!_drained.load(std::memory_order_acquire))
+				Sys::CPUPause();
+
+			return;
+		}
+	}
+}
@@ -0,0 +1,65 @@
+//
+//  rwlock.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_RWLOCK_H_
+#define _OS_RWLOCK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libc/sys/spinlock.h>
+#include <libcpp/atomic.h>
+#include "mutex.h"
+
+namespace OS
+{
+	class Thread;
+
+	/**
+	 * Sleeping reader-writer lock. Readers only increment a counter as long as no writer is around,
+	 * writers serialize on an adaptive mutex and then wait for the readers inside to drain. Readers
+	 * that show up while a writer holds or waits for the lock queue up on the same mutex, so they
+	 * sleep in FIFO order behind it and the writer inherits their priority.
+	 *
+	 * The embedded mutex carries the name, so named locks show up in /dev/mutexes.
+	 **/
+	class RWLock
+	{
+	public:
+		RWLock(const char *name = nullptr);
+
+		void ReadLock();
+		void ReadUnlock();
+
+		void WriteLock();
+		void WriteUnlock();
+
+	private:
+		static constexpr uint32_t kWriter = (1 << 31);
+
+		void DrainReaders();
+
+		std::atomic<uint32_t> _state; // Reader count and the writer bit
+		Mutex _mutex;
+
+		spinlock_t _drainLock;
+		Thread *_drainer; // Writer sleeping until the last reader leaves
+		std::atomic<bool> _drained;
+	};
+}
+
+#endif /* _OS_RWLOCK_H_ */
@@ -0,0 +1,98 @@
+//
+//  rwspinlock.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_RWSPINLOCK_H_
+#define _OS_RWSPINLOCK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libcpp/atomic.h>
+#include <machine/cpu.h>
+
+namespace OS
+{
+	/**
+	 * Fair reader-writer spinlock. Everyone draws a ticket and is served in order, consecutive
+	 * readers share the lock while a writer waits for all readers ahead of it and keeps every later
+	 * ticket out. Neither side can starve the other, unlike reader preferring locks.
+	 *
+	 * Like spinlock_t it doesn't touch interrupts, code that also runs in interrupt context has to
+	 * disable them around it.
+	 **/
+	class RWSpinLock
+	{
+	public:
+		RWSpinLock() :
+			_ticket(0),
+			_read(0),
+			_write(0)
+		{}
+
+		void ReadLock()
+		{
+			uint32_t ticket = _ticket.fetch_add(1, std::memory_order_relaxed);
+
+			while(_read.load(std::memory_order_acquire) != ticket)
+				Sys::CPUPause();
+
+			// Let the next ticket in right away if it's another reader
+			_read.store(ticket + 1, std::memory_order_release);
+		}
+		void ReadUnlock()
+		{
+			_write.fetch_add(1, std::memory_order_release);
+		}
+
+		void WriteLock()
+		{
+			uint32_t ticket = _ticket.fetch_add(1, std::memory_order_relaxed);
+
+			while(_write.load(std::memory_order_acquire) != ticket)
+				Sys::CPUPause();
+		}
+		void WriteUnlock()
+		{
+			// No one else can touch the counters while the writer holds the lock
+			_read.store(_read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			_write.store(_write.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		bool TryReadLock()
+		{
+			uint32_t ticket = _read.load(std::memory_order_relaxed);
+
+			if(!_ticket.compare_exchange(ticket, ticket + 1, std::memory_order_acquire))
+				return false;
+
+			_read.store(ticket + 1, std::memory_order_release);
+			return true;
+		}
+		bool TryWriteLock()
+		{
+			uint32_t ticket = _write.load(std::memory_order_relaxed);
+			return _ticket.compare_exchange(ticket, ticket + 1, std::memory_order_acquire);
+		}
+
+	private:
+		std::atomic<uint32_t> _ticket; // Next ticket to hand out
+		std::atomic<uint32_t> _read; // Ticket that may take the lock for reading
+		std::atomic<uint32_t> _write; // Ticket that may take the lock for writing
+	};
+}
+
+#endif /* _OS_RWSPINLOCK_H_ */
@@ -0,0 +1,81 @@
+//
+//  seqlock.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _OS_SEQLOCK_H_
+#define _OS_SEQLOCK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libcpp/atomic.h>
+#include <machine/cpu.h>
+
+namespace OS
+{
+	/**
+	 * Sequence lock for small, hot values that are read far more often than written, like the
+	 * time base or statistics counters. Readers never write to shared memory, they copy the data
+	 * and retry if a writer was active in the meantime:
+	 *
+	 *     uint32_t sequence;
+	 *     do {
+	 *         sequence = lock.ReadBegin();
+	 *         copy = data;
+	 *     } while(lock.ReadRetry(sequence));
+	 *
+	 * Writers have to be serialized by the caller and must not be interrupted by a reader on the
+	 * same CPU, which would spin forever. The data is only ever copied, never dereferenced.
+	 **/
+	class SeqLock
+	{
+	public:
+		SeqLock() :
+			_sequence(0)
+		{}
+
+		uint32_t ReadBegin() const
+		{
+			uint32_t sequence;
+
+			// An odd sequence means a write is in progress
+			while((sequence = _sequence.load(std::memory_order_acquire)) & 1)
+				Sys::CPUPause();
+
+			return sequence;
+		}
+		bool ReadRetry(uint32_t sequence) const
+		{
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			return (_sequence.load(std::memory_order_relaxed) != sequence);
+		}
+
+		void WriteBegin()
+		{
+			_sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+		}
+		void WriteEnd()
+		{
+			_sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		std::atomic<uint32_t> _sequence;
+	};
+}
+
+#endif /* _OS_SEQLOCK_H_ */
@@ -0,0 +1,213 @@
+//
+//  rcu.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/sys/spinlock.h>
+#include <os/scheduler/scheduler.h>
+#include <os/waitqueue.h>
+#include "rcu.h"
+
+namespace OS
+{
+	namespace RCU
+	{
+		static constexpr uint64_t kSynchronizeInterval = 1000; // Microseconds between checks for the end of the grace period
+
+		// Taken from the scheduler interrupt, so only ever with interrupts disabled
+		static spinlock_t _lock = SPINLOCK_INIT;
+
+		// Protected by the lock
+		static bool _inProgress = false;
+		static uint32_t _requested = 0; // Last grace period a Synchronize() is waiting for
+		static Entry *_current = nullptr; // Waiting for the grace period in progress
+		static Entry *_next = nullptr; // Unlinked after the grace period in progress started, wait for the one after it
+		static Entry *_ready = nullptr; // Done, but didn't fit into the work queue yet
+		static Statistics _statistics = { 0, 0, 0, 0 };
+
+		static std::atomic<uint32_t> _completed; // Number of grace periods so far
+		static std::atomic<uint32_t> _pendingCPUs; // CPUs that haven't passed a quiescent state in the grace period in progress
+
+		static bool IsBefore(uint32_t generation, uint32_t other)
+		{
+			return (static_cast<int32_t>(generation - other) < 0);
+		}
+
+		static void RunCallbacks(void *context)
+		{
+			Entry *entry = reinterpret_cast<Entry *>(context);
+
+			while(entry)
+			{
+				Entry *next = entry->next; // The callback usually frees the entry
+				entry->callback(entry->context);
+
+				entry = next;
+			}
+		}
+
+		static void FlushReady()
+		{
+			if(_ready && Sys::CPU::GetCurrentCPU()->GetWorkQueue()->PushEntry(&RunCallbacks, _ready))
+				_ready = nullptr;
+		}
+
+		static void StartGracePeriod()
+		{
+			uint32_t cpus = 0;
+			size_t count = Sys::CPU::GetCPUCount();
+
+			for(size_t i = 0; i < count; i ++)
+			{
+				if(Sys::CPU::GetCPUWithID(i)->GetFlags() & Sys::CPU::Flags::Running)
+					cpus |= (1 << i);
+			}
+
+			_inProgress = true;
+			_pendingCPUs.store(cpus); // Orders the unlinking before any quiescent state of the grace period
+
+			// Idle CPUs would otherwise sit in HLT or MWAIT without ever entering the scheduler
+			Scheduler *scheduler = Scheduler::GetScheduler();
+
+			for(size_t i = 0; i < count && scheduler; i ++)
+			{
+				if(cpus & (1 << i))
+				{
+					scheduler->RescheduleCPU(Sys::CPU::GetCPUWithID(i));
+					_statistics.kicks ++;
+				}
+			}
+		}
+
+		static void CompleteGracePeriod()
+		{
+			_inProgress = false;
+			_completed.fetch_add(1, std::memory_order_release);
+			_statistics.gracePeriods ++;
+
+			if(_current)
+			{
+				Entry *last = _current;
+				_statistics.callbacks ++;
+
+				while(last->next)
+				{
+					last = last->next;
+					_statistics.callbacks ++;
+				}
+
+				last->next = _ready;
+				_ready = _current;
+			}
+
+			_current = _next;
+			_next = nullptr;
+
+			if(_current || IsBefore(_completed.load(std::memory_order_relaxed), _requested))
+				StartGracePeriod();
+
+			FlushReady();
+		}
+
+
+		void Synchronize()
+		{
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_lock);
+
+			// A grace period that is already running might have started before the caller unlinked its object
+			uint32_t target = _completed.load(std::memory_order_relaxed) + (_inProgress ? 2 : 1);
+
+			if(IsBefore(_requested, target))
+				_requested = target;
+			if(!_inProgress)
+				StartGracePeriod();
+
+			_statistics.synchronizes ++;
+
+			spinlock_unlock(&_lock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+
+			while(IsBefore(_completed.load(std::memory_order_acquire), target))
+			{
+				// Syscall handlers can't sleep, their CPU still gets rescheduled by the interrupts
+				if(Sys::CPU::GetCurrentCPU()->GetFlagsSet(Sys::CPU::Flags::WaitQueueEnabled))
+					WaitWithTimeout(&_completed, kSynchronizeInterval);
+				else
+					Sys::CPUPause();
+			}
+		}
+
+		void Call(Entry *entry, Callback callback, void *context)
+		{
+			entry->callback = callback;
+			entry->context = context;
+
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_lock);
+
+			if(_inProgress)
+			{
+				entry->next = _next;
+				_next = entry;
+			}
+			else
+			{
+				entry->next = _current;
+				_current = entry;
+
+				StartGracePeriod();
+			}
+
+			FlushReady();
+			spinlock_unlock(&_lock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+		}
+
+		void QuiescentState(Sys::CPU *cpu)
+		{
+			uint32_t bit = (1 << cpu->GetID());
+
+			if(__expect_true(!(_pendingCPUs.load(std::memory_order_relaxed) & bit)))
+				return;
+
+			// The last CPU to report ends the grace period
+			if(_pendingCPUs.fetch_and(~bit) != bit)
+				return;
+
+			spinlock_lock(&_lock);
+			CompleteGracePeriod();
+			spinlock_unlock(&_lock);
+		}
+
+		void GetStatistics(Statistics *statistics)
+		{
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_lock);
+
+			*statistics = _statistics;
+
+			spinlock_unlock(&_lock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+		}
+	}
+}
@@ -0,0 +1,143 @@
+//
+//  rcu.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libcpp/atomic.h>
+#include <machine/cpu.h>
+#include <machine/interrupts/interrupts.h>
+
+namespace OS
+{
+	/**
+	 * Read-copy-update for read-mostly kernel tables. Readers don't take any lock and don't write
+	 * any shared memory, they only keep the CPU from being rescheduled by disabling interrupts.
+	 * Every entry into the scheduler is therefore a quiescent state of its CPU, and once every CPU
+	 * went through one after an object was unlinked, no reader can still see it.
+	 *
+	 * Readers must not sleep or fault. Writers serialize among themselves with a lock of their own,
+	 * unlink the object and then either wait with Synchronize() or hand the cleanup to Call(), whose
+	 * callbacks run on the kernel work queue after the grace period.
+	 **/
+	namespace RCU
+	{
+		typedef void (*Callback)(void *);
+
+		// Embedded into the object that is freed, so Call() works in interrupt context
+		struct Entry
+		{
+			Callback callback;
+			void *context;
+			Entry *next;
+		};
+
+		struct Statistics
+		{
+			uint64_t gracePeriods;
+			uint64_t callbacks; // Callbacks handed to the work queue
+			uint64_t synchronizes;
+			uint64_t kicks; // CPUs rescheduled to report a quiescent state
+		};
+
+		// Singly linked list that can be walked inside a read section while writers modify it
+		template<class T>
+		class List
+		{
+		public:
+			class Member
+			{
+			public:
+				Member(T *value) :
+					_value(value),
+					_next(nullptr)
+				{}
+
+				T *Get() const { return _value; }
+				Member *GetNext() const { return _next.load(std::memory_order_acquire); }
+
+			private:
+				friend class List;
+
+				T *_value;
+				std::atomic<Member *> _next;
+			};
+
+			List() :
+				_head(nullptr)
+			{}
+
+			Member *GetHead() const { return _head.load(std::memory_order_acquire); }
+
+			// Writers have to be serialized by the caller
+			void PushFront(Member &member)
+			{
+				member._next.store(_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				_head.store(&member, std::memory_order_release);
+			}
+
+			// Readers that are already on the member can still continue from it, so it must
+			// neither be freed nor reused before a grace period passed
+			void Remove(Member &member)
+			{
+				std::atomic<Member *> *link = &_head;
+				Member *current;
+
+				while((current = link->load(std::memory_order_relaxed)))
+				{
+					if(current == &member)
+					{
+						link->store(member._next.load(std::memory_order_relaxed), std::memory_order_release);
+						return;
+					}
+
+					link = &current->_next;
+				}
+			}
+
+		private:
+			std::atomic<Member *> _head;
+		};
+
+		// Returns whether interrupts were enabled, which has to be passed on to ReadUnlock(). Read sections nest
+		static inline bool ReadLock()
+		{
+			return Sys::DisableInterrupts();
+		}
+		static inline void ReadUnlock(bool enabled)
+		{
+			if(enabled)
+				Sys::EnableInterrupts();
+		}
+
+		// Waits for a full grace period, must not be called from within a read section
+		void Synchronize();
+
+		// Calls the callback on the work queue once a grace period passed, safe in interrupt context
+		void Call(Entry *entry, Callback callback, void *context);
+
+		// Called by the scheduler every time it is entered on the CPU, with interrupts disabled
+		void QuiescentState(Sys::CPU *cpu);
+
+		void GetStatistics(Statistics *statistics);
+	}
+}
+
+#endif /* _RCU_H_ */
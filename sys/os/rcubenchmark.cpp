@@ -0,0 +1,91 @@
+//
+//  rcubenchmark.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <machine/cpu.h>
+#include <os/scheduler/scheduler.h>
+#include <os/linker/LDStore.h>
+#include "rcubenchmark.h"
+
+namespace OS
+{
+	namespace RCUBenchmark
+	{
+		static constexpr size_t kIterations = 20000;
+
+		struct Worker
+		{
+			uint64_t taskCycles;
+			uint64_t moduleCycles;
+		};
+
+		static Worker _workers[CONFIG_MAX_CPUS];
+		static pid_t _pid;
+
+		static void WorkerThread()
+		{
+			Scheduler *scheduler = Scheduler::GetScheduler();
+			Worker *worker = &_workers[Benchmark::Begin()];
+
+			uint64_t start = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+				scheduler->GetTaskWithPID(_pid);
+
+			uint64_t middle = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kIterations; i ++)
+				LD::GetModuleWithName("libio.so");
+
+			uint64_t end = Sys::CPUReadTimestamp();
+
+			worker->taskCycles = middle - start;
+			worker->moduleCycles = end - middle;
+
+			Benchmark::Finish();
+		}
+
+		static void Average(size_t workers, uint32_t *taskCycles, uint32_t *moduleCycles)
+		{
+			uint64_t tasks = 0;
+			uint64_t modules = 0;
+
+			for(size_t i = 0; i < workers; i ++)
+			{
+				tasks += _workers[i].taskCycles;
+				modules += _workers[i].moduleCycles;
+			}
+
+			*taskCycles = workers ? static_cast<uint32_t>(tasks / (workers * kIterations)) : 0;
+			*moduleCycles = workers ? static_cast<uint32_t>(modules / (workers * kIterations)) : 0;
+		}
+
+		void Run(Result &result)
+		{
+			// The kernel task was added first and is at the very end of the task list
+			_pid = Scheduler::GetScheduler()->GetKernelTask()->GetPid();
+
+			size_t workers = Benchmark::RunParallel(&WorkerThread, 1);
+			Average(workers, &result.taskCycles, &result.moduleCycles);
+
+			workers = Benchmark::RunParallel(&WorkerThread, CONFIG_MAX_CPUS);
+			Average(workers, &result.parallelTaskCycles, &result.parallelModuleCycles);
+
+			result.cpus = workers;
+		}
+	}
+}
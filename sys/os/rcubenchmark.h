@@ -0,0 +1,50 @@
+//
+//  rcubenchmark.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _RCUBENCHMARK_H_
+#define _RCUBENCHMARK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <os/benchmark.h>
+
+namespace OS
+{
+	/**
+	 * Measures the lock free task and module lookups, first on a single CPU and then on all CPUs
+	 * at once. Without a shared lock the parallel lookups should cost about the same as the lone ones.
+	 * Started by writing "benchmark" to /dev/rcu, which also shows the result.
+	 **/
+	namespace RCUBenchmark
+	{
+		// Average TSC cycles per lookup
+		struct Result
+		{
+			uint32_t cpus;
+			uint32_t taskCycles;
+			uint32_t parallelTaskCycles;
+			uint32_t moduleCycles;
+			uint32_t parallelModuleCycles;
+		};
+
+		void Run(Result &result);
+		typedef Benchmark::Runner<Result, &Run> Runner;
+	}
+}
+
+#endif /* _RCUBENCHMARK_H_ */
@@ -0,0 +1,107 @@
+//
+//  accounting.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include <machine/clock/clock.h>
+#include <os/interruptguard.h>
+#include "accounting.h"
+#include "thread.h"
+
+namespace OS
+{
+	namespace Accounting
+	{
+		struct CPUAccounting
+		{
+			uint64_t timestamp;
+			Thread *thread;
+		} __attribute__((aligned(64)));
+
+		static CPUAccounting _cpuAccounting[CONFIG_MAX_CPUS];
+
+		static inline void ChargeThread(CPUAccounting *accounting, bool user)
+		{
+			uint64_t now = Sys::CPUReadTimestamp();
+
+			if(accounting->thread)
+			{
+				Thread::Usage *usage = accounting->thread->GetUsage();
+				uint64_t cycles = now - accounting->timestamp;
+
+				if(user)
+					usage->userCycles += cycles;
+				else
+					usage->kernelCycles += cycles;
+			}
+
+			accounting->timestamp = now;
+		}
+
+		void EnterInterrupt(Sys::CPU *cpu, Sys::CPUState *state)
+		{
+			ChargeThread(_cpuAccounting + cpu->GetID(), ((state->cs & 0x3) == 0x3));
+		}
+
+		void LeaveInterrupt(Sys::CPU *cpu)
+		{
+			ChargeThread(_cpuAccounting + cpu->GetID(), false);
+		}
+
+		void Charge(Sys::CPU *cpu)
+		{
+			ChargeThread(_cpuAccounting + cpu->GetID(), false);
+		}
+
+		void SwitchThread(Sys::CPU *cpu, Thread *thread)
+		{
+			// The time since the last charge goes to the new thread, it's what's left of the interrupt
+			_cpuAccounting[cpu->GetID()].thread = thread;
+		}
+
+		uint64_t BeginTransfer(Sys::CPU *cpu)
+		{
+			InterruptGuard guard(InterruptGuard::Mode::DisableInterrupts);
+
+			CPUAccounting *accounting = _cpuAccounting + cpu->GetID();
+			ChargeThread(accounting, false);
+
+			return accounting->thread->GetUsage()->kernelCycles;
+		}
+
+		void EndTransfer(Sys::CPU *cpu, uint64_t token, Thread *thread)
+		{
+			InterruptGuard guard(InterruptGuard::Mode::DisableInterrupts);
+
+			CPUAccounting *accounting = _cpuAccounting + cpu->GetID();
+			ChargeThread(accounting, false);
+
+			// Only counts the time the thread actually ran, not the time it slept in between
+			Thread::Usage *usage = accounting->thread->GetUsage();
+			uint64_t cycles = usage->kernelCycles - token;
+
+			usage->kernelCycles -= cycles;
+			thread->GetUsage()->kernelCycles += cycles;
+		}
+
+		uint64_t CyclesToMicroseconds(uint64_t cycles)
+		{
+			uint32_t frequency = Sys::Clock::GetTimestampFrequency();
+			return frequency ? (cycles / frequency) : 0;
+		}
+	}
+}
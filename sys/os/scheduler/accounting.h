@@ -0,0 +1,53 @@
+//
+//  accounting.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef _ACCOUNTING_H_
+#define _ACCOUNTING_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <machine/cpu.h>
+
+namespace OS
+{
+	class Thread;
+
+	/**
+	 * CPU time accounting. Every CPU remembers the thread it runs and when it last charged it,
+	 * every kernel entry and exit charges the time in between. Time before an interrupt counts
+	 * as user time if the interrupt came from ring 3, everything else is kernel time.
+	 **/
+	namespace Accounting
+	{
+		void EnterInterrupt(Sys::CPU *cpu, Sys::CPUState *state);
+		void LeaveInterrupt(Sys::CPU *cpu);
+
+		// Called by the scheduler before the thread could possibly go away, and once it picked the next one
+		void Charge(Sys::CPU *cpu);
+		void SwitchThread(Sys::CPU *cpu, Thread *thread);
+
+		// Hands the kernel time the running thread spends between the two calls over to another thread
+		uint64_t BeginTransfer(Sys::CPU *cpu);
+		void EndTransfer(Sys::CPU *cpu, uint64_t token, Thread *thread);
+
+		uint64_t CyclesToMicroseconds(uint64_t cycles);
+	}
+}
+
+#endif /* _ACCOUNTING_H_ */
@@ -0,0 +1,176 @@
+//
+//  idle.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/string.h>
+#include <libcpp/atomic.h>
+#include <machine/interrupts/interrupts.h>
+#include <machine/interrupts/apic.h>
+#include <bootstrap/multiboot.h>
+#include <kern/kprintf.h>
+#include "idle.h"
+
+namespace OS
+{
+	namespace Idle
+	{
+		static constexpr uint32_t kIdleWaiting = (1 << 0);
+
+		// Every CPU monitors its own cache line, so unrelated writes don't end the wait
+		struct CPUIdle
+		{
+			std::atomic<uint32_t> state; // kIdleWaiting and pending requests
+			Statistics statistics;
+		} __attribute__((aligned(64)));
+
+		static CPUIdle _cpuIdle[CONFIG_MAX_CPUS];
+
+		static bool _mwaitSupported = false;
+		static std::atomic<uint32_t> _mode = static_cast<uint32_t>(Mode::Halt);
+
+		// The instruction right after sti still runs with interrupts disabled, so an interrupt
+		// that arrives in between ends the wait instead of being handled before it
+		static inline void EnableInterruptsAndHalt(Sys::CPU *cpu)
+		{
+			cpu->AddFlags(Sys::CPU::Flags::InterruptsEnabled);
+			__asm__ volatile("sti; hlt");
+		}
+		static inline void EnableInterruptsAndMWait(Sys::CPU *cpu)
+		{
+			cpu->AddFlags(Sys::CPU::Flags::InterruptsEnabled);
+			__asm__ volatile("sti; mwait" :: "a" (0), "c" (0));
+		}
+
+		static inline void RaiseRequests(uint32_t requests)
+		{
+			if(requests & static_cast<uint32_t>(Request::Commands))
+				__asm__ volatile("int $0x41");
+			if(requests & static_cast<uint32_t>(Request::Reschedule))
+				__asm__ volatile("int $0x23");
+		}
+
+		void Run()
+		{
+			Sys::DisableInterrupts();
+
+			Sys::CPU *cpu = Sys::CPU::GetCurrentCPU(); // Idle threads never migrate
+			CPUIdle &idle = _cpuIdle[cpu->GetID()];
+
+			while(1)
+			{
+				Sys::DisableInterrupts();
+
+				if(_mode.load(std::memory_order_relaxed) != static_cast<uint32_t>(Mode::MWait))
+				{
+					idle.statistics.halts ++;
+					EnableInterruptsAndHalt(cpu);
+
+					continue;
+				}
+
+				// Requests written after the monitor is armed end the wait, the ones before are caught by the check
+				idle.state.store(kIdleWaiting);
+				Sys::CPUMonitor(&idle.state);
+
+				if(idle.state.load() == kIdleWaiting)
+				{
+					idle.statistics.mwaits ++;
+					EnableInterruptsAndMWait(cpu);
+				}
+
+				Sys::DisableInterrupts();
+
+				uint32_t requests = idle.state.exchange(0) & ~kIdleWaiting;
+				if(requests)
+				{
+					idle.statistics.wakeups ++;
+					RaiseRequests(requests);
+				}
+			}
+		}
+
+		bool Wake(Sys::CPU *cpu, Request request)
+		{
+			CPUIdle &idle = _cpuIdle[cpu->GetID()];
+			uint32_t state = idle.state.load(std::memory_order_relaxed);
+
+			do {
+				if(!(state & kIdleWaiting))
+					return false;
+			} while(!idle.state.compare_exchange(state, state | static_cast<uint32_t>(request)));
+
+			return true;
+		}
+
+		void Leave(Sys::CPU *cpu)
+		{
+			// An interrupt that ended the wait might switch to another thread before the idle
+			// loop gets to look at the requests. Scheduling is already underway at this point,
+			// only the commands still need to be worked off
+			uint32_t requests = _cpuIdle[cpu->GetID()].state.exchange(0);
+
+			if(requests & static_cast<uint32_t>(Request::Commands))
+				Sys::APIC::SendIPI(0x41, cpu);
+		}
+
+		Mode GetMode()
+		{
+			return static_cast<Mode>(_mode.load(std::memory_order_relaxed));
+		}
+		KernReturn<void> SetMode(Mode mode)
+		{
+			if(mode == Mode::MWait && !_mwaitSupported)
+				return Error(KERN_UNSUPPORTED);
+
+			_mode.store(static_cast<uint32_t>(mode), std::memory_order_relaxed);
+			return ErrorNone;
+		}
+
+		bool GetStatistics(Sys::CPU *cpu, Statistics *statistics)
+		{
+			if(!cpu)
+				return false;
+
+			*statistics = _cpuIdle[cpu->GetID()].statistics;
+			return true;
+		}
+
+		KernReturn<void> Init()
+		{
+			Sys::CPUInfo *info = Sys::CPU::GetCurrentCPU()->GetInfo();
+			_mwaitSupported = (info->GetFeatures() & Sys::CPUInfo::Feature::MONITOR);
+
+			for(size_t i = 0; i < CONFIG_MAX_CPUS; i ++)
+			{
+				_cpuIdle[i].state.store(0);
+				memset(&_cpuIdle[i].statistics, 0, sizeof(Statistics));
+			}
+
+			// idle=hlt on the command line keeps using HLT even if MWAIT is available
+			size_t length;
+			const char *value = Sys::GetBootArgument("idle", &length);
+
+			bool forceHalt = (value && length == 3 && strncmp(value, "hlt", 3) == 0);
+
+			if(_mwaitSupported && !forceHalt)
+				_mode.store(static_cast<uint32_t>(Mode::MWait));
+
+			kprintf("idle: %s\n", (GetMode() == Mode::MWait) ? "mwait" : "hlt");
+			return ErrorNone;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+//
+//  idle.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <kern/kern_return.h>
+#include <machine/cpu.h>
+
+namespace OS
+{
+	/**
+	 * The idle loop. With MWAIT an idle CPU monitors a per-CPU word, other CPUs wake it up
+	 * by writing their request into it instead of sending an IPI. The idle thread then raises
+	 * the matching interrupt itself. Without MONITOR/MWAIT, or with idle=hlt on the command
+	 * line, the CPU halts and has to be woken by an IPI.
+	 **/
+	namespace Idle
+	{
+		enum class Mode
+		{
+			Halt,
+			MWait
+		};
+
+		enum class Request : uint32_t
+		{
+			Commands = (1 << 1), // Raises 0x41
+			Reschedule = (1 << 2) // Raises 0x23
+		};
+
+		struct Statistics
+		{
+			uint64_t halts;
+			uint64_t mwaits;
+			uint64_t wakeups; // Requests that arrived through the monitored word instead of an IPI
+		};
+
+		void Run() __attribute__((noreturn));
+
+		// Returns false if the CPU isn't waiting in MWAIT, the caller has to send the IPI then
+		bool Wake(Sys::CPU *cpu, Request request);
+
+		// Must be called when the CPU switches away from its idle thread, with interrupts disabled
+		void Leave(Sys::CPU *cpu);
+
+		Mode GetMode();
+		KernReturn<void> SetMode(Mode mode);
+		bool GetStatistics(Sys::CPU *cpu, Statistics *statistics);
+
+		KernReturn<void> Init();
+	}
+}
+
+#endif /* _IDLE_H_ */
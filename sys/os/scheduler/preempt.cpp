@@ -0,0 +1,125 @@
+//
+//  preempt.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include <libcpp/algorithm.h>
+#include <machine/interrupts/interrupts.h>
+#include "scheduler.h"
+#include "preempt.h"
+
+namespace OS
+{
+	namespace Preempt
+	{
+		struct CPUPreempt
+		{
+			uint64_t deferredAt;
+			Statistics statistics;
+		} __attribute__((aligned(64)));
+
+		static CPUPreempt _cpuPreempt[CONFIG_MAX_CPUS];
+
+		uint32_t EnterInterrupt()
+		{
+			uint32_t previous;
+			uint32_t count;
+
+			CPU_DATA_GET(preemptSnapshot, previous);
+			CPU_DATA_GET(preemptCount, count);
+			CPU_DATA_SET(preemptSnapshot, count);
+
+			return previous;
+		}
+
+		void LeaveInterrupt(uint32_t previous)
+		{
+			uint32_t count;
+
+			CPU_DATA_GET(preemptSnapshot, count);
+			CPU_DATA_SET(preemptCount, count);
+			CPU_DATA_SET(preemptSnapshot, previous);
+		}
+
+		uint32_t GetInterruptedCount()
+		{
+			uint32_t count;
+			CPU_DATA_GET(preemptSnapshot, count);
+
+			return count;
+		}
+
+		void SwitchThread(uint32_t count)
+		{
+			CPU_DATA_SET(preemptSnapshot, count);
+			CPU_DATA_SET(preemptPending, 0U);
+		}
+
+		bool IsPreemptible(Sys::CPUState *state)
+		{
+			// Code that disabled interrupts only ever gets here through exceptions, it's just as unsafe to switch
+			return (GetInterruptedCount() == 0 && (state->eflags & (1 << 9)));
+		}
+
+		void Defer(Sys::CPU *cpu)
+		{
+			uint32_t pending;
+			CPU_DATA_GET(preemptPending, pending);
+
+			if(pending)
+				return;
+
+			CPUPreempt *preempt = _cpuPreempt + cpu->GetID();
+
+			preempt->deferredAt = Sys::CPUReadTimestamp();
+			preempt->statistics.deferred ++;
+
+			CPU_DATA_SET(preemptPending, 1U);
+		}
+
+		bool GetStatistics(Sys::CPU *cpu, Statistics *statistics)
+		{
+			if(!cpu)
+				return false;
+
+			*statistics = _cpuPreempt[cpu->GetID()].statistics;
+			return true;
+		}
+	}
+}
+
+// Called by Preempt::Enable() and spinlock_unlock() when the count drops to zero with a preemption pending.
+// The reschedule IPI goes to the CPU itself, with interrupts disabled it arrives as soon as they are enabled again
+void preempt_resume()
+{
+	bool enabled = Sys::DisableInterrupts();
+
+	Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
+	OS::Preempt::CPUPreempt *preempt = OS::Preempt::_cpuPreempt + cpu->GetID();
+
+	CPU_DATA_SET(preemptPending, 0U);
+
+	uint64_t cycles = Sys::CPUReadTimestamp() - preempt->deferredAt;
+
+	preempt->statistics.resumed ++;
+	preempt->statistics.maxDeferredCycles = std::max(preempt->statistics.maxDeferredCycles, cycles);
+
+	OS::Scheduler::GetScheduler()->RescheduleCPU(cpu);
+
+	if(enabled)
+		Sys::EnableInterrupts();
+}
@@ -0,0 +1,98 @@
+//
+//  preempt.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef _PREEMPT_H_
+#define _PREEMPT_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <machine/cpu.h>
+
+extern "C" void preempt_resume();
+
+namespace OS
+{
+	/**
+	 * Kernel preemption. Every CPU keeps a preemption count in its CPU data, which is raised by
+	 * every spinlock held and by explicit Disable() calls. A thread in kernel mode can be switched
+	 * out by the scheduler as long as the count is zero and it didn't run with interrupts disabled,
+	 * otherwise the switch is deferred until the count drops back to zero.
+	 *
+	 * The count belongs to the thread, the scheduler saves and restores it on every switch.
+	 **/
+	namespace Preempt
+	{
+		struct Statistics
+		{
+			uint64_t deferred; // Scheduling decisions that had to leave a thread running
+			uint64_t resumed; // Deferred preemptions that were acted on once the count dropped
+			uint64_t maxDeferredCycles;
+		};
+
+		static inline void Disable()
+		{
+			__asm__ volatile("incl %%fs:%P0" :: "i" (offsetof(Sys::CPUData, preemptCount)) : "memory");
+		}
+
+		static inline void Enable()
+		{
+			uint32_t count;
+
+			__asm__ volatile("decl %%fs:%P0" :: "i" (offsetof(Sys::CPUData, preemptCount)) : "memory");
+			CPU_DATA_GET(preemptCount, count);
+
+			if(count == 0)
+			{
+				uint32_t pending;
+				CPU_DATA_GET(preemptPending, pending);
+
+				if(pending)
+					preempt_resume();
+			}
+		}
+
+		static inline uint32_t GetCount()
+		{
+			uint32_t count;
+			CPU_DATA_GET(preemptCount, count);
+
+			return count;
+		}
+
+		// Called around every interrupt. The handler takes locks of its own, the scheduler looks
+		// at the count the interrupted thread had instead, which is restored on the way out
+		uint32_t EnterInterrupt();
+		void LeaveInterrupt(uint32_t previous);
+
+		// The count of the thread the current interrupt returns to. Switching installs the count
+		// of the new thread, which also settles a deferred preemption
+		uint32_t GetInterruptedCount();
+		void SwitchThread(uint32_t count);
+
+		// Whether the thread interrupted with the given state can be switched out
+		bool IsPreemptible(Sys::CPUState *state);
+
+		// Remembers that the scheduler wanted to switch, must be called with interrupts disabled
+		void Defer(Sys::CPU *cpu);
+
+		bool GetStatistics(Sys::CPU *cpu, Statistics *statistics);
+	}
+}
+
+#endif /* _PREEMPT_H_ */
@@ -25,6 +25,7 @@
 #include <kern/panic.h>
 
 #include "scheduler.h"
+#include "idle.h"
 #include "smp/smp_scheduler.h"
 
 namespace OS
@@ -33,8 +34,7 @@ namespace OS
 
 	void IdleTask()
 	{
-		while(1)
-			Sys::CPUHalt();
+		Idle::Run();
 	}
 
 	static Scheduler *_sharedScheduler;
@@ -49,44 +49,66 @@ namespace OS
 		return _sharedScheduler;
 	}
 
-	Task *Scheduler::GetTaskWithPID(pid_t pid) const
+	IO::StrongRef<Task> Scheduler::GetTaskWithPID(pid_t pid) const
 	{
-		Task *task = nullptr;
+		IO::StrongRef<Task> result;
 
-		spinlock_lock(&_taskLock);
+		bool enabled = RCU::ReadLock();
 
-		std::intrusive_list<Task>::member *entry = _tasks.head();
-		while(entry)
+		// The scheduler only drops its reference after a grace period, so the task can still be retained here
+		for(RCU::List<Task>::Member *entry = _tasks.GetHead(); entry; entry = entry->GetNext())
 		{
-			Task *temp = entry->get();
+			Task *task = entry->Get();
 
-			if(temp->GetPid() == pid)
+			if(task->GetPid() == pid)
 			{
-				task = temp;
+				result = task;
 				break;
 			}
-
-			entry = entry->next();
 		}
 
+		RCU::ReadUnlock(enabled);
+
+		return result;
+	}
+
+	IO::Array *Scheduler::CopyTasks() const
+	{
+		IO::Array *tasks = IO::Array::Alloc()->Init();
+		if(!tasks)
+			return nullptr;
+
+		spinlock_lock(&_taskLock);
+
+		for(RCU::List<Task>::Member *entry = _tasks.GetHead(); entry; entry = entry->GetNext())
+			tasks->AddObject(entry->Get());
+
 		spinlock_unlock(&_taskLock);
 
-		return task;
+		return tasks;
+	}
+
+	static void ReleaseTask(void *context)
+	{
+		Task *task = reinterpret_cast<Task *>(context);
+		task->Release();
 	}
 
 	void Scheduler::AddTask(Task *task)
 	{
-		spinlock_lock(&_taskLock);
-		_tasks.push_back(task->schedulerEntry);
 		task->Retain();
+
+		spinlock_lock(&_taskLock);
+		_tasks.PushFront(task->schedulerEntry);
 		spinlock_unlock(&_taskLock);
 	}
 	void Scheduler::RemoveTask(Task *task)
 	{
 		spinlock_lock(&_taskLock);
-		_tasks.erase(task->schedulerEntry);
-		task->Release();
+		_tasks.Remove(task->schedulerEntry);
 		spinlock_unlock(&_taskLock);
+
+		RCU::Call(&task->schedulerRelease, &ReleaseTask, task);
 	}
 
 	KernReturn<void> Scheduler::InitializeTasks()
@@ -100,6 +122,8 @@ namespace OS
 
 	KernReturn<void> SchedulerInit()
 	{
+		Idle::Init();
+
 		_sharedScheduler = new SMPScheduler();
 
 		if(!_sharedScheduler)
@@ -24,6 +24,8 @@
 #include <libc/sys/spinlock.h>
 #include <libcpp/intrusive_list.h>
 #include <machine/cpu.h>
+#include <libio/core/IOObject.h>
+#include <os/rcu.h>
 
 #include "task.h"
 #include "thread.h"
@@ -33,13 +35,36 @@ namespace OS
 	class Scheduler
 	{
 	public:
+		struct Statistics
+		{
+			size_t threads; // Threads owned by the CPU
+			size_t runnable; // Threads waiting in the runqueue
+			size_t load; // Runnable threads including the running one
+			bool fair; // Normal priority threads are scheduled by virtual runtime
+			uint64_t decisions;
+			uint64_t decisionCycles;
+			uint64_t maxDecisionCycles;
+			uint64_t switches;
+			uint64_t migrationsIn;
+			uint64_t migrationsOut;
+			uint64_t commands; // Commands received from other CPUs
+			uint64_t commandBatches; // Times the command queue was drained, roughly one per IPI
+			size_t deadlineThreads;
+			uint32_t deadlineBandwidth; // Reserved by deadline threads, in permille
+			uint64_t deadlineMisses;
+			uint64_t deadlineOverruns;
+		};
+
 		static Scheduler *GetScheduler();
 
 		virtual Task *GetActiveTask() const = 0;
 		virtual Thread *GetActiveThread() const = 0;
+		virtual bool IsThreadRunning(Thread *thread) const = 0; // Racy, only meant as a hint for spinning
+		virtual uint32_t GetThreadPriority(Thread *thread) const = 0; // Level of the thread without inherited priority, lower is more important
 
 		Task *GetKernelTask() const { return _kernelTask; }
-		Task *GetTaskWithPID(pid_t pid) const;
+		IO::StrongRef<Task> GetTaskWithPID(pid_t pid) const; // Lock free, the task list is protected by RCU
+		IO::Array *CopyTasks() const; // Returns a snapshot of all tasks, which has to be released by the caller
 
 		virtual uint32_t ScheduleOnCPU(uint32_t esp, Sys::CPU *cpu) = 0;
 		virtual uint32_t PokeCPU(uint32_t esp, Sys::CPU *cpu) = 0;
@@ -48,15 +73,21 @@ namespace OS
 		virtual void BlockThread(Thread *thread) = 0;
 		virtual void UnblockThread(Thread *thread) = 0;
 		virtual void YieldThread(Thread *thread) = 0;
+		virtual void UpdateInheritedPriority(Thread *thread) = 0; // Has to be called after Thread::_inheritedPriority changed
 
 		virtual void AddThread(Thread *thread) = 0;
 		virtual void RemoveThread(Thread *thread) = 0;
 
+		virtual KernReturn<void> SetThreadAffinity(Thread *thread, uint32_t affinity) = 0;
+		virtual KernReturn<void> SetThreadDeadline(Thread *thread, const Thread::DeadlineParameters &parameters) = 0; // A runtime of 0 leaves the deadline class
+
 		virtual void ActivateCPU(Sys::CPU *cpu) = 0;
 
 		virtual bool DisableCPU(Sys::CPU *cpu) = 0;
 		virtual void EnableCPU(Sys::CPU *cpu) = 0;
 
+		virtual bool GetStatistics(Sys::CPU *cpu, Statistics *statistics) const = 0;
+
 		void AddTask(Task *task);
 		void RemoveTask(Task *task);
 
@@ -67,8 +98,8 @@ namespace OS
 
 	private:
 		Task *_kernelTask;
-		std::intrusive_list<Task> _tasks;
-		mutable spinlock_t _taskLock;
+		RCU::List<Task> _tasks;
+		mutable spinlock_t _taskLock; // Serializes the writers
 	};
 
 	void IdleTask();
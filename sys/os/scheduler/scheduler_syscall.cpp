@@ -20,6 +20,7 @@
 #include <kern/kprintf.h>
 #include <libio/core/IONumber.h>
 #include <os/waitqueue.h>
+#include "accounting.h"
 #include "scheduler_syscall.h"
 
 namespace OS
@@ -61,9 +62,12 @@ namespace OS
 
 		if(task->GetMainThread() == thread)
 		{
-			Sys::CPU::GetCurrentCPU()->GetWorkQueue()->PushEntry(&MarkThreadExit, task);
-
 			task->Retain(); // Defer the Dealloc() until we are out of the syscall handler to avoid crashing
+
+			// RCU::Call() can't fail and also runs only after we left the handler
+			if(!Sys::CPU::GetCurrentCPU()->GetWorkQueue()->PushEntry(&MarkThreadExit, task))
+				RCU::Call(&task->exitRelease, &MarkThreadExit, task);
+
 			task->PronounceDead(arguments->exitCode);
 		}
 
@@ -80,7 +84,7 @@ namespace OS
 	KernReturn<uint32_t> Syscall_SchedThreadJoin(Thread *thread, SchedThreadJoinArgs *arguments)
 	{
 		Task *task = thread->GetTask();
-		Thread *target = task->GetThreadWithID(arguments->tid);
+		IO::StrongRef<Thread> target = task->GetThreadWithID(arguments->tid);
 
 		if(!target)
 			return Error(KERN_INVALID_ARGUMENT);
@@ -98,6 +102,179 @@ namespace OS
 	}
 
 
+	// A tid of 0 refers to the calling thread
+	static IO::StrongRef<Thread> GetTargetThread(Thread *thread, tid_t tid)
+	{
+		if(tid == 0)
+			return thread;
+
+		return thread->GetTask()->GetThreadWithID(tid);
+	}
+
+	KernReturn<uint32_t> Syscall_SchedSetAffinity(Thread *thread, SchedAffinityArgs *arguments)
+	{
+		IO::StrongRef<Thread> target = GetTargetThread(thread, arguments->tid);
+		if(!target)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		KernReturn<void> result = Scheduler::GetScheduler()->SetThreadAffinity(target, arguments->affinity);
+		if(!result.IsValid())
+			return result.GetError();
+
+		return 0;
+	}
+
+	KernReturn<uint32_t> Syscall_SchedGetAffinity(Thread *thread, SchedAffinityInfoArgs *arguments)
+	{
+		IO::StrongRef<Thread> target = GetTargetThread(thread, arguments->tid);
+		if(!target)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		OS::SyscallScopedMapping mapping(thread->GetTask(), arguments->mask, sizeof(uint32_t));
+
+		KernReturn<uint32_t *> mask = mapping.GetMemory<uint32_t>();
+		if(!mask.IsValid())
+			return mask.GetError();
+
+		// Only report CPUs that actually exist
+		uint32_t online = 0;
+
+		for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			online |= (1u << i);
+
+		*mask.Get() = target->GetAffinity() & online;
+		return 0;
+	}
+
+
+	static void SleepTimeout(__unused Timer *timer, void *context)
+	{
+		Thread *thread = reinterpret_cast<Thread *>(context);
+
+		Scheduler::GetScheduler()->UnblockThread(thread);
+		thread->Release();
+	}
+
+	KernReturn<uint32_t> Syscall_SchedSleep(Thread *thread, SchedSleepArgs *arguments)
+	{
+		if(arguments->nanoseconds >= 1000000000)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		uint64_t timeout = static_cast<uint64_t>(arguments->seconds) * 1000000 + (arguments->nanoseconds + 999) / 1000;
+		if(timeout == 0)
+			return 0;
+
+		// Like joining, the extra block keeps the thread asleep after the syscall returns until the timer fires
+		Scheduler::GetScheduler()->BlockThread(thread);
+
+		Timer *timer = thread->GetSleepTimer();
+		timer->SetCallback(&SleepTimeout, thread->Retain());
+		timer->Arm(timeout);
+
+		return 0;
+	}
+
+
+	static constexpr uint32_t kDeadlineMinRuntime = 100; // Microseconds, roughly what the clock can still enforce
+	static constexpr uint32_t kDeadlineMaxPeriod = 10000000;
+
+	KernReturn<uint32_t> Syscall_SchedSetDeadline(Thread *thread, SchedDeadlineArgs *arguments)
+	{
+		IO::StrongRef<Thread> target = GetTargetThread(thread, arguments->tid);
+		if(!target)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		Thread::DeadlineParameters parameters;
+		parameters.runtime = arguments->runtime;
+		parameters.period = arguments->period;
+		parameters.deadline = arguments->deadline ? arguments->deadline : arguments->period;
+
+		if(parameters.runtime == 0)
+		{
+			parameters.period = 0;
+			parameters.deadline = 0;
+		}
+		else if(parameters.runtime < kDeadlineMinRuntime || parameters.runtime > parameters.deadline || parameters.deadline > parameters.period || parameters.period > kDeadlineMaxPeriod)
+		{
+			return Error(KERN_INVALID_ARGUMENT);
+		}
+
+		KernReturn<void> result = Scheduler::GetScheduler()->SetThreadDeadline(target, parameters);
+		if(!result.IsValid())
+			return result.GetError();
+
+		return 0;
+	}
+
+	KernReturn<uint32_t> Syscall_SchedGetDeadline(Thread *thread, SchedDeadlineInfoArgs *arguments)
+	{
+		IO::StrongRef<Thread> target = GetTargetThread(thread, arguments->tid);
+		if(!target)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		OS::SyscallScopedMapping mapping(thread->GetTask(), arguments->info, sizeof(struct sched_deadline));
+
+		KernReturn<struct sched_deadline *> info = mapping.GetMemory<struct sched_deadline>();
+		if(!info.IsValid())
+			return info.GetError();
+
+		const Thread::DeadlineParameters &parameters = target->GetDeadlineParameters();
+		const Thread::DeadlineStatistics *statistics = target->GetDeadlineStatistics();
+
+		info->runtime = parameters.runtime;
+		info->period = parameters.period;
+		info->deadline = parameters.deadline;
+		info->jobs = statistics->jobs;
+		info->misses = statistics->misses;
+		info->overruns = statistics->overruns;
+
+		return 0;
+	}
+
+	static void ConvertCycles(uint64_t cycles, struct timeval *time)
+	{
+		uint64_t microseconds = Accounting::CyclesToMicroseconds(cycles);
+
+		time->tv_sec = static_cast<time_t>(microseconds / 1000000);
+		time->tv_usec = static_cast<long>(microseconds % 1000000);
+	}
+
+	KernReturn<uint32_t> Syscall_GetRusage(Thread *thread, GetRusageArgs *arguments)
+	{
+		Thread::Usage usage;
+
+		switch(arguments->who)
+		{
+			case RUSAGE_SELF:
+				thread->GetTask()->GetUsage(&usage);
+				break;
+			case RUSAGE_THREAD:
+				usage = *thread->GetUsage();
+				break;
+
+			default:
+				return Error(KERN_INVALID_ARGUMENT);
+		}
+
+		OS::SyscallScopedMapping mapping(thread->GetTask(), arguments->usage, sizeof(struct rusage));
+
+		KernReturn<struct rusage *> result = mapping.GetMemory<struct rusage>();
+		if(!result.IsValid())
+			return result.GetError();
+
+		struct rusage *info = result;
+
+		ConvertCycles(usage.userCycles, &info->ru_utime);
+		ConvertCycles(usage.kernelCycles, &info->ru_stime);
+
+		info->ru_nvcsw = static_cast<uint32_t>(usage.voluntarySwitches);
+		info->ru_nivcsw = static_cast<uint32_t>(usage.involuntarySwitches);
+		info->ru_nsyscalls = static_cast<uint32_t>(usage.syscalls);
+
+		return 0;
+	}
+
+
 	KernReturn<uint32_t> Syscall_Fork(__unused Thread *thread, __unused void *arguments)
 	{
 		return 0;
@@ -18,6 +18,8 @@
 
 #include <prefix.h>
 #include <libc/stdint.h>
+#include <libc/sys/thread.h>
+#include <libc/sys/resource.h>
 #include "scheduler.h"
 
 namespace OS
@@ -40,6 +42,44 @@ namespace OS
 		tid_t tid;
 	};
 
+	struct SchedAffinityArgs
+	{
+		tid_t tid;
+		uint32_t affinity;
+	};
+
+	struct SchedAffinityInfoArgs
+	{
+		tid_t tid;
+		uint32_t *mask;
+	};
+
+	struct SchedDeadlineArgs
+	{
+		tid_t tid;
+		uint32_t runtime;
+		uint32_t period;
+		uint32_t deadline;
+	};
+
+	struct SchedDeadlineInfoArgs
+	{
+		tid_t tid;
+		struct sched_deadline *info;
+	};
+
+	struct GetRusageArgs
+	{
+		int32_t who;
+		struct rusage *usage;
+	};
+
+	struct SchedSleepArgs
+	{
+		uint32_t seconds;
+		uint32_t nanoseconds;
+	};
+
 	struct SchedExecArgs
 	{
 		const char *path;
@@ -51,6 +91,12 @@ namespace OS
 	KernReturn<uint32_t> Syscall_SchedThreadExit(Thread *thread, SchedThreadExitArgs *arguments);
 	KernReturn<uint32_t> Syscall_SchedThreadJoin(Thread *thread, SchedThreadJoinArgs *arguments);
 	KernReturn<uint32_t> Syscall_SchedThreadYield(Thread *thread, void *arguments);
+	KernReturn<uint32_t> Syscall_SchedSetAffinity(Thread *thread, SchedAffinityArgs *arguments);
+	KernReturn<uint32_t> Syscall_SchedGetAffinity(Thread *thread, SchedAffinityInfoArgs *arguments);
+	KernReturn<uint32_t> Syscall_SchedSleep(Thread *thread, SchedSleepArgs *arguments);
+	KernReturn<uint32_t> Syscall_SchedSetDeadline(Thread *thread, SchedDeadlineArgs *arguments);
+	KernReturn<uint32_t> Syscall_SchedGetDeadline(Thread *thread, SchedDeadlineInfoArgs *arguments);
+	KernReturn<uint32_t> Syscall_GetRusage(Thread *thread, GetRusageArgs *arguments);
 
 	KernReturn<uint32_t> Syscall_Fork(Thread *thread, void *arguments);
 	KernReturn<uint32_t> Syscall_Exec(Thread *thread, SchedExecArgs *arguments);
@@ -16,19 +16,219 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <libcpp/vector.h>
 #include <libc/sys/spinlock.h>
 #include <libcpp/new.h>
 #include <libcpp/atomic.h>
+#include <libcpp/algorithm.h>
+#include <libc/string.h>
 #include <kern/panic.h>
 #include <kern/kprintf.h>
 #include <machine/clock/clock.h>
 #include <machine/interrupts/interrupts.h>
 #include <machine/cpu.h>
+#include <machine/fpu.h>
+#include <bootstrap/multiboot.h>
+#include <os/rcu.h>
 #include "smp_scheduler.h"
+#include "../trace.h"
+#include "../idle.h"
+#include "../preempt.h"
+#include "../accounting.h"
 
 namespace OS
 {
+	static constexpr uint32_t kPriorityLevels = 8; // Levels per priority class
+	static constexpr uint32_t kRunQueueLevels = Thread::__PriorityClassMax * kPriorityLevels;
+	static constexpr uint32_t kTimeSlice = 4; // Ticks a thread may run before others of its level get a turn
+	static constexpr uint32_t kBalanceInterval = 100000; // Microseconds between periodic load balancing
+	static constexpr uint32_t kDecayInterval = 500000; // Microseconds between CPU usage decays
+
+	// Fair class, which replaces the priority levels of normal threads on CPUs that opt in
+	static constexpr uint32_t kFairLevel = Thread::PriorityClassNormal * kPriorityLevels;
+	static constexpr uint32_t kFairLatency = 12000; // Microseconds in which every runnable fair thread should get a turn
+	static constexpr uint32_t kFairMinGranularity = 1500; // Microseconds a fair thread runs before it can be preempted
+	static constexpr uint32_t kFairWakeupGranularity = 1000; // Virtual runtime a woken thread must be behind to preempt
+	static constexpr uint32_t kFairSleeperCredit = kFairLatency / 2; // How far behind the pack a woken thread may start
+	static constexpr uint32_t kFairWeightNice0 = 1024;
+
+	// Every nice level is worth roughly 10% of CPU time
+	static const uint32_t kFairWeights[40] = {
+		88761, 71755, 56483, 46273, 36291,
+		29154, 23254, 18705, 14949, 11916,
+		9548,  7620,  6100,  4904,  3906,
+		3121,  2501,  1991,  1586,  1277,
+		1024,  820,   655,   526,   423,
+		335,   272,   215,   172,   137,
+		110,   87,    70,    56,    45,
+		36,    29,    23,    18,    15
+	};
+
+	static inline uint32_t GetFairWeight(int nice)
+	{
+		nice = std::max(-20, std::min(nice, 19));
+		return kFairWeights[nice + 20];
+	}
+
+	// Deadline class, which preempts all other classes
+	static constexpr uint32_t kDeadlineBandwidthShift = 20; // Bandwidth is runtime / period as fixed point
+	static constexpr uint32_t kDeadlineMaxBandwidth = (95 << kDeadlineBandwidthShift) / 100; // The rest is left for everyone else
+
+	static_assert(kRunQueueLevels <= 32, "The runqueue bitmap only has 32 bits");
+	static_assert(CONFIG_MAX_CPUS <= 32, "Thread affinity masks only have 32 bits");
+
+	static inline bool IsAllowedOnCPU(Thread *thread, Sys::CPU *cpu)
+	{
+		// Deadline threads stay on the CPU their bandwidth is reserved on
+		int32_t deadlineCPU = thread->GetDeadlineCPU();
+		if(deadlineCPU != -1)
+			return (deadlineCPU == static_cast<int32_t>(cpu->GetID()));
+
+		return (thread->GetAffinity() & (1 << cpu->GetID()));
+	}
+
+	static inline uint32_t GetDeadlineBandwidth(const Thread::DeadlineParameters &parameters)
+	{
+		return static_cast<uint32_t>((static_cast<uint64_t>(parameters.runtime) << kDeadlineBandwidthShift) / parameters.period);
+	}
+
+	static SMPScheduler *_sharedScheduler = nullptr;
+
+	// ---------------
+	// Run Queue
+	// FIFO queue of runnable threads per level, lower levels are more important.
+	// A bitmap of non-empty levels allows to find the next thread in constant time.
+	// Fair threads all share one level, where they are ordered by virtual runtime instead
+	// ---------------
+
+	struct SMPScheduler::RunQueue
+	{
+		RunQueue() :
+			bitmap(0),
+			count(0)
+		{}
+
+		static bool IsBefore(Thread *thread, Thread *other)
+		{
+			return (thread->GetSchedulingData<SchedulingData>()->vruntime < other->GetSchedulingData<SchedulingData>()->vruntime);
+		}
+
+		// Fair threads that inherited a higher priority are queued by level like everyone else
+		static bool IsFairQueued(SchedulingData *data)
+		{
+			return (data->fair && data->level == kFairLevel);
+		}
+
+		void Push(SchedulingData *data, bool front)
+		{
+			std::intrusive_list<Thread> &queue = levels[data->level];
+
+			if(IsFairQueued(data))
+				fair.insert(data->fairEntry, &RunQueue::IsBefore);
+			else if(front)
+				queue.push_front(data->runqueueEntry);
+			else
+				queue.push_back(data->runqueueEntry);
+
+			bitmap |= (1 << data->level);
+			data->runqueue = this;
+			count ++;
+		}
+
+		void Remove(SchedulingData *data)
+		{
+			std::intrusive_list<Thread> &queue = levels[data->level];
+
+			if(IsFairQueued(data))
+				fair.erase(data->fairEntry);
+			else
+				queue.erase(data->runqueueEntry);
+
+			if(queue.empty() && (data->level != kFairLevel || fair.empty()))
+				bitmap &= ~(1 << data->level);
+
+			data->runqueue = nullptr;
+			count --;
+		}
+
+		int32_t GetHighestLevel() const
+		{
+			return bitmap ? static_cast<int32_t>(Sys::CPUBitScanForward(bitmap)) : -1;
+		}
+
+		Thread *Pop()
+		{
+			if(!bitmap)
+				return nullptr;
+
+			uint32_t level = Sys::CPUBitScanForward(bitmap);
+
+			Thread *thread = (level == kFairLevel && !fair.empty()) ? fair.head()->get() : levels[level].head()->get();
+			Remove(thread->GetSchedulingData<SchedulingData>());
+
+			return thread;
+		}
+
+		std::intrusive_list<Thread> levels[kRunQueueLevels];
+		std::intrusive_rbtree<Thread> fair;
+		uint32_t bitmap;
+		size_t count;
+	};
+
+	// ---------------
+	// Command Pool
+	// Every CPU allocates the commands it sends to other CPUs from its own pool. The receiving
+	// CPU hands nodes back through a lock-free stack that the owner takes over as a whole once
+	// its free list runs dry, so neither side needs a lock or the allocator in the common case
+	// ---------------
+
+	static constexpr size_t kCommandPoolSize = 64;
+
+	struct SMPScheduler::CommandPool
+	{
+		CommandPool() :
+			freeList(nullptr),
+			returned(nullptr)
+		{
+			for(size_t i = 0; i < kCommandPoolSize; i ++)
+			{
+				CommandNode *node = new CommandNode(this);
+				node->next = freeList;
+				freeList = node;
+			}
+		}
+
+		// Only called by the owning CPU with interrupts disabled
+		CommandNode *Allocate()
+		{
+			if(__expect_false(!freeList))
+			{
+				freeList = returned.exchange(nullptr, std::memory_order_acquire);
+
+				// The pool grows to whatever the CPU needs at most, nodes are never given back
+				if(!freeList)
+					return new CommandNode(this);
+			}
+
+			CommandNode *node = freeList;
+			freeList = node->next;
+
+			return node;
+		}
+
+		// Called by the CPU that ran the command
+		void Free(CommandNode *node)
+		{
+			CommandNode *head = returned.load(std::memory_order_relaxed);
+
+			do {
+				node->next = head;
+			} while(!returned.compare_exchange(head, node));
+		}
+
+		CommandNode *freeList;
+		std::atomic<CommandNode *> returned;
+	};
+
 	// ---------------
 	// CPU Scheduler
 	// Responsible for doing scheduling decisions for one single CPU
@@ -41,16 +241,31 @@ namespace OS
 
 		CPUScheduler(Sys::CPU *cpu) :
 			_cpu(cpu),
+			_activeQueue(_runQueues + 0),
+			_expiredQueue(_runQueues + 1),
+			_lastUpdate(0),
+			_tickTime(0),
+			_time(0),
+			_balanceTime(0),
+			_minVruntime(0),
+			_deadlineThreads(0),
+			_deadlineBandwidth(0),
+			_load(0),
+			_stealPending(false),
 			_activeThread(nullptr),
 			_idleThread(nullptr),
 			_nextThread(nullptr),
+			_pendingMigration(nullptr),
 			_firstRun(true),
-			_hasForcedDown(false),
+			_wakeupPending(false),
 			_needsReschedule(false),
-			_enabled(true)
+			_enabled(true),
+			_fair(false),
+			_commands(nullptr)
 		{
 			spinlock_init(&_internalLock);
-			spinlock_init(&_commandLock);
+
+			memset(&_statistics, 0, sizeof(Statistics));
 		}
 		
 
@@ -58,44 +273,108 @@ namespace OS
 		{
 			Thread *thread = _nextThread;
 
+			Accounting::Charge(_cpu);
+
+			// Read sections run with interrupts disabled, so none can be active on the CPU right now
+			// Dead threads can be freed once the quiescent state is reported
+			RCU::QuiescentState(_cpu);
+
 			if(__expect_true(!_firstRun))
+			{
 				thread->SetESP(esp);
+				thread->SetPreemptCount(Preempt::GetInterruptedCount());
+			}
+
+			MigratePendingThread();
+
+			// Dying threads are gone after the scheduling decision
+			tid_t previous = thread->GetTid();
+
+			// The timer only fires when needed, so the running thread is charged by the time that passed
+			// instead of the number of calls. Usage and time slices are still counted in ticks
+			uint64_t now = Sys::Clock::GetMicroseconds();
+			uint32_t elapsed = __expect_true(!_firstRun) ? static_cast<uint32_t>(std::min(now - _lastUpdate, static_cast<uint64_t>(kDecayInterval))) : 0;
+			uint32_t tick = Sys::Clock::GetMicrosecondsPerTick();
+
+			_lastUpdate = now;
+			_tickTime += elapsed;
+
+			uint32_t ticks = _tickTime / tick;
+			_tickTime -= ticks * tick;
 
 			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
-			data->usage ++;
+			if(data)
+			{
+				data->usage += ticks;
+				data->slice += ticks;
+				data->runtime += elapsed;
+
+				if(data->deadline && !data->throttled)
+					ChargeDeadline(thread, elapsed);
+
+				if(data->fair)
+				{
+					uint32_t weight = GetFairWeight(thread->GetTask()->GetNice());
+
+					data->vruntime += (static_cast<uint64_t>(elapsed) * kFairWeightNice0) / weight;
+					UpdateMinVruntime();
+				}
+			}
 
 			// Decay CPU usage roughly every 500ms
-			_time += Sys::Clock::GetMicrosecondsPerTick();
-			if(_time >= 500000)
+			_time += elapsed;
+			if(_time >= kDecayInterval)
 			{
 				if(spinlock_try_lock(&_internalLock))
 				{
-					for(int i = 0; i < Thread::__PriorityClassMax; i ++)
-					{
-						std::intrusive_list<Thread>::member *entry = _threads[i].head();
-						while(entry)
-						{
-							SchedulingData *temp = entry->get()->GetSchedulingData<SchedulingData>();
-							Task *task = entry->get()->GetTask();
-
-							temp->usage = (temp->usage + task->GetNice()) / 3;
-
-							entry = entry->next();
-						}
-					}
+					DecayThreads();
 
 					_time = 0;
 					spinlock_unlock(&_internalLock);
 				}
 			}
 
+			_balanceTime += elapsed;
+
 			// Check if we are enabled
 			if(__expect_false(_enabled.load(std::memory_order_acquire) == false))
+			{
+				// Keep checking back until scheduling is enabled again
+				Sys::Clock::SetTimerDeadline(Sys::Clock::Event::Scheduler, now + tick);
 				return esp;
+			}
 
 			// Update the scheduling decision
+			uint64_t start = Sys::CPUReadTimestamp();
+
 			MakeSchedulingDecision();
 
+			uint64_t cycles = Sys::CPUReadTimestamp() - start;
+
+			_statistics.decisions ++;
+			_statistics.decisionCycles += cycles;
+			_statistics.maxDecisionCycles = std::max(_statistics.maxDecisionCycles, cycles);
+
+			if(_activeThread != _nextThread)
+			{
+				_statistics.switches ++;
+				_tickTime = 0;
+
+				Preempt::SwitchThread(_nextThread->GetPreemptCount());
+				Accounting::SwitchThread(_cpu, _nextThread);
+
+				if(_activeThread == _idleThread)
+				{
+					Idle::Leave(_cpu);
+					SchedulerTrace::Record(SchedulerTrace::Type::IdleExit, _activeThread);
+				}
+
+				SchedulerTrace::Record(SchedulerTrace::Type::Switch, _nextThread, previous);
+
+				if(_nextThread == _idleThread)
+					SchedulerTrace::Record(SchedulerTrace::Type::IdleEnter, _nextThread);
+			}
+
 			_firstRun = false;
 			_needsReschedule = false;
 
@@ -104,12 +383,19 @@ namespace OS
 			data = thread->GetSchedulingData<SchedulingData>();
 			data->needsWakeup = false;
 
+			Sys::Clock::SetTimerDeadline(Sys::Clock::Event::Scheduler, GetNextEvent());
+
 			Task *task = thread->GetTask();
 			Sys::Trampoline *trampoline = _cpu->GetTrampoline();
 
 			trampoline->pageDirectory = task->GetDirectory()->GetPhysicalDirectory();
 			trampoline->tss.esp0 = thread->GetESP() + sizeof(Sys::CPUState);
 
+			if((reinterpret_cast<Sys::CPUState *>(thread->GetESP())->cs & 0x3) == 0x3)
+				Sys::TrampolineSetSysenterStack(_cpu, trampoline->tss.esp0);
+
+			Sys::FPU::SwitchThread(_cpu, thread);
+
 			CPU_DATA_SET(pid, thread->GetTask()->GetPid());
 			CPU_DATA_SET(tid, thread->GetTid());
 			CPU_DATA_SET(tls, thread->GetTLSVirtual());
@@ -126,36 +412,85 @@ namespace OS
 
 		void PushCommand(SchedulerCommand &&command)
 		{
-			if(_cpu == Sys::CPU::GetCurrentCPU())
+			// The runqueues are only ever touched by their own CPU, but the timer might fire in the middle of it.
+			// Disabling interrupts also keeps us on the CPU whose command pool is used
+			bool enabled = Sys::DisableInterrupts();
+			Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
+
+			if(_cpu == cpu)
 			{
 				RunCommand(command);
+				UpdateTimer();
+
+				if(enabled)
+					Sys::EnableInterrupts();
+
 				return;
 			}
 
-			spinlock_lock(&_commandLock);
-			_commands.push_back(std::move(command));
-			spinlock_unlock(&_commandLock);
+			CommandNode *node = _sharedScheduler->_schedulerMap[cpu->GetID()]->_commandPool.Allocate();
+			node->command = std::move(command);
+
+			// The commands form a lock-free stack, only the push that finds it empty has to kick the CPU.
+			// Everything pushed before the CPU takes the stack is picked up by that same run
+			CommandNode *head = _commands.load(std::memory_order_relaxed);
+
+			do {
+				node->next = head;
+			} while(!_commands.compare_exchange(head, node));
+
+			if(enabled)
+				Sys::EnableInterrupts();
 
-			Notify();
+			if(!head)
+				Notify();
 		}
 
 		bool __WorkCommandQueue()
 		{
-			spinlock_lock(&_commandLock);
-			size_t count = _commands.size();
+			// Take all pending commands at once and restore the order they were pushed in
+			CommandNode *node = _commands.exchange(nullptr, std::memory_order_acquire);
+			CommandNode *queue = nullptr;
 
-			for(size_t i = 0; i < count; i ++)
+			while(node)
 			{
-				SchedulerCommand &command = _commands.at(i);
-				RunCommand(command);
+				CommandNode *next = node->next;
+
+				node->next = queue;
+				queue = node;
+				node = next;
+			}
+
+			uint32_t count = 0;
+
+			// Commands can push commands to other CPUs, which is fine since nothing is locked
+			while(queue)
+			{
+				CommandNode *next = queue->next;
+
+				RunCommand(queue->command);
+				queue->command = SchedulerCommand();
+				queue->pool->Free(queue);
+
+				count ++;
+				queue = next;
+			}
+
+			if(count > 0)
+			{
+				_statistics.commands += count;
+				_statistics.commandBatches ++;
+
+				SchedulerTrace::Record(SchedulerTrace::Type::Commands, nullptr, count);
 			}
 
-			_commands.clear();
+			MigratePendingThread();
 
 			bool needsReschedule = _needsReschedule;
 			_needsReschedule = false;
 
-			spinlock_unlock(&_commandLock);
+			if(!needsReschedule)
+				UpdateTimer();
 
 			return needsReschedule;
 		}
@@ -170,148 +505,792 @@ namespace OS
 			_enabled.store(true, std::memory_order_release);
 		}
 
-	private:
-		inline bool CanScheduleThread(Task *task, SchedulingData *data)
-		{
-			return (data->blocks == 0 && !data->forcedDown && task->GetState() == Task::State::Running);
+		void GetStatistics(Statistics *statistics) const
+		{
+			*statistics = _statistics;
+
+			statistics->threads = _threads.size();
+			statistics->runnable = _activeQueue->count + _expiredQueue->count + _deadlineQueue.size();
+			statistics->load = _load.load(std::memory_order_relaxed);
+			statistics->fair = _fair;
+			statistics->deadlineThreads = _deadlineThreads;
+			statistics->deadlineBandwidth = static_cast<uint32_t>((static_cast<uint64_t>(_deadlineBandwidth.load(std::memory_order_relaxed)) * 1000) >> kDeadlineBandwidthShift);
+		}
+
+		size_t GetLoad() const
+		{
+			return _load.load(std::memory_order_relaxed);
+		}
+
+		bool IsAvailable() const
+		{
+			return (_idleThread && _enabled.load(std::memory_order_acquire));
+		}
+
+		// credit is bandwidth the thread already holds on this CPU and gives up in exchange
+		bool ReserveBandwidth(uint32_t bandwidth, uint32_t credit)
+		{
+			uint32_t reserved = _deadlineBandwidth.load(std::memory_order_relaxed);
+
+			do {
+				if(reserved - credit + bandwidth > kDeadlineMaxBandwidth)
+					return false;
+			} while(!_deadlineBandwidth.compare_exchange(reserved, reserved + bandwidth));
+
+			return true;
+		}
+		void ReleaseBandwidth(uint32_t bandwidth)
+		{
+			uint32_t reserved = _deadlineBandwidth.load(std::memory_order_relaxed);
+			while(!_deadlineBandwidth.compare_exchange(reserved, reserved - bandwidth))
+			{}
+		}
+
+		// Level of the thread without any priority it inherited
+		static uint32_t GetBaseLevel(SchedulingData *data)
+		{
+			if(data->fair)
+				return kFairLevel;
+
+			uint32_t priority = std::min(data->priority, kPriorityLevels - 1);
+			return (data->priorityClass * kPriorityLevels) + priority;
+		}
+
+	private:
+		inline bool CanScheduleThread(Task *task, SchedulingData *data)
+		{
+			return (data->blocks == 0 && !data->forcedDown && task->GetState() == Task::State::Running);
+		}
+
+		uint32_t GetLevel(SchedulingData *data)
+		{
+			return std::min(GetBaseLevel(data), data->inheritedLevel);
+		}
+
+		void PushRunQueue(SchedulingData *data, bool front)
+		{
+			if(data->deadline)
+			{
+				// Throttled threads wait for their next period outside of any queue
+				if(!data->throttled)
+				{
+					_deadlineQueue.insert(data->deadlineEntry, &CPUScheduler::IsDeadlineBefore);
+					data->deadlineQueued = true;
+				}
+
+				return;
+			}
+
+			data->level = GetLevel(data);
+
+			// Fair threads are kept in order by their virtual runtime and never expire
+			RunQueue *queue = (data->forcedDown && !data->fair) ? _expiredQueue : _activeQueue;
+			queue->Push(data, front);
+		}
+
+		void Enqueue(Thread *thread, bool front)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			// The active thread gets put back by MakeSchedulingDecision(), the idle thread is never queued
+			if(data->runqueue || data->deadlineQueued || thread == _activeThread || thread == _idleThread)
+				return;
+
+			PushRunQueue(data, front);
+
+			// An idle CPU doesn't take timer interrupts, it has to be told to pick up the thread
+			if(_activeThread == _idleThread)
+				_needsReschedule = true;
+		}
+		void Dequeue(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			if(data->deadlineQueued)
+			{
+				_deadlineQueue.erase(data->deadlineEntry);
+				data->deadlineQueued = false;
+			}
+
+			if(data->runqueue)
+				data->runqueue->Remove(data);
+		}
+
+		void DecayThreads()
+		{
+			std::intrusive_list<Thread>::member *entry = _threads.head();
+			while(entry)
+			{
+				Thread *thread = entry->get();
+				entry = entry->next();
+
+				// Blocked threads of dead tasks never make it back into the runqueue, so they are reaped here
+				Task *task = thread->GetTask();
+				if(task->GetState() == Task::State::Died && thread != _activeThread)
+				{
+					RemoveThread(thread);
+					task->MarkThreadExit(thread);
+
+					continue;
+				}
+
+				SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+				data->usage = (data->usage + task->GetNice()) / 3;
+			}
+		}
+
+		void MakeSchedulingDecision()
+		{
+			if(!spinlock_try_lock(&_internalLock))
+				return;
+
+			Thread *thread = _activeThread;
+			Task *task = thread->GetTask();
+
+			bool keepRunning = false;
+			bool deferred = false;
+
+			if(task->GetState() == Task::State::Died)
+			{
+				RemoveThread(thread);
+				task->MarkThreadExit(thread);
+
+				thread = nullptr;
+			}
+			else if(thread != _idleThread)
+			{
+				SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+				// Threads holding up a more important one through a mutex are never forced down
+				if(data->usage >= 5 && !data->fair && !data->deadline && data->inheritedLevel == Thread::kNoInheritedPriority) // Todo: This should probably be priority dependent
+					data->forcedDown = true;
+
+				bool isAllowed = IsAllowedOnCPU(thread, _cpu);
+
+				if(isAllowed && data->deadline)
+				{
+					// Earliest deadline first, throttled threads have to wait for their next period
+					std::intrusive_rbtree<Thread>::member *earliest = _deadlineQueue.head();
+					keepRunning = (CanScheduleThread(task, data) && !data->throttled && (!earliest || !IsDeadlineBefore(earliest->get(), thread)));
+				}
+				else if(isAllowed && CanScheduleThread(task, data) && _deadlineQueue.empty())
+				{
+					// Recalculate the threads priority every 4 ticks
+					if((data->usage % 4) == 0)
+						data->priority = (data->usage / 4) + task->GetNice();
+
+					// Keep running unless a more important thread is waiting, or one of the
+					// same level that either just woke up or waited for a whole time slice
+					int32_t highest = _activeQueue->GetHighestLevel();
+					int32_t level = static_cast<int32_t>(GetLevel(data));
+
+					if(data->fair && level == static_cast<int32_t>(kFairLevel))
+						keepRunning = (highest == -1 || highest > level || (highest == level && !ShouldPreemptFair(data)));
+					else
+						keepRunning = (highest == -1 || highest > level || (highest == level && !_wakeupPending && data->slice < kTimeSlice));
+				}
+
+				// Threads holding a spinlock or running with interrupts disabled are switched once they leave the critical section.
+				// Blocked ones asked for the switch themselves, a fault in a critical section that has to wait for swap for example
+				if(!keepRunning && data->blocks == 0 && !Preempt::IsPreemptible(reinterpret_cast<Sys::CPUState *>(thread->GetESP())))
+				{
+					Preempt::Defer(_cpu);
+
+					keepRunning = true;
+					deferred = true;
+				}
+				else if(!isAllowed)
+				{
+					// Its affinity changed, it gets moved to another CPU once we are off its stack
+					_pendingMigration = thread->Retain();
+					Notify();
+				}
+				else if(!keepRunning && data->blocks == 0)
+				{
+					// Put it back, forced down threads end up in the expired queue
+					PushRunQueue(data, false);
+				}
+			}
+
+			// A deferred wakeup still has to get its turn when the preemption is acted on
+			if(!deferred)
+				_wakeupPending = false;
+
+			if(keepRunning)
+			{
+				_nextThread = thread;
+
+				UpdateLoad();
+				spinlock_unlock(&_internalLock);
+
+				if(_balanceTime >= kBalanceInterval)
+				{
+					_balanceTime = 0;
+					Balance();
+				}
+
+				return;
+			}
+
+			// Find the next thread to run
+			Thread *newThread = nullptr;
+
+			while(!newThread)
+			{
+				Thread *candidate;
+
+				if(!_deadlineQueue.empty())
+				{
+					candidate = _deadlineQueue.head()->get();
+					Dequeue(candidate);
+				}
+				else
+				{
+					if(_activeQueue->bitmap == 0)
+					{
+						// Everyone either got their turn or is blocked, give the forced down threads another go
+						if(_expiredQueue->bitmap == 0)
+							break;
+
+						RunQueue *temp = _activeQueue;
+
+						_activeQueue = _expiredQueue;
+						_expiredQueue = temp;
+					}
+
+					candidate = _activeQueue->Pop();
+				}
+
+				Task *candidateTask = candidate->GetTask();
+
+				if(candidateTask->GetState() == Task::State::Died)
+				{
+					RemoveThread(candidate);
+					candidateTask->MarkThreadExit(candidate);
+
+					continue;
+				}
+
+				newThread = candidate;
+			}
+
+			if(newThread)
+			{
+				SchedulingData *data = newThread->GetSchedulingData<SchedulingData>();
+
+				data->forcedDown = false;
+				data->slice = 0;
+				data->runtime = 0;
+			}
+			else
+			{
+				newThread = _idleThread;
+			}
+
+			if(thread && thread != _idleThread && thread != newThread)
+			{
+				SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+				Thread::Usage *usage = thread->GetUsage();
+
+				if(data->blocks > 0 || data->throttled)
+					usage->voluntarySwitches ++;
+				else
+					usage->involuntarySwitches ++;
+			}
+
+			_nextThread = newThread;
+
+			UpdateLoad();
+			spinlock_unlock(&_internalLock);
+
+			// Going idle or the periodic check, see if someone else has work to share
+			if(newThread == _idleThread || _balanceTime >= kBalanceInterval)
+			{
+				_balanceTime = 0;
+				Balance();
+			}
+		}
+
+		void UpdateLoad()
+		{
+			size_t load = _activeQueue->count + _expiredQueue->count + _deadlineQueue.size();
+
+			if(_nextThread && _nextThread != _idleThread)
+				load ++;
+
+			size_t previous = _load.load(std::memory_order_relaxed);
+			_load.store(load, std::memory_order_relaxed);
+
+			// Idle CPUs only balance when going idle, so poke one to come and take the extra work
+			if(load >= 2 && previous < 2)
+				_sharedScheduler->KickIdleScheduler(this);
+		}
+
+		// Time of the next event the CPU has to wake up for, or 0 if it can sleep until an interrupt arrives
+		uint64_t GetNextEvent() const
+		{
+			uint32_t tick = Sys::Clock::GetMicrosecondsPerTick();
+
+			if(_nextThread == _idleThread)
+			{
+				// Blocked threads might belong to tasks that die in the meantime, those are reaped when decaying
+				if(_threads.size() > 1)
+					return _lastUpdate + GetRemainingTime(_time, kDecayInterval);
+
+				return 0;
+			}
+
+			SchedulingData *data = _nextThread->GetSchedulingData<SchedulingData>();
+
+			// Deadline threads are only preempted by earlier deadlines, which arrive through commands,
+			// so the next thing to do is to throttle the thread once its budget is used up
+			if(data->deadline)
+				return _lastUpdate + std::min(data->budget, GetRemainingTime(_time, kDecayInterval));
+
+			// Others are waiting, the thread is charged and maybe preempted at the next tick.
+			// Fair threads only compete with each other and have their own slices
+			if(_activeQueue->count + _expiredQueue->count > 0)
+			{
+				if(data->fair && _activeQueue->GetHighestLevel() == static_cast<int32_t>(kFairLevel) && _expiredQueue->count == 0)
+					return _lastUpdate + GetFairTimeLeft(data);
+
+				return _lastUpdate + (tick - _tickTime);
+			}
+
+			// Running alone, nothing to do until the next balancing or decay
+			uint32_t remaining = std::min(GetRemainingTime(_balanceTime, kBalanceInterval), GetRemainingTime(_time, kDecayInterval));
+			return _lastUpdate + std::max(remaining, tick - _tickTime);
+		}
+
+		static uint32_t GetRemainingTime(uint32_t elapsed, uint32_t interval)
+		{
+			return (elapsed >= interval) ? Sys::Clock::GetMicrosecondsPerTick() : (interval - elapsed);
+		}
+
+		// Moves the deadline closer if the commands that were just run require it
+		void UpdateTimer()
+		{
+			if(_firstRun || !_nextThread)
+				return;
+
+			uint64_t deadline = GetNextEvent();
+
+			if(_needsReschedule)
+			{
+				uint32_t tick = Sys::Clock::GetMicrosecondsPerTick();
+				deadline = (_activeThread == _idleThread) ? _lastUpdate : std::min(deadline, _lastUpdate + (tick - _tickTime));
+			}
+
+			uint64_t current = Sys::Clock::GetTimerDeadline(Sys::Clock::Event::Scheduler);
+
+			if(deadline && (current == 0 || deadline < current))
+				Sys::Clock::SetTimerDeadline(Sys::Clock::Event::Scheduler, deadline);
+		}
+
+		// Virtual runtime only ever moves forward, new and woken threads are placed relative to it
+		void UpdateMinVruntime()
+		{
+			uint64_t vruntime = UINT64_MAX;
+
+			SchedulingData *data = _activeThread->GetSchedulingData<SchedulingData>();
+			if(data && data->fair)
+				vruntime = data->vruntime;
+
+			std::intrusive_rbtree<Thread>::member *leftmost = _activeQueue->fair.head();
+			if(leftmost)
+				vruntime = std::min(vruntime, leftmost->get()->GetSchedulingData<SchedulingData>()->vruntime);
+
+			if(vruntime != UINT64_MAX)
+				_minVruntime = std::max(_minVruntime, vruntime);
+		}
+
+		uint32_t GetFairSlice() const
+		{
+			uint32_t count = static_cast<uint32_t>(_activeQueue->fair.size()) + 1;
+			return std::max(kFairLatency / count, kFairMinGranularity);
+		}
+
+		uint32_t GetFairTimeLeft(SchedulingData *data) const
+		{
+			if(data->runtime < kFairMinGranularity)
+				return kFairMinGranularity - data->runtime;
+
+			uint32_t slice = GetFairSlice();
+			if(data->runtime < slice)
+				return slice - data->runtime;
+
+			return kFairMinGranularity;
+		}
+
+		// The active thread gives up the CPU once its slice is used up and someone is further behind,
+		// or right away if a thread woke up that is behind by more than the wakeup granularity
+		bool ShouldPreemptFair(SchedulingData *data) const
+		{
+			std::intrusive_rbtree<Thread>::member *leftmost = _activeQueue->fair.head();
+			if(!leftmost || data->runtime < kFairMinGranularity)
+				return false;
+
+			SchedulingData *other = leftmost->get()->GetSchedulingData<SchedulingData>();
+
+			if(data->runtime >= GetFairSlice())
+				return (other->vruntime < data->vruntime);
+
+			return (data->vruntime > other->vruntime + kFairWakeupGranularity);
+		}
+
+		static bool IsDeadlineBefore(Thread *thread, Thread *other)
+		{
+			return (thread->GetSchedulingData<SchedulingData>()->absoluteDeadline < other->GetSchedulingData<SchedulingData>()->absoluteDeadline);
+		}
+
+		void StartDeadlineJob(Thread *thread, uint64_t start)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			const Thread::DeadlineParameters &parameters = thread->GetDeadlineParameters();
+
+			data->periodStart = start;
+			data->absoluteDeadline = start + parameters.deadline;
+			data->budget = parameters.runtime;
+			data->throttled = false;
+
+			thread->GetDeadlineStatistics()->jobs ++;
+		}
+
+		// Takes the thread off the CPU until its next period starts
+		void ThrottleDeadline(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			const Thread::DeadlineParameters &parameters = thread->GetDeadlineParameters();
+
+			Dequeue(thread);
+			data->throttled = true;
+
+			if(thread == _activeThread)
+				_needsReschedule = true;
+
+			data->deadlineTimer.SetCallback(&CPUScheduler::DeadlineTimeout, thread->Retain());
+			data->deadlineTimer.ArmDeadline(data->periodStart + parameters.period);
+		}
+
+		static void DeadlineTimeout(__unused Timer *timer, void *context)
+		{
+			Thread *thread = reinterpret_cast<Thread *>(context);
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			if(data)
+			{
+				CPUScheduler *scheduler = _sharedScheduler->_schedulerMap[data->runningCPU->GetID()];
+				scheduler->PushCommand(SchedulerCommand(SchedulerCommand::Command::ReplenishDeadline, thread));
+			}
+
+			thread->Release();
+		}
+
+		// Called from the clock interrupt with the time the running deadline thread used
+		void ChargeDeadline(Thread *thread, uint32_t elapsed)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			data->budget = (elapsed < data->budget) ? data->budget - elapsed : 0;
+
+			if(data->budget == 0)
+			{
+				// The job can't finish before its deadline anymore, which is at most the end of the period
+				Thread::DeadlineStatistics *statistics = thread->GetDeadlineStatistics();
+
+				statistics->overruns ++;
+				statistics->misses ++;
+
+				_statistics.deadlineOverruns ++;
+				_statistics.deadlineMisses ++;
+
+				ThrottleDeadline(thread);
+			}
+		}
+
+		void ReplenishDeadline(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			if(!data->deadline || !data->throttled)
+				return;
+
+			// Stay in phase with the period, unless the thread fell behind by more than one
+			uint32_t period = thread->GetDeadlineParameters().period;
+			uint64_t now = Sys::Clock::GetMicroseconds();
+			uint64_t start = data->periodStart + period;
+
+			if(now >= start + period)
+				start = now;
+
+			StartDeadlineJob(thread, start);
+
+			if(data->blocks == 0)
+			{
+				Enqueue(thread, false);
+				_needsReschedule = true;
+			}
+		}
+
+		void EnterDeadlineClass(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			data->deadline = true;
+			data->fair = false;
+			_deadlineThreads ++;
+
+			StartDeadlineJob(thread, Sys::Clock::GetMicroseconds());
+		}
+		void LeaveDeadlineClass(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			if(!data->deadline)
+				return;
+
+			Dequeue(thread);
+
+			if(data->deadlineTimer.Cancel())
+				thread->Release();
+
+			data->deadline = false;
+			data->throttled = false;
+			_deadlineThreads --;
+		}
+
+		// Sets up the class of a thread that is new to the CPU. The virtual runtime of fair
+		// threads is relative to the previous CPU at this point, or 0 if it wasn't fair before
+		void PlaceThread(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			if(thread->GetDeadlineCPU() == static_cast<int32_t>(_cpu->GetID()) && thread->GetDeadlineParameters().runtime > 0)
+			{
+				EnterDeadlineClass(thread);
+				return;
+			}
+
+			data->fair = (_fair && data->priorityClass == Thread::PriorityClassNormal);
+			data->vruntime = data->fair ? data->vruntime + _minVruntime : 0;
+		}
+
+		void UpdateDeadline(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			Dequeue(thread);
+			LeaveDeadlineClass(thread);
+
+			// Threads leaving the deadline class start over with everyone else in the fair class
+			data->vruntime = 0;
+			PlaceThread(thread);
+
+			if(data->blocks == 0)
+				Enqueue(thread, false);
+
+			if(thread == _activeThread)
+				_needsReschedule = true;
+
+			// Moves it over if the bandwidth got reserved on another CPU
+			CheckAffinity(thread);
+		}
+
+		void InsertThread(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			_threads.push_back(data->schedulerEntry);
+
+			PlaceThread(thread);
+
+			if(data->blocks == 0)
+				Enqueue(thread, false);
+		}
+
+		// Picks a waiting thread that can be moved to the target CPU. Prefers the least important threads,
+		// and from those the ones that waited the longest, as their cache footprint is most likely gone anyway
+		Thread *GetMigrationCandidate(Sys::CPU *target)
+		{
+			RunQueue *queues[2] = { _expiredQueue, _activeQueue };
+
+			for(RunQueue *queue : queues)
+			{
+				uint32_t bitmap = queue->bitmap;
+
+				while(bitmap)
+				{
+					uint32_t level = Sys::CPUBitScanReverse(bitmap);
+					bitmap &= ~(1 << level);
+
+					std::intrusive_rbtree<Thread>::member *member = (level == kFairLevel) ? queue->fair.head() : nullptr;
+					while(member)
+					{
+						Thread *thread = member->get();
+
+						if(IsAllowedOnCPU(thread, target))
+							return thread;
+
+						member = member->next();
+					}
+
+					std::intrusive_list<Thread>::member *entry = queue->levels[level].head();
+					while(entry)
+					{
+						Thread *thread = entry->get();
+
+						if(IsAllowedOnCPU(thread, target))
+							return thread;
+
+						entry = entry->next();
+					}
+				}
+			}
+
+			return nullptr;
+		}
+
+		void GiveThread(Sys::CPU *target)
+		{
+			CPUScheduler *other = _sharedScheduler->_schedulerMap[target->GetID()];
+			other->_stealPending.store(false, std::memory_order_release);
+
+			// Only hand something out if it actually evens out the load
+			if(!other->IsAvailable() || GetLoad() < other->GetLoad() + 2)
+				return;
+
+			Thread *thread = GetMigrationCandidate(target);
+			if(thread)
+				MigrateThread(thread, other);
+		}
+
+		// The thread must not be the one currently running on the CPU
+		void MigrateThread(Thread *thread, CPUScheduler *target)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			// Other CPUs keep sending commands for the thread here until the new CPU adopted it and
+			// published itself as runningCPU. We forward them, which queues them behind the MigrateThread command
+			Dequeue(thread);
+			LeaveDeadlineClass(thread);
+			_threads.erase(data->schedulerEntry);
+
+			// The FPU state might still be in our registers, the new CPU has to find it in memory
+			Sys::FPU::SaveThread(_cpu, thread);
+
+			// Only the lag to the rest of the fair threads carries over
+			data->vruntime = (data->fair && data->vruntime > _minVruntime) ? data->vruntime - _minVruntime : 0;
+			data->migrationTarget.store(target->_cpu, std::memory_order_release);
+
+			_statistics.migrationsOut ++;
+			SchedulerTrace::Record(SchedulerTrace::Type::Migrate, thread, target->_cpu->GetID());
+
+			UpdateLoad();
+
+			target->PushCommand(SchedulerCommand(SchedulerCommand::Command::MigrateThread, thread));
+		}
+
+		void CheckAffinity(Thread *thread)
+		{
+			if(IsAllowedOnCPU(thread, _cpu))
+				return;
+
+			// The running thread is still on our stack, it's moved once it has been switched out
+			if(thread == _activeThread)
+			{
+				_needsReschedule = true;
+				return;
+			}
+
+			if(thread == _pendingMigration)
+				return;
+
+			CPUScheduler *target = _sharedScheduler->GetLeastLoadedScheduler(thread);
+			if(target != this)
+				MigrateThread(thread, target);
 		}
 
-		void MakeSchedulingDecision()
+		void MigratePendingThread()
 		{
-			if(!spinlock_try_lock(&_internalLock))
+			Thread *thread = _pendingMigration;
+			if(!thread)
 				return;
 
-			Thread *thread = _activeThread;
-			Task *task = thread->GetTask();
+			_pendingMigration = nullptr;
 
-			bool needsReschedule;
+			CPUScheduler *target = _sharedScheduler->GetLeastLoadedScheduler(thread);
 
-			if(task->GetState() == Task::State::Died)
+			if(target != this)
 			{
-				RemoveThread(thread);
-				task->MarkThreadExit(thread);
-
-				thread = nullptr;
-				task = nullptr;
-				needsReschedule = true;
+				MigrateThread(thread, target);
 			}
 			else
 			{
 				SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
 
-				if(data->usage >= 5) // Todo: This should probably be priority dependent
-				{
-					data->forcedDown = true;
-					_hasForcedDown = true;
-				}
-
-				needsReschedule = !CanScheduleThread(thread->GetTask(), data);
-				if(!needsReschedule)
-				{
-					// Recalculate the threads priority every 4 ticks
-					if((data->usage % 4) == 0)
-						data->priority = (data->usage / 4) + task->GetNice();
-				}
-
-				// If we are in the idle priority class, unblock all force blocked threads
-				if(data->priorityClass == Thread::PriorityClassIdle && _hasForcedDown)
-				{
-					for(int i = 0; i < Thread::__PriorityClassMax; i ++)
-					{
-						std::intrusive_list<Thread>::member *entry = _threads[i].head();
-						while(entry)
-						{
-							SchedulingData *temp = entry->get()->GetSchedulingData<SchedulingData>();
-							temp->forcedDown = false;
-
-							entry = entry->next();
-						}
-					}
-
-					_hasForcedDown = false;
-				}
+				if(data->blocks == 0)
+					Enqueue(thread, false);
 			}
 
-			// See if there is a thread with a higher priority that we can schedule
-			Thread *newThread = nullptr;
-
-			for(int i = 0; i < Thread::__PriorityClassMax; i ++)
-			{
-				Thread *lowest = nullptr;
-				SchedulingData *lowestData = nullptr;
-
-				std::intrusive_list<Thread>::member *entry = _threads[i].head();
-				while(entry)
-				{
-					Thread *temp = entry->get();
-					SchedulingData *tempData = temp->GetSchedulingData<SchedulingData>();
-
-					if(CanScheduleThread(temp->GetTask(), tempData))
-					{
-						if(tempData->needsWakeup)
-						{
-							lowestData = tempData;
-							lowest = temp;
-
-							break;
-						}
-
-						if(!lowestData || tempData->priority < lowestData->priority)
-						{
-							lowestData = tempData;
-							lowest = temp;
-						}
-					}
-					else if(temp->GetTask()->GetState() == Task::State::Died)
-					{
-						entry = entry->next();
+			thread->Release();
+		}
+		void AdoptThread(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			data->slice = 0;
 
-						RemoveThread(temp);
-						temp->GetTask()->MarkThreadExit(temp);
+			// Publish ourselves before clearing the target, readers check the target first and fall back to runningCPU
+			data->runningCPU = _cpu;
+			data->migrationTarget.store(nullptr, std::memory_order_release);
 
-						continue;
-					}
+			_threads.push_back(data->schedulerEntry);
+			PlaceThread(thread);
 
-					entry = entry->next();
-				}
+			if(data->blocks == 0)
+				Enqueue(thread, false);
 
-				if(lowest)
-				{
-					newThread = lowest;
-					break;
-				}
-			}
+			_statistics.migrationsIn ++;
+			_needsReschedule = true;
 
-			if(needsReschedule && (newThread == nullptr || newThread == thread))
-				newThread = _idleThread;
-			
-			_nextThread = newThread;
-			
-			spinlock_unlock(&_internalLock);
+			UpdateLoad();
 		}
 
-		void InsertThread(Thread *thread)
+		void Balance()
 		{
-			SchedulingData *data = new SchedulingData(thread);
-			data->usage = 0;
-			data->priority = 0;
-			data->priorityClass = thread->GetPriorityClass();
-			data->pinnedCPU = nullptr;
-			data->runningCPU = _cpu;
-			data->blocks = 0;
-			data->forcedDown = false;
-			data->needsWakeup = false;
+			if(_stealPending.load(std::memory_order_acquire))
+				return;
+
+			CPUScheduler *busiest = _sharedScheduler->GetBusiestScheduler(this);
+			if(!busiest || busiest->GetLoad() < GetLoad() + 2)
+				return;
 
-			thread->SetSchedulingData(data);
-			_threads[data->priorityClass].push_back(data->schedulerEntry);
+			_stealPending.store(true, std::memory_order_release);
+			busiest->PushCommand(SchedulerCommand(SchedulerCommand::Command::StealThread, _cpu));
 		}
 		void RemoveThread(Thread *thread)
 		{
 			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
 
-			_threads[data->priorityClass].erase(data->schedulerEntry);
+			Dequeue(thread);
+			LeaveDeadlineClass(thread);
+
+			// Give back the bandwidth of deadline threads that die
+			if(thread->GetDeadlineCPU() == static_cast<int32_t>(_cpu->GetID()))
+			{
+				ReleaseBandwidth(GetDeadlineBandwidth(thread->GetDeadlineParameters()));
+
+				Thread::DeadlineParameters parameters = { 0, 0, 0 };
+				thread->SetDeadlineParameters(parameters, -1);
+			}
+
+			_threads.erase(data->schedulerEntry);
 			thread->SetSchedulingData(nullptr);
 
+			Sys::FPU::ReleaseThread(_cpu, thread);
+
+			if(_pendingMigration == thread)
+			{
+				_pendingMigration = nullptr;
+				thread->Release();
+			}
+
 			if(_activeThread == thread)
 				_needsReschedule = true;
 
@@ -323,6 +1302,9 @@ namespace OS
 			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
 			data->blocks ++;
 
+			Dequeue(thread);
+			SchedulerTrace::Record(SchedulerTrace::Type::Block, thread);
+
 			if(_activeThread == thread)
 				_needsReschedule = true;
 		}
@@ -340,6 +1322,26 @@ namespace OS
 				data->usage = (data->usage + task->GetNice()) / 3;
 				data->priority = (data->usage / 4) + task->GetNice();
 
+				// Deadline threads that slept through their deadline start a new job right away
+				if(data->deadline && !data->throttled)
+				{
+					uint64_t now = Sys::Clock::GetMicroseconds();
+
+					if(now >= data->absoluteDeadline)
+						StartDeadlineJob(thread, now);
+				}
+
+				// Fair threads don't get to bank the time they slept, but start a bit behind everyone else
+				if(data->fair)
+				{
+					uint64_t floor = (_minVruntime > kFairSleeperCredit) ? _minVruntime - kFairSleeperCredit : 0;
+					data->vruntime = std::max(data->vruntime, floor);
+				}
+
+				Enqueue(thread, true);
+				SchedulerTrace::Record(SchedulerTrace::Type::Wakeup, thread, _cpu->GetID());
+
+				_wakeupPending = true;
 				_needsReschedule = true;
 			}
 		}
@@ -347,14 +1349,83 @@ namespace OS
 		void YieldThread(Thread *thread)
 		{
 			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+
+			// For deadline threads yielding means the job is done, they sleep until the next period
+			if(data->deadline)
+			{
+				if(!data->throttled)
+				{
+					if(Sys::Clock::GetMicroseconds() > data->absoluteDeadline)
+					{
+						thread->GetDeadlineStatistics()->misses ++;
+						_statistics.deadlineMisses ++;
+					}
+
+					ThrottleDeadline(thread);
+				}
+
+				return;
+			}
 			
 			data->forcedDown = true;
 			_needsReschedule = true;
+
+			// Move it over to the expired queue if it's waiting
+			if(data->runqueue)
+			{
+				Dequeue(thread);
+				Enqueue(thread, false);
+			}
+		}
+
+
+		void UpdatePriority(Thread *thread)
+		{
+			SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+			uint32_t level = thread->GetInheritedPriority();
+
+			if(level == data->inheritedLevel)
+				return;
+
+			// Deadline threads aren't in a runqueue, they already run ahead of every level
+			bool requeue = (data->runqueue != nullptr);
+			if(requeue)
+				Dequeue(thread);
+
+			data->inheritedLevel = level;
+
+			if(level != Thread::kNoInheritedPriority)
+				data->forcedDown = false;
+
+			if(requeue)
+				Enqueue(thread, true);
+
+			_needsReschedule = true;
 		}
 
 
 		void RunCommand(const SchedulerCommand &command)
 		{
+			if(command.thread && command.command != SchedulerCommand::Command::InsertThread && command.command != SchedulerCommand::Command::MigrateThread)
+			{
+				SchedulingData *data = command.thread->GetSchedulingData<SchedulingData>();
+				if(!data)
+					return;
+
+				// The thread got migrated away after the command was issued, or is on its way
+				Sys::CPU *cpu = data->migrationTarget.load(std::memory_order_acquire);
+				if(!cpu)
+					cpu = data->runningCPU;
+
+				if(cpu != _cpu)
+				{
+					CPUScheduler *owner = _sharedScheduler->_schedulerMap[cpu->GetID()];
+					owner->PushCommand(SchedulerCommand(command.command, command.thread));
+
+					return;
+				}
+			}
+
 			switch(command.command)
 			{
 				case SchedulerCommand::Command::InsertThread:
@@ -372,28 +1443,66 @@ namespace OS
 				case SchedulerCommand::Command::YieldThread:
 					YieldThread(command.thread);
 					break;
+				case SchedulerCommand::Command::MigrateThread:
+					AdoptThread(command.thread);
+					break;
+				case SchedulerCommand::Command::StealThread:
+					GiveThread(command.cpu);
+					break;
+				case SchedulerCommand::Command::CheckAffinity:
+					CheckAffinity(command.thread);
+					break;
+				case SchedulerCommand::Command::UpdateDeadline:
+					UpdateDeadline(command.thread);
+					break;
+				case SchedulerCommand::Command::ReplenishDeadline:
+					ReplenishDeadline(command.thread);
+					break;
+				case SchedulerCommand::Command::UpdatePriority:
+					UpdatePriority(command.thread);
+					break;
 			}
 		}
 
 		void Notify()
 		{
+			// A CPU waiting in MWAIT picks up the request from its monitored word
+			if(Idle::Wake(_cpu, Idle::Request::Commands))
+				return;
+
+			SchedulerTrace::RecordIPI(SchedulerTrace::Type::IPISent, 0x41, _cpu->GetID());
 			Sys::APIC::SendIPI(0x41, _cpu);
 		}
 
 		Sys::CPU *_cpu;
-		std::intrusive_list<Thread> _threads[Thread::__PriorityClassMax];
+		std::intrusive_list<Thread> _threads; // All threads owned by the CPU
+		RunQueue _runQueues[2];
+		RunQueue *_activeQueue;
+		RunQueue *_expiredQueue;
+		uint64_t _lastUpdate; // Time of the last Schedule() call
+		uint32_t _tickTime; // Time the active thread ran since it was last charged a tick
 		uint32_t _time;
+		uint32_t _balanceTime;
+		uint64_t _minVruntime; // Smallest virtual runtime of the fair threads, never decreases
+		std::intrusive_rbtree<Thread> _deadlineQueue; // Runnable deadline threads by absolute deadline
+		size_t _deadlineThreads;
+		std::atomic<uint32_t> _deadlineBandwidth; // Reserved on this CPU, changed by any CPU during admission
+		std::atomic<size_t> _load;
+		std::atomic<bool> _stealPending;
 		Thread *_activeThread;
 		Thread *_idleThread;
 		Thread *_nextThread;
+		Thread *_pendingMigration;
 		bool _firstRun;
-		bool _hasForcedDown;
+		bool _wakeupPending;
 		bool _needsReschedule;
 		std::atomic<bool> _enabled;
+		bool _fair; // Set at boot, normal priority threads are put in the fair class
+		Statistics _statistics;
 
 		spinlock_t _internalLock;
-		spinlock_t _commandLock;
-		std::vector<SchedulerCommand> _commands;
+		std::atomic<CommandNode *> _commands; // Pushed by other CPUs, newest first
+		CommandPool _commandPool; // Nodes for commands this CPU sends to others
 	};
 
 	// ---------------
@@ -401,11 +1510,54 @@ namespace OS
 	// Responsible for coordinating the CPU schedulers
 	// ---------------
 
-	static SMPScheduler *_sharedScheduler = nullptr;
+	// sched.fair=<mask> on the command line puts the CPUs in the mask into the fair class,
+	// the mask is either a number, optionally in hex, or "all"
+	static uint32_t GetFairCPUMask()
+	{
+		size_t length;
+		const char *value = Sys::GetBootArgument("sched.fair", &length);
+
+		if(!value)
+			return 0;
+
+		if(length == 3 && strncmp(value, "all", 3) == 0)
+			return 0xffffffff;
+
+		uint32_t base = 10;
+		uint32_t mask = 0;
+
+		if(length > 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'X'))
+		{
+			base = 16;
+			value += 2;
+			length -= 2;
+		}
+
+		for(size_t i = 0; i < length; i ++)
+		{
+			char character = value[i];
+			uint32_t digit;
+
+			if(character >= '0' && character <= '9')
+				digit = character - '0';
+			else if(base == 16 && character >= 'a' && character <= 'f')
+				digit = character - 'a' + 10;
+			else if(base == 16 && character >= 'A' && character <= 'F')
+				digit = character - 'A' + 10;
+			else
+				break;
+
+			mask = (mask * base) + digit;
+		}
+
+		return mask;
+	}
 
 	SMPScheduler::SMPScheduler() :
 		_schedulerCount(Sys::CPU::GetCPUCount())
 	{
+		uint32_t fairMask = GetFairCPUMask();
+
 		spinlock_init(&_moveLock);
 
 		void *data = kalloc(_schedulerCount * sizeof(CPUScheduler));
@@ -415,12 +1567,19 @@ namespace OS
 		for(size_t i = 0; i < CONFIG_MAX_CPUS; i ++)
 		{
 			Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
+			_schedulerMap[i] = nullptr;
 
 			if(!cpu)
 				continue;
 
 			if(cpu->GetFlags() & Sys::CPU::Flags::Running)
+			{
 				_schedulerMap[i] = new(proxies + i) CPUScheduler(cpu);
+				_schedulerMap[i]->_fair = (fairMask & (1 << i));
+
+				if(_schedulerMap[i]->_fair)
+					kprintf("cpu%d: fair scheduling\n", static_cast<int>(i));
+			}
 		}
 
 		Sys::SetInterruptHandler(0x23, &SMPScheduler::DoReschedule);
@@ -439,6 +1598,8 @@ namespace OS
 		if((thread = task->AttachThread((Thread::Entry)&IdleTask, Thread::PriorityClass::PriorityClassIdle, 0, nullptr)).IsValid() == false)
 			panic("Failed to activate CPU %d", cpu->GetID());
 
+		scheduler->Dequeue(thread);
+
 		scheduler->_idleThread = thread;
 		scheduler->_activeThread = thread;
 		scheduler->_nextThread = thread;
@@ -449,7 +1610,8 @@ namespace OS
 	uint32_t SMPScheduler::DoWorkqueue(uint32_t esp, Sys::CPU *cpu)
 	{
 		CPUScheduler *scheduler = _sharedScheduler->_schedulerMap[cpu->GetID()];
-		
+		SchedulerTrace::RecordIPI(SchedulerTrace::Type::IPIReceived, 0x41);
+
 		if(scheduler->__WorkCommandQueue())
 			esp = scheduler->Schedule(esp);
 
@@ -457,6 +1619,7 @@ namespace OS
 	}
 	uint32_t SMPScheduler::DoReschedule(uint32_t esp, Sys::CPU *cpu)
 	{
+		SchedulerTrace::RecordIPI(SchedulerTrace::Type::IPIReceived, 0x23);
 		return _sharedScheduler->ScheduleOnCPU(esp, cpu);
 	}
 
@@ -470,6 +1633,25 @@ namespace OS
 		Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
 		return _schedulerMap[cpu->GetID()]->GetActiveThread();
 	}
+	bool SMPScheduler::IsThreadRunning(Thread *thread) const
+	{
+		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+		if(!data || !data->runningCPU)
+			return false;
+
+		return (_schedulerMap[data->runningCPU->GetID()]->GetActiveThread() == thread);
+	}
+	uint32_t SMPScheduler::GetThreadPriority(Thread *thread) const
+	{
+		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+		if(!data)
+			return kRunQueueLevels;
+
+		if(data->deadline)
+			return 0;
+
+		return CPUScheduler::GetBaseLevel(data);
+	}
 
 
 	uint32_t SMPScheduler::ScheduleOnCPU(uint32_t esp, Sys::CPU *cpu)
@@ -481,6 +1663,10 @@ namespace OS
 	{
 		CPUScheduler *scheduler = _schedulerMap[cpu->GetID()];
 
+		// Also called on the way out of every interrupt, which might be before the CPU ran its first thread
+		if(!scheduler || scheduler->_firstRun)
+			return esp;
+
 		if(scheduler->_needsReschedule)
 			return scheduler->Schedule(esp);
 
@@ -489,6 +1675,10 @@ namespace OS
 
 	void SMPScheduler::RescheduleCPU(Sys::CPU *cpu)
 	{
+		if(Idle::Wake(cpu, Idle::Request::Reschedule))
+			return;
+
+		SchedulerTrace::RecordIPI(SchedulerTrace::Type::IPISent, 0x23, cpu->GetID());
 		Sys::APIC::SendIPI(0x23, cpu);
 	}
 
@@ -531,6 +1721,17 @@ namespace OS
 	}
 
 
+	bool SMPScheduler::GetStatistics(Sys::CPU *cpu, Statistics *statistics) const
+	{
+		CPUScheduler *scheduler = _schedulerMap[cpu->GetID()];
+		if(!scheduler)
+			return false;
+
+		scheduler->GetStatistics(statistics);
+		return true;
+	}
+
+
 	void SMPScheduler::BlockThread(Thread *thread)
 	{
 		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
@@ -553,15 +1754,215 @@ namespace OS
 		SchedulerCommand command(SchedulerCommand::Command::UnblockThread, thread);
 		_schedulerMap[cpu->GetID()]->PushCommand(std::move(command));
 	}
+	void SMPScheduler::UpdateInheritedPriority(Thread *thread)
+	{
+		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+		if(!data)
+			return;
+
+		Sys::CPU *cpu = data->runningCPU;
 
+		SchedulerCommand command(SchedulerCommand::Command::UpdatePriority, thread);
+		_schedulerMap[cpu->GetID()]->PushCommand(std::move(command));
+	}
 
-	void SMPScheduler::AddThread(Thread *thread)
+
+	SMPScheduler::CPUScheduler *SMPScheduler::GetLeastLoadedScheduler(Thread *thread) const
 	{
 		Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
-		CPUScheduler *scheduler = _schedulerMap[cpu->GetID()];
+		CPUScheduler *result = _schedulerMap[cpu->GetID()];
+
+		// Prefer the current CPU when it's tied, it's the one the creator runs on
+		size_t load = (result->IsAvailable() && IsAllowedOnCPU(thread, cpu)) ? result->GetLoad() : static_cast<size_t>(-1);
+
+		for(size_t i = 0; i < _schedulerCount; i ++)
+		{
+			CPUScheduler *scheduler = _schedulerMap[i];
+
+			if(!scheduler || !scheduler->IsAvailable() || !IsAllowedOnCPU(thread, scheduler->_cpu))
+				continue;
+
+			if(scheduler->GetLoad() < load)
+			{
+				result = scheduler;
+				load = scheduler->GetLoad();
+			}
+		}
+
+		return result;
+	}
+
+	void SMPScheduler::KickIdleScheduler(CPUScheduler *busy)
+	{
+		for(size_t i = 0; i < _schedulerCount; i ++)
+		{
+			CPUScheduler *scheduler = _schedulerMap[i];
 
+			if(!scheduler || scheduler == busy || !scheduler->IsAvailable())
+				continue;
+
+			if(scheduler->GetLoad() == 0 && !scheduler->_stealPending.load(std::memory_order_acquire))
+			{
+				RescheduleCPU(scheduler->_cpu);
+				return;
+			}
+		}
+	}
+
+	SMPScheduler::CPUScheduler *SMPScheduler::GetBusiestScheduler(CPUScheduler *exclude) const
+	{
+		CPUScheduler *result = nullptr;
+		size_t load = 0;
+
+		for(size_t i = 0; i < _schedulerCount; i ++)
+		{
+			CPUScheduler *scheduler = _schedulerMap[i];
+
+			if(!scheduler || scheduler == exclude || !scheduler->IsAvailable())
+				continue;
+
+			if(scheduler->GetLoad() > load)
+			{
+				result = scheduler;
+				load = scheduler->GetLoad();
+			}
+		}
+
+		return result;
+	}
+
+	void SMPScheduler::AddThread(Thread *thread)
+	{
+		// Idle threads are created by the CPU they belong to
+		bool isIdle = (thread->GetPriorityClass() == Thread::PriorityClassIdle);
+		if(isIdle)
+			thread->SetAffinity(1 << Sys::CPU::GetCurrentCPU()->GetID());
+
+		CPUScheduler *scheduler = GetLeastLoadedScheduler(thread);
+
+		// Set up the scheduling data right away, so that commands for the thread find their way to its CPU
+		SchedulingData *data = new SchedulingData(thread);
+		data->usage = 0;
+		data->priority = 0;
+		data->slice = 0;
+		data->level = 0;
+		data->inheritedLevel = Thread::kNoInheritedPriority;
+		data->priorityClass = thread->GetPriorityClass();
+		data->runqueue = nullptr;
+		data->runningCPU = scheduler->_cpu;
+		data->migrationTarget.store(nullptr, std::memory_order_relaxed);
+		data->blocks = 0;
+		data->forcedDown = false;
+		data->needsWakeup = false;
+		data->vruntime = 0;
+		data->runtime = 0;
+		data->fair = false;
+		data->periodStart = 0;
+		data->absoluteDeadline = 0;
+		data->budget = 0;
+		data->deadline = false;
+		data->deadlineQueued = false;
+		data->throttled = false;
+
+		thread->SetSchedulingData(data);
 		scheduler->PushCommand(SchedulerCommand(SchedulerCommand::Command::InsertThread, thread));
 	}
+	KernReturn<void> SMPScheduler::SetThreadAffinity(Thread *thread, uint32_t affinity)
+	{
+		if(thread->GetPriorityClass() == Thread::PriorityClassIdle)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		// There has to be at least one CPU left that can run the thread
+		bool hasCPU = false;
+
+		for(size_t i = 0; i < _schedulerCount; i ++)
+		{
+			CPUScheduler *scheduler = _schedulerMap[i];
+
+			if(scheduler && scheduler->IsAvailable() && (affinity & (1 << i)))
+			{
+				hasCPU = true;
+				break;
+			}
+		}
+
+		if(!hasCPU)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		// Deadline threads can't be moved away from their reserved bandwidth
+		int32_t deadlineCPU = thread->GetDeadlineCPU();
+		if(deadlineCPU != -1 && !(affinity & (1 << deadlineCPU)))
+			return Error(KERN_INVALID_ARGUMENT);
+
+		thread->SetAffinity(affinity);
+
+		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+		if(data && !IsAllowedOnCPU(thread, data->runningCPU))
+		{
+			SchedulerCommand command(SchedulerCommand::Command::CheckAffinity, thread);
+			_schedulerMap[data->runningCPU->GetID()]->PushCommand(std::move(command));
+		}
+
+		return ErrorNone;
+	}
+
+	KernReturn<void> SMPScheduler::SetThreadDeadline(Thread *thread, const Thread::DeadlineParameters &parameters)
+	{
+		if(thread->GetPriorityClass() == Thread::PriorityClassIdle)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
+		if(!data)
+			return Error(KERN_INVALID_ARGUMENT);
+
+		int32_t previousCPU = thread->GetDeadlineCPU();
+		uint32_t previous = (previousCPU != -1) ? GetDeadlineBandwidth(thread->GetDeadlineParameters()) : 0;
+
+		int32_t cpu = -1;
+
+		if(parameters.runtime > 0)
+		{
+			// Admission control, try the CPU the thread is on, then the one it already has bandwidth on, then any other
+			uint32_t bandwidth = GetDeadlineBandwidth(parameters);
+			uint32_t affinity = thread->GetAffinity();
+
+			int32_t candidates[CONFIG_MAX_CPUS + 2];
+			size_t count = 0;
+
+			candidates[count ++] = static_cast<int32_t>(data->runningCPU->GetID());
+			candidates[count ++] = previousCPU;
+
+			for(size_t i = 0; i < _schedulerCount; i ++)
+				candidates[count ++] = static_cast<int32_t>(i);
+
+			for(size_t i = 0; i < count && cpu == -1; i ++)
+			{
+				int32_t candidate = candidates[i];
+				CPUScheduler *scheduler = (candidate != -1) ? _schedulerMap[candidate] : nullptr;
+
+				if(!scheduler || !scheduler->IsAvailable() || !(affinity & (1 << candidate)))
+					continue;
+
+				if(scheduler->ReserveBandwidth(bandwidth, (candidate == previousCPU) ? previous : 0))
+					cpu = candidate;
+			}
+
+			if(cpu == -1)
+				return Error(KERN_RESOURCE_EXHAUSTED);
+		}
+
+		if(previousCPU != -1)
+			_schedulerMap[previousCPU]->ReleaseBandwidth(previous);
+
+		thread->SetDeadlineParameters(parameters, cpu);
+
+		// The thread might be moved to another CPU at the same time, in which case the command is forwarded
+		SchedulerCommand command(SchedulerCommand::Command::UpdateDeadline, thread);
+		_schedulerMap[data->runningCPU->GetID()]->PushCommand(std::move(command));
+
+		return ErrorNone;
+	}
+
 	void SMPScheduler::RemoveThread(Thread *thread)
 	{
 		SchedulingData *data = thread->GetSchedulingData<SchedulingData>();
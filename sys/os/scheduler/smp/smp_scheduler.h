@@ -22,6 +22,7 @@
 #include <prefix.h>
 #include <os/scheduler/scheduler.h>
 #include <libcpp/intrusive_list.h>
+#include <libcpp/intrusive_rbtree.h>
 #include <libc/sys/spinlock.h>
 
 namespace OS
@@ -33,6 +34,8 @@ namespace OS
 
 		Task *GetActiveTask() const final;
 		Thread *GetActiveThread() const final;
+		bool IsThreadRunning(Thread *thread) const final;
+		uint32_t GetThreadPriority(Thread *thread) const final;
 
 		uint32_t ScheduleOnCPU(uint32_t esp, Sys::CPU *cpu) final;
 		uint32_t PokeCPU(uint32_t esp, Sys::CPU *cpu) final;
@@ -43,29 +46,57 @@ namespace OS
 		void BlockThread(Thread *thread) final;
 		void UnblockThread(Thread *thread) final;
 		void YieldThread(Thread *thread) final;
+		void UpdateInheritedPriority(Thread *thread) final;
 
 		void AddThread(Thread *thread) final;
 		void RemoveThread(Thread *thread) final;
 
+		KernReturn<void> SetThreadAffinity(Thread *thread, uint32_t affinity) final;
+		KernReturn<void> SetThreadDeadline(Thread *thread, const Thread::DeadlineParameters &parameters) final;
+
 		bool DisableCPU(Sys::CPU *cpu) final;
 		void EnableCPU(Sys::CPU *cpu) final;
 
+		bool GetStatistics(Sys::CPU *cpu, Statistics *statistics) const final;
+
 	private:
 		static uint32_t DoWorkqueue(uint32_t esp, Sys::CPU *cpu);
 		static uint32_t DoReschedule(uint32_t esp, Sys::CPU *cpu);
 
+		struct RunQueue;
+
 		struct SchedulingData
 		{
 			SchedulingData(Thread *thread) :
-				schedulerEntry(thread)
+				schedulerEntry(thread),
+				runqueueEntry(thread),
+				fairEntry(thread),
+				deadlineEntry(thread)
 			{}
 
 			uint32_t usage;
 			uint32_t priority;
+			uint32_t slice; // Ticks since the thread was last picked
+			uint32_t level; // Runqueue level the thread was queued at
+			uint32_t inheritedLevel; // Level inherited from the waiters of its mutexes, Thread::kNoInheritedPriority if none
 			Thread::PriorityClass priorityClass;
 			std::intrusive_list<Thread>::member schedulerEntry;
-			Sys::CPU *pinnedCPU;
-			Sys::CPU *runningCPU;
+			std::intrusive_list<Thread>::member runqueueEntry;
+			std::intrusive_rbtree<Thread>::member fairEntry;
+			uint64_t vruntime; // Weighted microseconds, only meaningful for threads in the fair class
+			uint32_t runtime; // Microseconds since the thread was last picked
+			bool fair;
+			std::intrusive_rbtree<Thread>::member deadlineEntry;
+			Timer deadlineTimer; // Hands out the next budget at the start of the next period
+			uint64_t periodStart;
+			uint64_t absoluteDeadline;
+			uint32_t budget; // Microseconds left in the current period
+			bool deadline; // Scheduled by the deadline class of the CPU
+			bool deadlineQueued;
+			bool throttled; // Waiting for the next period
+			RunQueue *runqueue; // nullptr while running, blocked or being moved
+			Sys::CPU *runningCPU; // Only changed by the owning CPU, it stays the old CPU until the new one adopted the thread
+			std::atomic<Sys::CPU *> migrationTarget; // Set while a MigrateThread command is in flight
 			uint32_t blocks;
 			bool forcedDown;
 			bool needsWakeup;
@@ -79,12 +110,29 @@ namespace OS
 				RemoveThread,
 				BlockThread,
 				UnblockThread,
-				YieldThread
+				YieldThread,
+				MigrateThread, // Hands a detached thread over to the receiving CPU
+				StealThread, // Asks the receiving CPU to give one of its threads to cpu
+				CheckAffinity, // Moves the thread away if the receiving CPU is no longer in its affinity mask
+				UpdateDeadline, // Applies the thread's deadline parameters
+				ReplenishDeadline, // A throttled deadline thread reached its next period
+				UpdatePriority // Picks up a change of the thread's inherited priority
 			};
 
+			SchedulerCommand() :
+				command(Command::InsertThread),
+				thread(nullptr),
+				cpu(nullptr)
+			{}
 			SchedulerCommand(Command tcommand, Thread *tthread) :
 				command(tcommand),
-				thread(tthread->Retain())
+				thread(tthread->Retain()),
+				cpu(nullptr)
+			{}
+			SchedulerCommand(Command tcommand, Sys::CPU *tcpu) :
+				command(tcommand),
+				thread(nullptr),
+				cpu(tcpu)
 			{}
 			~SchedulerCommand()
 			{
@@ -93,22 +141,30 @@ namespace OS
 
 			SchedulerCommand &operator =(const SchedulerCommand &other)
 			{
+				Thread *previous = thread;
+
 				thread = IO::SafeRetain(other.thread);
+				IO::SafeRelease(previous);
 				command = other.command;
+				cpu = other.cpu;
 				return *this;
 			}	
 
 			SchedulerCommand(SchedulerCommand &&other) :
 				command(other.command),
-				thread(other.thread)
+				thread(other.thread),
+				cpu(other.cpu)
 			{
 				other.thread = nullptr;
 			}
 
 			SchedulerCommand &operator =(SchedulerCommand &&other)
 			{
+				IO::SafeRelease(thread);
+
 				thread = other.thread;
 				command = other.command;
+				cpu = other.cpu;
 
 				other.thread = nullptr;
 				return *this;
@@ -116,10 +172,29 @@ namespace OS
 
 			Command command;
 			Thread *thread;
+			Sys::CPU *cpu;
+		};
+
+		struct CommandPool;
+
+		struct CommandNode
+		{
+			CommandNode(CommandPool *tpool) :
+				next(nullptr),
+				pool(tpool)
+			{}
+
+			CommandNode *next;
+			CommandPool *pool; // The pool of the CPU that allocated the node
+			SchedulerCommand command;
 		};
 
 		class CPUScheduler;
 
+		CPUScheduler *GetLeastLoadedScheduler(Thread *thread) const;
+		CPUScheduler *GetBusiestScheduler(CPUScheduler *exclude) const;
+		void KickIdleScheduler(CPUScheduler *busy);
+
 		size_t _schedulerCount;
 		CPUScheduler *_schedulerMap[CONFIG_MAX_CPUS]; // The CPU number corresponds with the array index
 		spinlock_t _moveLock;
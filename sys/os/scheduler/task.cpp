@@ -23,8 +23,10 @@
 #include <vfs/vfs.h>
 #include <machine/interrupts/trampoline.h>
 #include <machine/debug.h>
+#include <os/futex.h>
 #include <os/waitqueue.h>
 #include <os/linker/LDService.h>
+#include <os/swap/swap.h>
 #include <libc/ipc/ipc_message.h>
 #include "scheduler.h"
 #include "task.h"
@@ -37,6 +39,15 @@ namespace OS
 	extern IPC::Port *hostPort;
 	extern IPC::Port *bootstrapPort;
 
+	static void AddUsage(Thread::Usage *usage, const Thread::Usage *other)
+	{
+		usage->userCycles += other->userCycles;
+		usage->kernelCycles += other->kernelCycles;
+		usage->voluntarySwitches += other->voluntarySwitches;
+		usage->involuntarySwitches += other->involuntarySwitches;
+		usage->syscalls += other->syscalls;
+	}
+
 	void __TaskIPCCallback(IPC::Port *port, IPC::Message *message)
 	{
 		ipc_header_t *header = message->GetHeader();
@@ -99,6 +110,8 @@ namespace OS
 		_executable = nullptr;
 		_threads = IO::Array::Alloc()->Init();
 		_name = nullptr;
+
+		memset(&_removedUsage, 0, sizeof(Thread::Usage));
 		_exitedThreads = 0;
 
 		_space = IPC::Space::Alloc()->Init();
@@ -162,7 +175,10 @@ namespace OS
 		_executable->Release();
 
 		if(_directory != Sys::VM::Directory::GetKernelDirectory())
+		{
+			Swap::Discard(_directory);
 			delete _directory;
+		}
 
 		_files->Release();
 		_threads->Release();
@@ -226,6 +242,9 @@ namespace OS
 
 	void Task::MarkThreadExit(Thread *thread)
 	{
+		Futex::Cancel(thread);
+		Waitqueue::Cancel(thread);
+
 		_exitedThreads ++;
 		Wakeup(thread->GetJoinToken());
 
@@ -234,13 +253,36 @@ namespace OS
 
 	void Task::RemoveThread(Thread *thread)
 	{
+		Futex::Cancel(thread);
+		Waitqueue::Cancel(thread);
+
 		thread->_task = nullptr;
 
 		spinlock_lock(&_lock);
+
+		AddUsage(&_removedUsage, thread->GetUsage());
 		_threads->RemoveObject(thread);
+
 		spinlock_unlock(&_lock);
 	}
 
+	size_t Task::GetUsage(Thread::Usage *usage)
+	{
+		Lock();
+
+		*usage = _removedUsage;
+
+		_threads->Enumerate<Thread>([&](Thread *thread, __unused size_t index, __unused bool &stop) {
+			AddUsage(usage, thread->GetUsage());
+		});
+
+		size_t count = _threads->GetCount();
+
+		Unlock();
+
+		return count;
+	}
+
 
 	void Task::Lock()
 	{
@@ -252,11 +294,11 @@ namespace OS
 	}
 
 
-	Thread *Task::GetThreadWithID(tid_t id)
+	IO::StrongRef<Thread> Task::GetThreadWithID(tid_t id)
 	{
 		Lock();
 
-		Thread *result = nullptr;
+		IO::StrongRef<Thread> result;
 
 		_threads->Enumerate<Thread>([&](Thread *thread, __unused size_t index, bool &stop) {
 
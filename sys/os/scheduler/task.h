@@ -37,6 +37,7 @@
 #include <os/ipc/IPC.h>
 #include <os/syscall/syscall_mmap.h>
 #include <os/loader/loader.h>
+#include <os/rcu.h>
 
 #include "thread.h"
 
@@ -79,9 +80,12 @@ namespace OS
 		Sys::VM::Directory *GetDirectory() const { return _directory; }
 		int GetNice() const { return _nice.load(); }
 		Thread *GetMainThread() const { return _mainThread; }
-		Thread *GetThreadWithID(tid_t id);
+		IO::StrongRef<Thread> GetThreadWithID(tid_t id); // Retained under the task lock, so it can't exit in between
 		State GetState() const { return _state.load(); }
 
+		// Sum of all threads, including the ones that were removed already. Returns the number of live threads
+		size_t GetUsage(Thread::Usage *usage);
+
 		IO::String *GetName() const { return _name; }
 
 		// VFS
@@ -101,7 +105,9 @@ namespace OS
 		IPC::Port *GetSpecialPort(int port) const { return _specialPorts[port]; }
 
 		// Scheduler
-		std::intrusive_list<Task>::member schedulerEntry;
+		RCU::List<Task>::Member schedulerEntry;
+		RCU::Entry schedulerRelease; // Drops the scheduler's reference once no lookup can see the task anymore
+		RCU::Entry exitRelease; // Fallback for dropping the exit reference when the work queue is full
 
 		// Mmap
 		std::intrusive_list<MmapTaskEntry> mmapList;
@@ -120,6 +126,7 @@ namespace OS
 		std::atomic<int32_t> _tidCounter;
 		IO::Array *_threads;
 		Thread *_mainThread;
+		Thread::Usage _removedUsage;
 
 		IO::String *_name;
 		int32_t _exitCode;
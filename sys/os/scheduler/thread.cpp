@@ -44,6 +44,17 @@ namespace OS
 		_task  = task;
 		_entry = entry;
 		_esp   = 0;
+		_faultAddress = 0;
+		_affinity = UINT32_MAX;
+		_syscallDeadline = 0;
+		_preemptCount = 0;
+		_deadlineCPU = -1;
+		_inheritedPriority = kNoInheritedPriority;
+		_blockingMutex = nullptr;
+
+		memset(&_deadlineParameters, 0, sizeof(DeadlineParameters));
+		memset(&_deadlineStatistics, 0, sizeof(DeadlineStatistics));
+		memset(&_usage, 0, sizeof(Usage));
 		_priority = priority;
 		_kernelStack = nullptr;
 		_kernelStackVirtual = nullptr;
@@ -51,6 +62,7 @@ namespace OS
 		_userStackVirtual = nullptr;
 		_tlsPhysical = 0;
 		_tlsVirtual = 0;
+		_fpuState = nullptr;
 
 		_tid = _task->_tidCounter.fetch_add(1);
 
@@ -104,6 +116,8 @@ namespace OS
 		if(_tlsVirtual)
 			_task->_directory->Free(_tlsVirtual, 1);
 
+		Sys::FPU::FreeState(_fpuState);
+
 		IO::Object::Dealloc();
 	}
 
@@ -352,4 +366,10 @@ namespace OS
 	{
 		_schedulingData = data;
 	}
+
+	void Thread::SetDeadlineParameters(const DeadlineParameters &parameters, int32_t cpu)
+	{
+		_deadlineParameters = parameters;
+		_deadlineCPU.store(cpu, std::memory_order_release); // Publishes the parameters to the CPU
+	}
 }
@@ -26,15 +26,20 @@
 #include <libcpp/atomic.h>
 #include <libcpp/intrusive_list.h>
 #include <machine/cpu.h>
+#include <machine/fpu.h>
 #include <kern/kern_return.h>
 #include <libc/sys/spinlock.h>
 #include <libio/core/IOObject.h>
 #include <libio/core/IOArray.h>
 #include <os/ipc/IPCPort.h>
+#include <os/timer.h>
+#include <os/futex.h>
+#include <os/waitqueue.h>
 
 namespace OS
 {
 	class Task;
+	class Mutex;
 
 	class Thread : public IO::Object
 	{
@@ -48,20 +53,67 @@ namespace OS
 			__PriorityClassMax
 		};
 		
+		// Earliest deadline first class, times are in microseconds
+		struct DeadlineParameters
+		{
+			uint32_t runtime; // CPU time per period, 0 if the thread isn't in the deadline class
+			uint32_t period;
+			uint32_t deadline; // Relative to the start of the period
+		};
+
+		struct DeadlineStatistics
+		{
+			uint32_t jobs; // Periods the thread got its budget for
+			uint32_t misses; // Jobs that weren't done by their deadline
+			uint32_t overruns; // Jobs that used up their budget and were throttled
+		};
+
+		// CPU time is in TSC cycles. Only ever written by the CPU the thread runs on, or by the
+		// worker completing one of its syscalls while it's blocked
+		struct Usage
+		{
+			uint64_t userCycles;
+			uint64_t kernelCycles; // Includes the syscalls workers completed on behalf of the thread
+			uint64_t voluntarySwitches; // The thread blocked or used up its deadline budget
+			uint64_t involuntarySwitches; // The thread was preempted
+			uint64_t syscalls;
+		};
+
 		friend class Task;
+		friend class Mutex;
 		typedef uint32_t Entry;
 
+		static constexpr uint32_t kNoInheritedPriority = UINT32_MAX;
+
 		void SetESP(uint32_t esp);
 		void SetSchedulingData(void *data);
+		void SetFaultAddress(vm_address_t address) { _faultAddress = address; }
+		void SetAffinity(uint32_t affinity) { _affinity.store(affinity, std::memory_order_release); }
+		void SetSyscallDeadline(uint64_t deadline) { _syscallDeadline = deadline; }
+		void SetPreemptCount(uint32_t count) { _preemptCount = count; }
+		void SetDeadlineParameters(const DeadlineParameters &parameters, int32_t cpu);
 
 		Task *GetTask() const { return _task; }
 		tid_t GetTid() const { return _tid; }
 		uint32_t GetESP() const { return _esp; }
+		vm_address_t GetFaultAddress() const { return _faultAddress; }
+		uint32_t GetAffinity() const { return _affinity.load(std::memory_order_acquire); } // Mask of CPU IDs the thread may run on
+		uint64_t GetSyscallDeadline() const { return _syscallDeadline; } // Deadline of a timed syscall across restarts, 0 if there is none
+		uint32_t GetPreemptCount() const { return _preemptCount; } // Only valid while the thread is switched out
+		Timer *GetSleepTimer() { return &_sleepTimer; }
+		Futex::Waiter *GetFutexWaiter() { return &_futexWaiter; }
+		WaitqueueWaiter *GetWaitqueueWaiter() { return &_waitqueueWaiter; }
+
+		const DeadlineParameters &GetDeadlineParameters() const { return _deadlineParameters; }
+		int32_t GetDeadlineCPU() const { return _deadlineCPU.load(std::memory_order_acquire); } // CPU the deadline bandwidth is reserved on, or -1
+		DeadlineStatistics *GetDeadlineStatistics() { return &_deadlineStatistics; }
+		Usage *GetUsage() { return &_usage; }
 
 		template<class T>
 		T *GetSchedulingData() const { return static_cast<T *>(_schedulingData); }
 
 		PriorityClass GetPriorityClass() const { return _priority; }
+		uint32_t GetInheritedPriority() const { return _inheritedPriority.load(std::memory_order_acquire); } // Runqueue level inherited from threads waiting on its mutexes
 
 		uint8_t *GetUserStack() const { return _userStack; }
 		uint8_t *GetUserStackVirtual() const { return _userStackVirtual; }
@@ -74,6 +126,11 @@ namespace OS
 		IPC::Port *GetThreadPort() const { return _threadSendPort; }
 
 		vm_address_t GetTLSVirtual() const { return _tlsVirtual; }
+
+		// Allocated on the threads first FPU or SSE instruction
+		Sys::FPUState *GetFPUState() const { return _fpuState; }
+		void SetFPUState(Sys::FPUState *state) { _fpuState = state; }
+
 		void *GetJoinToken() const { return const_cast<void *>(reinterpret_cast<const void *>(&_joinToken)); }
 
 	private:
@@ -102,9 +159,29 @@ namespace OS
 		uint32_t _esp;
 		uint32_t _entry;
 
+		vm_address_t _faultAddress;
+		std::atomic<uint32_t> _affinity;
+		uint64_t _syscallDeadline;
+		uint32_t _preemptCount;
+		Timer _sleepTimer;
+		Futex::Waiter _futexWaiter;
+		WaitqueueWaiter _waitqueueWaiter;
+
+		// Protected by the mutex inheritance lock
+		std::atomic<uint32_t> _inheritedPriority;
+		Mutex *_blockingMutex;
+		std::intrusive_list<Mutex> _contendedMutexes; // Held mutexes with sleeping waiters
+
+		DeadlineParameters _deadlineParameters;
+		DeadlineStatistics _deadlineStatistics;
+		Usage _usage;
+		std::atomic<int32_t> _deadlineCPU;
+
 		uintptr_t _tlsPhysical;
 		vm_address_t _tlsVirtual;
 
+		Sys::FPUState *_fpuState;
+
 		IPC::Port *_threadPort;
 		IPC::Port *_threadSendPort;
 
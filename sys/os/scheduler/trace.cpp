@@ -0,0 +1,232 @@
+//
+//  trace.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/sys/spinlock.h>
+#include <libcpp/algorithm.h>
+#include <machine/cpu.h>
+#include <machine/clock/clock.h>
+#include "scheduler.h"
+#include "trace.h"
+
+namespace OS
+{
+	namespace SchedulerTrace
+	{
+		static constexpr uint32_t kRingSize = 4096; // Events per CPU, must be a power of two
+		static constexpr uint32_t kRingMask = kRingSize - 1;
+
+		// The writer claims a slot by bumping reserved, fills it and then publishes it through committed.
+		// A reader copies committed events and afterwards drops the ones reserved has caught up with,
+		// since the writer might have overwritten them in the meantime
+		struct Ring
+		{
+			Event *events;
+			std::atomic<uint32_t> reserved;
+			std::atomic<uint32_t> committed;
+			uint32_t read; // Only touched by readers
+			uint64_t lost;
+		};
+
+		std::atomic<bool> _enabled = false;
+
+		static Ring _rings[CONFIG_MAX_CPUS];
+		static spinlock_t _lock = SPINLOCK_INIT;
+
+		void __Record(Type type, Thread *thread, uint32_t argument, uint16_t vector)
+		{
+			bool enabled = Sys::DisableInterrupts();
+
+			Sys::CPU *cpu = Sys::CPU::GetCurrentCPU();
+			Ring &ring = _rings[cpu->GetID()];
+
+			if(ring.events)
+			{
+				uint32_t index = ring.reserved.load(std::memory_order_relaxed);
+				ring.reserved.store(index + 1, std::memory_order_relaxed);
+
+				__atomic_thread_fence(__ATOMIC_RELEASE);
+
+				Event &event = ring.events[index & kRingMask];
+
+				event.timestamp = Sys::CPUReadTimestamp();
+				event.type = type;
+				event.cpu = cpu->GetID();
+				event.vector = vector;
+				event.pid = thread ? thread->GetTask()->GetPid() : 0;
+				event.tid = thread ? thread->GetTid() : 0;
+				event.argument = argument;
+
+				ring.committed.store(index + 1, std::memory_order_release);
+			}
+
+			if(enabled)
+				Sys::EnableInterrupts();
+		}
+
+		KernReturn<void> Enable()
+		{
+			spinlock_lock(&_lock);
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				Ring &ring = _rings[i];
+				if(ring.events)
+					continue;
+
+				// Never freed again, CPUs might still be in the middle of recording after tracing is disabled
+				ring.events = new Event[kRingSize];
+				if(!ring.events)
+				{
+					spinlock_unlock(&_lock);
+					return Error(KERN_NO_MEMORY);
+				}
+			}
+
+			_enabled.store(true, std::memory_order_release);
+			spinlock_unlock(&_lock);
+
+			return ErrorNone;
+		}
+		void Disable()
+		{
+			_enabled.store(false, std::memory_order_release);
+		}
+		void Clear()
+		{
+			spinlock_lock(&_lock);
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				Ring &ring = _rings[i];
+
+				ring.read = ring.committed.load(std::memory_order_acquire);
+				ring.lost = 0;
+			}
+
+			spinlock_unlock(&_lock);
+		}
+
+		bool IsEnabled()
+		{
+			return _enabled.load(std::memory_order_relaxed);
+		}
+		size_t GetCapacity()
+		{
+			return kRingSize;
+		}
+		void GetState(uint32_t cpu, size_t *buffered, uint64_t *lost)
+		{
+			spinlock_lock(&_lock);
+
+			Ring &ring = _rings[cpu];
+			uint32_t pending = ring.committed.load(std::memory_order_acquire) - ring.read;
+
+			*buffered = std::min(pending, kRingSize);
+			*lost = ring.lost + (pending - *buffered);
+
+			spinlock_unlock(&_lock);
+		}
+
+		// Copies the oldest events of the ring to events + 1, leaving room for a lost event in front
+		static size_t DrainRing(Ring &ring, uint8_t cpu, Event *events, size_t count)
+		{
+			uint32_t committed = ring.committed.load(std::memory_order_acquire);
+			uint32_t read = ring.read;
+			uint32_t lost = 0;
+
+			if(committed - read > kRingSize)
+			{
+				lost = (committed - read) - kRingSize;
+				read = committed - kRingSize;
+			}
+
+			uint32_t available = std::min(committed - read, static_cast<uint32_t>(count - 1));
+
+			for(uint32_t i = 0; i < available; i ++)
+				events[i + 1] = ring.events[(read + i) & kRingMask];
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			// Everything the writer could have touched while we were copying is gone
+			uint32_t reserved = ring.reserved.load(std::memory_order_relaxed);
+			uint32_t torn = 0;
+
+			while(torn < available && reserved - (read + torn) > kRingSize)
+				torn ++;
+
+			ring.read = read + available;
+
+			lost += torn;
+			available -= torn;
+
+			// Close the gap in front of the valid events, either to the lost event or the start
+			size_t offset = (lost == 0) ? 0 : 1;
+
+			for(uint32_t i = 0; i < available; i ++)
+				events[offset + i] = events[1 + torn + i];
+
+			if(lost == 0)
+				return available;
+
+			ring.lost += lost;
+
+			Event &event = events[0];
+
+			event.timestamp = available ? events[1].timestamp : Sys::CPUReadTimestamp();
+			event.type = Type::Lost;
+			event.cpu = cpu;
+			event.vector = 0;
+			event.pid = 0;
+			event.tid = 0;
+			event.argument = lost;
+
+			return available + 1;
+		}
+
+		size_t Drain(Event *events, size_t count, bool header)
+		{
+			size_t result = 0;
+
+			if(header && count > 0)
+			{
+				Event &event = events[result ++];
+
+				event.timestamp = Sys::CPUReadTimestamp();
+				event.type = Type::Header;
+				event.cpu = Sys::CPU::GetCPUCount();
+				event.vector = 0;
+				event.pid = 0;
+				event.tid = 0;
+				event.argument = Sys::Clock::GetTimestampFrequency();
+			}
+
+			spinlock_lock(&_lock);
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount() && count - result >= 2; i ++)
+			{
+				Ring &ring = _rings[i];
+
+				if(ring.events)
+					result += DrainRing(ring, static_cast<uint8_t>(i), events + result, count - result);
+			}
+
+			spinlock_unlock(&_lock);
+			return result;
+		}
+	}
+}
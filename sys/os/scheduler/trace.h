@@ -0,0 +1,101 @@
+//
+//  trace.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SCHEDULER_TRACE_H_
+#define _SCHEDULER_TRACE_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libc/stddef.h>
+#include <libcpp/atomic.h>
+#include <kern/kern_return.h>
+
+namespace OS
+{
+	class Thread;
+
+	/**
+	 * Binary trace of scheduler events. Every CPU records into its own ring buffer, which
+	 * is only ever written by that CPU with interrupts disabled, so recording needs no locks.
+	 * When a ring is full the oldest events are overwritten and counted as lost once drained.
+	 *
+	 * Recording is off by default and costs a single branch in that case. It's controlled
+	 * and drained through /dev/schedtrace_control and /dev/schedtrace, scripts/schedtrace.py
+	 * turns a dump into a Chrome trace.
+	 **/
+	namespace SchedulerTrace
+	{
+		enum class Type : uint8_t
+		{
+			Header, // cpu: number of CPUs, argument: TSC cycles per microsecond
+			Lost, // argument: events overwritten before they could be drained
+			Switch, // The thread is switched in, argument: tid of the previous thread
+			Wakeup, // argument: CPU the thread runs on
+			Block,
+			Migrate, // argument: CPU the thread moves to
+			IPISent, // argument: target CPU
+			IPIReceived,
+			Commands, // argument: number of commands that were run in the batch
+			IdleEnter,
+			IdleExit
+		};
+
+		// The layout is read by scripts/schedtrace.py
+		struct Event
+		{
+			uint64_t timestamp; // TSC
+			Type type;
+			uint8_t cpu;
+			uint16_t vector; // Only set for IPIs
+			uint32_t pid;
+			uint32_t tid;
+			uint32_t argument;
+		} __attribute__((packed));
+
+		static_assert(sizeof(Event) == 24, "Event layout changed");
+
+		extern std::atomic<bool> _enabled;
+
+		void __Record(Type type, Thread *thread, uint32_t argument, uint16_t vector);
+
+		static inline void Record(Type type, Thread *thread, uint32_t argument = 0)
+		{
+			if(__expect_false(_enabled.load(std::memory_order_relaxed)))
+				__Record(type, thread, argument, 0);
+		}
+		static inline void RecordIPI(Type type, uint16_t vector, uint32_t argument = 0)
+		{
+			if(__expect_false(_enabled.load(std::memory_order_relaxed)))
+				__Record(type, nullptr, argument, vector);
+		}
+
+		KernReturn<void> Enable(); // Allocates the buffers the first time
+		void Disable();
+		void Clear();
+
+		bool IsEnabled();
+		size_t GetCapacity(); // Events per CPU
+		void GetState(uint32_t cpu, size_t *buffered, uint64_t *lost);
+
+		// Moves up to count events into the buffer, oldest first per CPU. The header is only
+		// written when requested, lost events are reported in place of the ones that are missing
+		size_t Drain(Event *events, size_t count, bool header);
+	}
+}
+
+#endif /* _SCHEDULER_TRACE_H_ */
@@ -0,0 +1,201 @@
+//
+//  compressor.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/string.h>
+#include <libcpp/algorithm.h>
+#include "compressor.h"
+
+namespace OS
+{
+	namespace Swap
+	{
+		static constexpr size_t kMinMatch = 4;
+		static constexpr size_t kLastLiterals = 5;
+		static constexpr size_t kMaxOffset = 0xffff;
+		static constexpr size_t kHashBits = 12;
+
+		static uint16_t _hashTable[1 << kHashBits];
+
+		static inline uint32_t Read32(const uint8_t *data)
+		{
+			return (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24));
+		}
+
+		static inline uint32_t Hash(uint32_t sequence)
+		{
+			return (sequence * 2654435761U) >> (32 - kHashBits);
+		}
+
+		static inline uint8_t *WriteLength(uint8_t *output, size_t length)
+		{
+			while(length >= 255)
+			{
+				*output ++ = 255;
+				length -= 255;
+			}
+
+			*output ++ = static_cast<uint8_t>(length);
+			return output;
+		}
+
+		static inline bool ReadLength(const uint8_t *&input, const uint8_t *end, size_t &length)
+		{
+			uint8_t byte;
+
+			do {
+				if(input >= end)
+					return false;
+
+				byte = *input ++;
+				length += byte;
+			} while(byte == 255);
+
+			return true;
+		}
+
+		static inline uint8_t *WriteLiterals(uint8_t *output, uint8_t token, const uint8_t *literals, size_t length)
+		{
+			*output ++ = token | (std::min<size_t>(length, 15) << 4);
+
+			if(length >= 15)
+				output = WriteLength(output, length - 15);
+
+			memcpy(output, literals, length);
+			return output + length;
+		}
+
+
+		size_t Compress(const uint8_t *source, size_t size, uint8_t *destination, size_t capacity)
+		{
+			const uint8_t *input = source;
+			const uint8_t *anchor = source;
+			const uint8_t *end = source + size;
+			const uint8_t *limit = (size > kLastLiterals) ? (end - kLastLiterals) : source;
+
+			uint8_t *output = destination;
+			uint8_t *outputEnd = destination + capacity;
+
+			memset(_hashTable, 0, sizeof(_hashTable));
+
+			while(input + kMinMatch <= limit)
+			{
+				uint32_t sequence = Read32(input);
+				uint32_t hash = Hash(sequence);
+
+				const uint8_t *candidate = source + _hashTable[hash];
+				_hashTable[hash] = static_cast<uint16_t>(input - source);
+
+				if(candidate >= input || static_cast<size_t>(input - candidate) > kMaxOffset || Read32(candidate) != sequence)
+				{
+					input ++;
+					continue;
+				}
+
+				const uint8_t *matchEnd = input + kMinMatch;
+				const uint8_t *reference = candidate + kMinMatch;
+
+				while(matchEnd < limit && *matchEnd == *reference)
+				{
+					matchEnd ++;
+					reference ++;
+				}
+
+				size_t literals = input - anchor;
+				size_t match = (matchEnd - input) - kMinMatch;
+
+				// Token, literal run, offset and match length, with their length extensions
+				if(static_cast<size_t>(outputEnd - output) < 1 + (literals / 255 + 1) + literals + 2 + (match / 255 + 1))
+					return 0;
+
+				output = WriteLiterals(output, std::min<size_t>(match, 15), anchor, literals);
+
+				size_t offset = input - candidate;
+
+				*output ++ = offset & 0xff;
+				*output ++ = (offset >> 8) & 0xff;
+
+				if(match >= 15)
+					output = WriteLength(output, match - 15);
+
+				input  = matchEnd;
+				anchor = matchEnd;
+			}
+
+			size_t literals = end - anchor;
+
+			if(static_cast<size_t>(outputEnd - output) < 1 + (literals / 255 + 1) + literals)
+				return 0;
+
+			output = WriteLiterals(output, 0, anchor, literals);
+			return output - destination;
+		}
+
+		bool Decompress(const uint8_t *source, size_t size, uint8_t *destination, size_t length)
+		{
+			const uint8_t *input = source;
+			const uint8_t *end = source + size;
+
+			uint8_t *output = destination;
+			uint8_t *outputEnd = destination + length;
+
+			while(input < end)
+			{
+				uint8_t token = *input ++;
+
+				size_t literals = token >> 4;
+				if(literals == 15 && !ReadLength(input, end, literals))
+					return false;
+
+				if(literals > static_cast<size_t>(end - input) || literals > static_cast<size_t>(outputEnd - output))
+					return false;
+
+				memcpy(output, input, literals);
+
+				output += literals;
+				input  += literals;
+
+				// The last sequence only consists of literals
+				if(input >= end)
+					break;
+
+				if(end - input < 2)
+					return false;
+
+				size_t offset = input[0] | (input[1] << 8);
+				input += 2;
+
+				size_t match = token & 0xf;
+				if(match == 15 && !ReadLength(input, end, match))
+					return false;
+
+				match += kMinMatch;
+
+				if(offset == 0 || offset > static_cast<size_t>(output - destination) || match > static_cast<size_t>(outputEnd - output))
+					return false;
+
+				// Matches may overlap with the output, so this has to go byte by byte
+				const uint8_t *reference = output - offset;
+
+				while(match --)
+					*output ++ = *reference ++;
+			}
+
+			return (output == outputEnd);
+		}
+	}
+}
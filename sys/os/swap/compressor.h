@@ -0,0 +1,38 @@
+//
+//  compressor.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SWAP_COMPRESSOR_H_
+#define _SWAP_COMPRESSOR_H_
+
+#include <prefix.h>
+#include <libc/stddef.h>
+#include <libc/stdint.h>
+
+namespace OS
+{
+	namespace Swap
+	{
+		// LZ77 style block codec with an LZ4 like sequence layout, tuned for single pages.
+		// Compress() returns 0 if the output doesn't fit into the capacity and is not reentrant,
+		// callers have to serialize access. Decompress() only succeeds if it produces exactly length bytes
+		size_t Compress(const uint8_t *source, size_t size, uint8_t *destination, size_t capacity);
+		bool Decompress(const uint8_t *source, size_t size, uint8_t *destination, size_t length);
+	}
+}
+
+#endif /* _SWAP_COMPRESSOR_H_ */
@@ -0,0 +1,841 @@
+//
+//  swap.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <config.h>
+#include <libc/string.h>
+#include <libcpp/algorithm.h>
+#include <libcpp/atomic.h>
+#include <libio/core/IOArray.h>
+#include <machine/memory/memory.h>
+#include <machine/interrupts/interrupts.h>
+#include <os/scheduler/scheduler.h>
+#include <os/workqueue.h>
+#include <kern/kprintf.h>
+#include <kern/panic.h>
+#include "compressor.h"
+#include "swap.h"
+
+namespace OS
+{
+	namespace Swap
+	{
+		static constexpr size_t kSlotCount = CONFIG_SWAP_SLOTS;
+		static constexpr size_t kPoolSize = CONFIG_SWAP_POOL_SIZE;
+		static constexpr size_t kLowWatermark = CONFIG_SWAP_LOW_WATERMARK;
+		static constexpr size_t kHighWatermark = CONFIG_SWAP_HIGH_WATERMARK;
+		static constexpr size_t kMaxCompressedSize = CONFIG_SWAP_MAX_COMPRESSED;
+
+		static constexpr size_t kBatchSize = 32;
+		static constexpr size_t kPinCount = 256;
+		static constexpr uint32_t kNoSlot = UINT32_MAX;
+		static constexpr uint8_t kShootdownVector = 0x3b;
+
+		static constexpr uint32_t kEntryStaged = (Sys::VM::kEntrySwapped | Sys::VM::kEntryResident);
+		static constexpr uint32_t kEntryFlagsMask = (Sys::VM::Directory::Flags::Writeable | Sys::VM::Directory::Flags::Userspace | Sys::VM::Directory::Flags::Writethrough | Sys::VM::Directory::Flags::NoCache);
+
+		struct Slot
+		{
+			Sys::VM::Directory *directory;
+			vm_address_t address;
+			uint8_t *data; // nullptr for pages that were all zeros
+			uint32_t flags;
+			uint32_t next;
+			uint16_t size;
+			bool used;
+		};
+
+		struct Candidate
+		{
+			Sys::VM::Directory *directory;
+			vm_address_t address;
+		};
+
+		static Slot *_slots = nullptr;
+		static uint32_t _freeSlots = kNoSlot;
+		static Statistics _statistics;
+		static spinlock_t _slotLock = SPINLOCK_INIT;
+
+		// Everything below is protected by the reclaim lock
+		static spinlock_t _reclaimLock = SPINLOCK_INIT;
+		static Candidate _candidates[kBatchSize];
+		static uint8_t _buffer[VM_PAGE_SIZE];
+
+		static pid_t _handPid = 0;
+		static vm_address_t _handAddress = 0;
+
+		static std::atomic<uint32_t> _shootdownAcks;
+
+		// Pins per hashed page frame, shared by all frames that hash to the same slot
+		static std::atomic<uint32_t> _pins[kPinCount];
+
+		// --------------------
+		// MARK: -
+		// MARK: Pins
+		// --------------------
+
+		static std::atomic<uint32_t> *GetPin(uintptr_t physical)
+		{
+			return _pins + ((physical >> VM_PAGE_SHIFT) % kPinCount);
+		}
+
+		void PinPage(uintptr_t physical)
+		{
+			GetPin(physical)->fetch_add(1, std::memory_order_acq_rel);
+		}
+		void UnpinPage(uintptr_t physical)
+		{
+			GetPin(physical)->fetch_sub(1, std::memory_order_release);
+		}
+		bool IsPagePinned(uintptr_t physical)
+		{
+			return (GetPin(physical)->load(std::memory_order_acquire) > 0);
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: Slots
+		// --------------------
+
+		static uint32_t AllocateSlot()
+		{
+			uint32_t index = _freeSlots;
+
+			if(index != kNoSlot)
+			{
+				_freeSlots = _slots[index].next;
+				_slots[index].used = true;
+			}
+
+			return index;
+		}
+
+		static void FreeSlot(uint32_t index)
+		{
+			Slot *slot = _slots + index;
+
+			if(slot->data)
+				_statistics.compressedBytes -= slot->size;
+			else
+				_statistics.zeroPages --;
+
+			_statistics.storedPages --;
+
+			slot->used = false;
+			slot->data = nullptr;
+			slot->next = _freeSlots;
+
+			_freeSlots = index;
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: TLB shootdown
+		// --------------------
+
+		static uint32_t HandleShootdown(uint32_t esp, __unused Sys::CPU *cpu)
+		{
+			// Entering the interrupt handler reloaded CR3, which is all we need
+			_shootdownAcks ++;
+			return esp;
+		}
+
+		static void Shootdown()
+		{
+			Sys::CPU *self = Sys::CPU::GetCurrentCPU();
+			size_t count = Sys::CPU::GetCPUCount();
+			uint32_t targets = 0;
+
+			for(size_t i = 0; i < count; i ++)
+			{
+				Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
+
+				if(cpu != self && (cpu->GetFlags() & Sys::CPU::Flags::Running))
+					targets ++;
+			}
+
+			if(targets == 0)
+				return;
+
+			_shootdownAcks.store(0);
+			Sys::APIC::BroadcastIPI(kShootdownVector, false);
+
+			while(_shootdownAcks.load() < targets)
+				Sys::CPUPause();
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: Swap out
+		// --------------------
+
+		static bool IsZeroPage(const uint8_t *page)
+		{
+			const uint32_t *words = reinterpret_cast<const uint32_t *>(page);
+
+			for(size_t i = 0; i < VM_PAGE_SIZE / sizeof(uint32_t); i ++)
+			{
+				if(words[i])
+					return false;
+			}
+
+			return true;
+		}
+
+		static void Restore(Sys::VM::Directory *directory, vm_address_t address, uint32_t staged)
+		{
+			uint32_t entry = (staged & ~kEntryStaged) | Sys::VM::Directory::Flags::Present;
+			directory->ExchangeEntry(address, staged, entry).Suppress(); // Fails if it was faulted back in already
+		}
+
+		// Walks the anonymous mappings of the task, starting at the given address, and unmaps pages
+		// whose accessed bit is clear. Pages that were accessed get their bit cleared for the next round
+		static size_t StageTask(Task *task, vm_address_t resume, size_t count, size_t offset)
+		{
+			Sys::VM::Directory *directory = task->GetDirectory();
+			size_t staged = 0;
+
+			if(directory == Sys::VM::Directory::GetKernelDirectory())
+				return 0;
+
+			task->Lock();
+
+			std::intrusive_list<MmapTaskEntry>::member *member = task->mmapList.head();
+			while(member)
+			{
+				MmapTaskEntry *entry = member->get();
+				member = member->next();
+
+				if(entry->node || !(entry->flags & MAP_ANONYMOUS))
+					continue;
+
+				for(size_t i = 0; i < entry->pages; i ++)
+				{
+					vm_address_t address = entry->vmaddress + (i * VM_PAGE_SIZE);
+
+					if(address < resume)
+						continue;
+
+					if(staged >= count)
+					{
+						_handPid = task->GetPid();
+						_handAddress = address;
+
+						task->Unlock();
+						return staged;
+					}
+
+					KernReturn<uint32_t> result = directory->GetEntry(address);
+					if(!result.IsValid())
+						continue;
+
+					uint32_t value = result.Get();
+
+					if(!(value & Sys::VM::Directory::Flags::Present))
+						continue;
+
+					if(value & Sys::VM::Directory::Flags::Accessed)
+					{
+						directory->ExchangeEntry(address, value, value & ~Sys::VM::Directory::Flags::Accessed).Suppress();
+						continue;
+					}
+
+					uint32_t stagedEntry = (value & ~Sys::VM::Directory::Flags::Present) | kEntryStaged;
+
+					if(directory->ExchangeEntry(address, value, stagedEntry).IsValid())
+					{
+						Candidate *candidate = _candidates + offset + staged;
+
+						candidate->directory = directory;
+						candidate->address = address;
+
+						staged ++;
+					}
+				}
+			}
+
+			task->Unlock();
+			return staged;
+		}
+
+		static size_t StageCandidates(IO::Array *tasks, size_t count)
+		{
+			size_t taskCount = tasks->GetCount();
+			size_t start = 0;
+			size_t staged = 0;
+
+			for(size_t i = 0; i < taskCount; i ++)
+			{
+				if(tasks->GetObjectAtIndex<Task>(i)->GetPid() == _handPid)
+				{
+					start = i;
+					break;
+				}
+			}
+
+			// One more than the number of tasks, so the task the hand points into is finished as well
+			for(size_t i = 0; i <= taskCount && staged < count; i ++)
+			{
+				Task *task = tasks->GetObjectAtIndex<Task>((start + i) % taskCount);
+				vm_address_t resume = (i == 0 && task->GetPid() == _handPid) ? _handAddress : 0;
+
+				staged += StageTask(task, resume, count - staged, staged);
+
+				if(staged < count)
+				{
+					Task *next = tasks->GetObjectAtIndex<Task>((start + i + 1) % taskCount);
+
+					_handPid = next->GetPid();
+					_handAddress = 0;
+				}
+			}
+
+			return staged;
+		}
+
+		static bool SwapOut(Candidate *candidate)
+		{
+			Sys::VM::Directory *directory = candidate->directory;
+			Sys::VM::Directory *kernelDirectory = Sys::VM::Directory::GetKernelDirectory();
+
+			KernReturn<uint32_t> result = directory->GetEntry(candidate->address);
+			if(!result.IsValid())
+				return false;
+
+			uint32_t staged = result.Get();
+			if((staged & kEntryStaged) != kEntryStaged)
+				return false; // Faulted back in while we were busy
+
+			uintptr_t physical = staged & VM_PAGE_MASK;
+			size_t size = 0;
+
+			// Futex waiters are keyed by the physical address and kernel mappings alias the frame, the page has to stay where it is
+			if(IsPagePinned(physical))
+			{
+				Restore(directory, candidate->address, staged);
+				return false;
+			}
+
+			bool isZero;
+
+			{
+				KernReturn<vm_address_t> mapping = kernelDirectory->Alloc(physical, 1, kVMFlagsKernel);
+				if(!mapping.IsValid())
+				{
+					Restore(directory, candidate->address, staged);
+					return false;
+				}
+
+				const uint8_t *page = reinterpret_cast<const uint8_t *>(mapping.Get());
+
+				isZero = IsZeroPage(page);
+				if(!isZero)
+					size = Compress(page, VM_PAGE_SIZE, _buffer, kMaxCompressedSize);
+
+				kernelDirectory->Free(mapping, 1);
+			}
+
+			if(!isZero && (size == 0 || _statistics.compressedBytes + size > kPoolSize))
+			{
+				spinlock_lock(&_slotLock);
+				_statistics.rejected ++;
+				spinlock_unlock(&_slotLock);
+
+				Restore(directory, candidate->address, staged);
+				return false;
+			}
+
+			uint8_t *data = nullptr;
+
+			if(!isZero)
+			{
+				data = new uint8_t[size];
+				if(!data)
+				{
+					Restore(directory, candidate->address, staged);
+					return false;
+				}
+
+				memcpy(data, _buffer, size);
+			}
+
+			spinlock_lock(&_slotLock);
+
+			uint32_t index = AllocateSlot();
+			if(index == kNoSlot)
+			{
+				spinlock_unlock(&_slotLock);
+
+				delete[] data;
+				Restore(directory, candidate->address, staged);
+
+				return false;
+			}
+
+			Slot *slot = _slots + index;
+			slot->directory = directory;
+			slot->address = candidate->address;
+			slot->flags = staged & kEntryFlagsMask;
+			slot->data = data;
+			slot->size = static_cast<uint16_t>(size);
+
+			_statistics.storedPages ++;
+
+			if(data)
+				_statistics.compressedBytes += size;
+			else
+				_statistics.zeroPages ++;
+
+			// Publishing the slot has to happen under the lock, otherwise a concurrent Discard() could miss it
+			uint32_t swapped = (index << VM_PAGE_SHIFT) | Sys::VM::kEntrySwapped;
+
+			if(!directory->ExchangeEntry(candidate->address, staged, swapped).IsValid())
+			{
+				FreeSlot(index);
+				spinlock_unlock(&_slotLock);
+
+				delete[] data;
+				return false;
+			}
+
+			_statistics.swapOuts ++;
+			spinlock_unlock(&_slotLock);
+
+			Sys::PM::Free(physical, 1);
+			return true;
+		}
+
+		size_t Reclaim(size_t pages)
+		{
+			if(!_slots || pages == 0)
+				return 0;
+
+			IO::Array *tasks = Scheduler::GetScheduler()->CopyTasks();
+			if(!tasks)
+				return 0;
+
+			size_t reclaimed = 0;
+			size_t idleRounds = 0;
+
+			spinlock_lock(&_reclaimLock);
+
+			// The first pass over cold memory mostly clears accessed bits,
+			// so give up only after two rounds that didn't find anything
+			while(reclaimed < pages && idleRounds < 2)
+			{
+				size_t staged = StageCandidates(tasks, std::min(pages - reclaimed, kBatchSize));
+				if(staged == 0)
+				{
+					idleRounds ++;
+					continue;
+				}
+
+				idleRounds = 0;
+
+				// Other CPUs might still have the unmapped pages in their TLB
+				Shootdown();
+
+				for(size_t i = 0; i < staged; i ++)
+				{
+					if(SwapOut(_candidates + i))
+						reclaimed ++;
+				}
+			}
+
+			spinlock_unlock(&_reclaimLock);
+
+			tasks->Release();
+			return reclaimed;
+		}
+
+		void Balance()
+		{
+			size_t freePages = Sys::PM::GetFreePages();
+
+			if(freePages < kLowWatermark)
+				Reclaim(kHighWatermark - freePages);
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: Swap in
+		// --------------------
+
+		static KernReturn<void> SwapInCompressed(Sys::VM::Directory *directory, vm_address_t address, uint32_t value, bool reclaim)
+		{
+			uint64_t start = Sys::CPUReadTimestamp();
+
+			KernReturn<uintptr_t> physical = Sys::PM::Alloc(1);
+			if(!physical.IsValid())
+			{
+				// Reclaiming takes task locks and needs other CPUs to acknowledge the shootdown
+				if(!reclaim || !Sys::CPUInterruptsEnabled() || Reclaim(kBatchSize) == 0)
+					return physical.GetError();
+
+				physical = Sys::PM::Alloc(1);
+				if(!physical.IsValid())
+					return physical.GetError();
+			}
+
+			Sys::VM::Directory *kernelDirectory = Sys::VM::Directory::GetKernelDirectory();
+			KernReturn<vm_address_t> mapping = kernelDirectory->Alloc(physical, 1, kVMFlagsKernel);
+
+			if(!mapping.IsValid())
+			{
+				Sys::PM::Free(physical, 1);
+				return mapping.GetError();
+			}
+
+			uint8_t *page = reinterpret_cast<uint8_t *>(mapping.Get());
+			uint8_t *data = nullptr;
+
+			spinlock_lock(&_slotLock);
+
+			// Only holders of the slot lock turn swapped entries back into present ones,
+			// so if the entry is unchanged the slot is still ours
+			KernReturn<uint32_t> entry = directory->GetEntry(address);
+			if(!entry.IsValid() || entry.Get() != value)
+			{
+				spinlock_unlock(&_slotLock);
+
+				kernelDirectory->Free(mapping, 1);
+				Sys::PM::Free(physical, 1);
+
+				return ErrorNone; // Somebody else beat us to it, let the caller retry
+			}
+
+			uint32_t index = value >> VM_PAGE_SHIFT;
+			Slot *slot = _slots + index;
+
+			if(slot->data)
+			{
+				if(!Decompress(slot->data, slot->size, page, VM_PAGE_SIZE))
+					panic("Corrupted swap slot %d for address %p", index, (void *)address);
+			}
+			else
+			{
+				memset(page, 0, VM_PAGE_SIZE);
+			}
+
+			uint32_t mapped = physical.Get() | slot->flags | Sys::VM::Directory::Flags::Present;
+			KernReturn<void> result = directory->ExchangeEntry(address, value, mapped);
+
+			if(!result.IsValid())
+				panic("Swapped page table entry changed under the slot lock");
+
+			data = slot->data;
+			FreeSlot(index);
+
+			uint64_t cycles = Sys::CPUReadTimestamp() - start;
+
+			_statistics.swapIns ++;
+			_statistics.faultCycles += cycles;
+			_statistics.maxFaultCycles = std::max(_statistics.maxFaultCycles, cycles);
+
+			spinlock_unlock(&_slotLock);
+
+			delete[] data;
+			kernelDirectory->Free(mapping, 1);
+
+			return ErrorNone;
+		}
+
+		static KernReturn<void> SwapInPage(Sys::VM::Directory *directory, vm_address_t address, bool reclaim)
+		{
+			address = VM_PAGE_ALIGN_DOWN(address);
+
+			while(1)
+			{
+				KernReturn<uint32_t> entry = directory->GetEntry(address);
+				if(!entry.IsValid())
+					return entry.GetError();
+
+				uint32_t value = entry.Get();
+
+				if(value & Sys::VM::Directory::Flags::Present)
+					return ErrorNone;
+
+				if(!(value & Sys::VM::kEntrySwapped))
+					return Error(KERN_INVALID_ADDRESS);
+
+				if(value & Sys::VM::kEntryResident)
+				{
+					uint32_t mapped = (value & ~kEntryStaged) | Sys::VM::Directory::Flags::Present;
+
+					if(directory->ExchangeEntry(address, value, mapped).IsValid())
+					{
+						spinlock_lock(&_slotLock);
+						_statistics.minorFaults ++;
+						spinlock_unlock(&_slotLock);
+
+						return ErrorNone;
+					}
+
+					continue;
+				}
+
+				KernReturn<void> result = SwapInCompressed(directory, address, value, reclaim);
+				if(!result.IsValid())
+					return result;
+			}
+		}
+
+		KernReturn<void> SwapIn(Sys::VM::Directory *directory, vm_address_t address)
+		{
+			return SwapInPage(directory, address, true);
+		}
+
+		KernReturn<uintptr_t> ResolveAddress(Sys::VM::Directory *directory, vm_address_t address)
+		{
+			KernReturn<uintptr_t> physical = directory->ResolveAddress(address);
+			if(physical.IsValid())
+				return physical;
+
+			KernReturn<void> result = SwapInPage(directory, address, false);
+			if(!result.IsValid())
+				return result.GetError();
+
+			return directory->ResolveAddress(address);
+		}
+
+		// Resolves and pins the page, SwapOut() checks the pin only after the page was unmapped
+		static KernReturn<uintptr_t> PinAddress(Sys::VM::Directory *directory, vm_address_t address)
+		{
+			while(1)
+			{
+				KernReturn<uintptr_t> physical = ResolveAddress(directory, address);
+				if(!physical.IsValid())
+					return physical;
+
+				PinPage(physical);
+
+				// The page could have been swapped out and back in before the pin was visible
+				KernReturn<uintptr_t> pinned = directory->ResolveAddress(address);
+				if(pinned.IsValid() && pinned.Get() == physical.Get())
+					return physical;
+
+				UnpinPage(physical);
+			}
+		}
+
+		static void UnpinMapping(vm_address_t mapping, size_t pages)
+		{
+			Sys::VM::Directory *kernelDirectory = Sys::VM::Directory::GetKernelDirectory();
+
+			for(size_t i = 0; i < pages; i ++)
+			{
+				KernReturn<uintptr_t> physical = kernelDirectory->ResolveAddress(mapping + (i * VM_PAGE_SIZE));
+				if(physical.IsValid())
+					UnpinPage(physical);
+			}
+		}
+
+		KernReturn<vm_address_t> MapIntoKernel(Sys::VM::Directory *directory, vm_address_t address, size_t pages)
+		{
+			Sys::VM::Directory *kernelDirectory = Sys::VM::Directory::GetKernelDirectory();
+			vm_address_t base = VM_PAGE_ALIGN_DOWN(address);
+
+			KernReturn<uintptr_t> physical = PinAddress(directory, base);
+			if(!physical.IsValid())
+				return physical.GetError();
+
+			uintptr_t first = physical.Get();
+
+			KernReturn<vm_address_t> mapping = kernelDirectory->Alloc(first, pages, kVMFlagsKernel);
+			if(!mapping.IsValid())
+			{
+				UnpinPage(first);
+				return mapping.GetError();
+			}
+
+			// Alloc() assumed contiguous physical memory, fix up every page that isn't
+			for(size_t i = 1; i < pages; i ++)
+			{
+				vm_address_t offset = i * VM_PAGE_SIZE;
+
+				physical = PinAddress(directory, base + offset);
+				if(!physical.IsValid())
+				{
+					UnpinMapping(mapping, i);
+					kernelDirectory->Free(mapping, pages);
+
+					return physical.GetError();
+				}
+
+				if(physical.Get() == first + offset)
+					continue;
+
+				KernReturn<void> result = kernelDirectory->MapPage(physical, mapping + offset, kVMFlagsKernel);
+				if(!result.IsValid())
+				{
+					UnpinPage(physical);
+					UnpinMapping(mapping, i);
+					kernelDirectory->Free(mapping, pages);
+
+					return result.GetError();
+				}
+			}
+
+			return mapping.Get() + (address - base);
+		}
+
+		void UnmapFromKernel(vm_address_t address, size_t pages)
+		{
+			vm_address_t mapping = VM_PAGE_ALIGN_DOWN(address);
+
+			UnpinMapping(mapping, pages);
+			Sys::VM::Directory::GetKernelDirectory()->Free(mapping, pages);
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: Fault handling
+		// --------------------
+
+		static void CompleteFault(void *context)
+		{
+			Thread *thread = reinterpret_cast<Thread *>(context);
+			Sys::VM::Directory *directory = thread->GetTask()->GetDirectory();
+
+			KernReturn<void> result = SwapIn(directory, thread->GetFaultAddress());
+			if(!result.IsValid())
+				panic("Failed to swap in %p, error %d", (void *)thread->GetFaultAddress(), result.GetError().GetCode());
+
+			Scheduler::GetScheduler()->UnblockThread(thread);
+		}
+
+		static uint32_t HandlePageFault(uint32_t esp, Sys::CPU *cpu)
+		{
+			Sys::CPUState *state = cpu->GetLastState();
+
+			vm_address_t address;
+			__asm__ volatile("movl %%cr2, %0" : "=r" (address));
+
+			// Only non present pages touched from userland can be in the swap
+			if((state->cs & 0x3) != 0x3 || (state->error & 0x1))
+			{
+				panicSegfault();
+				return esp;
+			}
+
+			Scheduler *scheduler = Scheduler::GetScheduler();
+			Thread *thread = scheduler->GetActiveThread();
+			Sys::VM::Directory *directory = thread->GetTask()->GetDirectory();
+
+			address = VM_PAGE_ALIGN_DOWN(address);
+
+			KernReturn<uint32_t> entry = directory->GetEntry(address);
+			if(!entry.IsValid() || !(entry.Get() & Sys::VM::kEntrySwapped))
+			{
+				panicSegfault();
+				return esp;
+			}
+
+			uint32_t value = entry.Get();
+
+			// Unmapped but still resident pages can be mapped right away
+			if(value & Sys::VM::kEntryResident)
+			{
+				uint32_t mapped = (value & ~kEntryStaged) | Sys::VM::Directory::Flags::Present;
+
+				if(directory->ExchangeEntry(address, value, mapped).IsValid())
+				{
+					spinlock_lock(&_slotLock);
+					_statistics.minorFaults ++;
+					spinlock_unlock(&_slotLock);
+
+					return esp;
+				}
+			}
+
+			// Decompression can require reclaiming memory, which has to happen outside of the interrupt context
+			thread->SetESP(esp);
+			thread->SetFaultAddress(address);
+
+			scheduler->BlockThread(thread);
+
+			// With a full queue the thread simply faults again once it's back on the CPU
+			if(!cpu->GetWorkQueue()->PushEntry(&CompleteFault, reinterpret_cast<void *>(thread), WorkQueue::Priority::High))
+			{
+				scheduler->UnblockThread(thread);
+				scheduler->YieldThread(thread);
+			}
+
+			return scheduler->PokeCPU(esp, cpu);
+		}
+
+		// --------------------
+		// MARK: -
+		// MARK: Misc
+		// --------------------
+
+		void Discard(Sys::VM::Directory *directory)
+		{
+			if(!_slots)
+				return;
+
+			spinlock_lock(&_slotLock);
+
+			for(size_t i = 0; i < kSlotCount; i ++)
+			{
+				Slot *slot = _slots + i;
+
+				if(slot->used && slot->directory == directory)
+				{
+					delete[] slot->data;
+					FreeSlot(i);
+				}
+			}
+
+			spinlock_unlock(&_slotLock);
+		}
+
+		void GetStatistics(Statistics *statistics)
+		{
+			spinlock_lock(&_slotLock);
+			*statistics = _statistics;
+			spinlock_unlock(&_slotLock);
+		}
+	}
+
+	KernReturn<void> SwapInit()
+	{
+		if(Swap::kSlotCount == 0)
+			return ErrorNone;
+
+		Swap::_slots = new Swap::Slot[Swap::kSlotCount];
+		if(!Swap::_slots)
+			return Error(KERN_NO_MEMORY);
+
+		for(size_t i = 0; i < Swap::kSlotCount; i ++)
+		{
+			Swap::Slot *slot = Swap::_slots + i;
+
+			slot->used = false;
+			slot->data = nullptr;
+			slot->next = (i + 1 < Swap::kSlotCount) ? static_cast<uint32_t>(i + 1) : Swap::kNoSlot;
+		}
+
+		Swap::_freeSlots = 0;
+		memset(&Swap::_statistics, 0, sizeof(Swap::Statistics));
+
+		Sys::SetInterruptHandler(Swap::kShootdownVector, &Swap::HandleShootdown);
+		Sys::SetInterruptHandler(0xe, &Swap::HandlePageFault);
+
+		return ErrorNone;
+	}
+}
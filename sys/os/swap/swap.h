@@ -0,0 +1,79 @@
+//
+//  swap.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <kern/kern_return.h>
+#include <machine/memory/virtual.h>
+
+namespace OS
+{
+	namespace Swap
+	{
+		struct Statistics
+		{
+			size_t storedPages; // Pages currently held by the swap, including zero pages
+			size_t zeroPages;
+			size_t compressedBytes;
+
+			uint64_t swapOuts;
+			uint64_t swapIns;
+			uint64_t rejected; // Pages that didn't compress well enough
+			uint64_t minorFaults; // Faults on pages that were unmapped but not yet compressed
+
+			uint64_t faultCycles;
+			uint64_t maxFaultCycles;
+		};
+
+		// Compresses up to the given number of cold anonymous user pages and returns how many pages were freed.
+		// Must be called with interrupts enabled, as other CPUs have to acknowledge the TLB shootdown
+		size_t Reclaim(size_t pages);
+
+		// Reclaims memory up to the high watermark if the free memory dropped below the low watermark
+		void Balance();
+
+		// Swaps the page in, reclaiming memory if there is none left. Must not be called with locks held
+		KernReturn<void> SwapIn(Sys::VM::Directory *directory, vm_address_t address);
+
+		// Both swap pages in as needed but never reclaim memory, so they are safe to call with locks held.
+		// They fail with KERN_NO_MEMORY instead if swapping a page in needs memory that isn't free
+		KernReturn<uintptr_t> ResolveAddress(Sys::VM::Directory *directory, vm_address_t address);
+
+		// Maps the user pages backing the range into the kernel directory, swapping them in if needed.
+		// The pages don't have to be physically contiguous. They stay pinned until the mapping is
+		// freed again with UnmapFromKernel(), which takes the address returned by MapIntoKernel()
+		KernReturn<vm_address_t> MapIntoKernel(Sys::VM::Directory *directory, vm_address_t address, size_t pages);
+		void UnmapFromKernel(vm_address_t address, size_t pages);
+
+		// Pinned page frames are skipped by the swap. Pins are counted per hashed frame, so a frame
+		// may be reported as pinned when it isn't, but one that is pinned is never missed
+		void PinPage(uintptr_t physical);
+		void UnpinPage(uintptr_t physical);
+		bool IsPagePinned(uintptr_t physical);
+
+		void Discard(Sys::VM::Directory *directory);
+		void GetStatistics(Statistics *statistics);
+	}
+
+	KernReturn<void> SwapInit();
+}
+
+#endif /* _SWAP_H_ */
@@ -74,7 +74,7 @@ namespace OS
 	SyscallTrap _kernTrapTable[128] = {
 		/* 0 */ KERN_TRAP1("ipc_task_port", &OS::IPC::Syscall_IPCTaskPort, IPC::IPCPortCallArgs, port),
 		/* 1 */ KERN_TRAP1("ipc_thread_port", &OS::IPC::Syscall_IPCThreadPort, IPC::IPCPortCallArgs, port),
-		/* 2 */ KERN_TRAP3("ipc_message", &OS::IPC::Syscall_IPCMessage, IPC::IPCReadWriteArgs, header, size, mode),
+		/* 2 */ KERN_TRAP4("ipc_message", &OS::IPC::Syscall_IPCMessage, IPC::IPCReadWriteArgs, header, size, mode, timeout),
 		/* 3 */ KERN_TRAP1("ipc_allocate_port", &OS::IPC::Syscall_IPCAllocatePort, IPC::IPCPortCallArgs, port),
 		/* 4 */ KERN_TRAP2("ipc_get_special_port", &OS::IPC::Syscall_IPCGetSpecialPort, IPC::IPCSpecialPortArgs, result, port),
 		/* 5 */ KERN_TRAP1("ipc_deallocate_port", &OS::IPC::Syscall_IPCDeallocatePort, IPC::IPCDeallcoatePortArgs, port),
@@ -20,6 +20,8 @@
 #include <libc/string.h>
 #include <machine/interrupts/interrupts.h>
 #include <os/scheduler/scheduler.h>
+#include <os/scheduler/accounting.h>
+#include <os/swap/swap.h>
 #include <os/workqueue.h>
 #include <kern/kprintf.h>
 #include <kern/kalloc.h>
@@ -43,21 +45,32 @@ namespace OS
 		if(!base)
 			return;
 
-		Sys::VM::Directory *directory = task->GetDirectory();
-		KernReturn<uintptr_t> physical = directory->ResolveAddress(base);
+		size_t pages = VM_PAGE_COUNT(size + offset);
+		KernReturn<vm_address_t> mapping = Swap::MapIntoKernel(task->GetDirectory(), base, pages);
 
-		if(!physical.IsValid())
+		if(!mapping.IsValid())
 			return;
 
-		_pages = VM_PAGE_COUNT(size + offset);
-		_address = Sys::VM::Directory::GetKernelDirectory()->Alloc(physical, _pages, kVMFlagsKernel);
+		_pages = pages;
+		_address = mapping;
 		_pointer = _address + offset;
 	}
 
 	SyscallScopedMapping::~SyscallScopedMapping()
 	{
 		if(_address)
-			Sys::VM::Directory::GetKernelDirectory()->Free(_address, _pages);
+			Swap::UnmapFromKernel(_address, _pages);
+	}
+
+	// Backs the thread out of the syscall, it traps again once it runs the next time
+	static void RetrySyscall(Thread *thread, Sys::CPUState *state)
+	{
+		state->eip -= 2; // int 0x80, int 0x81 and sysenter are all two bytes long
+
+		Scheduler *scheduler = Scheduler::GetScheduler();
+
+		scheduler->UnblockThread(thread);
+		scheduler->YieldThread(thread);
 	}
 
 	void CompleteSyscall(void *context)
@@ -81,14 +94,26 @@ namespace OS
 				goto badMemory;
 
 			uint32_t *buffer = reinterpret_cast<uint32_t *>(arguments);
+			size_t registers;
+
+			// SYSENTER needs edx for the return address, its fourth argument comes in ebx instead
+			if(state->interrupt == IR_SYSENTER_VECTOR)
+			{
+				buffer[3] = state->ebx;
+				registers = 4;
+			}
+			else
+			{
+				buffer[4] = state->ebx;
+				buffer[3] = state->edx;
+				registers = 5;
+			}
 
-			buffer[4] = state->ebx;
-			buffer[3] = state->edx;
 			buffer[2] = state->esi;
 			buffer[1] = state->edi;
 			buffer[0] = state->ecx;
 
-			if(size > 5 * sizeof(uint32_t))
+			if(size > registers * sizeof(uint32_t))
 			{
 				// Get all the other arguments from the stack
 				size_t left = 0;
@@ -99,7 +124,7 @@ namespace OS
 				{
 					const SyscallArg *arg = entry->args + i;
 
-					if(arg->offset + arg->size >= 5 * sizeof(uint32_t))
+					if(arg->offset + arg->size >= registers * sizeof(uint32_t))
 					{
 						left = size - arg->offset;
 						argOffset = arg->offset;
@@ -149,20 +174,31 @@ namespace OS
 			bool hadFlag = cpu->GetFlagsSet(Sys::CPU::Flags::WaitQueueEnabled);
 			cpu->RemoveFlags(Sys::CPU::Flags::WaitQueueEnabled);
 
+			// Workers complete syscalls on behalf of the blocked thread, which is charged for it instead
+			bool onBehalf = (scheduler->GetActiveThread() != thread);
+			uint64_t token = onBehalf ? Accounting::BeginTransfer(cpu) : 0;
+
 			KernReturn<uint32_t> result = entry->handler(thread, arguments);
 
+			if(onBehalf)
+				Accounting::EndTransfer(cpu, token, thread);
+
 			if(hadFlag)
 				cpu->AddFlags(Sys::CPU::Flags::WaitQueueEnabled);
 
 			if(!result.IsValid() && result.GetError().GetCode() == KERN_TASK_RESTART)
 			{
 				delete[] arguments;
-				if(!cpu->GetWorkQueue()->PushEntry(&CompleteSyscall, reinterpret_cast<void *>(thread)))
-					panic("Out of workqueue items\n");
+
+				// If the queue is full, restarting from scratch is equivalent and applies the backpressure to the caller
+				if(!cpu->GetWorkQueue()->PushEntry(&CompleteSyscall, reinterpret_cast<void *>(thread), WorkQueue::Priority::High))
+					RetrySyscall(thread, state);
 
 				return;
 			}
 
+			thread->SetSyscallDeadline(0);
+
 			if(kernelTrap)
 			{
 				state->eax = (result.IsValid()) ? KERN_SUCCESS : result.GetError().GetCode();
@@ -198,6 +234,7 @@ namespace OS
 
 		Thread *thread = scheduler->GetActiveThread();
 		thread->SetESP(esp);
+		thread->GetUsage()->syscalls ++;
 
 		scheduler->BlockThread(thread);
 
@@ -207,8 +244,8 @@ namespace OS
 
 		if(!entry->interruptSafe)
 		{
-			if(!cpu->GetWorkQueue()->PushEntry(&CompleteSyscall, reinterpret_cast<void *>(thread)))
-				panic("Out of workqueue items!\n");
+			if(!cpu->GetWorkQueue()->PushEntry(&CompleteSyscall, reinterpret_cast<void *>(thread), WorkQueue::Priority::High))
+				RetrySyscall(thread, state);
 		}
 		else
 			CompleteSyscall(thread);
@@ -220,6 +257,7 @@ namespace OS
 	{
 		Sys::SetInterruptHandler(0x80, HandleSyscall);
 		Sys::SetInterruptHandler(0x81, HandleSyscall);
+		Sys::SetInterruptHandler(IR_SYSENTER_VECTOR, HandleSyscall);
 
 		return ErrorNone;
 	}
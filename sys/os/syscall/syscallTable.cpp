@@ -22,6 +22,7 @@
 #include <vfs/vfs_syscall.h>
 #include <os/scheduler/scheduler_syscall.h>
 #include "syscall_mmap.h"
+#include <os/futex.h>
 
 namespace OS
 {
@@ -81,23 +82,23 @@ namespace OS
 		/* 6 */ SYSCALL_TRAP_INVALID(),
 		/* 7 */ SYSCALL_TRAP_INVALID(),
 		/* 8 */ SYSCALL_TRAP3("ioctl", &VFS::Syscall_VFSIoctl, VFS::VFSIoctlArgs, fd, request, arg),
-		/* 9 */ SYSCALL_TRAP_INVALID(),
+		/* 9 */ SYSCALL_TRAP4("futex", &OS::Syscall_Futex, OS::FutexArgs, operation, address, value, timeout),
 		/* 10 */ SYSCALL_TRAP4("thread_create", &OS::Syscall_SchedThreadCreate, OS::SchedThreadCreateArgs, entry, argument1, argument2, stack),
 		/* 11 */ SYSCALL_TRAP1("thread_join", &OS::Syscall_SchedThreadJoin, OS::SchedThreadJoinArgs, tid),
 		/* 12 */ SYSCALL_TRAP0("thread_yield", &OS::Syscall_SchedThreadYield),
 		/* 13 */ SYSCALL_TRAP0("fork", &OS::Syscall_Fork),
 		/* 14 */ SYSCALL_TRAP3("exec", &OS::Syscall_Exec, OS::SchedExecArgs, path, args, envp),
 		/* 15 */ SYSCALL_TRAP3("spawn", &OS::Syscall_Spawn, OS::SchedExecArgs, path, args, envp),
-		/* 16 */ SYSCALL_TRAP_INVALID(),
-		/* 17 */ SYSCALL_TRAP_INVALID(),
-		/* 18 */ SYSCALL_TRAP_INVALID(),
-		/* 19 */ SYSCALL_TRAP_INVALID(),
+		/* 16 */ SYSCALL_TRAP2("sched_setaffinity", &OS::Syscall_SchedSetAffinity, OS::SchedAffinityArgs, tid, affinity),
+		/* 17 */ SYSCALL_TRAP2("sched_getaffinity", &OS::Syscall_SchedGetAffinity, OS::SchedAffinityInfoArgs, tid, mask),
+		/* 18 */ SYSCALL_TRAP2("nanosleep", &OS::Syscall_SchedSleep, OS::SchedSleepArgs, seconds, nanoseconds),
+		/* 19 */ SYSCALL_TRAP4("sched_setdeadline", &OS::Syscall_SchedSetDeadline, OS::SchedDeadlineArgs, tid, runtime, period, deadline),
 		/* 20 */ SYSCALL_TRAP6("mmap", &OS::Syscall_mmap, OS::MmapArgs, address, length, protection, flags, fd, offset),
 		/* 21 */ SYSCALL_TRAP_INVALID(),
 		/* 22 */ SYSCALL_TRAP_INVALID(),
 		/* 23 */ SYSCALL_TRAP3("msync", &OS::Syscall_msync, OS::MsyncArgs, address, length, flags),
-		/* 24 */ SYSCALL_TRAP_INVALID(),
-		/* 25 */ SYSCALL_TRAP_INVALID(),
+		/* 24 */ SYSCALL_TRAP2("sched_getdeadline", &OS::Syscall_SchedGetDeadline, OS::SchedDeadlineInfoArgs, tid, info),
+		/* 25 */ SYSCALL_TRAP2("getrusage", &OS::Syscall_GetRusage, OS::GetRusageArgs, who, usage),
 		/* 26 */ SYSCALL_TRAP_INVALID(),
 		/* 27 */ SYSCALL_TRAP_INVALID(),
 		/* 28 */ SYSCALL_TRAP_INVALID(),
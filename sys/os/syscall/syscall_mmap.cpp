@@ -18,16 +18,67 @@
 
 #include <machine/memory/physical.h>
 #include <os/scheduler/task.h>
+#include <os/swap/swap.h>
 #include <vfs/vfs.h>
 #include <vfs/file.h>
 #include "syscall_mmap.h"
 
 namespace OS
 {
+	// Fallback for when there is no contiguous physical memory left, maps every page individually
+	static KernReturn<vm_address_t> mmapScattered(Sys::VM::Directory *directory, size_t pages, Sys::VM::Directory::Flags flags)
+	{
+		KernReturn<uintptr_t> first = Sys::PM::Alloc(1);
+		if(!first.IsValid())
+			return first.GetError();
+
+		KernReturn<vm_address_t> vmemory = directory->Alloc(first, pages, flags);
+		if(!vmemory.IsValid())
+		{
+			Sys::PM::Free(first, 1);
+			return vmemory.GetError();
+		}
+
+		for(size_t i = 1; i < pages; i ++)
+		{
+			vm_address_t address = vmemory + (i * VM_PAGE_SIZE);
+
+			KernReturn<uintptr_t> physical = Sys::PM::Alloc(1);
+			Error error = physical.IsValid() ? ErrorNone : physical.GetError();
+
+			if(physical.IsValid())
+			{
+				KernReturn<void> result = directory->MapPage(physical, address, flags);
+				if(!result.IsValid())
+				{
+					Sys::PM::Free(physical, 1);
+					error = result.GetError();
+				}
+			}
+
+			if(error.GetCode() != KERN_SUCCESS)
+			{
+				Sys::PM::Free(first, 1);
+
+				for(size_t j = 1; j < i; j ++)
+				{
+					KernReturn<uintptr_t> mapped = directory->ResolveAddress(vmemory + (j * VM_PAGE_SIZE));
+					Sys::PM::Free(mapped, 1);
+				}
+
+				directory->Free(vmemory, pages);
+				return error;
+			}
+		}
+
+		return vmemory;
+	}
+
 	KernReturn<MmapTaskEntry *> mmapAnonymous(OS::Task *task, MmapArgs *arguments)
 	{
 		Error error(KERN_FAILURE);
 		Sys::VM::Directory *directory = task->GetDirectory();
+		Sys::VM::Directory::Flags vmflags = Sys::VM::TranslateMmapProtection(arguments->protection);
 
 		size_t pages = VM_PAGE_COUNT(arguments->length);
 
@@ -36,20 +87,17 @@ namespace OS
 
 		MmapTaskEntry *entry = nullptr;
 
+		Swap::Balance();
+
 		// Find some physical storage
 		{
 			KernReturn<uintptr_t> result = Sys::PM::Alloc(pages);
-			if(!result.IsValid())
-			{
-				error = result.GetError();
-				goto mmapFailed;
-			}
-
-			pmemory = result.Get();
+			if(result.IsValid())
+				pmemory = result.Get();
 		}
 
+		if(pmemory)
 		{
-			Sys::VM::Directory::Flags  vmflags = Sys::VM::TranslateMmapProtection(arguments->protection);
 			KernReturn<vm_address_t> result = directory->Alloc(pmemory, pages, vmflags);
 
 			if(!result.IsValid())
@@ -60,6 +108,18 @@ namespace OS
 
 			vmemory = result.Get();
 		}
+		else
+		{
+			// Make room by pushing cold pages into the swap and take whatever pages are left
+			Swap::Reclaim(pages);
+
+			KernReturn<vm_address_t> result = mmapScattered(directory, pages, vmflags);
+			if(!result.IsValid())
+				return result.GetError();
+
+			vmemory = result.Get();
+			pmemory = directory->ResolveAddress(vmemory);
+		}
 
 		// Zero out the memory
 		// TODO: Use page fault handler to clean pages when they are used
@@ -85,10 +145,19 @@ namespace OS
 
 	mmapFailed:
 		if(vmemory)
-			directory->Free(vmemory, pages);
+		{
+			for(size_t i = 0; i < pages; i ++)
+			{
+				KernReturn<uintptr_t> physical = directory->ResolveAddress(vmemory + (i * VM_PAGE_SIZE));
+				Sys::PM::Free(physical, 1);
+			}
 
-		if(pmemory)
+			directory->Free(vmemory, pages);
+		}
+		else if(pmemory)
+		{
 			Sys::PM::Free(pmemory, pages);
+		}
 
 		return error;
 	}
@@ -0,0 +1,408 @@
+//
+//  timer.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libcpp/algorithm.h>
+#include <libc/string.h>
+#include <libc/sys/spinlock.h>
+#include <machine/clock/clock.h>
+#include <machine/interrupts/interrupts.h>
+#include <kern/panic.h>
+#include "timer.h"
+
+namespace OS
+{
+	static constexpr uint32_t kTimerResolution = 100; // Microseconds per wheel tick
+
+	// The root level has one slot per tick, every level above covers 64 slots of the level below.
+	// All slots live in one array so that a single bitmap can track the non-empty ones
+	static constexpr uint32_t kRootBits = 8;
+	static constexpr uint32_t kRootSize = (1 << kRootBits);
+	static constexpr uint32_t kLevelBits = 6;
+	static constexpr uint32_t kLevelSize = (1 << kLevelBits);
+	static constexpr uint32_t kLevels = 4;
+	static constexpr uint32_t kSlots = kRootSize + kLevels * kLevelSize;
+
+	static constexpr uint32_t kNoSlot = kSlots;
+	static constexpr uint64_t kMaxDelta = (UINT64_C(1) << (kRootBits + kLevels * kLevelBits)) - 1; // About 5 days
+
+	static constexpr uint32_t GetLevelShift(uint32_t level)
+	{
+		return kRootBits + level * kLevelBits;
+	}
+	static constexpr uint32_t GetLevelOffset(uint32_t level)
+	{
+		return kRootSize + level * kLevelSize;
+	}
+
+	static inline uint64_t GetCurrentTick()
+	{
+		return Sys::Clock::GetMicroseconds() / kTimerResolution;
+	}
+
+	struct TimerWheel
+	{
+		TimerWheel() :
+			current(GetCurrentTick()),
+			count(0),
+			running(nullptr)
+		{
+			spinlock_init(&lock);
+			memset(bitmap, 0, sizeof(bitmap));
+		}
+
+		// Returns the first non-empty slot in [from, to), or to if there is none
+		uint32_t FindSlot(uint32_t from, uint32_t to) const
+		{
+			while(from < to)
+			{
+				uint32_t bits = bitmap[from / 32] & ~((UINT32_C(1) << (from % 32)) - 1);
+
+				if(bits)
+					return std::min(static_cast<uint32_t>((from & ~31) + Sys::CPUBitScanForward(bits)), to);
+
+				from = (from & ~31) + 32;
+			}
+
+			return to;
+		}
+
+		void Insert(Timer *timer)
+		{
+			uint64_t expires = std::max(timer->_expires, current);
+			uint64_t delta = std::min(expires - current, kMaxDelta);
+			uint32_t slot;
+
+			if(delta < kRootSize)
+			{
+				slot = static_cast<uint32_t>(expires & (kRootSize - 1));
+			}
+			else
+			{
+				uint32_t level = 0;
+				while(delta >= (UINT64_C(1) << GetLevelShift(level + 1)))
+					level ++;
+
+				expires = current + delta;
+				slot = GetLevelOffset(level) + static_cast<uint32_t>((expires >> GetLevelShift(level)) & (kLevelSize - 1));
+			}
+
+			slots[slot].push_back(timer->_entry);
+			bitmap[slot / 32] |= (1 << (slot % 32));
+
+			timer->_slot = slot;
+			count ++;
+		}
+
+		void Remove(Timer *timer)
+		{
+			uint32_t slot = timer->_slot;
+
+			slots[slot].erase(timer->_entry);
+
+			if(slots[slot].empty())
+				bitmap[slot / 32] &= ~(1 << (slot % 32));
+
+			timer->_slot = kNoSlot;
+			count --;
+		}
+
+		// Redistributes the timers of a slot to the lower levels, returns the index within the level
+		uint32_t Cascade(uint32_t level)
+		{
+			uint32_t index = static_cast<uint32_t>((current >> GetLevelShift(level)) & (kLevelSize - 1));
+			uint32_t slot = GetLevelOffset(level) + index;
+
+			if(!slots[slot].empty())
+			{
+				// Timers that are still too far out may end up in the same slot again
+				std::intrusive_list<Timer> timers;
+
+				while(!slots[slot].empty())
+				{
+					Timer *timer = slots[slot].head()->get();
+
+					Remove(timer);
+					timers.push_back(timer->_entry);
+				}
+
+				while(!timers.empty())
+				{
+					Timer *timer = timers.head()->get();
+
+					timers.erase(timer->_entry);
+					Insert(timer);
+				}
+			}
+
+			return index;
+		}
+
+		// Runs all timers up to and including the given tick. Must be called with the lock held
+		void Expire(uint64_t now)
+		{
+			while(current <= now)
+			{
+				uint32_t index = static_cast<uint32_t>(current & (kRootSize - 1));
+
+				if(index == 0)
+				{
+					for(uint32_t level = 0; level < kLevels; level ++)
+					{
+						if(Cascade(level) != 0)
+							break;
+					}
+				}
+
+				if(slots[index].empty())
+				{
+					// Skip ahead to the next timer, but never past the next cascade
+					uint32_t next = FindSlot(index, kRootSize);
+					current = std::min(current - index + next, now + 1);
+
+					continue;
+				}
+
+				current ++;
+
+				while(!slots[index].empty())
+				{
+					Timer *timer = slots[index].head()->get();
+					Remove(timer);
+
+					Timer::Callback callback = timer->_callback;
+					void *context = timer->_context;
+
+					// Cancel() looks for running timers once they are off the wheel
+					running.store(timer, std::memory_order_relaxed);
+					timer->_wheel.store(nullptr, std::memory_order_release);
+
+					spinlock_unlock(&lock);
+					callback(timer, context);
+					spinlock_lock(&lock);
+
+					running.store(nullptr, std::memory_order_release);
+				}
+			}
+		}
+
+		// Tick at which the CPU has to look at the wheel again, either to run or to cascade timers
+		bool GetNextExpiry(uint64_t &result) const
+		{
+			if(count == 0)
+				return false;
+
+			uint32_t index = static_cast<uint32_t>(current & (kRootSize - 1));
+			uint64_t base = current - index;
+
+			uint32_t next = FindSlot(index, kRootSize);
+			if(next < kRootSize)
+			{
+				result = base + next;
+				return true;
+			}
+
+			uint64_t best = UINT64_MAX;
+
+			next = FindSlot(0, index);
+			if(next < index)
+				best = base + kRootSize + next;
+
+			for(uint32_t level = 0; level < kLevels; level ++)
+			{
+				uint32_t shift = GetLevelShift(level);
+				uint32_t offset = GetLevelOffset(level);
+				uint32_t position = static_cast<uint32_t>((current >> shift) & (kLevelSize - 1));
+
+				uint64_t block = (current >> shift) - position;
+
+				// Slots up to the current position belong to the next round
+				next = FindSlot(offset + position + 1, offset + kLevelSize) - offset;
+
+				if(next < kLevelSize)
+					block += next;
+				else if((next = FindSlot(offset, offset + position + 1) - offset) <= position)
+					block += kLevelSize + next;
+				else
+					continue;
+
+				best = std::min(best, block << shift);
+			}
+
+			result = best;
+			return true;
+		}
+
+		// Must be called with the lock held and only on the wheel's own CPU
+		void UpdateDeadline()
+		{
+			uint64_t next;
+
+			if(GetNextExpiry(next))
+				Sys::Clock::SetTimerDeadline(Sys::Clock::Event::Timers, next * kTimerResolution);
+			else
+				Sys::Clock::SetTimerDeadline(Sys::Clock::Event::Timers, 0);
+		}
+
+		std::intrusive_list<Timer> slots[kSlots];
+		uint32_t bitmap[kSlots / 32];
+		uint64_t current; // The next tick to process
+		size_t count;
+		std::atomic<Timer *> running;
+		spinlock_t lock;
+	};
+
+	static TimerWheel *_wheels[CONFIG_MAX_CPUS];
+
+
+	Timer::Timer(Callback callback, void *context) :
+		_callback(callback),
+		_context(context),
+		_expires(0),
+		_wheel(nullptr),
+		_slot(kNoSlot),
+		_entry(this)
+	{}
+
+	Timer::~Timer()
+	{
+		Cancel();
+	}
+
+	void Timer::SetCallback(Callback callback, void *context)
+	{
+		_callback = callback;
+		_context = context;
+	}
+
+	void Timer::Arm(uint64_t timeout)
+	{
+		ArmDeadline(Sys::Clock::GetMicroseconds() + timeout);
+	}
+
+	void Timer::ArmDeadline(uint64_t deadline)
+	{
+		Cancel();
+
+		bool enabled = Sys::DisableInterrupts();
+
+		TimerWheel *wheel = _wheels[Sys::CPU::GetCurrentCPU()->GetID()];
+		if(!wheel)
+			panic("Timer armed before the timer wheels were set up");
+
+		spinlock_lock(&wheel->lock);
+
+		// An empty wheel may lag behind after a long idle period, there is nothing to cascade so just move it forward
+		if(wheel->count == 0)
+			wheel->current = std::max(wheel->current, GetCurrentTick());
+
+		_expires = (deadline + kTimerResolution - 1) / kTimerResolution;
+		_wheel.store(wheel, std::memory_order_release);
+
+		wheel->Insert(this);
+		wheel->UpdateDeadline();
+
+		spinlock_unlock(&wheel->lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+	}
+
+	bool Timer::Cancel()
+	{
+		bool enabled = Sys::DisableInterrupts();
+		bool result = false;
+
+		TimerWheel *local = _wheels[Sys::CPU::GetCurrentCPU()->GetID()];
+
+		while(1)
+		{
+			TimerWheel *wheel = _wheel.load(std::memory_order_acquire);
+			if(!wheel)
+				break;
+
+			spinlock_lock(&wheel->lock);
+
+			// The timer might have expired or moved while waiting for the lock
+			if(_wheel.load(std::memory_order_relaxed) == wheel)
+			{
+				wheel->Remove(this);
+				_wheel.store(nullptr, std::memory_order_relaxed);
+
+				if(wheel == local)
+					wheel->UpdateDeadline();
+
+				result = true;
+			}
+
+			spinlock_unlock(&wheel->lock);
+
+			if(result)
+				break;
+		}
+
+		// Wait for the callback to finish if it's running elsewhere. On our own CPU it can only be the callback itself calling us
+		for(size_t i = 0; i < CONFIG_MAX_CPUS; i ++)
+		{
+			TimerWheel *wheel = _wheels[i];
+
+			if(!wheel || wheel == local)
+				continue;
+
+			while(wheel->running.load(std::memory_order_acquire) == this)
+				Sys::CPUPause();
+		}
+
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		return result;
+	}
+
+
+	void ExpireTimers(Sys::CPU *cpu)
+	{
+		TimerWheel *wheel = _wheels[cpu->GetID()];
+		if(!wheel)
+			return;
+
+		spinlock_lock(&wheel->lock);
+
+		wheel->Expire(GetCurrentTick());
+		wheel->UpdateDeadline();
+
+		spinlock_unlock(&wheel->lock);
+	}
+
+	KernReturn<void> TimerInit()
+	{
+		for(size_t i = 0; i < CONFIG_MAX_CPUS; i ++)
+		{
+			Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
+			_wheels[i] = nullptr;
+
+			if(!cpu || !(cpu->GetFlags() & Sys::CPU::Flags::Running))
+				continue;
+
+			_wheels[i] = new TimerWheel();
+			if(!_wheels[i])
+				return Error(KERN_NO_MEMORY);
+		}
+
+		return ErrorNone;
+	}
+}
@@ -0,0 +1,78 @@
+//
+//  timer.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <libcpp/atomic.h>
+#include <libcpp/intrusive_list.h>
+#include <kern/kern_return.h>
+#include <machine/cpu.h>
+
+namespace OS
+{
+	struct TimerWheel;
+
+	/**
+	 * One-shot kernel timer. Timers are kept in a hierarchical timer wheel per CPU, arming
+	 * and cancelling are constant time operations. A timer is queued on the CPU that arms it
+	 * and expires on that same CPU.
+	 *
+	 * The callback runs from the clock interrupt with interrupts disabled and no locks held,
+	 * so it must not block. It is allowed to re-arm or cancel timers, wake up threads and to
+	 * push work onto the CPU's work queue for anything that needs a thread context.
+	 *
+	 * Cancel() waits for the callback to finish if it is running on another CPU, after it
+	 * returns it is safe to free the timer.
+	 **/
+	class Timer
+	{
+	public:
+		typedef void (*Callback)(Timer *timer, void *context);
+
+		Timer(Callback callback = nullptr, void *context = nullptr);
+		~Timer();
+
+		void SetCallback(Callback callback, void *context); // Must not be called while the timer is pending
+
+		void Arm(uint64_t timeout); // In microseconds from now
+		void ArmDeadline(uint64_t deadline); // Absolute, in the time of Sys::Clock::GetMicroseconds()
+		bool Cancel(); // Returns true if the timer was still pending
+
+		bool IsPending() const { return (_wheel.load(std::memory_order_acquire) != nullptr); }
+
+	private:
+		friend struct TimerWheel;
+
+		Callback _callback;
+		void *_context;
+
+		uint64_t _expires; // In wheel ticks
+		std::atomic<TimerWheel *> _wheel; // The wheel the timer is queued on
+		uint32_t _slot;
+		std::intrusive_list<Timer>::member _entry;
+	};
+
+	void ExpireTimers(Sys::CPU *cpu);
+
+	KernReturn<void> TimerInit();
+}
+
+#endif /* _TIMER_H_ */
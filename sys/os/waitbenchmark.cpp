@@ -0,0 +1,152 @@
+//
+//  waitbenchmark.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include <libcpp/atomic.h>
+#include <machine/cpu.h>
+#include <os/waitqueue.h>
+#include "waitbenchmark.h"
+
+namespace OS
+{
+	namespace WaitBenchmark
+	{
+		static constexpr size_t kRoundTrips = 10000;
+		static constexpr uint64_t kPollInterval = 1000;
+		static constexpr uint64_t kTimeout = 1000000; // Only armed to measure the timer, never expires
+
+		static char _ping;
+		static char _pong;
+
+		static uint32_t _cpus[2];
+		static uint64_t _timeout;
+		static uint64_t _cycles;
+		static std::atomic<uint32_t> _ready;
+		static std::atomic<uint32_t> _done;
+		static std::atomic<bool> _go;
+		static bool _abort;
+
+		// Returns false if the other thread failed to start
+		static bool WaitForStart(uint32_t cpu)
+		{
+			// They start wherever the scheduler puts them and are moved over once their affinity is set
+			while(Sys::CPU::GetCurrentCPU()->GetID() != cpu)
+				Sys::CPUPause();
+
+			while(!_go.load(std::memory_order_acquire))
+				WaitWithTimeout(&_go, kPollInterval);
+
+			if(_abort)
+			{
+				_done ++;
+				return false;
+			}
+
+			return true;
+		}
+
+		// Both sides wake their partner only once they are queued themselves, so no wakeup gets lost
+		static void PingThread()
+		{
+			if(!WaitForStart(_cpus[0]))
+				Benchmark::Exit();
+
+			while(_ready.load() == 0)
+				WaitWithTimeout(&_ready, kPollInterval);
+
+			uint64_t start = Sys::CPUReadTimestamp();
+
+			for(size_t i = 0; i < kRoundTrips; i ++)
+				WaitWithCallback(&_ping, _timeout, [] { WakeupOne(&_pong); });
+
+			_cycles = Sys::CPUReadTimestamp() - start;
+			_done ++;
+
+			Benchmark::Exit();
+		}
+
+		static void PongThread()
+		{
+			if(!WaitForStart(_cpus[1]))
+				Benchmark::Exit();
+
+			WaitWithCallback(&_pong, [] { _ready ++; });
+
+			for(size_t i = 1; i < kRoundTrips; i ++)
+				WaitWithCallback(&_pong, _timeout, [] { WakeupOne(&_ping); });
+
+			WakeupOne(&_ping);
+			_done ++;
+
+			Benchmark::Exit();
+		}
+
+		// Returns the average cycles per round trip, or 0 if the threads couldn't be started
+		static uint32_t RoundTrips(uint32_t ping, uint32_t pong, uint64_t timeout)
+		{
+			_cpus[0] = ping;
+			_cpus[1] = pong;
+			_timeout = timeout;
+			_cycles = 0;
+			_ready = 0;
+			_done = 0;
+			_go = false;
+
+			uint32_t started = 0;
+
+			if(Benchmark::StartThread(&PongThread, Thread::PriorityClassHigh, 1 << pong).IsValid())
+				started ++;
+
+			if(started == 1 && Benchmark::StartThread(&PingThread, Thread::PriorityClassHigh, 1 << ping).IsValid())
+				started ++;
+
+			// A lone thread would wait for its partner forever
+			_abort = (started != 2);
+			_go.store(true, std::memory_order_release);
+
+			while(_done.load() != started)
+				WaitWithTimeout(&_done, kPollInterval);
+
+			if(_abort)
+				return 0;
+
+			return static_cast<uint32_t>(_cycles / kRoundTrips);
+		}
+
+		void Run(Result &result)
+		{
+			uint32_t cpus[2];
+			size_t count = 0;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount() && count < 2; i ++)
+			{
+				if(Sys::CPU::GetCPUWithID(i)->GetFlags() & Sys::CPU::Flags::Running)
+					cpus[count ++] = static_cast<uint32_t>(i);
+			}
+
+			result.localCycles = RoundTrips(cpus[0], cpus[0], 0);
+			result.localTimedCycles = RoundTrips(cpus[0], cpus[0], kTimeout);
+
+			if(count == 2)
+			{
+				result.remoteCycles = RoundTrips(cpus[0], cpus[1], 0);
+				result.remoteTimedCycles = RoundTrips(cpus[0], cpus[1], kTimeout);
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+//
+//  waitbenchmark.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef _WAITBENCHMARK_H_
+#define _WAITBENCHMARK_H_
+
+#include <prefix.h>
+#include <libc/stdint.h>
+#include <os/benchmark.h>
+
+namespace OS
+{
+	/**
+	 * Two threads ping-pong between two wait channels, each one waking the other from the callback of
+	 * its own wait. Runs with both threads on the same CPU and on two different CPUs, with and without
+	 * an armed timeout. Started by writing "benchmark" to /dev/waitqueue, which also shows the result.
+	 **/
+	namespace WaitBenchmark
+	{
+		// Average TSC cycles per round trip, the cross CPU results are 0 with only one CPU
+		struct Result
+		{
+			uint32_t localCycles;
+			uint32_t localTimedCycles;
+			uint32_t remoteCycles;
+			uint32_t remoteTimedCycles;
+		};
+
+		void Run(Result &result);
+		typedef Benchmark::Runner<Result, &Run> Runner;
+	}
+}
+
+#endif /* _WAITBENCHMARK_H_ */
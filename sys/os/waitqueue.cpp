@@ -16,105 +16,99 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <libio/core/IOObject.h>
-#include <libio/core/IODictionary.h>
-#include <libcpp/vector.h>
+#include <machine/interrupts/interrupts.h>
 #include <os/scheduler/scheduler.h>
+#include <os/timer.h>
+#include <os/workqueue.h>
 #include "waitqueue.h"
 
 namespace OS
 {
-	class WaitqueueLookup : public IO::Object
+	static constexpr size_t kBucketCount = 128;
+
+	struct WaitqueueBucket
 	{
-	public:
-		WaitqueueLookup *Init(void *channel)
-		{
-			if(!IO::Object::Init())
-				return nullptr;
+		spinlock_t lock;
+		std::intrusive_list<WaitqueueWaiter> waiters;
+	} __attribute__((aligned(64)));
 
-			_channel = channel;
+	static WaitqueueBucket _buckets[kBucketCount];
 
-			return this;
-		}
+	static_assert(kBucketCount == 128, "GetBucket() uses the top 7 bits of the hash");
 
-		size_t GetHash() const override
-		{
-			return reinterpret_cast<size_t>(_channel);
-		}
-		bool IsEqual(IO::Object *other) const override
-		{
-			WaitqueueLookup *lookup = static_cast<WaitqueueLookup *>(other);
-			return (lookup->_channel == _channel);
-		}
+	static WaitqueueBucket *GetBucket(void *channel)
+	{
+		uint32_t hash = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(channel)) * 0x9e3779b1;
+		return _buckets + (hash >> 25);
+	}
 
-		void AddThread(Thread *thread)
-		{
-			_waiters.push_back(thread);
-		}
-		std::vector<Thread *>::iterator GetBegin()
-		{
-			return _waiters.begin();
-		}
-		std::vector<Thread *>::iterator GetEnd()
-		{
-			return _waiters.end();
-		}
+	// Timeouts take the bucket lock from the timer interrupt, so it must never be held with interrupts enabled
+	static bool LockBucket(WaitqueueBucket *bucket)
+	{
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&bucket->lock);
 
-	private:
-		std::vector<Thread *> _waiters;
-		void *_channel;
+		return enabled;
+	}
+	static void UnlockBucket(WaitqueueBucket *bucket, bool enabled)
+	{
+		spinlock_unlock(&bucket->lock);
 
-		IODeclareMeta(WaitqueueLookup)
-	};
+		if(enabled)
+			Sys::EnableInterrupts();
+	}
 
-	class WaitqueueEntry : public IO::Object
+	// Called with the bucket lock held and the thread already blocked
+	static void Enqueue(WaitqueueBucket *bucket, Thread *thread, void *channel)
 	{
-	public:
-		WaitqueueEntry *Init()
-		{
-			if(!IO::Object::Init())
-				return nullptr;
-			return this;
-		}
+		WaitqueueWaiter *waiter = thread->GetWaitqueueWaiter();
 
-		void AddThread(Thread *thread)
-		{
-			_waiters.push_back(thread);
-		}
-		std::vector<Thread *>::iterator GetBegin()
-		{
-			return _waiters.begin();
-		}
-		std::vector<Thread *>::iterator GetEnd()
-		{
-			return _waiters.end();
-		}
+		waiter->thread = thread;
+		waiter->channel = channel;
+		waiter->timer = nullptr;
+		waiter->queued = true;
+		waiter->timedOut = false;
 
-		Thread *PopAny()
-		{
-			std::vector<Thread *>::iterator last = _waiters.end() - 1;
+		bucket->waiters.push_back(waiter->entry);
+	}
 
-			Thread *thread = *last;
-			_waiters.erase(last);
+	// Called with the bucket lock held. The waiter is dequeued only after its thread is unblocked,
+	// so a waiting thread that sees it dequeued can be sure that nobody is going to unblock it anymore
+	static void Dequeue(WaitqueueBucket *bucket, WaitqueueWaiter *waiter)
+	{
+		bucket->waiters.erase(waiter->entry);
 
-			return thread;
-		}
-		bool IsEmpty() const
-		{
-			return (_waiters.size() == 0);
-		}
+		Scheduler::GetScheduler()->UnblockThread(waiter->thread);
+		waiter->queued = false;
+	}
+
+	static bool IsQueued(WaitqueueWaiter *waiter)
+	{
+		WaitqueueBucket *bucket = GetBucket(waiter->channel);
 
-	private:
-		std::vector<Thread *> _waiters;
+		bool enabled = LockBucket(bucket);
+		bool queued = waiter->queued;
+		UnlockBucket(bucket, enabled);
 
-		IODeclareMeta(WaitqueueEntry)
-	};
+		return queued;
+	}
 
-	IODefineMeta(WaitqueueLookup, IO::Object)
-	IODefineMeta(WaitqueueEntry, IO::Object)
+	static void WaitTimeout(__unused Timer *timer, void *context)
+	{
+		WaitqueueWaiter *waiter = reinterpret_cast<WaitqueueWaiter *>(context);
+		WaitqueueBucket *bucket = GetBucket(waiter->channel);
 
-	static IO::Dictionary *_waitqueue;
-	static spinlock_t _waitLock = SPINLOCK_INIT;
+		bool enabled = LockBucket(bucket);
+
+		// If the waiter is gone from the bucket, a wakeup beat us to it
+		if(waiter->queued)
+		{
+			waiter->timedOut = true;
+			Dequeue(bucket, waiter);
+		}
+
+		UnlockBucket(bucket, enabled);
+	}
 
 
 	KernReturn<void> Wait(void *channel)
@@ -122,115 +116,155 @@ namespace OS
 		return WaitWithCallback(channel, []{});
 	}
 
+	KernReturn<void> WaitWithTimeout(void *channel, uint64_t timeout)
+	{
+		return WaitWithCallback(channel, timeout, []{});
+	}
+
 	KernReturn<void> WaitWithCallback(void *channel, IO::Function<void ()> &&callback)
+	{
+		return WaitWithCallback(channel, 0, std::move(callback));
+	}
+
+	KernReturn<void> WaitWithCallback(void *channel, uint64_t timeout, IO::Function<void ()> &&callback)
 	{
 		if(!Sys::CPU::GetCurrentCPU()->GetFlagsSet(Sys::CPU::Flags::WaitQueueEnabled))
 			return Error(KERN_RESOURCES_MISSING);
 
-		WaitqueueLookup *lookup = WaitqueueLookup::Alloc()->Init(channel);
+		Scheduler *scheduler = Scheduler::GetScheduler();
+
+		Thread *thread = scheduler->GetActiveThread();
+		Sys::CPU::GetCurrentCPU()->GetWorkQueue()->WorkerWillSleep(thread);
 
-		spinlock_lock(&_waitLock);
+		WaitqueueWaiter *waiter = thread->GetWaitqueueWaiter();
+		WaitqueueBucket *bucket = GetBucket(channel);
 
-		WaitqueueEntry *entry = _waitqueue->GetObjectForKey<WaitqueueEntry>(lookup);
-		if(!entry)
+		Timer timer(&WaitTimeout, waiter);
+
+		bool enabled = LockBucket(bucket);
+
+		scheduler->BlockThread(thread);
+		Enqueue(bucket, thread, channel);
+
+		if(timeout)
 		{
-			entry = WaitqueueEntry::Alloc()->Init();
-			_waitqueue->SetObjectForKey(entry, lookup);
+			waiter->timer = &timer;
+			timer.Arm(timeout);
 		}
 
-		Thread *thread = Scheduler::GetScheduler()->GetActiveThread();
+		UnlockBucket(bucket, enabled);
 
-		Scheduler::GetScheduler()->BlockThread(thread);
-		entry->AddThread(thread);
+		callback();
+		scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU()); // Make sure we don't return until Wakeup() is called
 
-		spinlock_unlock(&_waitLock);
+		// The reschedule IPI might not have arrived yet, and the waiter must be out of the bucket before it can be reused.
+		// With interrupts off this would spin forever if this CPU is the one that has to do the wakeup
+		assert(Sys::CPUInterruptsEnabled());
 
-		lookup->Release();
+		while(IsQueued(waiter))
+			Sys::CPUPause();
 
-		callback();
-		Scheduler::GetScheduler()->RescheduleCPU(Sys::CPU::GetCurrentCPU()); // Make sure we don't return until Wakeup() is called
+		if(timeout)
+			timer.Cancel();
+
+		if(waiter->timedOut)
+			return Error(KERN_TIMEOUT);
 
 		return ErrorNone;
 	}
 
 	KernReturn<void> WaitThread(Thread *thread, void *channel)
 	{
-		IO::StrongRef<WaitqueueLookup> lookup(IOTransferRef(WaitqueueLookup::Alloc()->Init(channel)));
+		WaitqueueBucket *bucket = GetBucket(channel);
 
-		spinlock_lock(&_waitLock);
+		bool enabled = LockBucket(bucket);
 
-		WaitqueueEntry *entry = _waitqueue->GetObjectForKey<WaitqueueEntry>(lookup);
-		if(!entry)
-		{
-			entry = WaitqueueEntry::Alloc()->Init();
-			_waitqueue->SetObjectForKey(entry, lookup);
-		}
-		
 		Scheduler::GetScheduler()->BlockThread(thread);
-		entry->AddThread(thread);
+		Enqueue(bucket, thread, channel);
 
-		spinlock_unlock(&_waitLock);
+		UnlockBucket(bucket, enabled);
 
 		return ErrorNone;
 	}
-	
+
+	// The lock is held while unblocking, so that a timeout can't unblock any of the threads a second time
 	void Wakeup(void *channel)
 	{
-		IO::StrongRef<WaitqueueLookup> lookup(IOTransferRef(WaitqueueLookup::Alloc()->Init(channel)));
+		WaitqueueBucket *bucket = GetBucket(channel);
 
-		spinlock_lock(&_waitLock);
+		bool enabled = LockBucket(bucket);
 
-		WaitqueueEntry *entry = _waitqueue->GetObjectForKey<WaitqueueEntry>(lookup);
-		if(!entry)
+		std::intrusive_list<WaitqueueWaiter>::member *member = bucket->waiters.head();
+		while(member)
 		{
-			spinlock_unlock(&_waitLock);
-			return;
+			WaitqueueWaiter *waiter = member->get();
+			member = member->next();
+
+			if(waiter->channel == channel)
+				Dequeue(bucket, waiter);
 		}
 
-		entry->Retain();
+		UnlockBucket(bucket, enabled);
+	}
+
+	void WakeupOne(void *channel)
+	{
+		WaitqueueBucket *bucket = GetBucket(channel);
 
-		_waitqueue->RemoveObjectForKey(lookup);
-		spinlock_unlock(&_waitLock);
+		bool enabled = LockBucket(bucket);
 
-		// Unblock all threads waiting on the channel
-		std::vector<Thread *>::iterator iterator = entry->GetBegin();
-		while(iterator != entry->GetEnd())
+		for(std::intrusive_list<WaitqueueWaiter>::member *member = bucket->waiters.head(); member; member = member->next())
 		{
-			Thread *thread = *iterator;
-			Scheduler::GetScheduler()->UnblockThread(thread);
+			WaitqueueWaiter *waiter = member->get();
 
-			iterator ++;
+			if(waiter->channel == channel)
+			{
+				Dequeue(bucket, waiter);
+				break;
+			}
 		}
 
-		entry->Release();
+		UnlockBucket(bucket, enabled);
 	}
 
-	void WakeupOne(void *channel)
+	namespace Waitqueue
 	{
-		IO::StrongRef<WaitqueueLookup> lookup(IOTransferRef(WaitqueueLookup::Alloc()->Init(channel)));
+		void Cancel(Thread *thread)
+		{
+			WaitqueueWaiter *waiter = thread->GetWaitqueueWaiter();
+			if(!waiter->channel)
+				return; // Never waited
 
-		spinlock_lock(&_waitLock);
+			WaitqueueBucket *bucket = GetBucket(waiter->channel);
 
-		WaitqueueEntry *entry = _waitqueue->GetObjectForKey<WaitqueueEntry>(lookup);
-		if(!entry)
-		{
-			spinlock_unlock(&_waitLock);
-			return;
-		}
+			bool enabled = LockBucket(bucket);
+
+			// A wakeup or timeout already took it
+			if(!waiter->queued)
+			{
+				UnlockBucket(bucket, enabled);
+				return;
+			}
 
-		Thread *thread = entry->PopAny();
+			bucket->waiters.erase(waiter->entry);
+			waiter->queued = false;
 
-		if(entry->IsEmpty())
-			_waitqueue->RemoveObjectForKey(lookup);
+			Timer *timer = waiter->timer;
+			waiter->timer = nullptr;
 
-		spinlock_unlock(&_waitLock);
+			UnlockBucket(bucket, enabled);
 
-		Scheduler::GetScheduler()->UnblockThread(thread);
+			// Waits for a timeout that is running right now, which finds the waiter dequeued and backs off
+			if(timer)
+				timer->Cancel();
+		}
 	}
 
 	KernReturn<void> WaitqueueInit()
 	{
-		_waitqueue = IO::Dictionary::Alloc()->Init();
+		for(size_t i = 0; i < kBucketCount; i ++)
+			spinlock_init(&_buckets[i].lock);
+
 		return ErrorNone;
 	}
 }
@@ -22,19 +22,58 @@
 #include <prefix.h>
 #include <libc/stdint.h>
 #include <kern/kern_return.h>
+#include <libcpp/intrusive_list.h>
 #include <libio/core/IOFunction.h>
 
 namespace OS
 {
 	class Thread;
-	
+	class Timer;
+
+	/**
+	 * Threads wait on arbitrary channel addresses, which are hashed into a fixed number of buckets
+	 * with their own lock each. The waiter is embedded in the thread and linked into its bucket,
+	 * so neither waiting nor waking allocates. Wakeups are handed out in the order threads started
+	 * waiting.
+	 **/
+
+	// Embedded in every thread, a thread can only wait on one channel at a time
+	struct WaitqueueWaiter
+	{
+		WaitqueueWaiter() :
+			thread(nullptr),
+			channel(nullptr),
+			timer(nullptr),
+			queued(false),
+			timedOut(false),
+			entry(this)
+		{}
+
+		Thread *thread;
+		void *channel;
+		Timer *timer; // Armed timeout, lives on the stack of the waiting thread
+		bool queued;
+		bool timedOut;
+		std::intrusive_list<WaitqueueWaiter>::member entry;
+	};
+
 	KernReturn<void> Wait(void *channel);
 	KernReturn<void> WaitWithCallback(void *channel, IO::Function<void ()> &&callback);
 	KernReturn<void> WaitThread(Thread *thread, void *channel);
 
+	// Timeouts are in microseconds, 0 waits forever. Returns KERN_TIMEOUT if nobody woke the thread up in time
+	KernReturn<void> WaitWithTimeout(void *channel, uint64_t timeout);
+	KernReturn<void> WaitWithCallback(void *channel, uint64_t timeout, IO::Function<void ()> &&callback);
+
 	void Wakeup(void *channel);
 	void WakeupOne(void *channel);
 
+	namespace Waitqueue
+	{
+		// Unlinks the waiter of a dying thread without unblocking it, and cancels its timeout
+		void Cancel(Thread *thread);
+	}
+
 	KernReturn<void> WaitqueueInit();
 }
 
@@ -17,106 +17,450 @@
 //
 
 #include <kern/kprintf.h>
+#include <libc/string.h>
+#include <libcpp/algorithm.h>
+#include <libio/core/IOArray.h>
+#include <libio/core/IONumber.h>
+#include <machine/interrupts/interrupts.h>
+#include <machine/memory/memory.h>
+#include <os/scheduler/scheduler.h>
 #include "workqueue.h"
 
 namespace OS
 {
 	WorkQueue::WorkQueue() :
-		_exhausted(false),
+		_refill(false),
 		_freeListHead(nullptr),
-		_workListHead(nullptr)
+		_freeCount(0),
+		_slabCount(0),
+		_primary(nullptr),
+		_workerCount(0),
+		_idleCount(0),
+		_spawning(false)
 	{
-		spinlock_init(&_readWriterLock);
-		_ExtendFreeList(50);
+		spinlock_init(&_lock);
+		memset(&_statistics, 0, sizeof(Statistics));
+
+		for(size_t i = 0; i < kMaxWorkers; i ++)
+		{
+			_workers[i] = nullptr;
+			_idle[i] = nullptr;
+		}
+
+		for(size_t i = 0; i < static_cast<size_t>(Priority::__Count); i ++)
+		{
+			_workLists[i].head = nullptr;
+			_workLists[i].tail = nullptr;
+		}
+
+		_AllocateSlab();
 	}
 
-	void WorkQueue::_ExtendFreeList(size_t size)
+	// Has to be called from thread context
+	bool WorkQueue::_AllocateSlab()
 	{
-		Entry *entries = new Entry[size];
+		Entry *entries = Sys::Alloc<Entry>(Sys::VM::Directory::GetKernelDirectory(), 1, kVMFlagsKernel);
+		if(!entries)
+			return false;
+
+		for(size_t i = 0; i < kEntriesPerSlab - 1; i ++)
+			entries[i].next = entries + i + 1;
 
-		for(size_t i = 0; i < size - 1; i ++)
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		entries[kEntriesPerSlab - 1].next = _freeListHead;
+		_freeListHead = entries;
+		_freeCount += kEntriesPerSlab;
+		_slabCount ++;
+
+		spinlock_unlock(&_lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		return true;
+	}
+
+	bool WorkQueue::PushEntry(Callback callback, void *context, Priority priority)
+	{
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		Entry *entry = _freeListHead;
+
+		// Let a worker grow the cache before it runs dry, allocating isn't possible from interrupt context
+		if(_freeCount <= kLowWatermark && _slabCount < kMaxSlabs)
+			_refill = true;
+
+		Thread *worker = (_idleCount > 0 && (entry || _refill)) ? _idle[-- _idleCount] : nullptr;
+
+		if(entry)
 		{
-			Entry *entry = entries + i;
-			Entry *next = entries + i + 1;
+			_freeListHead = entry->next;
+			_freeCount --;
+
+			entry->callback = callback;
+			entry->context = context;
+			entry->next = nullptr;
+			entry->timestamp = Sys::CPUReadTimestamp();
+
+			List &list = _workLists[static_cast<size_t>(priority)];
+
+			if(list.tail)
+				list.tail->next = entry;
+			else
+				list.head = entry;
 
-			entry->next = next;
-			next->next = nullptr;
+			list.tail = entry;
+
+			Statistics::Level &level = _statistics.levels[static_cast<size_t>(priority)];
+
+			level.pushed ++;
+			level.depth ++;
+			level.maxDepth = std::max(level.maxDepth, level.depth);
+		}
+		else
+		{
+			_statistics.rejected ++;
 		}
 
-		RefurbishList(entries);
+		spinlock_unlock(&_lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		if(worker)
+			Scheduler::GetScheduler()->UnblockThread(worker);
+
+		return (entry != nullptr);
 	}
 
-	bool WorkQueue::PushEntry(Callback callback, void *context)
+	void WorkQueue::RefurbishList(Entry *entry, Priority priority, size_t count, uint64_t latency, uint64_t maxLatency)
 	{
-		spinlock_lock(&_readWriterLock);
+		Entry *last = entry;
+		while(last->next)
+			last = last->next;
 
-		Entry *entry = _freeListHead;
-		if(!entry)
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		last->next = _freeListHead;
+		_freeListHead = entry;
+		_freeCount += count;
+
+		Statistics::Level &level = _statistics.levels[static_cast<size_t>(priority)];
+
+		level.depth -= count;
+		level.completed += count;
+		level.latencyCycles += latency;
+		level.maxLatencyCycles = std::max(level.maxLatencyCycles, maxLatency);
+
+		spinlock_unlock(&_lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+	}
+
+	void WorkQueue::GetStatistics(Statistics *statistics)
+	{
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		*statistics = _statistics;
+		statistics->capacity = _slabCount * kEntriesPerSlab;
+		statistics->workers = _workerCount;
+
+		spinlock_unlock(&_lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
+	}
+
+	void WorkQueue::WorkerWillSleep(Thread *thread)
+	{
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		bool isWorker = false;
+
+		for(size_t i = 0; i < kMaxWorkers; i ++)
 		{
-			spinlock_unlock(&_readWriterLock);
-			return false;
+			if(_workers[i] == thread)
+				isWorker = true;
+		}
+
+		// Only one spawn at a time, creating the thread might sleep as well
+		bool spawn = (isWorker && _idleCount == 0 && _workerCount < kMaxWorkers && !_spawning);
+		if(spawn)
+		{
+			_spawning = true;
+			_workerCount ++;
 		}
 
-		_freeListHead = entry->next;
+		spinlock_unlock(&_lock);
 
-		entry->callback = callback;
-		entry->context = context;
+		if(enabled)
+			Sys::EnableInterrupts();
 
-		entry->next = _workListHead;
-		_workListHead = entry;
+		if(!spawn)
+			return;
 
-		spinlock_unlock(&_readWriterLock);
-		return true;
+		KernReturn<void> result = SpawnWorker(Sys::CPU::GetCurrentCPU()->GetID());
+
+		enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		if(!result.IsValid())
+			_workerCount --;
+
+		_spawning = false;
+
+		spinlock_unlock(&_lock);
+
+		if(enabled)
+			Sys::EnableInterrupts();
 	}
 
-	WorkQueue::Entry *WorkQueue::PopAll()
+	void WorkQueue::AddWorker(Thread *thread)
 	{
-		Entry *entry = _workListHead;
-		_workListHead = nullptr;
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		if(!_primary)
+			_primary = thread;
+
+		for(size_t i = 0; i < kMaxWorkers; i ++)
+		{
+			if(!_workers[i])
+			{
+				_workers[i] = thread;
+				break;
+			}
+		}
+
+		spinlock_unlock(&_lock);
 
-		// Pop All is not safe to call from an interrupt context
-		// Which means it is safe for us to extend the free list
-		if(_exhausted)
+		if(enabled)
+			Sys::EnableInterrupts();
+	}
+
+	// Called with the lock held
+	bool WorkQueue::RemoveWorker(Thread *thread)
+	{
+		for(size_t i = 0; i < kMaxWorkers; i ++)
 		{
-			_ExtendFreeList(10);
-			_exhausted = false;
+			if(_workers[i] == thread)
+			{
+				_workers[i] = nullptr;
+				_workerCount --;
+
+				return true;
+			}
 		}
 
-		return entry;
+		return false;
 	}
 
-	WorkQueue::Entry *WorkQueue::PopAllRemote()
+	bool WorkQueue::IsIdle(Thread *thread)
 	{
-		spinlock_lock(&_readWriterLock);
-		Entry *result = PopAll();
-		spinlock_unlock(&_readWriterLock);
+		bool enabled = Sys::DisableInterrupts();
+		spinlock_lock(&_lock);
+
+		bool idle = false;
+
+		for(size_t i = 0; i < _idleCount; i ++)
+		{
+			if(_idle[i] == thread)
+				idle = true;
+		}
+
+		spinlock_unlock(&_lock);
 
-		return result;
+		if(enabled)
+			Sys::EnableInterrupts();
+
+		return idle;
 	}
 
-	void WorkQueue::RefurbishList(Entry *entry)
+	// Returns all pending high priority entries, or the oldest normal priority one, sleeping until there are some.
+	// Returns nullptr if the worker should exit
+	WorkQueue::Entry *WorkQueue::WaitForWork(Thread *thread, Priority &priority)
 	{
-		if(!entry->next)
-		{		
-			entry->next = _freeListHead;
-			_freeListHead = entry;
+		Scheduler *scheduler = Scheduler::GetScheduler();
+
+		while(1)
+		{
+			bool enabled = Sys::DisableInterrupts();
+			spinlock_lock(&_lock);
+
+			if(_refill)
+			{
+				_refill = false;
+
+				spinlock_unlock(&_lock);
+
+				if(enabled)
+					Sys::EnableInterrupts();
+
+				// Workers run in thread context, so it's safe for us to grow the cache
+				if(!_AllocateSlab())
+					kprintf("Failed to grow the work queue of CPU %d\n", static_cast<int>(Sys::CPU::GetCurrentCPU()->GetID()));
+
+				continue;
+			}
+
+			List &high = _workLists[static_cast<size_t>(Priority::High)];
+			List &normal = _workLists[static_cast<size_t>(Priority::Normal)];
+
+			Entry *entries = nullptr;
+
+			if(high.head)
+			{
+				entries = high.head;
+				priority = Priority::High;
+
+				high.head = high.tail = nullptr;
+			}
+			else if(normal.head)
+			{
+				// Normal entries are taken one at a time so that new high priority ones can overtake them
+				entries = normal.head;
+				priority = Priority::Normal;
+
+				normal.head = entries->next;
+				if(!normal.head)
+					normal.tail = nullptr;
+
+				entries->next = nullptr;
+			}
+
+			if(entries)
+			{
+				spinlock_unlock(&_lock);
+
+				if(enabled)
+					Sys::EnableInterrupts();
+
+				return entries;
+			}
+
+			// One idle worker is enough to pick up new work
+			if(thread != _primary && _idleCount > 0)
+			{
+				RemoveWorker(thread);
+				spinlock_unlock(&_lock);
+
+				if(enabled)
+					Sys::EnableInterrupts();
+
+				return nullptr;
+			}
+
+			_idle[_idleCount ++] = thread;
+			scheduler->BlockThread(thread);
+
+			spinlock_unlock(&_lock);
+
+			if(enabled)
+				Sys::EnableInterrupts();
+
+			scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU());
+
+			// The reschedule IPI might not have arrived yet
+			while(IsIdle(thread))
+				Sys::CPUPause();
 		}
-		else
+	}
+
+
+	void WorkQueue::WorkerThread(uint32_t cpu)
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+		Thread *self = scheduler->GetActiveThread();
+
+		WorkQueue *queue = Sys::CPU::GetCPUWithID(cpu)->GetWorkQueue();
+		queue->AddWorker(self);
+
+		while(1)
 		{
-			Entry *last = entry;
-			do {
-				last = last->next;
-			} while(last->next);
-			
-			last->next = _freeListHead;
-			_freeListHead = entry;
+			Priority priority;
+
+			Entry *entries = queue->WaitForWork(self, priority);
+			if(!entries)
+				break;
+
+			size_t count = 0;
+			uint64_t latency = 0;
+			uint64_t maxLatency = 0;
+
+			for(Entry *entry = entries; entry; entry = entry->next)
+			{
+				uint64_t waited = Sys::CPUReadTimestamp() - entry->timestamp;
+
+				count ++;
+				latency += waited;
+				maxLatency = std::max(maxLatency, waited);
+
+				entry->callback(entry->context);
+			}
+
+			queue->RefurbishList(entries, priority, count, latency, maxLatency);
+
+			// Restarted syscalls are pushed right back, give everyone else a chance to run in between
+			scheduler->YieldThread(self);
 		}
+
+		scheduler->BlockThread(self);
+		scheduler->RemoveThread(self);
+
+		self->GetTask()->MarkThreadExit(self);
+
+		while(1)
+			scheduler->RescheduleCPU(Sys::CPU::GetCurrentCPU());
+	}
+
+	KernReturn<void> WorkQueue::SpawnWorker(uint32_t cpu)
+	{
+		Scheduler *scheduler = Scheduler::GetScheduler();
+
+		IO::Array *parameters = IO::Array::Alloc()->Init();
+		if(!parameters)
+			return Error(KERN_NO_MEMORY);
+
+		IO::Number *cpuNum = IO::Number::Alloc()->InitWithUint32(cpu);
+		parameters->AddObject(cpuNum);
+		cpuNum->Release();
+
+		KernReturn<Thread *> thread = scheduler->GetKernelTask()->AttachThread(reinterpret_cast<Thread::Entry>(&WorkerThread), Thread::PriorityClassKernel, 16, parameters);
+		parameters->Release();
+
+		if(!thread.IsValid())
+			return thread.GetError();
+
+		return scheduler->SetThreadAffinity(thread, 1 << cpu);
 	}
 
-	void WorkQueue::RefurbishListRemote(Entry *entry)
+	KernReturn<void> WorkQueue::StartWorkers()
 	{
-		spinlock_lock(&_readWriterLock);
-		RefurbishList(entry);
-		spinlock_unlock(&_readWriterLock);
+		for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+		{
+			Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
+
+			if(!(cpu->GetFlags() & Sys::CPU::Flags::Running))
+				continue;
+
+			WorkQueue *queue = cpu->GetWorkQueue();
+			queue->_workerCount ++;
+
+			KernReturn<void> result = queue->SpawnWorker(static_cast<uint32_t>(i));
+			if(!result.IsValid())
+			{
+				kprintf("Failed to start the kernel worker for CPU %d\n", static_cast<int>(i));
+				return result;
+			}
+		}
+
+		return ErrorNone;
 	}
 }
@@ -22,21 +22,26 @@
 #include <prefix.h>
 #include <libc/sys/spinlock.h>
 #include <libc/stdint.h>
+#include <machine/memory/virtual.h>
+#include <kern/kern_return.h>
 
 namespace OS
 {
+	class Thread;
+
 	/**
-	 * The work queue class is supposed to be used from within an interrupt context
-	 * to communicate work to non-interrupt context kernel workers. They are per CPU
-	 * and writes and reads happen with interrupts disabled. However, reads from the work queue
-	 * from another CPU are additionally protected by a spin lock which is only taken
-	 * when reading from another CPUs work queue.
+	 * The work queue class is used from within interrupt context to communicate work
+	 * to non-interrupt context kernel workers. Every CPU has its own queue and its own workers,
+	 * which are pinned to the CPU and sleep while the queue is empty. Pushing an entry wakes
+	 * one of them up. Entries run in the order they were pushed.
 	 *
-	 * Inserts into the list can fail and should be handled gracefully
+	 * A worker that goes to sleep inside an entry makes sure there is an idle worker left to pick
+	 * up the rest of the queue, spawning a new one if needed. Spare workers exit again once they
+	 * find another worker idle.
 	 *
-	 * Accessing other CPUs work queues requires the usage of the xxxRemote methods and must
-	 * never be performed with the regular methods. Likewise, accessing the current CPUs work
-	 * queue must only be done via the non suffixed methods.
+	 * High priority entries always run before normal ones. Entries come from page sized slabs
+	 * which the workers add whenever the queue runs low, up to kMaxSlabs. Once those are used up
+	 * pushing fails, which callers have to handle by retrying later instead of dropping the work.
 	 **/
 	class WorkQueue
 	{
@@ -47,25 +52,83 @@ namespace OS
 			Callback callback;
 			void *context;
 			Entry *next;
+			uint64_t timestamp;
+		};
+
+		enum class Priority : uint8_t
+		{
+			High,
+			Normal,
+			__Count
+		};
+
+		struct Statistics
+		{
+			struct Level
+			{
+				size_t depth;
+				size_t maxDepth;
+				uint64_t pushed;
+				uint64_t completed;
+				uint64_t latencyCycles; // From push until the callback starts
+				uint64_t maxLatencyCycles;
+			};
+
+			Level levels[static_cast<size_t>(Priority::__Count)];
+			size_t capacity;
+			size_t workers;
+			uint64_t rejected;
 		};
 
 		WorkQueue();
 
-		bool PushEntry(Callback callback, void *context);
+		bool PushEntry(Callback callback, void *context, Priority priority = Priority::Normal);
+		void GetStatistics(Statistics *statistics);
 
-		Entry *PopAll();
-		Entry *PopAllRemote();
+		// Has to be called by a thread that is about to sleep, before it blocks
+		void WorkerWillSleep(Thread *thread);
 
-		void RefurbishList(Entry *entry);
-		void RefurbishListRemote(Entry *entry);
+		static KernReturn<void> StartWorkers();
 
 	private:
-		void _ExtendFreeList(size_t size);
+		static constexpr size_t kMaxWorkers = 4;
+		static constexpr size_t kEntriesPerSlab = VM_PAGE_SIZE / sizeof(Entry);
+		static constexpr size_t kMaxSlabs = 16;
+		static constexpr size_t kLowWatermark = kEntriesPerSlab / 4;
 
-		spinlock_t _readWriterLock;
-		bool _exhausted;
+		struct List
+		{
+			Entry *head;
+			Entry *tail;
+		};
+
+		static void WorkerThread(uint32_t cpu);
+
+		KernReturn<void> SpawnWorker(uint32_t cpu);
+
+		void AddWorker(Thread *thread);
+		bool RemoveWorker(Thread *thread);
+		bool IsIdle(Thread *thread);
+
+		Entry *WaitForWork(Thread *thread, Priority &priority);
+		void RefurbishList(Entry *entry, Priority priority, size_t count, uint64_t latency, uint64_t maxLatency);
+
+		bool _AllocateSlab();
+
+		spinlock_t _lock; // Always taken with interrupts disabled
+		bool _refill;
 		Entry *_freeListHead;
-		Entry *_workListHead;
+		size_t _freeCount;
+		size_t _slabCount;
+		List _workLists[static_cast<size_t>(Priority::__Count)];
+		Statistics _statistics;
+
+		Thread *_primary; // Never exits
+		Thread *_workers[kMaxWorkers];
+		Thread *_idle[kMaxWorkers]; // Workers sleeping until there is work
+		size_t _workerCount; // Includes workers that are still starting up
+		size_t _idleCount;
+		bool _spawning;
 	};
 }
 
@@ -35,10 +35,13 @@ extern "C" init_array_func_t __init_array_end;
 #include <machine/memory/memory.h>
 #include <machine/interrupts/interrupts.h>
 #include <machine/clock/clock.h>
+#include <machine/fpu.h>
 #include <machine/smp/smp.h>
 #include <libio/core/IOCatalogue.h>
 #include <os/scheduler/scheduler.h>
 #include <os/syscall/syscall.h>
+#include <os/swap/swap.h>
+#include <os/timer.h>
 #include <os/waitqueue.h>
 #include <os/ipc/IPC.h>
 #include <os/linker/LDStore.h>
@@ -119,6 +122,7 @@ namespace Sys
 	void PCPersonality::FinishBootstrapping()
 	{
 		Init("syscalls", OS::SyscallInit);
+		Init("swap", OS::SwapInit);
 		Init("vfs", VFS::Init);
 		Init("linker", OS::LDInit);
 
@@ -151,8 +155,10 @@ namespace Sys
 		Init("objects", IO::CatalogueInit);
 		Init("interrupts", Sys::InterruptsInit);
 		Init("cpu second stage", Sys::CPUInitSecondStage);
+		Init("fpu", Sys::FPUInit);
 		Init("clock", Sys::ClockInit);
 		Init("smp", Sys::SMPInit);
+		Init("timers", OS::TimerInit);
 		Init("waitqueue", OS::WaitqueueInit);
 		Init("ipc", OS::IPCInit);
 		Init("scheduler", OS::SchedulerInit);
@@ -18,6 +18,7 @@
 
 #include <libc/string.h>
 #include <os/scheduler/scheduler.h>
+#include <os/swap/swap.h>
 #include "context.h"
 #include "vfs.h"
 
@@ -107,21 +108,17 @@ namespace VFS
 			vm_address_t temp = reinterpret_cast<vm_address_t>(data);
 			vm_address_t page = VM_PAGE_ALIGN_DOWN(temp);
 
-			size_t pages  = VM_PAGE_COUNT(length);
-			size_t offset = temp - page; 
+			size_t offset = temp - page;
+			size_t pages  = VM_PAGE_COUNT(length + offset);
 
-			KernReturn<uintptr_t> physical;
-
-			if((physical = _directory->ResolveAddress(page)).IsValid() == false)
-				return physical.GetError();
-			
+			// The user buffer might be physically scattered or swapped out
 			KernReturn<vm_address_t> mapping;
 
-			if((mapping = kernelDir->Alloc(physical, pages, kVMFlagsKernel)).IsValid() == false)
+			if((mapping = OS::Swap::MapIntoKernel(_directory, page, pages)).IsValid() == false)
 				return mapping.GetError();
 
 			memcpy(target, reinterpret_cast<void *>(mapping + offset), length);
-			kernelDir->Free(mapping, pages);
+			OS::Swap::UnmapFromKernel(mapping, pages);
 		}
 
 		return ErrorNone;
@@ -143,21 +140,17 @@ namespace VFS
 			vm_address_t temp = reinterpret_cast<vm_address_t>(target);
 			vm_address_t page = VM_PAGE_ALIGN_DOWN(temp);
 
-			size_t pages  = VM_PAGE_COUNT(length);
-			size_t offset = temp - page; 
-
-			KernReturn<uintptr_t> physical;
+			size_t offset = temp - page;
+			size_t pages  = VM_PAGE_COUNT(length + offset);
 
-			if((physical = _directory->ResolveAddress(page)).IsValid() == false)
-				return physical.GetError();
-			
+			// The user buffer might be physically scattered or swapped out
 			KernReturn<vm_address_t> mapping;
 
-			if((mapping = kernelDir->Alloc(physical, pages, kVMFlagsKernel)).IsValid() == false)
+			if((mapping = OS::Swap::MapIntoKernel(_directory, page, pages)).IsValid() == false)
 				return mapping.GetError();
 
 			memcpy(reinterpret_cast<void *>(mapping + offset), data, length);
-			kernelDir->Free(mapping, pages);
+			OS::Swap::UnmapFromKernel(mapping, pages);
 		}
 
 		return ErrorNone;
@@ -16,7 +16,24 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <libc/string.h>
+#include <machine/clock/clock.h>
+#include <machine/fpu.h>
+#include <os/functionbenchmark.h>
+#include <os/locks/mutex.h>
+#include <os/locks/inversion.h>
+#include <os/locks/lockstat.h>
+#include <os/locks/rwbenchmark.h>
+#include <os/rcu.h>
+#include <os/rcubenchmark.h>
+#include <os/scheduler/scheduler.h>
+#include <os/scheduler/idle.h>
+#include <os/scheduler/preempt.h>
+#include <os/scheduler/accounting.h>
+#include <os/swap/swap.h>
+#include <os/waitbenchmark.h>
 #include "devices.h"
+#include "schedtrace.h"
 
 namespace VFS
 {
@@ -87,11 +104,409 @@ namespace VFS
 		// PTY's
 		static IO::Array *_ptys = nullptr;
 
+		// Statistics
+		static IO::Array *_statistics = nullptr;
+		static SchedulerTrace *_schedulerTrace = nullptr;
+
+		static size_t GenerateSwapStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			OS::Swap::Statistics statistics;
+			OS::Swap::GetStatistics(&statistics);
+
+			size_t length = 0;
+			size_t original = statistics.storedPages - statistics.zeroPages;
+			size_t ratio = original ? (statistics.compressedBytes * 100) / (original * VM_PAGE_SIZE) : 0;
+			uint64_t average = statistics.swapIns ? (statistics.faultCycles / statistics.swapIns) : 0;
+
+			length = Statistics::Append(buffer, size, length, "stored: %u pages (%u zero)\n", (uint32_t)statistics.storedPages, (uint32_t)statistics.zeroPages);
+			length = Statistics::Append(buffer, size, length, "compressed: %u bytes (%u%% of original)\n", (uint32_t)statistics.compressedBytes, (uint32_t)ratio);
+			length = Statistics::Append(buffer, size, length, "swap outs: %llu\n", statistics.swapOuts);
+			length = Statistics::Append(buffer, size, length, "swap ins: %llu\n", statistics.swapIns);
+			length = Statistics::Append(buffer, size, length, "rejected: %llu\n", statistics.rejected);
+			length = Statistics::Append(buffer, size, length, "minor faults: %llu\n", statistics.minorFaults);
+			length = Statistics::Append(buffer, size, length, "fault cycles: %llu avg, %llu max\n", average, statistics.maxFaultCycles);
+
+			return length;
+		}
+
+		static size_t GenerateSchedulerStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			OS::Scheduler *scheduler = OS::Scheduler::GetScheduler();
+			size_t length = 0;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				OS::Scheduler::Statistics statistics;
+
+				if(!scheduler->GetStatistics(Sys::CPU::GetCPUWithID(i), &statistics))
+					continue;
+
+				uint64_t average = statistics.decisions ? (statistics.decisionCycles / statistics.decisions) : 0;
+
+				length = Statistics::Append(buffer, size, length, "cpu%u (%s): threads %u, runnable %u, load %u, switches %llu, migrations %llu in %llu out, decisions %llu (%llu cycles avg, %llu max), commands %llu in %llu batches\n",
+				                            (uint32_t)i, statistics.fair ? "fair" : "classic", (uint32_t)statistics.threads, (uint32_t)statistics.runnable, (uint32_t)statistics.load, statistics.switches,
+				                            statistics.migrationsIn, statistics.migrationsOut, statistics.decisions, average, statistics.maxDecisionCycles,
+				                            statistics.commands, statistics.commandBatches);
+
+				if(statistics.deadlineThreads > 0 || statistics.deadlineMisses > 0)
+					length = Statistics::Append(buffer, size, length, "cpu%u deadline: threads %u, bandwidth %u.%u%%, misses %llu, overruns %llu\n",
+					                            (uint32_t)i, (uint32_t)statistics.deadlineThreads, statistics.deadlineBandwidth / 10, statistics.deadlineBandwidth % 10,
+					                            statistics.deadlineMisses, statistics.deadlineOverruns);
+			}
+
+			return length;
+		}
+
+		// One line per task for bin/top, times are in microseconds. The first line is the current time,
+		// so the reader can turn two samples into CPU percentages
+		static size_t GenerateTopStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			IO::Array *tasks = OS::Scheduler::GetScheduler()->CopyTasks();
+			if(!tasks)
+				return 0;
+
+			size_t length = 0;
+
+			length = Statistics::Append(buffer, size, length, "time %llu\n", Sys::Clock::GetMicroseconds());
+
+			tasks->Enumerate<OS::Task>([&](OS::Task *task, __unused size_t index, __unused bool &stop) {
+
+				OS::Thread::Usage usage;
+				size_t threads = task->GetUsage(&usage);
+
+				task->Lock();
+
+				IO::String *name = task->GetName();
+				length = Statistics::Append(buffer, size, length, "%d %u %llu %llu %llu %llu %llu %s\n",
+				                            task->GetPid(), (uint32_t)threads,
+				                            OS::Accounting::CyclesToMicroseconds(usage.userCycles), OS::Accounting::CyclesToMicroseconds(usage.kernelCycles),
+				                            usage.voluntarySwitches, usage.involuntarySwitches, usage.syscalls, name ? name->GetCString() : "-");
+
+				task->Unlock();
+
+			});
+
+			tasks->Release();
+
+			return length;
+		}
+
+		static size_t GenerateClockStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			size_t length = 0;
+
+			length = Statistics::Append(buffer, size, length, "uptime: %llu us\n", Sys::Clock::GetMicroseconds());
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				Sys::Clock::Statistics statistics;
+
+				if(!Sys::Clock::GetStatistics(Sys::CPU::GetCPUWithID(i), &statistics))
+					continue;
+
+				length = Statistics::Append(buffer, size, length, "cpu%u: wakeups %llu (%llu idle, %llu early), reprogrammed %llu\n",
+				                            (uint32_t)i, statistics.interrupts, statistics.idleWakeups, statistics.earlyInterrupts, statistics.programmed);
+			}
+
+			return length;
+		}
+
+		static size_t GenerateFPUStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			size_t length = 0;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				Sys::FPU::Statistics statistics;
+
+				if(!Sys::FPU::GetStatistics(Sys::CPU::GetCPUWithID(i), &statistics))
+					continue;
+
+				length = Statistics::Append(buffer, size, length, "cpu%u: traps %llu, saves %llu, restores %llu\n",
+				                            (uint32_t)i, statistics.traps, statistics.saves, statistics.restores);
+			}
+
+			return length;
+		}
+
+		static size_t GenerateIdleStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			size_t length = 0;
+
+			length = Statistics::Append(buffer, size, length, "mode: %s\n", (OS::Idle::GetMode() == OS::Idle::Mode::MWait) ? "mwait" : "hlt");
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				OS::Idle::Statistics statistics;
+
+				if(!OS::Idle::GetStatistics(Sys::CPU::GetCPUWithID(i), &statistics))
+					continue;
+
+				length = Statistics::Append(buffer, size, length, "cpu%u: halts %llu, mwaits %llu, monitor wakeups %llu\n",
+				                            (uint32_t)i, statistics.halts, statistics.mwaits, statistics.wakeups);
+			}
+
+			return length;
+		}
+
+		static size_t GeneratePreemptStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			size_t length = 0;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				OS::Preempt::Statistics statistics;
+
+				if(!OS::Preempt::GetStatistics(Sys::CPU::GetCPUWithID(i), &statistics))
+					continue;
+
+				length = Statistics::Append(buffer, size, length, "cpu%u: deferred %llu, resumed %llu, max deferred cycles %llu\n",
+				                            (uint32_t)i, statistics.deferred, statistics.resumed, statistics.maxDeferredCycles);
+			}
+
+			return length;
+		}
+
+		// Every benchmark is started by a command and shows up as running until its result is in
+		struct BenchmarkDevice
+		{
+			const char *name;
+			const char *command;
+			KernReturn<void> (*start)();
+			OS::Benchmark::State (*getState)();
+			size_t (*append)(char *buffer, size_t size, size_t length); // Appends the result of the last run
+		};
+
+		static size_t AppendBenchmark(void *memo, char *buffer, size_t size, size_t length)
+		{
+			BenchmarkDevice *device = reinterpret_cast<BenchmarkDevice *>(memo);
+
+			switch(device->getState())
+			{
+				case OS::Benchmark::State::Idle:
+					break;
+				case OS::Benchmark::State::Running:
+					length = Statistics::Append(buffer, size, length, "%s: running\n", device->name);
+					break;
+				case OS::Benchmark::State::Done:
+					length = device->append(buffer, size, length);
+					break;
+			}
+
+			return length;
+		}
+
+		static size_t GenerateBenchmarkStatistics(void *memo, char *buffer, size_t size)
+		{
+			return AppendBenchmark(memo, buffer, size, 0);
+		}
+
+		static bool HandleBenchmarkCommand(void *memo, const char *command)
+		{
+			BenchmarkDevice *device = reinterpret_cast<BenchmarkDevice *>(memo);
+
+			if(strcmp(command, device->command) == 0)
+				return device->start().IsValid();
+
+			return false;
+		}
+
+		static size_t AppendInversionResult(char *buffer, size_t size, size_t length)
+		{
+			OS::Inversion::Result result;
+			OS::Inversion::Runner::GetResult(&result);
+
+			return Statistics::Append(buffer, size, length, "inversion: %s, high waited %u us, owner inherited level %u, medium at level %u%s\n",
+			                          result.passed ? "passed" : "failed", result.waited, result.inherited, result.medium,
+			                          result.overtaken ? ", overtaken by medium" : "");
+		}
+
+		static size_t AppendFunctionResult(char *buffer, size_t size, size_t length)
+		{
+			OS::FunctionBenchmark::Result result;
+			OS::FunctionBenchmark::Runner::GetResult(&result);
+
+			return Statistics::Append(buffer, size, length, "benchmark: lambda %u cycles, member %u cycles, heap %u cycles\n", result.lambdaCycles, result.memberCycles, result.heapCycles);
+		}
+
+		static size_t AppendLockResult(char *buffer, size_t size, size_t length)
+		{
+			OS::RWBenchmark::Result result;
+			OS::RWBenchmark::Runner::GetResult(&result);
+
+			for(size_t i = 0; i < static_cast<size_t>(OS::RWBenchmark::Lock::__Count); i ++)
+			{
+				length = Statistics::Append(buffer, size, length, "%s:", OS::RWBenchmark::GetLockName(static_cast<OS::RWBenchmark::Lock>(i)));
+
+				for(size_t step = 0; step < OS::RWBenchmark::kSteps; step ++)
+					length = Statistics::Append(buffer, size, length, " %u cycles on %u cpus%s", result.cycles[step][i], result.cpus[step], (step + 1 < OS::RWBenchmark::kSteps) ? "," : "\n");
+			}
+
+			return length;
+		}
+
+		static size_t AppendRCUResult(char *buffer, size_t size, size_t length)
+		{
+			OS::RCUBenchmark::Result result;
+			OS::RCUBenchmark::Runner::GetResult(&result);
+
+			return Statistics::Append(buffer, size, length, "benchmark: task lookup %u cycles, %u on %u cpus; module lookup %u cycles, %u on %u cpus\n",
+			                          result.taskCycles, result.parallelTaskCycles, result.cpus, result.moduleCycles, result.parallelModuleCycles, result.cpus);
+		}
+
+		static size_t AppendWaitqueueResult(char *buffer, size_t size, size_t length)
+		{
+			OS::WaitBenchmark::Result result;
+			OS::WaitBenchmark::Runner::GetResult(&result);
+
+			length = Statistics::Append(buffer, size, length, "same cpu: %u cycles, %u with timeout\n", result.localCycles, result.localTimedCycles);
+			return Statistics::Append(buffer, size, length, "cross cpu: %u cycles, %u with timeout\n", result.remoteCycles, result.remoteTimedCycles);
+		}
+
+		static BenchmarkDevice _inversionBenchmark = { "inversion", "inversion", &OS::Inversion::Runner::Start, &OS::Inversion::Runner::GetState, &AppendInversionResult };
+		static BenchmarkDevice _functionBenchmark = { "benchmark", "benchmark", &OS::FunctionBenchmark::Runner::Start, &OS::FunctionBenchmark::Runner::GetState, &AppendFunctionResult };
+		static BenchmarkDevice _lockBenchmark = { "benchmark", "benchmark", &OS::RWBenchmark::Runner::Start, &OS::RWBenchmark::Runner::GetState, &AppendLockResult };
+		static BenchmarkDevice _rcuBenchmark = { "benchmark", "benchmark", &OS::RCUBenchmark::Runner::Start, &OS::RCUBenchmark::Runner::GetState, &AppendRCUResult };
+		static BenchmarkDevice _waitqueueBenchmark = { "benchmark", "benchmark", &OS::WaitBenchmark::Runner::Start, &OS::WaitBenchmark::Runner::GetState, &AppendWaitqueueResult };
+
+		struct MutexStatisticsBuffer
+		{
+			char *buffer;
+			size_t size;
+			size_t length;
+		};
+
+		static void AppendMutexStatistics(const OS::Mutex *mutex, void *context)
+		{
+			MutexStatisticsBuffer *output = reinterpret_cast<MutexStatisticsBuffer *>(context);
+
+			OS::Mutex::Statistics statistics;
+			mutex->GetStatistics(&statistics);
+
+			uint64_t hold = statistics.acquisitions ? (statistics.holdCycles / statistics.acquisitions) : 0;
+			uint64_t wait = statistics.contentions ? (statistics.waitCycles / statistics.contentions) : 0;
+
+			output->length = Statistics::Append(output->buffer, output->size, output->length, "%s: acquisitions %llu, contentions %llu, sleeps %llu, hold %llu cycles avg (%llu max), wait %llu cycles avg (%llu max)\n",
+			                                    mutex->GetName(), statistics.acquisitions, statistics.contentions, statistics.sleeps, hold, statistics.maxHoldCycles, wait, statistics.maxWaitCycles);
+		}
+
+		// The priority inversion self-test shows up at the end of the statistics
+		static size_t GenerateMutexStatistics(void *memo, char *buffer, size_t size)
+		{
+			MutexStatisticsBuffer output = { buffer, size, 0 };
+			OS::Mutex::EnumerateNamed(&AppendMutexStatistics, &output);
+
+			return AppendBenchmark(memo, buffer, size, output.length);
+		}
+
+		static constexpr size_t kLockStatSites = 24;
+
+		static size_t GenerateLockStatStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			if(!OS::LockStat::IsAvailable())
+				return Statistics::Append(buffer, size, 0, "not available, the kernel has to be built with CONFIG_LOCKSTAT\n");
+
+			size_t length = Statistics::Append(buffer, size, 0, "recording: %s\n", OS::LockStat::IsRecording() ? "yes" : "no");
+
+			OS::LockStat::Site sites[kLockStatSites];
+			size_t count = OS::LockStat::GetSites(sites, kLockStatSites);
+
+			for(size_t i = 0; i < count; i ++)
+			{
+				length = Statistics::Append(buffer, size, length, "%p: acquisitions %llu, contended %llu, spins %llu, max hold %llu cycles\n",
+				                            reinterpret_cast<void *>(sites[i].address), sites[i].acquisitions, sites[i].contentions, sites[i].spins, sites[i].maxHoldCycles);
+			}
+
+			return length;
+		}
+
+		static bool HandleLockStatCommand(__unused void *memo, const char *command)
+		{
+			if(strcmp(command, "start") == 0)
+				return OS::LockStat::Start().IsValid();
+
+			if(strcmp(command, "stop") == 0)
+			{
+				OS::LockStat::Stop();
+				return true;
+			}
+			if(strcmp(command, "reset") == 0)
+			{
+				OS::LockStat::Reset();
+				return true;
+			}
+
+			return false;
+		}
+
+		// Switches between hlt and mwait at runtime, mostly so both can be compared in one boot
+		static bool HandleIdleCommand(__unused void *memo, const char *command)
+		{
+			if(strcmp(command, "hlt") == 0)
+				return OS::Idle::SetMode(OS::Idle::Mode::Halt).IsValid();
+			if(strcmp(command, "mwait") == 0)
+				return OS::Idle::SetMode(OS::Idle::Mode::MWait).IsValid();
+
+			return false;
+		}
+
+		static size_t GenerateRCUStatistics(void *memo, char *buffer, size_t size)
+		{
+			OS::RCU::Statistics statistics;
+			OS::RCU::GetStatistics(&statistics);
+
+			size_t length = Statistics::Append(buffer, size, 0, "grace periods: %llu, callbacks %llu, synchronizes %llu, kicks %llu\n",
+			                                   statistics.gracePeriods, statistics.callbacks, statistics.synchronizes, statistics.kicks);
+
+			return AppendBenchmark(memo, buffer, size, length);
+		}
+
+		static size_t GenerateWorkQueueStatistics(__unused void *memo, char *buffer, size_t size)
+		{
+			size_t length = 0;
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				Sys::CPU *cpu = Sys::CPU::GetCPUWithID(i);
+				if(!(cpu->GetFlags() & Sys::CPU::Flags::Running))
+					continue;
+
+				OS::WorkQueue::Statistics statistics;
+				cpu->GetWorkQueue()->GetStatistics(&statistics);
+
+				length = Statistics::Append(buffer, size, length, "cpu%u: workers %u, capacity %u entries, rejected %llu\n",
+				                            (uint32_t)i, (uint32_t)statistics.workers, (uint32_t)statistics.capacity, statistics.rejected);
+
+				for(size_t j = 0; j < static_cast<size_t>(OS::WorkQueue::Priority::__Count); j ++)
+				{
+					const OS::WorkQueue::Statistics::Level &level = statistics.levels[j];
+					uint64_t average = level.completed ? (level.latencyCycles / level.completed) : 0;
+
+					length = Statistics::Append(buffer, size, length, "cpu%u %s: depth %u (%u max), pushed %llu, completed %llu, latency %llu cycles avg (%llu max)\n",
+					                            (uint32_t)i, (j == static_cast<size_t>(OS::WorkQueue::Priority::High)) ? "high" : "normal",
+					                            (uint32_t)level.depth, (uint32_t)level.maxDepth, level.pushed, level.completed, average, level.maxLatencyCycles);
+				}
+			}
+
+			return length;
+		}
+
+		static void CreateStatistics(const char *name, Statistics::Generator generator, void *memo, Statistics::CommandHandler handler = nullptr)
+		{
+			Statistics *statistics = Statistics::Alloc()->Init(name, generator, memo, handler);
+			if(statistics)
+			{
+				_statistics->AddObject(statistics);
+				statistics->Release();
+			}
+		}
+
 		KernReturn<void> Init()
 		{
 			_keyboardMap = IO::Dictionary::Alloc()->Init();
 			_framebufferMap = IO::Dictionary::Alloc()->Init();
 			_ptys = IO::Array::Alloc()->Init();
+			_statistics = IO::Array::Alloc()->Init();
 
 			// Create 10 PTY's
 			for(size_t i = 0; i < 10; i ++)
@@ -101,6 +516,23 @@ namespace VFS
 					_ptys->AddObject(pty);
 			}
 
+			CreateStatistics("clock", &GenerateClockStatistics, nullptr);
+			CreateStatistics("fpu", &GenerateFPUStatistics, nullptr);
+			CreateStatistics("functions", &GenerateBenchmarkStatistics, &_functionBenchmark, &HandleBenchmarkCommand);
+			CreateStatistics("idle", &GenerateIdleStatistics, nullptr, &HandleIdleCommand);
+			CreateStatistics("locks", &GenerateBenchmarkStatistics, &_lockBenchmark, &HandleBenchmarkCommand);
+			CreateStatistics("lockstat", &GenerateLockStatStatistics, nullptr, &HandleLockStatCommand);
+			CreateStatistics("mutexes", &GenerateMutexStatistics, &_inversionBenchmark, &HandleBenchmarkCommand);
+			CreateStatistics("preempt", &GeneratePreemptStatistics, nullptr);
+			CreateStatistics("rcu", &GenerateRCUStatistics, &_rcuBenchmark, &HandleBenchmarkCommand);
+			CreateStatistics("scheduler", &GenerateSchedulerStatistics, nullptr);
+			CreateStatistics("swap", &GenerateSwapStatistics, nullptr);
+			CreateStatistics("top", &GenerateTopStatistics, nullptr);
+			CreateStatistics("waitqueue", &GenerateBenchmarkStatistics, &_waitqueueBenchmark, &HandleBenchmarkCommand);
+			CreateStatistics("workqueue", &GenerateWorkQueueStatistics, nullptr);
+
+			_schedulerTrace = SchedulerTrace::Alloc()->Init();
+
 			return ErrorNone;
 		}
 	}
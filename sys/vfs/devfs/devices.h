@@ -23,6 +23,7 @@
 #include "pty.h"
 #include "keyboard.h"
 #include "framebuffer.h"
+#include "statistics.h"
 
 namespace VFS
 {
@@ -0,0 +1,134 @@
+//
+//  schedtrace.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/string.h>
+#include <libcpp/algorithm.h>
+#include <os/scheduler/trace.h>
+#include "schedtrace.h"
+#include "statistics.h"
+
+#define kSchedulerTraceReadEvents 256 // Events moved per read call
+
+namespace VFS
+{
+	namespace Devices
+	{
+		IODefineMeta(SchedulerTrace, IO::Object)
+
+		SchedulerTrace *SchedulerTrace::Init()
+		{
+			if(!IO::Object::Init())
+				return nullptr;
+
+			KernReturn<CFS::Node *> node;
+
+			node = VFS::GetDevFS()->CreateNode("schedtrace", this, IOMemberFunctionCast(CFS::Node::ReadProc, this, &SchedulerTrace::ReadEvents), nullptr);
+			if(!node.IsValid())
+				return nullptr;
+
+			_eventsNode = node.Get();
+
+			node = VFS::GetDevFS()->CreateNode("schedtrace_control", this,
+			                                   IOMemberFunctionCast(CFS::Node::ReadProc, this, &SchedulerTrace::ReadControl),
+			                                   IOMemberFunctionCast(CFS::Node::WriteProc, this, &SchedulerTrace::WriteControl));
+			if(!node.IsValid())
+				return nullptr;
+
+			_controlNode = node.Get();
+			return this;
+		}
+
+		size_t SchedulerTrace::ReadEvents(VFS::Context *context, off_t offset, void *data, size_t size)
+		{
+			size_t count = std::min(size / sizeof(OS::SchedulerTrace::Event), static_cast<size_t>(kSchedulerTraceReadEvents));
+			if(count == 0)
+				return (size == 0) ? 0 : (size_t)-1;
+
+			OS::SchedulerTrace::Event *events = new OS::SchedulerTrace::Event[count];
+			if(!events)
+				return (size_t)-1;
+
+			// Every reader gets a header first, it has what's needed to make sense of the timestamps
+			size_t drained = OS::SchedulerTrace::Drain(events, count, (offset == 0));
+			size_t result = drained * sizeof(OS::SchedulerTrace::Event);
+
+			if(result > 0 && !context->CopyDataIn(events, data, result).IsValid())
+				result = (size_t)-1;
+
+			delete[] events;
+			return result;
+		}
+
+		size_t SchedulerTrace::ReadControl(VFS::Context *context, off_t offset, void *data, size_t size)
+		{
+			char buffer[512];
+			size_t length = 0;
+
+			length = Statistics::Append(buffer, sizeof(buffer), length, "tracing: %s\n", OS::SchedulerTrace::IsEnabled() ? "on" : "off");
+			length = Statistics::Append(buffer, sizeof(buffer), length, "capacity: %u events per cpu\n", (uint32_t)OS::SchedulerTrace::GetCapacity());
+
+			for(size_t i = 0; i < Sys::CPU::GetCPUCount(); i ++)
+			{
+				size_t buffered;
+				uint64_t lost;
+
+				OS::SchedulerTrace::GetState(i, &buffered, &lost);
+				length = Statistics::Append(buffer, sizeof(buffer), length, "cpu%u: %u buffered, %llu lost\n", (uint32_t)i, (uint32_t)buffered, lost);
+			}
+
+			if(offset < 0 || static_cast<size_t>(offset) >= length)
+				return 0;
+
+			size_t result = std::min(size, length - static_cast<size_t>(offset));
+
+			if(!context->CopyDataIn(buffer + offset, data, result).IsValid())
+				return (size_t)-1;
+
+			return result;
+		}
+
+		size_t SchedulerTrace::WriteControl(VFS::Context *context, __unused off_t offset, const void *data, size_t size)
+		{
+			char command[16];
+			size_t length = std::min(size, sizeof(command) - 1);
+
+			if(!context->CopyDataOut(data, command, length).IsValid())
+				return (size_t)-1;
+
+			command[length] = '\0';
+
+			// Allow for echo's trailing newline
+			while(length > 0 && (command[length - 1] == '\n' || command[length - 1] == ' '))
+				command[-- length] = '\0';
+
+			if(strcmp(command, "start") == 0)
+			{
+				if(!OS::SchedulerTrace::Enable().IsValid())
+					return (size_t)-1;
+			}
+			else if(strcmp(command, "stop") == 0)
+				OS::SchedulerTrace::Disable();
+			else if(strcmp(command, "clear") == 0)
+				OS::SchedulerTrace::Clear();
+			else
+				return (size_t)-1;
+
+			return size;
+		}
+	}
+}
@@ -0,0 +1,51 @@
+//
+//  schedtrace.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _DEVICES_SCHEDTRACE_H_
+#define _DEVICES_SCHEDTRACE_H_
+
+#include <prefix.h>
+#include <libio/core/IOObject.h>
+#include <vfs/vfs.h>
+#include <vfs/cfs/cfs_node.h>
+
+namespace VFS
+{
+	namespace Devices
+	{
+		// Exposes the scheduler trace. schedtrace_control takes "start", "stop" and "clear" and reads
+		// back the state of the buffers, reading schedtrace drains the recorded events in binary form
+		class SchedulerTrace : public IO::Object
+		{
+		public:
+			SchedulerTrace *Init();
+
+		private:
+			size_t ReadEvents(VFS::Context *context, off_t offset, void *data, size_t size);
+			size_t ReadControl(VFS::Context *context, off_t offset, void *data, size_t size);
+			size_t WriteControl(VFS::Context *context, off_t offset, const void *data, size_t size);
+
+			CFS::Node *_eventsNode;
+			CFS::Node *_controlNode;
+
+			IODeclareMeta(SchedulerTrace)
+		};
+	}
+}
+
+#endif /* _DEVICES_SCHEDTRACE_H_ */
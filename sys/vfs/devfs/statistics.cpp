@@ -0,0 +1,111 @@
+//
+//  statistics.cpp
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <libc/stdio.h>
+#include <libc/stdarg.h>
+#include <libcpp/algorithm.h>
+#include "statistics.h"
+
+#define kStatisticsBufferSize 4096
+
+namespace VFS
+{
+	namespace Devices
+	{
+		IODefineMeta(Statistics, IO::Object)
+
+		Statistics *Statistics::Init(const char *name, Generator generator, void *memo, CommandHandler handler)
+		{
+			if(!IO::Object::Init())
+				return nullptr;
+
+			_generator = generator;
+			_handler = handler;
+			_memo = memo;
+
+			CFS::Node::WriteProc write = handler ? IOMemberFunctionCast(CFS::Node::WriteProc, this, &Statistics::Write) : nullptr;
+
+			KernReturn<CFS::Node *> node = VFS::GetDevFS()->CreateNode(name, this, IOMemberFunctionCast(CFS::Node::ReadProc, this, &Statistics::Read), write);
+			if(!node.IsValid())
+				return nullptr;
+
+			_node = node.Get();
+			return this;
+		}
+
+		size_t Statistics::Append(char *buffer, size_t size, size_t length, const char *format, ...)
+		{
+			if(length + 1 >= size)
+				return length;
+
+			va_list args;
+			va_start(args, format);
+
+			int written = vsnprintf(buffer + length, size - length, format, args);
+
+			va_end(args);
+
+			if(written < 0)
+				return length;
+
+			return std::min(length + written, size - 1);
+		}
+
+		size_t Statistics::Read(VFS::Context *context, off_t offset, void *data, size_t size)
+		{
+			char *buffer = new char[kStatisticsBufferSize];
+			if(!buffer)
+				return (size_t)-1;
+
+			buffer[0] = '\0';
+
+			size_t length = _generator(_memo, buffer, kStatisticsBufferSize);
+			size_t result = 0;
+
+			if(offset >= 0 && static_cast<size_t>(offset) < length)
+			{
+				result = std::min(size, length - static_cast<size_t>(offset));
+
+				if(!context->CopyDataIn(buffer + offset, data, result).IsValid())
+					result = (size_t)-1;
+			}
+
+			delete[] buffer;
+			return result;
+		}
+
+		size_t Statistics::Write(VFS::Context *context, __unused off_t offset, const void *data, size_t size)
+		{
+			char command[64];
+			size_t length = std::min(size, sizeof(command) - 1);
+
+			if(!context->CopyDataOut(data, command, length).IsValid())
+				return (size_t)-1;
+
+			command[length] = '\0';
+
+			while(length > 0 && (command[length - 1] == '\n' || command[length - 1] == ' '))
+				command[-- length] = '\0';
+
+			if(!_handler(_memo, command))
+				return (size_t)-1;
+
+			return size;
+		}
+	}
+}
@@ -0,0 +1,59 @@
+//
+//  statistics.h
+//  Firedrake
+//
+//  Created by Sidney Just
+//  Copyright (c) 2015 by Sidney Just
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR 
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE 
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef _DEVICES_STATISTICS_H_
+#define _DEVICES_STATISTICS_H_
+
+#include <prefix.h>
+#include <libio/core/IOObject.h>
+#include <vfs/vfs.h>
+#include <vfs/cfs/cfs_node.h>
+
+namespace VFS
+{
+	namespace Devices
+	{
+		// Node that presents a textual snapshot of some kernel counters.
+		// The generator gets called on every read and has to fill the buffer with a null terminated string.
+		// Nodes with a command handler also accept writes, the handler gets the written line without its newline
+		class Statistics : public IO::Object
+		{
+		public:
+			typedef size_t (*Generator)(void *memo, char *buffer, size_t size);
+			typedef bool (*CommandHandler)(void *memo, const char *command);
+
+			Statistics *Init(const char *name, Generator generator, void *memo, CommandHandler handler = nullptr);
+
+			// Appends to the string in buffer, returns the new length. Output that doesn't fit is dropped
+			static size_t Append(char *buffer, size_t size, size_t length, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+		private:
+			size_t Read(VFS::Context *context, off_t offset, void *data, size_t size);
+			size_t Write(VFS::Context *context, off_t offset, const void *data, size_t size);
+
+			CFS::Node *_node;
+			Generator _generator;
+			CommandHandler _handler;
+			void *_memo;
+
+			IODeclareMeta(Statistics)
+		};
+	}
+}
+
+#endif /* _DEVICES_STATISTICS_H_ */
@@ -65,6 +65,10 @@ namespace FFS
 		size_t pages = VM_PAGE_COUNT(minimumSize);
 		if(pages > _pages)
 		{
+			// Files written in chunks grow geometrically, so the copy below runs a logarithmic number of
+			// times instead of once per chunk. It runs under the node lock, which can't be preempted
+			pages = std::max(pages, _pages * 2);
+
 			char *temp = Sys::Alloc<char>(Sys::VM::Directory::GetKernelDirectory(), pages, kVMFlagsKernel);
 			if(!temp)
 				return Error(KERN_NO_MEMORY);
@@ -85,7 +89,7 @@ namespace FFS
 
 		KernReturn<void> result;
 
-		if((result = AllocateMemory(_size + size)).IsValid() == false)
+		if((result = AllocateMemory(std::max(static_cast<size_t>(_size), static_cast<size_t>(offset + size)))).IsValid() == false)
 			return result.GetError();
 
 		if((result = Error(context->CopyDataOut(data, _data + offset, size))).IsValid() == false)
@@ -20,6 +20,7 @@
 #include <kern/kprintf.h>
 #include "path.h"
 #include "instance.h"
+#include "vfs.h"
 
 namespace VFS
 {
@@ -132,7 +133,7 @@ namespace VFS
 		if(_node->IsLink())
 			_node = _node->Downcast<Link>()->GetTarget();
 		if(_node->IsMountpoint())
-			_node = _node->Downcast<Mountpoint>()->GetLinkedNode();
+			_node = ResolveMountpoint(_node->Downcast<Mountpoint>());
 
 		// Advance to the next element
 		_element += offset + 1;
@@ -22,6 +22,7 @@
 #include <libc/string.h>
 #include <libcpp/vector.h>
 #include <os/scheduler/scheduler.h>
+#include <os/locks/rwlock.h>
 
 #include "vfs.h"
 #include "path.h"
@@ -42,6 +43,9 @@ namespace VFS
 	static CFS::Instance *_devFS = nullptr;
 	static Node *_rootNode = nullptr;
 
+	// Every path walk that crosses a mountpoint reads the mount table, mounting writes it
+	static OS::RWLock _mountLock("vfs mounts");
+
 	Node *GetRootNode()
 	{
 		return _rootNode;
@@ -375,7 +379,21 @@ namespace VFS
 			return Error(KERN_INVALID_ARGUMENT, ENOTDIR);
 
 		Instance *nInstance = node->GetInstance();
-		return nInstance->Mount(context, instance, static_cast<Directory *>(node), name->GetCString());
+
+		_mountLock.WriteLock();
+		KernReturn<void> mountResult = nInstance->Mount(context, instance, static_cast<Directory *>(node), name->GetCString());
+		_mountLock.WriteUnlock();
+
+		return mountResult;
+	}
+
+	IO::StrongRef<Node> ResolveMountpoint(Mountpoint *mountpoint)
+	{
+		_mountLock.ReadLock();
+		IO::StrongRef<Node> node = mountpoint->GetLinkedNode();
+		_mountLock.ReadUnlock();
+
+		return node;
 	}
 
 	KernReturn<void> Unmount(__unused Context *context, __unused const char *path)
@@ -436,7 +454,7 @@ namespace VFS
 		if(node->IsMountpoint())
 		{
 			Mountpoint *mount = node->Downcast<Mountpoint>();
-			IO::StrongRef<Node> target = mount->GetLinkedNode();
+			IO::StrongRef<Node> target = ResolveMountpoint(mount);
 
 			Directory *dir = target->Downcast<Directory>();
 			const IO::Dictionary *children = dir->GetChildren();
@@ -51,6 +51,7 @@ namespace VFS
 	KernReturn<off_t> ReadDir(Context *context, int fd, dirent *entry, size_t count);
 
 	KernReturn<void> Mount(Context *context, Instance *instance, const char *target);
+	IO::StrongRef<Node> ResolveMountpoint(Mountpoint *mountpoint);
 	KernReturn<void> Unmount(Context *context, const char *path);
 
 	KernReturn<void> Ioctl(Context *context, int fd, uint32_t request, void *arg);